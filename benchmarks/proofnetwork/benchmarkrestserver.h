@@ -0,0 +1,66 @@
+// clazy:skip
+#ifndef BENCHMARKRESTSERVER_H
+#define BENCHMARKRESTSERVER_H
+
+#include "proofseed/tasks.h"
+
+#include "proofnetwork/abstractrestserver.h"
+
+#include <QThread>
+
+class BenchmarkRestServer : public Proof::AbstractRestServer
+{
+    Q_OBJECT
+public:
+    BenchmarkRestServer(quint16 port, bool withAuth) : Proof::AbstractRestServer(port)
+    {
+        if (withAuth) {
+            setAuthType(Proof::RestAuthType::Basic);
+            setUserName(QStringLiteral("bench"));
+            setPassword(QStringLiteral("bench"));
+        }
+        setRouteExecutionPolicy(QStringLiteral("GET"), QStringLiteral("/slow"),
+                                Proof::RestExecutionPolicy::HandlerPool);
+    }
+
+public slots:
+    // Answer of ?size= bytes, computed inline in worker thread
+    void rest_get_Sync(QTcpSocket *socket, const QStringList &, const QStringList &, const QUrlQuery &query,
+                       const QByteArray &)
+    {
+        sendAnswer(socket, payload(query), QStringLiteral("application/octet-stream"));
+    }
+
+    // Answer of ?size= bytes, sent from task after handler returns
+    void rest_get_Future(QTcpSocket *socket, const QStringList &, const QStringList &, const QUrlQuery &query,
+                         const QByteArray &)
+    {
+        const Proof::RestRequestHandle request = requestHandle(socket);
+        const QByteArray body = payload(query);
+        Proof::tasks::run([this, request, body]() {
+            sendAnswer(request, body, QStringLiteral("application/octet-stream"));
+        });
+    }
+
+    // Answer of ?size= bytes after ?delay= msecs in handler pool
+    void rest_get_Slow(QTcpSocket *socket, const QStringList &, const QStringList &, const QUrlQuery &query,
+                       const QByteArray &)
+    {
+        QThread::msleep(query.queryItemValue(QStringLiteral("delay")).toULong());
+        sendAnswer(socket, payload(query), QStringLiteral("application/octet-stream"));
+    }
+
+    void rest_post_Echo(QTcpSocket *socket, const QStringList &, const QStringList &, const QUrlQuery &,
+                        const QByteArray &body)
+    {
+        sendAnswer(socket, body, QStringLiteral("application/octet-stream"));
+    }
+
+private:
+    static QByteArray payload(const QUrlQuery &query)
+    {
+        return QByteArray(query.queryItemValue(QStringLiteral("size")).toInt(), 'x');
+    }
+};
+
+#endif // BENCHMARKRESTSERVER_H
@@ -0,0 +1,167 @@
+// clazy:skip
+#include "loadgenerator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include <cerrno>
+#include <unistd.h>
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+struct ConnectionResult
+{
+    quint64 requests = 0;
+    quint64 errors = 0;
+    std::vector<qint64> latenciesUsecs;
+};
+
+int openConnection(quint16 port)
+{
+    const int descriptor = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (descriptor < 0)
+        return -1;
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    const int enabled = 1;
+    ::setsockopt(descriptor, IPPROTO_TCP, TCP_NODELAY, &enabled, sizeof(enabled));
+    if (::connect(descriptor, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+        ::close(descriptor);
+        return -1;
+    }
+    return descriptor;
+}
+
+bool sendAll(int descriptor, const QByteArray &data)
+{
+    qint64 sent = 0;
+    while (sent < data.size()) {
+        const ssize_t result = ::send(descriptor, data.constData() + sent, static_cast<size_t>(data.size() - sent),
+                                      MSG_NOSIGNAL);
+        if (result < 0 && errno == EINTR)
+            continue;
+        if (result <= 0)
+            return false;
+        sent += result;
+    }
+    return true;
+}
+
+// Reads one response with Content-Length, extra bytes are left in buffer. Returns status code or -1
+int readResponse(int descriptor, QByteArray &buffer)
+{
+    char chunk[64 * 1024];
+    int headersEnd = -1;
+    qint64 responseSize = -1;
+    forever {
+        if (responseSize < 0) {
+            headersEnd = buffer.indexOf("\r\n\r\n");
+            if (headersEnd >= 0) {
+                const QByteArray head = buffer.left(headersEnd + 2).toLower();
+                const int lengthIndex = head.indexOf("\r\ncontent-length:");
+                qint64 contentLength = 0;
+                if (lengthIndex >= 0) {
+                    const int valueStart = lengthIndex + 17;
+                    contentLength = head.mid(valueStart, head.indexOf("\r\n", valueStart) - valueStart)
+                                        .trimmed()
+                                        .toLongLong();
+                }
+                responseSize = headersEnd + 4 + contentLength;
+            }
+        }
+        if (responseSize >= 0 && buffer.size() >= responseSize) {
+            const int spaceIndex = buffer.indexOf(' ');
+            const int code = spaceIndex < 0 ? -1 : buffer.mid(spaceIndex + 1, 3).toInt();
+            buffer.remove(0, static_cast<int>(responseSize));
+            return code;
+        }
+        const ssize_t received = ::recv(descriptor, chunk, sizeof(chunk), 0);
+        if (received < 0 && errno == EINTR)
+            continue;
+        if (received <= 0)
+            return -1;
+        buffer.append(chunk, static_cast<int>(received));
+    }
+}
+
+void driveConnection(const LoadScenario &scenario, const Clock::time_point &deadline, ConnectionResult &result)
+{
+    int descriptor = -1;
+    QByteArray buffer;
+    result.latenciesUsecs.reserve(64 * 1024);
+    while (Clock::now() < deadline) {
+        const Clock::time_point startedAt = Clock::now();
+        if (descriptor < 0) {
+            buffer.clear();
+            descriptor = openConnection(scenario.port);
+            if (descriptor < 0) {
+                ++result.errors;
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+        }
+        const int code = sendAll(descriptor, scenario.request) ? readResponse(descriptor, buffer) : -1;
+        if (code < 0 || !scenario.keepAlive) {
+            ::close(descriptor);
+            descriptor = -1;
+        }
+        if (code < 200 || code >= 300) {
+            ++result.errors;
+            continue;
+        }
+        ++result.requests;
+        result.latenciesUsecs.push_back(
+            std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - startedAt).count());
+    }
+    if (descriptor >= 0)
+        ::close(descriptor);
+}
+} // namespace
+
+double LoadResult::rps() const
+{
+    return seconds > 0 ? static_cast<double>(requests) / seconds : 0;
+}
+
+qint64 LoadResult::percentile(double fraction) const
+{
+    if (latenciesUsecs.empty())
+        return 0;
+    const auto index = static_cast<size_t>(fraction * static_cast<double>(latenciesUsecs.size() - 1));
+    return latenciesUsecs[index];
+}
+
+LoadResult runLoad(const LoadScenario &scenario)
+{
+    std::vector<ConnectionResult> connectionResults(static_cast<size_t>(qMax(1, scenario.connections)));
+    std::vector<std::thread> threads;
+    threads.reserve(connectionResults.size());
+    const Clock::time_point startedAt = Clock::now();
+    const Clock::time_point deadline = startedAt + std::chrono::milliseconds(scenario.durationMsecs);
+    for (auto &connectionResult : connectionResults)
+        threads.emplace_back([&scenario, &deadline, &connectionResult] {
+            driveConnection(scenario, deadline, connectionResult);
+        });
+    for (auto &thread : threads)
+        thread.join();
+
+    LoadResult result;
+    result.seconds = std::chrono::duration<double>(Clock::now() - startedAt).count();
+    for (auto &connectionResult : connectionResults) {
+        result.requests += connectionResult.requests;
+        result.errors += connectionResult.errors;
+        result.latenciesUsecs.insert(result.latenciesUsecs.end(), connectionResult.latenciesUsecs.cbegin(),
+                                     connectionResult.latenciesUsecs.cend());
+    }
+    std::sort(result.latenciesUsecs.begin(), result.latenciesUsecs.end());
+    return result;
+}
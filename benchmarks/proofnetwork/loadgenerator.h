@@ -0,0 +1,36 @@
+// clazy:skip
+#ifndef LOADGENERATOR_H
+#define LOADGENERATOR_H
+
+#include <QByteArray>
+
+#include <vector>
+
+struct LoadScenario
+{
+    QByteArray name;
+    // Full HTTP request, sent as is for each iteration
+    QByteArray request;
+    quint16 port = 0;
+    int connections = 1;
+    int durationMsecs = 0;
+    // New connection is opened for each request if false
+    bool keepAlive = true;
+};
+
+struct LoadResult
+{
+    quint64 requests = 0;
+    quint64 errors = 0;
+    double seconds = 0;
+    // Sorted
+    std::vector<qint64> latenciesUsecs;
+
+    double rps() const;
+    qint64 percentile(double fraction) const;
+};
+
+// Closed-loop generator, each connection is driven by its own thread with blocking sockets
+LoadResult runLoad(const LoadScenario &scenario);
+
+#endif // LOADGENERATOR_H
@@ -0,0 +1,110 @@
+// clazy:skip
+#include "proofcore/coreapplication.h"
+#include "proofcore/logs.h"
+
+#include "benchmarkrestserver.h"
+#include "loadgenerator.h"
+
+#include <QCommandLineParser>
+#include <QTime>
+#include <QTimer>
+
+#include <cstdio>
+#include <memory>
+
+namespace {
+QByteArray getRequest(const QByteArray &path, bool withAuth, bool keepAlive)
+{
+    QByteArray result = "GET " + path + " HTTP/1.1\r\nHost: 127.0.0.1\r\n";
+    if (withAuth)
+        result += "Authorization: Basic " + QByteArray("bench:bench").toBase64() + "\r\n";
+    if (!keepAlive)
+        result += "Connection: close\r\n";
+    return result + "\r\n";
+}
+
+QByteArray postRequest(const QByteArray &path, int bodySize)
+{
+    return "POST " + path + " HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Length: " + QByteArray::number(bodySize)
+           + "\r\n\r\n" + QByteArray(bodySize, 'x');
+}
+
+bool waitForListening(Proof::AbstractRestServer *server)
+{
+    QTime timer;
+    timer.start();
+    while (!server->isListening() && timer.elapsed() < 10000)
+        QThread::msleep(50);
+    return server->isListening();
+}
+
+QVector<LoadScenario> scenarios(quint16 port, quint16 authPort)
+{
+    QVector<LoadScenario> result;
+    auto add = [&result](const QByteArray &name, const QByteArray &request, quint16 port, bool keepAlive = true) {
+        LoadScenario scenario;
+        scenario.name = name;
+        scenario.request = request;
+        scenario.port = port;
+        scenario.keepAlive = keepAlive;
+        result << scenario;
+    };
+
+    for (int size : {16, 1024, 64 * 1024}) {
+        const QByteArray sizeString = QByteArray::number(size);
+        add("sync-" + sizeString, getRequest("/sync?size=" + sizeString, false, true), port);
+    }
+    add("future-1024", getRequest("/future?size=1024", false, true), port);
+    add("slow-1024-5ms", getRequest("/slow?size=1024&delay=5", false, true), port);
+    add("auth-sync-1024", getRequest("/sync?size=1024", true, true), authPort);
+    add("close-sync-1024", getRequest("/sync?size=1024", false, false), port, false);
+    add("echo-64k", postRequest("/echo", 64 * 1024), port);
+    return result;
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    Proof::CoreApplication app(argc, argv, QStringLiteral("Opensoft"), QStringLiteral("proof_benchmarks"));
+    Proof::Logs::setRulesFromString(QStringLiteral("proof.*=false"));
+    QTimer::singleShot(0, &app, &Proof::CoreApplication::postInit);
+    qApp->processEvents();
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    parser.addOption({"duration", "Duration of each scenario in msecs", "msecs", "3000"});
+    parser.addOption({"connections", "Concurrent client connections", "count", "16"});
+    parser.addOption({"port", "Port of server without auth, next one is used for server with auth", "port", "9200"});
+    parser.addOption({"filter", "Run only scenarios which names contain this string", "filter"});
+    parser.process(app);
+
+    const auto port = static_cast<quint16>(parser.value("port").toUInt());
+    const auto authPort = static_cast<quint16>(port + 1);
+    std::unique_ptr<BenchmarkRestServer> server(new BenchmarkRestServer(port, false));
+    std::unique_ptr<BenchmarkRestServer> authServer(new BenchmarkRestServer(authPort, true));
+    server->startListen();
+    authServer->startListen();
+    if (!waitForListening(server.get()) || !waitForListening(authServer.get())) {
+        std::fprintf(stderr, "Can't start servers on ports %d and %d\n", port, authPort);
+        return 1;
+    }
+
+    std::printf("%-20s %12s %10s %10s %10s %10s %8s\n", "scenario", "requests", "rps", "p50 us", "p99 us",
+                "p999 us", "errors");
+    for (LoadScenario scenario : scenarios(port, authPort)) {
+        if (parser.isSet("filter") && !scenario.name.contains(parser.value("filter").toLatin1()))
+            continue;
+        scenario.connections = parser.value("connections").toInt();
+        scenario.durationMsecs = parser.value("duration").toInt();
+        const LoadResult result = runLoad(scenario);
+        std::printf("%-20s %12llu %10.0f %10lld %10lld %10lld %8llu\n", scenario.name.constData(),
+                    static_cast<unsigned long long>(result.requests), result.rps(),
+                    static_cast<long long>(result.percentile(0.5)), static_cast<long long>(result.percentile(0.99)),
+                    static_cast<long long>(result.percentile(0.999)), static_cast<unsigned long long>(result.errors));
+        std::fflush(stdout);
+    }
+
+    server->stopListen();
+    authServer->stopListen();
+    return 0;
+}
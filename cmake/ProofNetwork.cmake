@@ -7,7 +7,16 @@ proof_add_target_sources(Network
     src/proofnetwork/proofnetwork_init.cpp
     src/proofnetwork/abstractrestserver.cpp
     src/proofnetwork/urlquerybuilder.cpp
+    src/proofnetwork/restrequestcontext.cpp
+    src/proofnetwork/restauthenticator.cpp
+    src/proofnetwork/multipartparser.cpp
     src/proofnetwork/httpparser.cpp
+    src/proofnetwork/hpack.cpp
+    src/proofnetwork/http2session.cpp
+    src/proofnetwork/websocketcodec.cpp
+    src/proofnetwork/restpushqueue.cpp
+    src/proofnetwork/routetable.cpp
+    src/proofnetwork/listenershandover.cpp
     src/proofnetwork/proofservicerestapi.cpp
     src/proofnetwork/abstractamqpclient.cpp
     src/proofnetwork/jsonamqpclient.cpp
@@ -31,6 +40,9 @@ proof_add_target_headers(Network
     include/proofnetwork/qmlwrappers/networkdataentityqmlwrapper.h
     include/proofnetwork/abstractrestserver.h
     include/proofnetwork/urlquerybuilder.h
+    include/proofnetwork/restrequestcontext.h
+    include/proofnetwork/restauthenticator.h
+    include/proofnetwork/multipartparser.h
     include/proofnetwork/proofservicerestapi.h
     include/proofnetwork/abstractamqpclient.h
     include/proofnetwork/jsonamqpclient.h
@@ -53,6 +65,12 @@ proof_add_target_private_headers(Network
     include/private/proofnetwork/qmlwrappers/userqmlwrapper_p.h
     include/private/proofnetwork/urlquerybuilder_p.h
     include/private/proofnetwork/httpparser_p.h
+    include/private/proofnetwork/hpack_p.h
+    include/private/proofnetwork/http2session_p.h
+    include/private/proofnetwork/websocketcodec_p.h
+    include/private/proofnetwork/restpushqueue_p.h
+    include/private/proofnetwork/routetable_p.h
+    include/private/proofnetwork/listenershandover_p.h
     include/private/proofnetwork/proofservicerestapi_p.h
     include/private/proofnetwork/abstractamqpclient_p.h
     include/private/proofnetwork/jsonamqpclient_p.h
@@ -60,8 +78,10 @@ proof_add_target_private_headers(Network
     include/private/proofnetwork/baserestapi_p.h
 )
 
+find_package(ZLIB REQUIRED)
+
 proof_add_module(Network
     QT_LIBS Core Network
     PROOF_LIBS Core
-    OTHER_LIBS qca-qt5 qamqp
+    OTHER_LIBS qca-qt5 qamqp ZLIB::ZLIB
 )
@@ -0,0 +1,72 @@
+/* Copyright 2018, OpenSoft Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright notice, this list of
+ * conditions and the following disclaimer in the documentation and/or other materials provided
+ * with the distribution.
+ *     * Neither the name of OpenSoft Inc. nor the names of its contributors may be used to endorse
+ * or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#ifndef PROOF_HPACK_P_H
+#define PROOF_HPACK_P_H
+
+#include <QByteArray>
+#include <QPair>
+#include <QVector>
+
+#include <deque>
+
+namespace Proof {
+
+using HttpHeaderField = QPair<QByteArray, QByteArray>;
+using HttpHeaderFields = QVector<HttpHeaderField>;
+
+// HPACK (RFC 7541) header block decoder, keeps dynamic table shared by all header blocks of connection
+class HpackDecoder
+{
+public:
+    explicit HpackDecoder(int maxTableSize = 4096);
+
+    // Fields are appended in order of the block. Decoder state is undefined after failure,
+    // so connection must be closed with COMPRESSION_ERROR then. Decoding also fails if size of decoded fields
+    // exceeds maxDecodedSize, small block can reference large table entries many times
+    bool decode(const QByteArray &block, HttpHeaderFields &fields, qint64 maxDecodedSize);
+
+private:
+    bool field(quint32 index, HttpHeaderField &result) const;
+    void insert(const HttpHeaderField &field);
+    void evict(int maxSize);
+
+    std::deque<HttpHeaderField> m_table;
+    int m_tableSize = 0;
+    // Limit from our SETTINGS_HEADER_TABLE_SIZE and the one currently chosen by encoder
+    int m_maxTableSize = 0;
+    int m_currentMaxTableSize = 0;
+};
+
+// Stateless encoder, fields are sent as static table references or literals without indexing,
+// so peer's dynamic table is never used and doesn't need to be tracked
+class HpackEncoder
+{
+public:
+    QByteArray encode(const HttpHeaderFields &fields) const;
+};
+
+} // namespace Proof
+
+#endif // PROOF_HPACK_P_H
@@ -0,0 +1,170 @@
+/* Copyright 2018, OpenSoft Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright notice, this list of
+ * conditions and the following disclaimer in the documentation and/or other materials provided
+ * with the distribution.
+ *     * Neither the name of OpenSoft Inc. nor the names of its contributors may be used to endorse
+ * or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#ifndef PROOF_HTTP2SESSION_P_H
+#define PROOF_HTTP2SESSION_P_H
+
+#include "proofnetwork/hpack_p.h"
+
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+namespace Proof {
+
+// Request which headers and body are fully received
+struct Http2Request
+{
+    quint32 streamId = 0;
+    QString method;
+    QString uri;
+    // Regular fields in "name: value\r\n" form, :authority is added as host field
+    QByteArray rawHeaders;
+    QByteArray body;
+};
+
+// Server side of HTTP/2 connection (RFC 7540) without any I/O. Frames are parsed from data passed to feed(),
+// completed requests are taken with takeRequests() and everything that should be sent to client is collected
+// until takeOutput(). Answers are split to frames according to peer's flow control windows and frame size,
+// data that doesn't fit windows yet is kept per stream until WINDOW_UPDATE
+class Http2Session
+{
+public:
+    enum ErrorCode : quint32
+    {
+        NoError = 0x0,
+        ProtocolError = 0x1,
+        InternalError = 0x2,
+        FlowControlError = 0x3,
+        StreamClosedError = 0x5,
+        FrameSizeError = 0x6,
+        RefusedStream = 0x7,
+        Cancel = 0x8,
+        CompressionError = 0x9,
+        EnhanceYourCalm = 0xB
+    };
+
+    struct Settings
+    {
+        int maxConcurrentStreams = 100;
+        // Receive window of each stream and of connection, at least 65535
+        int windowSize = 1024 * 1024;
+        int maxHeadersSize = 64 * 1024;
+        // Streams with larger bodies are answered with 413 by session itself, 0 means no limit
+        qint64 maxBodySize = 0;
+    };
+
+    explicit Http2Session(const Settings &settings);
+
+    static QByteArray clientPreface();
+
+    // Connection is upgraded from HTTP/1.1 request with HTTP2-Settings header, that request is
+    // answered at half-closed stream 1. Returns false if header can't be decoded
+    bool upgrade(const QByteArray &encodedSettings);
+    // Parsed frames are removed from input, incomplete frame stays there
+    void feed(QByteArray &input);
+    QVector<Http2Request> takeRequests();
+    // Streams reset by client or because of their errors, their answers are not needed anymore
+    QVector<quint32> takeResetStreams();
+    int takeRefusedStreamsCount();
+    QByteArray takeOutput();
+
+    // Answers are ignored for streams that are already closed or reset
+    void sendHeaders(quint32 streamId, const HttpHeaderFields &fields, bool endStream);
+    void sendData(quint32 streamId, const QByteArray &data, bool endStream);
+    void resetStream(quint32 streamId, ErrorCode code);
+    // No new streams are accepted after it, already opened ones are processed as usual
+    void goAway(ErrorCode code = NoError);
+
+    qint64 queuedBytes(quint32 streamId) const;
+    int activeStreamsCount() const;
+    bool isGoingAway() const;
+    bool hasFailed() const;
+    QString error() const;
+
+private:
+    struct Stream
+    {
+        qint64 sendWindow = 0;
+        qint64 receiveWindow = 0;
+        qint64 expectedContentLength = -1;
+        Http2Request request;
+        QByteArray output;
+        int outputOffset = 0;
+        bool outputFinished = false;
+        bool remoteClosed = false;
+        bool localClosed = false;
+        // Answered by session itself, rest of body is dropped
+        bool rejected = false;
+    };
+
+    ErrorCode applySettings(const char *data, int size);
+    void processFrame(quint8 type, quint8 flags, quint32 streamId, const QByteArray &payload);
+    void processData(quint8 flags, quint32 streamId, const QByteArray &payload);
+    void processHeaders(quint8 flags, quint32 streamId, const QByteArray &payload);
+    void processSettings(quint8 flags, quint32 streamId, const QByteArray &payload);
+    void processWindowUpdate(quint32 streamId, const QByteArray &payload);
+    void finishHeaderBlock();
+    bool fillRequest(Stream &stream, const HttpHeaderFields &fields);
+    void completeRequest(quint32 streamId);
+    void rejectStream(quint32 streamId, int statusCode);
+    void flushStream(quint32 streamId);
+    void flushAllStreams();
+    void closeStreamIfDone(quint32 streamId);
+    void replenishWindows(quint32 streamId);
+    void connectionError(ErrorCode code, const QString &error);
+    void writeFrame(quint8 type, quint8 flags, quint32 streamId, const char *payload, int size);
+    void writeRstStream(quint32 streamId, ErrorCode code);
+    void writeWindowUpdate(quint32 streamId, quint32 increment);
+
+    Settings m_settings;
+    HpackDecoder m_decoder;
+    HpackEncoder m_encoder;
+    QHash<quint32, Stream> m_streams;
+    QVector<Http2Request> m_requests;
+    QVector<quint32> m_resetStreams;
+    int m_refusedStreamsCount = 0;
+    QByteArray m_output;
+    quint32 m_lastStreamId = 0;
+    qint64 m_connectionSendWindow = 65535;
+    qint64 m_connectionReceiveWindow = 65535;
+    qint64 m_peerInitialWindowSize = 65535;
+    int m_peerMaxFrameSize = 16384;
+    // Header block is collected from HEADERS and CONTINUATION frames before decoding
+    QByteArray m_headerBlock;
+    quint32 m_headerBlockStreamId = 0;
+    bool m_headerBlockEndsStream = false;
+    bool m_isHeaderBlockOpen = false;
+    bool m_prefaceReceived = false;
+    bool m_settingsReceived = false;
+    bool m_goAwaySent = false;
+    bool m_goAwayReceived = false;
+    bool m_failed = false;
+    QString m_error;
+};
+
+} // namespace Proof
+
+#endif // PROOF_HTTP2SESSION_P_H
@@ -25,8 +25,15 @@
 #ifndef PROOF_HTTPPARSER_P_H
 #define PROOF_HTTPPARSER_P_H
 
+#include "proofnetwork/multipartparser.h"
+
 #include <QByteArray>
+#include <QIODevice>
+#include <QSharedPointer>
 #include <QStringList>
+#include <QVector>
+
+class QTemporaryFile;
 
 namespace Proof {
 
@@ -37,20 +44,40 @@ public:
     {
         NeedMore,
         Error,
+        // Headers are parsed, body is not received yet
+        HeadersComplete,
         Success
     };
 
     HttpParser();
-    Result parseNextPart(QByteArray data);
+    Result parseNextPart(QByteArray &data);
+    void reset();
+    void setMaxHeadersSize(int size);
+    // Should be called after HeadersComplete, bodies larger than threshold are stored in temporary file
+    void setBodyStreamed(qint64 memoryThreshold);
+    // Should be called after HeadersComplete, body is split to parts while it is received and is not kept itself
+    void setBodyMultipart(const QByteArray &boundary, qint64 memoryThreshold);
 
     QString method() const;
     QString uri() const;
     QStringList headers() const;
+    // Header lines as they were received, including CRLF
+    QByteArray rawHeaders() const;
     QByteArray body() const;
+    qulonglong contentLength() const;
+    QSharedPointer<QIODevice> bodyDevice() const;
+    bool isBodyMultipart() const;
+    // Parts are moved out of parser
+    QVector<MultipartPart> takeMultipartParts();
+    bool isKeepAlive() const;
+    bool isHttp10() const;
+    bool isClean() const;
 
     QString error() const;
+    int errorStatusCode() const;
 
 private:
+    bool checkHeadersSize();
     Result initialState(QByteArray &data);
     Result headersState(QByteArray &data);
     Result bodyState(QByteArray &data);
@@ -61,13 +88,23 @@ private:
     State m_state = &HttpParser::initialState;
     QByteArray m_data;
     qulonglong m_contentLength = 0;
+    bool m_hasContentLength = false;
     QString m_method;
     QString m_uri;
-    QStringList m_headers;
+    QByteArray m_rawHeaders;
+    QString m_connection;
+    bool m_hasTransferEncoding = false;
+    bool m_isHttp10 = false;
+    bool m_isBodyStreamed = false;
+    int m_maxHeadersSize = 0;
+    int m_headersSize = 0;
+    QSharedPointer<QTemporaryFile> m_bodyFile;
+    QSharedPointer<MultipartParser> m_multipart;
+    qulonglong m_multipartBytesReceived = 0;
     QString m_error;
+    int m_errorStatusCode = 400;
 
     static const QRegExp FIRST_LINE_REG_EXP;
-    static const QRegExp HEADER_REG_EXP;
 };
 
 } // namespace Proof
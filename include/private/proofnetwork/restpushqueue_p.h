@@ -0,0 +1,69 @@
+/* Copyright 2018, OpenSoft Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright notice, this list of
+ * conditions and the following disclaimer in the documentation and/or other materials provided
+ * with the distribution.
+ *     * Neither the name of OpenSoft Inc. nor the names of its contributors may be used to endorse
+ * or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#ifndef PROOF_RESTPUSHQUEUE_P_H
+#define PROOF_RESTPUSHQUEUE_P_H
+
+#include "proofseed/asynqro_extra.h"
+
+#include <QByteArray>
+#include <QMutex>
+
+#include <atomic>
+
+namespace Proof {
+
+// Outgoing messages of Server-Sent Events or WebSocket connection. Messages are stored already encoded
+// and are coalesced into single chunk of streamed answer
+class RestPushQueue
+{
+public:
+    RestPushQueue(bool isWebSocket, qint64 limit, std::atomic_ullong *rejectedMessages)
+        : isWebSocket(isWebSocket), m_limit(limit), m_rejectedMessages(rejectedMessages)
+    {}
+
+    bool push(const QByteArray &message);
+    Future<QByteArray> next();
+    // Closing message is sent after already queued ones, stream ends right after it
+    void close(const QByteArray &closingMessage = QByteArray());
+    // Connection is gone, nothing is sent anymore
+    void abort();
+    bool isOpen() const;
+    qint64 queuedBytes() const;
+
+    const bool isWebSocket;
+
+private:
+    mutable QMutex m_mutex;
+    QByteArray m_queued;
+    const qint64 m_limit;
+    std::atomic_ullong *const m_rejectedMessages;
+    Promise<QByteArray> m_waiting;
+    bool m_isWaiting = false;
+    bool m_isOpen = true;
+};
+
+} // namespace Proof
+
+#endif // PROOF_RESTPUSHQUEUE_P_H
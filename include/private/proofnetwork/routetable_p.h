@@ -0,0 +1,70 @@
+/* Copyright 2018, OpenSoft Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright notice, this list of
+ * conditions and the following disclaimer in the documentation and/or other materials provided
+ * with the distribution.
+ *     * Neither the name of OpenSoft Inc. nor the names of its contributors may be used to endorse
+ * or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#ifndef PROOF_ROUTETABLE_P_H
+#define PROOF_ROUTETABLE_P_H
+
+#include <QByteArray>
+#include <QList>
+#include <QPair>
+#include <QString>
+#include <QStringRef>
+#include <QVarLengthArray>
+#include <QVector>
+
+namespace Proof {
+
+// Path parameters are stored as start and length in path, they are decoded only if handler needs them
+using PathParameters = QVarLengthArray<QPair<int, int>, 8>;
+
+// Tree of route segments, first segment is verb and segments in braces match any path segment.
+// Routes are referred by index that is assigned on first addition of their segments.
+// Immutable after construction, routing walks it without any allocations
+class RouteTable
+{
+public:
+    RouteTable();
+    // Returns index of route, it is the same as for previously added route with same segments
+    int addRoute(const QList<QByteArray> &segments);
+    // Returns -1 if nothing is matched
+    int find(const QString &verb, const QStringRef &path, PathParameters &parameters) const;
+
+private:
+    struct Node
+    {
+        QByteArray segment;
+        QVector<int> children;
+        int parameterChild = -1;
+        int routeIndex = -1;
+    };
+    int literalChild(int nodeIndex, const QStringRef &segment) const;
+    int matchNode(int nodeIndex, const QStringRef &path, int position, PathParameters &parameters) const;
+
+    QVector<Node> m_nodes;
+    int m_routesCount = 0;
+};
+
+} // namespace Proof
+
+#endif // PROOF_ROUTETABLE_P_H
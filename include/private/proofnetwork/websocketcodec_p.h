@@ -0,0 +1,90 @@
+/* Copyright 2018, OpenSoft Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright notice, this list of
+ * conditions and the following disclaimer in the documentation and/or other materials provided
+ * with the distribution.
+ *     * Neither the name of OpenSoft Inc. nor the names of its contributors may be used to endorse
+ * or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#ifndef PROOF_WEBSOCKETCODEC_P_H
+#define PROOF_WEBSOCKETCODEC_P_H
+
+#include <QByteArray>
+
+namespace Proof {
+
+// Server side of WebSocket (RFC 6455) framing without any I/O. Frames from client are taken from input
+// and fragmented messages are reassembled, control frames that need an answer are reported to caller
+class WebSocketCodec
+{
+public:
+    enum Opcode
+    {
+        ContinuationFrame = 0x0,
+        TextFrame = 0x1,
+        BinaryFrame = 0x2,
+        CloseFrame = 0x8,
+        PingFrame = 0x9,
+        PongFrame = 0xA
+    };
+
+    enum CloseCode
+    {
+        NormalClosure = 1000,
+        GoingAway = 1001,
+        ProtocolError = 1002,
+        MessageTooBig = 1009
+    };
+
+    enum class Result
+    {
+        NeedMore,
+        // Whole message is received, it is available in message()
+        Message,
+        // Ping is received, its payload is available in message() and should be sent back in pong
+        Ping,
+        Close,
+        // Connection should be closed with errorCode()
+        Error
+    };
+
+    // Takes frames from data until something should be reported, maxMessageSize is capped to what QByteArray can hold
+    Result decode(QByteArray &data, quint64 maxMessageSize);
+    QByteArray message() const;
+    bool isBinary() const;
+    CloseCode errorCode() const;
+
+    static QByteArray encodeFrame(Opcode opcode, const QByteArray &payload);
+    static QByteArray encodeClose(CloseCode code);
+    // Value of Sec-WebSocket-Accept header for Sec-WebSocket-Key of handshake request
+    static QByteArray acceptKey(const QByteArray &key);
+
+private:
+    Result fail(CloseCode code);
+
+    QByteArray m_message;
+    QByteArray m_fragments;
+    Opcode m_fragmentsOpcode = ContinuationFrame;
+    bool m_isBinary = false;
+    CloseCode m_errorCode = NormalClosure;
+};
+
+} // namespace Proof
+
+#endif // PROOF_WEBSOCKETCODEC_P_H
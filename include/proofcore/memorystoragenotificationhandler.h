@@ -31,6 +31,7 @@
 #include <QDateTime>
 #include <QMultiMap>
 #include <QString>
+#include <QVector>
 
 namespace Proof {
 class MemoryStorageNotificationHandlerPrivate;
@@ -43,6 +44,10 @@ public:
 
     QMultiMap<QDateTime, QString> messages() const;
     QPair<QDateTime, QString> lastMessage() const;
+    // Messages are serialized to compact JSON once when stored. Returns up to limit newest messages that are
+    // older than cursor (0 means from the newest one) and not older than since. nextCursor is 0 for last page
+    QVector<QByteArray> serializedMessages(quint64 cursor, const QDateTime &since, int limit,
+                                           quint64 &nextCursor) const;
 
     void notify(const QString &message, ErrorNotifier::Severity severity, const QString &packId) override;
 
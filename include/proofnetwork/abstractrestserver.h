@@ -28,12 +28,19 @@
 #include "proofseed/asynqro_extra.h"
 
 #include "proofnetwork/proofnetwork_global.h"
+#include "proofnetwork/multipartparser.h"
 #include "proofnetwork/proofnetwork_types.h"
+#include "proofnetwork/restrequestcontext.h"
 
+#include <QFileDevice>
 #include <QScopedPointer>
 #include <QStringList>
 #include <QTcpServer>
 #include <QUrlQuery>
+#include <QVector>
+
+#include <functional>
+#include <memory>
 
 #ifndef Q_MOC_RUN
 #    define NO_AUTH_REQUIRED
@@ -41,6 +48,119 @@
 
 namespace Proof {
 using HealthStatusMap = QMap<QString, QPair<QDateTime, QVariant>>;
+using RestHandler = std::function<void(QTcpSocket *socket, const QStringList &headers,
+                                       const QStringList &methodVariableParts, const QUrlQuery &query,
+                                       const QByteArray &body)>;
+// Gets request as is, headers and query are parsed only when handler asks for them
+using RestContextHandler = std::function<void(QTcpSocket *socket, const RestRequestContext &context)>;
+// Called in worker thread each time socket is ready for more data, empty chunk finishes the answer
+using RestChunkProducer = std::function<Future<QByteArray>()>;
+
+// Identifies single request on connection. Requests on persistent connections can be pipelined,
+// so handlers that answer asynchronously should capture handle instead of socket.
+// Connection is addressed by slot in its worker and generation of this slot, so stale handle is detected
+// without any locks even if socket is already deleted. Socket pointer is kept for information only
+class RestRequestHandle
+{
+public:
+    RestRequestHandle() = default;
+    RestRequestHandle(QTcpSocket *socket, quint64 sequence, QObject *worker, quint32 slot, quint32 generation)
+        : m_socket(socket), m_worker(worker), m_sequence(sequence), m_slot(slot), m_generation(generation)
+    {}
+
+    RestRequestHandle withSequence(quint64 sequence) const
+    {
+        return RestRequestHandle(m_socket, sequence, m_worker, m_slot, m_generation);
+    }
+
+    QTcpSocket *socket() const { return m_socket; }
+    quint64 sequence() const { return m_sequence; }
+    QObject *worker() const { return m_worker; }
+    quint32 slot() const { return m_slot; }
+    quint32 generation() const { return m_generation; }
+    bool isValid() const { return m_worker != nullptr; }
+
+private:
+    QTcpSocket *m_socket = nullptr;
+    QObject *m_worker = nullptr;
+    quint64 m_sequence = 0;
+    quint32 m_slot = 0;
+    quint32 m_generation = 0;
+};
+
+class RestPushQueue;
+// Server side of long-lived Server-Sent Events or WebSocket connection, can be copied and used from any thread.
+// Messages are queued per connection and written as fast as client reads them. push() fails when client is gone
+// or when queue reached pushQueueLimit(), so producer decides itself whether to drop, coalesce or retry later
+class PROOF_NETWORK_EXPORT RestPushChannel
+{
+public:
+    RestPushChannel() = default;
+    explicit RestPushChannel(const std::shared_ptr<RestPushQueue> &queue);
+
+    bool isOpen() const;
+    bool isWebSocket() const;
+    qint64 queuedBytes() const;
+    // Event stream gets data with optional event name and id, WebSocket gets data as text message
+    bool push(const QByteArray &data, const QByteArray &event = QByteArray(), const QByteArray &id = QByteArray());
+    // WebSocket only
+    bool pushBinary(const QByteArray &data);
+    // Ends event stream or sends WebSocket close frame, connection is closed after already queued messages
+    void close();
+
+private:
+    std::shared_ptr<RestPushQueue> m_queue;
+};
+// Called in worker thread for each complete message received from WebSocket client
+using RestWebSocketHandler = std::function<void(RestPushChannel channel, const QByteArray &message, bool isBinary)>;
+
+struct RestHandlerPoolStats
+{
+    qint64 queued = 0;
+    qint64 running = 0;
+    quint64 completed = 0;
+    quint64 rejected = 0;
+    qint64 maxWaitTime = 0;
+};
+
+struct RestAdmissionStats
+{
+    int connections = 0;
+    int inFlightRequests = 0;
+    qint64 pendingBytes = 0;
+    quint64 rejectedConnections = 0;
+    quint64 rejectedRequests = 0;
+};
+
+struct RestTimeoutStats
+{
+    quint64 idle = 0;
+    quint64 headers = 0;
+    quint64 body = 0;
+    quint64 write = 0;
+};
+
+struct RestPushStats
+{
+    int eventStreams = 0;
+    int webSockets = 0;
+    quint64 rejectedMessages = 0;
+};
+
+struct RestHttp2Stats
+{
+    int connections = 0;
+    quint64 streams = 0;
+    quint64 refusedStreams = 0;
+};
+
+struct RestAuthStats
+{
+    quint64 cacheHits = 0;
+    quint64 cacheMisses = 0;
+    quint64 failures = 0;
+    int cachedCredentials = 0;
+};
 
 class AbstractRestServerPrivate;
 class PROOF_NETWORK_EXPORT AbstractRestServer : public QTcpServer
@@ -62,21 +182,140 @@ public:
     QString pathPrefix() const;
     int port() const;
     RestAuthType authType() const;
+    int keepAliveTimeout() const;
+    int headersTimeout() const;
+    int bodyTimeout() const;
+    int writeTimeout() const;
+    int maxRequestsPerConnection() const;
+    int reusePortWorkersCount() const;
+    int minThreadsCount() const;
+    int threadIdleTimeout() const;
+    int listenBacklog() const;
+    QString unixSocketPath() const;
+    QFileDevice::Permissions unixSocketPermissions() const;
+    bool isTcpListeningEnabled() const;
+    bool isUnixSocketListening() const;
+    int deferAcceptTimeout() const;
+    int fastOpenQueueLength() const;
+    bool tcpNoDelay() const;
+    int maxHeadersSize() const;
+    qint64 maxBodySize() const;
+    qint64 bodySpoolThreshold() const;
+    qint64 streamHighWaterMark() const;
+    int compressionLevel() const;
+    int compressionMinSize() const;
+    int handlerThreadsCount() const;
+    int maxQueuedHandlers() const;
+    RestHandlerPoolStats handlerPoolStats() const;
+    int maxConnections() const;
+    int maxInFlightRequests() const;
+    qint64 maxPendingBytes() const;
+    int retryAfter() const;
+    int maxCachedResponses() const;
+    int statusRefreshInterval() const;
+    int healthStatusTtl() const;
+    RestAdmissionStats admissionStats() const;
+    RestTimeoutStats timeoutStats() const;
+    int authCacheTtl() const;
+    int maxAuthCacheSize() const;
+    RestAuthStats authStats() const;
+    qint64 pushQueueLimit() const;
+    RestPushStats pushStats() const;
+    bool isHttp2Enabled() const;
+    int http2MaxConcurrentStreams() const;
+    int http2WindowSize() const;
+    RestHttp2Stats http2Stats() const;
+    bool isDraining() const;
 
     void setUserName(const QString &userName);
     void setPassword(const QString &password);
     void setPathPrefix(const QString &pathPrefix);
     void setPort(quint16 port);
     void setSuggestedMaxThreadsCount(int count = -1);
+    // Basic type checks userName() and password() and also consults added authenticators,
+    // BearerToken type consults added authenticators only
     void setAuthType(RestAuthType authType);
+    void addAuthenticator(const RestAuthenticatorSP &authenticator);
+    void clearAuthenticators();
+    // Successfully validated credentials are cached for ttl msecs (0 disables caching)
+    void setAuthCacheTtl(int msecs);
+    void setMaxAuthCacheSize(int count);
+    // Should be called when custom authenticator revokes credentials it approved before
+    void invalidateAuthCache();
+    void setKeepAliveTimeout(int msecs);
+    // Time to receive whole request headers, counted from connect or from first byte of next request
+    void setHeadersTimeout(int msecs);
+    // Max time between two parts of request body
+    void setBodyTimeout(int msecs);
+    // Max time client doesn't read any part of answer
+    void setWriteTimeout(int msecs);
+    void setMaxRequestsPerConnection(int count);
+    // Listening options are applied at next startListen() call
+    void setReusePortWorkersCount(int count);
+    void setMinThreadsCount(int count);
+    void setThreadIdleTimeout(int msecs);
+    void setListenBacklog(int backlog);
+    // Local clients can connect via unix socket at this path in addition to TCP port, empty path disables it.
+    // Existing socket file is replaced and it is removed at stopListen()
+    void setUnixSocketPath(const QString &path);
+    // Socket file keeps permissions defined by umask if they are not set
+    void setUnixSocketPermissions(QFileDevice::Permissions permissions);
+    // Server can listen only on unix socket if it is disabled
+    void setTcpListeningEnabled(bool enabled);
+    void setDeferAcceptTimeout(int secs);
+    void setFastOpenQueueLength(int length);
+    void setTcpNoDelay(bool enabled);
+    void setMaxHeadersSize(int bytes);
+    // 64 MiB by default, 0 removes the limit
+    void setMaxBodySize(qint64 bytes);
+    void setBodySpoolThreshold(qint64 bytes);
+    void setStreamHighWaterMark(qint64 bytes);
+    // Max size of messages queued for single push channel
+    void setPushQueueLimit(qint64 bytes);
+    // Cleartext HTTP/2 is accepted both with prior knowledge and via Upgrade: h2c, disabled by default.
+    // Streams of single connection are dispatched to routes concurrently, their bodies are buffered whole
+    void setHttp2Enabled(bool enabled);
+    // Streams above this limit are refused with REFUSED_STREAM, so client can retry them later
+    void setHttp2MaxConcurrentStreams(int count);
+    // Receive window of each stream and of whole connection, at least 65535
+    void setHttp2WindowSize(int bytes);
+    // Compression of answers is disabled if level is set to 0
+    void setCompressionLevel(int level);
+    void setCompressionMinSize(int bytes);
+    void setHandlerThreadsCount(int count);
+    void setMaxQueuedHandlers(int count);
+    // Limits are disabled if set to 0
+    void setMaxConnections(int count);
+    void setMaxInFlightRequests(int count);
+    void setMaxPendingBytes(qint64 bytes);
+    void setRetryAfter(int secs);
+    void setMaxCachedResponses(int count);
+    // Static part of /system/status is rebuilt on interval and when crash dumps appear, 0 rebuilds it on each request
+    void setStatusRefreshInterval(int msecs);
+    // healthStatus() result for /system/status is reused during ttl, 0 disables it
+    void setHealthStatusTtl(int msecs);
 
     void setCustomHeader(const QString &header, const QString &value);
     QString customHeader(const QString &header) const;
     bool containsCustomHeader(const QString &header) const;
     void unsetCustomHeader(const QString &header);
 
+    // Should be called when data behind cached routes is changed
+    void invalidateCache();
+    void invalidateCache(const QString &method, const QString &path);
+
     void startListen();
     void stopListen();
+    // Stops listening, lets in-flight requests finish and closes keep-alive connections.
+    // Connections that are still open after timeout are closed forcibly, 0 means no timeout
+    void drain(int timeoutMsecs);
+
+    // Zero-downtime restart: successor calls receiveListeners() (it blocks until listeners arrive) and
+    // setInheritedListeners() before startListen(), current process calls handOverListeners() and then drain().
+    // Both processes should use same listening mode (reusePortWorkersCount() either 0 or not)
+    bool handOverListeners(const QString &handoverPath);
+    static QVector<qintptr> receiveListeners(const QString &handoverPath, int timeoutMsecs);
+    void setInheritedListeners(const QVector<qintptr> &descriptors);
 
 signals:
     void userNameChanged(const QString &arg);
@@ -84,6 +323,8 @@ signals:
     void pathPrefixChanged(const QString &arg);
     void portChanged(int arg);
     void authTypeChanged(Proof::RestAuthType arg);
+    void drainProgress(int connections, int inFlightRequests);
+    void drained(bool isCompleted);
 
 protected slots:
     NO_AUTH_REQUIRED void rest_get_System_Status(QTcpSocket *socket, const QStringList &headers,
@@ -92,31 +333,97 @@ protected slots:
     NO_AUTH_REQUIRED void rest_get_System_RecentErrors(QTcpSocket *socket, const QStringList &headers,
                                                        const QStringList &methodVariableParts, const QUrlQuery &query,
                                                        const QByteArray &body);
+    NO_AUTH_REQUIRED void rest_get_System_Metrics(QTcpSocket *socket, const QStringList &headers,
+                                                  const QStringList &methodVariableParts, const QUrlQuery &query,
+                                                  const QByteArray &body);
 
 protected:
     virtual Future<HealthStatusMap> healthStatus(bool quick) const;
 
     void incomingConnection(qintptr socketDescriptor) override;
 
+    void addRoute(const QString &method, const QString &path, const RestHandler &handler, bool authRequired = true);
+    void addRoute(const QString &method, const QString &path, const RestContextHandler &handler,
+                  bool authRequired = true);
+    // Handlers that are executed in handler pool must use socket only as an argument for answer methods
+    void setRouteExecutionPolicy(const QString &method, const QString &path, RestExecutionPolicy policy);
+    void setRouteMaxInFlightRequests(const QString &method, const QString &path, int count);
+    // Bodies of route requests that are not answered yet are limited separately from maxPendingBytes()
+    void setRouteMaxPendingBytes(const QString &method, const QString &path, qint64 bytes);
+    // Body of such routes is not passed to handler as QByteArray, it should be read from requestBody() instead
+    void setRouteBodyStreamed(const QString &method, const QString &path, bool streamed);
+    // Multipart body of such routes is split to parts while it is received, parts are available from requestParts().
+    // Requests with other content types are answered with 415
+    void setRouteBodyMultipart(const QString &method, const QString &path, bool multipart);
+    // Answers of all routes are compressed if client accepts it, should be disabled for already compressed data
+    void setRouteCompressed(const QString &method, const QString &path, bool compressed);
+    // Successful answers of GET route are cached for ttl msecs (0 disables caching) by path and query.
+    // Per user cache also takes Authorization header into account
+    void setRouteCacheTtl(const QString &method, const QString &path, int msecs, bool perUser = false);
+
+    RestRequestHandle requestHandle(QTcpSocket *socket) const;
+    QSharedPointer<QIODevice> requestBody(QTcpSocket *socket) const;
+    QVector<MultipartPart> requestParts(QTcpSocket *socket) const;
+
     void sendAnswer(QTcpSocket *socket, const QByteArray &body, const QString &contentType, int returnCode = 200,
                     const QString &reason = QString());
     void sendAnswer(QTcpSocket *socket, const QByteArray &body, const QString &contentType,
                     const QHash<QString, QString> &headers, int returnCode = 200, const QString &reason = QString());
+    void sendAnswer(const RestRequestHandle &request, const QByteArray &body, const QString &contentType,
+                    int returnCode = 200, const QString &reason = QString());
+    void sendAnswer(const RestRequestHandle &request, const QByteArray &body, const QString &contentType,
+                    const QHash<QString, QString> &headers, int returnCode = 200, const QString &reason = QString());
+    void sendStreamedAnswer(QTcpSocket *socket, const RestChunkProducer &producer, const QString &contentType,
+                            int returnCode = 200, const QString &reason = QString());
+    void sendStreamedAnswer(const RestRequestHandle &request, const RestChunkProducer &producer,
+                            const QString &contentType,
+                            const QHash<QString, QString> &headers = QHash<QString, QString>(), int returnCode = 200,
+                            const QString &reason = QString());
+    // Answers request with text/event-stream, events pushed to returned channel are sent to client until it is closed
+    RestPushChannel openEventStream(QTcpSocket *socket,
+                                    const QHash<QString, QString> &headers = QHash<QString, QString>());
+    RestPushChannel openEventStream(const RestRequestHandle &request,
+                                    const QHash<QString, QString> &headers = QHash<QString, QString>());
+    // Completes WebSocket handshake or answers with error if request is not a valid upgrade request
+    // (returned channel is closed then). Pings are answered by server itself
+    RestPushChannel acceptWebSocket(QTcpSocket *socket, const RestWebSocketHandler &handler = RestWebSocketHandler());
+    RestPushChannel acceptWebSocket(const RestRequestHandle &request,
+                                    const RestWebSocketHandler &handler = RestWebSocketHandler());
+    // Supports conditional and range requests, file data is sent directly from page cache where possible
+    void sendFile(QTcpSocket *socket, const QString &filePath, const QString &contentType);
+    void sendFile(const RestRequestHandle &request, const QString &filePath, const QString &contentType,
+                  const QHash<QString, QString> &headers = QHash<QString, QString>());
     void sendErrorCode(QTcpSocket *socket, int returnCode, const QString &reason, int errorCode,
                        const QStringList &args = QStringList());
+    void sendErrorCode(const RestRequestHandle &request, int returnCode, const QString &reason, int errorCode,
+                       const QStringList &args = QStringList());
     template <class Enum>
     void sendErrorCode(QTcpSocket *socket, int returnCode, const QString &reason, Enum errorCode,
                        const QStringList &args = QStringList())
     {
         sendErrorCode(socket, returnCode, reason, static_cast<int>(errorCode), args);
     }
+    template <class Enum>
+    void sendErrorCode(const RestRequestHandle &request, int returnCode, const QString &reason, Enum errorCode,
+                       const QStringList &args = QStringList())
+    {
+        sendErrorCode(request, returnCode, reason, static_cast<int>(errorCode), args);
+    }
     void sendBadRequest(QTcpSocket *socket, const QString &reason = QStringLiteral("Bad Request"));
+    void sendBadRequest(const RestRequestHandle &request, const QString &reason = QStringLiteral("Bad Request"));
     void sendNotFound(QTcpSocket *socket, const QString &reason = QStringLiteral("Not Found"));
+    void sendNotFound(const RestRequestHandle &request, const QString &reason = QStringLiteral("Not Found"));
     void sendNotAuthorized(QTcpSocket *socket, const QString &reason = QStringLiteral("Unauthorized"));
+    void sendNotAuthorized(const RestRequestHandle &request, const QString &reason = QStringLiteral("Unauthorized"));
     void sendConflict(QTcpSocket *socket, const QString &reason = QStringLiteral("Conflict"));
+    void sendConflict(const RestRequestHandle &request, const QString &reason = QStringLiteral("Conflict"));
     void sendInternalError(QTcpSocket *socket);
+    void sendInternalError(const RestRequestHandle &request);
     void sendNotImplemented(QTcpSocket *socket, const QString &reason = QStringLiteral("Not Implemented"));
+    void sendNotImplemented(const RestRequestHandle &request,
+                            const QString &reason = QStringLiteral("Not Implemented"));
     bool checkBasicAuth(const QString &encryptedAuth) const;
+    // Deprecated, Authorization header is parsed by authenticators now. Returns Basic credentials from header line
     QString parseAuth(QTcpSocket *socket, const QString &header);
 
     AbstractRestServer(AbstractRestServerPrivate &dd, const QString &pathPrefix, quint16 port);
@@ -0,0 +1,127 @@
+/* Copyright 2018, OpenSoft Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright notice, this list of
+ * conditions and the following disclaimer in the documentation and/or other materials provided
+ * with the distribution.
+ *     * Neither the name of OpenSoft Inc. nor the names of its contributors may be used to endorse
+ * or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#ifndef PROOF_MULTIPARTPARSER_H
+#define PROOF_MULTIPARTPARSER_H
+
+#include "proofnetwork/proofnetwork_global.h"
+
+#include <QByteArray>
+#include <QByteArrayMatcher>
+#include <QIODevice>
+#include <QList>
+#include <QPair>
+#include <QSharedPointer>
+#include <QString>
+#include <QVector>
+
+#include <functional>
+
+class QTemporaryFile;
+
+namespace Proof {
+
+struct PROOF_NETWORK_EXPORT MultipartPart
+{
+    // Name and file name from Content-Disposition header
+    QString name;
+    QString fileName;
+    QByteArray contentType;
+    QList<QPair<QByteArray, QByteArray>> headers;
+    qint64 size = 0;
+    // Opened for reading at the beginning, temporary file for parts larger than memory threshold
+    QSharedPointer<QIODevice> body;
+
+    // Value of first header with such name (compared case-insensitively), empty if there is no such header
+    QByteArray header(const QByteArray &name) const;
+};
+
+// Incremental multipart/form-data (RFC 7578) parser. Data can be fed in chunks of any size, only tail that can
+// contain part of boundary is buffered between calls and each part body is written to its own device as soon as
+// it is known that it doesn't belong to boundary
+class PROOF_NETWORK_EXPORT MultipartParser
+{
+public:
+    enum class Result
+    {
+        NeedMore,
+        // Closing boundary is received, everything after it is ignored
+        Finished,
+        Error
+    };
+
+    using PartHandler = std::function<void(const MultipartPart &)>;
+
+    explicit MultipartParser(const QByteArray &boundary, qint64 memoryThreshold = 64 * 1024);
+
+    // Boundary parameter of multipart Content-Type header value, empty if it is not multipart
+    static QByteArray boundaryFromContentType(const QByteArray &contentType);
+
+    Result feed(const char *data, qint64 size);
+    Result feed(const QByteArray &data);
+    void setMaxHeadersSize(int size);
+    void setMaxPartsCount(int count);
+    // Called for each part right after its closing delimiter is received
+    void setPartHandler(const PartHandler &handler);
+
+    bool isFinished() const;
+    QString error() const;
+    // Completed parts that were not taken yet
+    QVector<MultipartPart> takeParts();
+
+private:
+    enum class State
+    {
+        Preamble,
+        Delimiter,
+        Headers,
+        Body,
+        Epilogue,
+        Failed
+    };
+
+    bool parseHeaders(const char *data, int size);
+    bool appendToPart(const char *data, int size);
+    void finishPart();
+    Result fail(const QString &error);
+
+    QByteArray m_delimiter;
+    QByteArrayMatcher m_delimiterMatcher;
+    qint64 m_memoryThreshold = 0;
+    int m_maxHeadersSize = 16 * 1024;
+    int m_maxPartsCount = 0;
+    int m_partsCount = 0;
+    PartHandler m_partHandler;
+    State m_state = State::Preamble;
+    QByteArray m_buffer;
+    MultipartPart m_part;
+    QByteArray m_partData;
+    QSharedPointer<QTemporaryFile> m_partFile;
+    QVector<MultipartPart> m_parts;
+    QString m_error;
+};
+
+} // namespace Proof
+
+#endif // PROOF_MULTIPARTPARSER_H
@@ -50,6 +50,10 @@ class SmtpClient;
 using SmtpClientSP = QSharedPointer<SmtpClient>;
 using SmtpClientWP = QWeakPointer<SmtpClient>;
 
+class RestAuthenticator;
+using RestAuthenticatorSP = QSharedPointer<RestAuthenticator>;
+using RestAuthenticatorWP = QWeakPointer<RestAuthenticator>;
+
 enum class RestAuthType
 {
     NoAuth,
@@ -57,6 +61,12 @@ enum class RestAuthType
     Wsse,
     BearerToken
 };
+
+enum class RestExecutionPolicy
+{
+    Inline,
+    HandlerPool
+};
 } // namespace Proof
 
 Q_DECLARE_METATYPE(Proof::RestAuthType)
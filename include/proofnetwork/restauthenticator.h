@@ -0,0 +1,101 @@
+/* Copyright 2018, OpenSoft Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright notice, this list of
+ * conditions and the following disclaimer in the documentation and/or other materials provided
+ * with the distribution.
+ *     * Neither the name of OpenSoft Inc. nor the names of its contributors may be used to endorse
+ * or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#ifndef PROOF_RESTAUTHENTICATOR_H
+#define PROOF_RESTAUTHENTICATOR_H
+
+#include "proofnetwork/proofnetwork_global.h"
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QString>
+
+namespace Proof {
+
+struct RestAuthResult
+{
+    bool isValid = false;
+    QString identity;
+    // Msecs since epoch after which credentials are not valid anymore, 0 if they don't expire
+    qint64 validUntil = 0;
+};
+
+// Validates credentials of single Authorization scheme. Called concurrently from worker threads,
+// so implementations should be thread-safe. Successful results are cached by server, validate() is called
+// only for credentials that were not seen during cache ttl
+class PROOF_NETWORK_EXPORT RestAuthenticator
+{
+public:
+    RestAuthenticator() = default;
+    RestAuthenticator(const RestAuthenticator &) = delete;
+    RestAuthenticator &operator=(const RestAuthenticator &) = delete;
+    RestAuthenticator(RestAuthenticator &&) = delete;
+    RestAuthenticator &operator=(RestAuthenticator &&) = delete;
+    virtual ~RestAuthenticator();
+
+    // Scheme name as in Authorization header, compared case-insensitively
+    virtual QByteArray scheme() const = 0;
+    // Credentials are the part of Authorization header after scheme name
+    virtual RestAuthResult validate(const QByteArray &credentials) const = 0;
+
+    // Time of comparison doesn't depend on position of first mismatch
+    static bool isEqualInConstantTime(const QByteArray &left, const QByteArray &right);
+};
+
+// Only SHA-256 digest of expected credentials is kept, so each check is one hash and constant-time comparison
+class PROOF_NETWORK_EXPORT BasicRestAuthenticator : public RestAuthenticator
+{
+public:
+    BasicRestAuthenticator(const QString &userName, const QString &password);
+
+    QByteArray scheme() const override;
+    RestAuthResult validate(const QByteArray &credentials) const override;
+
+private:
+    QString m_userName;
+    QByteArray m_digest;
+};
+
+// Self-contained bearer tokens in "<payload>.<signature>" form, where payload is base64url encoded
+// "<identity>:<expiration in secs since epoch>" and signature is base64url encoded HMAC-SHA256 of payload
+class PROOF_NETWORK_EXPORT HmacBearerRestAuthenticator : public RestAuthenticator
+{
+public:
+    explicit HmacBearerRestAuthenticator(const QByteArray &secret);
+
+    QByteArray scheme() const override;
+    RestAuthResult validate(const QByteArray &credentials) const override;
+
+    // Null expiresAt means token never expires
+    QByteArray issueToken(const QString &identity, const QDateTime &expiresAt = QDateTime()) const;
+
+private:
+    QByteArray signature(const QByteArray &payload) const;
+
+    QByteArray m_secret;
+};
+
+} // namespace Proof
+
+#endif // PROOF_RESTAUTHENTICATOR_H
@@ -0,0 +1,100 @@
+/* Copyright 2018, OpenSoft Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright notice, this list of
+ * conditions and the following disclaimer in the documentation and/or other materials provided
+ * with the distribution.
+ *     * Neither the name of OpenSoft Inc. nor the names of its contributors may be used to endorse
+ * or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#ifndef PROOF_RESTREQUESTCONTEXT_H
+#define PROOF_RESTREQUESTCONTEXT_H
+
+#include "proofnetwork/proofnetwork_global.h"
+
+#include <QByteArray>
+#include <QList>
+#include <QPair>
+#include <QString>
+#include <QStringList>
+#include <QUrlQuery>
+#include <QVarLengthArray>
+
+namespace Proof {
+
+// Request as it came from the wire. Headers are indexed once by case-insensitive hash of their names and
+// kept as original bytes, query and path parameters are decoded only when they are asked for
+class PROOF_NETWORK_EXPORT RestRequestContext
+{
+public:
+    RestRequestContext() = default;
+    RestRequestContext(const QString &method, const QString &uri, const QByteArray &rawHeaders,
+                       const QByteArray &body = QByteArray());
+
+    QString method() const;
+    QString uri() const;
+    QStringRef path() const;
+    QStringRef rawQuery() const;
+    QByteArray body() const;
+    // Identity returned by authenticator, empty if route doesn't require authentication
+    QString authIdentity() const;
+
+    bool hasHeader(QLatin1String name) const;
+    // First value of header with surrounding whitespaces removed, empty if there is no such header
+    QByteArray header(QLatin1String name) const;
+    QList<QByteArray> headerValues(QLatin1String name) const;
+    QByteArray rawHeaders() const;
+    // Headers as "Name: value" strings, same as in QStringList-based handlers
+    QStringList headers() const;
+
+    bool hasQueryItem(const QString &name) const;
+    QString queryItem(const QString &name) const;
+    QUrlQuery query() const;
+
+    int pathParametersCount() const;
+    QString pathParameter(int index) const;
+    QStringList pathParameters() const;
+
+private:
+    friend class AbstractRestServerPrivate;
+
+    struct HeaderEntry
+    {
+        uint hash;
+        int nameStart;
+        int nameLength;
+        int valueStart;
+        int valueLength;
+    };
+
+    const HeaderEntry *findHeader(QLatin1String name, const HeaderEntry *from) const;
+    static uint headerNameHash(const char *name, int length);
+
+    QString m_method;
+    QString m_uri;
+    QByteArray m_rawHeaders;
+    QByteArray m_body;
+    QString m_authIdentity;
+    QVarLengthArray<HeaderEntry, 16> m_headers;
+    // Start and length of each path parameter in uri
+    QVarLengthArray<QPair<int, int>, 8> m_pathParameters;
+};
+
+} // namespace Proof
+
+#endif // PROOF_RESTREQUESTCONTEXT_H
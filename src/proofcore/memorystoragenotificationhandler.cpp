@@ -26,18 +26,35 @@
 
 #include "proofcore/abstractnotificationhandler_p.h"
 
+#include <QJsonDocument>
+#include <QJsonObject>
 #include <QMutex>
 #include <QMutexLocker>
 #include <QTimer>
 
+#include <algorithm>
+#include <deque>
+
 static const qlonglong MSECS_TO_KEEP = 1000 * 60 * 60 * 24; //24 hours
 
+namespace {
+struct StoredMessage
+{
+    quint64 id;
+    QDateTime time;
+    QString message;
+    QByteArray json;
+};
+} // namespace
+
 namespace Proof {
 class MemoryStorageNotificationHandlerPrivate : public AbstractNotificationHandlerPrivate
 {
     Q_DECLARE_PUBLIC(MemoryStorageNotificationHandler)
 
-    QMultiMap<QDateTime, QString> messages;
+    // Ordered by insertion, ids are sequential so position of any id is known without search
+    std::deque<StoredMessage> messages;
+    quint64 nextId = 1;
     QPair<QDateTime, QString> lastMessage;
     mutable QMutex mutex;
     QTimer *cleanupTimer = nullptr;
@@ -58,8 +75,8 @@ MemoryStorageNotificationHandler::MemoryStorageNotificationHandler(const QString
     connect(d->cleanupTimer, &QTimer::timeout, this, [d]() {
         QDateTime limiter = QDateTime::currentDateTimeUtc().addMSecs(-MSECS_TO_KEEP);
         d->mutex.lock();
-        while (!d->messages.isEmpty() && d->messages.firstKey() < limiter)
-            d->messages.remove(d->messages.firstKey());
+        while (!d->messages.empty() && d->messages.front().time < limiter)
+            d->messages.pop_front();
         d->mutex.unlock();
     });
     d->cleanupTimer->start();
@@ -69,7 +86,10 @@ QMultiMap<QDateTime, QString> MemoryStorageNotificationHandler::messages() const
 {
     Q_D_CONST(MemoryStorageNotificationHandler);
     QMutexLocker locker(&d->mutex);
-    return d->messages;
+    QMultiMap<QDateTime, QString> result;
+    for (const auto &message : d->messages)
+        result.insert(message.time, message.message);
+    return result;
 }
 
 QPair<QDateTime, QString> MemoryStorageNotificationHandler::lastMessage() const
@@ -79,15 +99,49 @@ QPair<QDateTime, QString> MemoryStorageNotificationHandler::lastMessage() const
     return d->lastMessage;
 }
 
+QVector<QByteArray> MemoryStorageNotificationHandler::serializedMessages(quint64 cursor, const QDateTime &since,
+                                                                        int limit, quint64 &nextCursor) const
+{
+    Q_D_CONST(MemoryStorageNotificationHandler);
+    nextCursor = 0;
+    QVector<QByteArray> result;
+    QMutexLocker locker(&d->mutex);
+    if (d->messages.empty())
+        return result;
+
+    const quint64 firstId = d->messages.front().id;
+    const auto size = static_cast<quint64>(d->messages.size());
+    const quint64 end = !cursor ? size : cursor <= firstId ? 0 : qMin(size, cursor - firstId);
+    quint64 begin = 0;
+    if (since.isValid()) {
+        begin = static_cast<quint64>(std::lower_bound(d->messages.cbegin(), d->messages.cbegin() + end, since,
+                                                      [](const StoredMessage &message, const QDateTime &time) {
+                                                          return message.time < time;
+                                                      })
+                                     - d->messages.cbegin());
+    }
+    const quint64 count = limit > 0 ? qMin(end - begin, static_cast<quint64>(limit)) : end - begin;
+    result.reserve(static_cast<int>(count));
+    for (quint64 i = end; i > end - count; --i)
+        result << d->messages[i - 1].json;
+    if (end - count > begin)
+        nextCursor = d->messages[end - count].id;
+    return result;
+}
+
 void MemoryStorageNotificationHandler::notify(const QString &message, ErrorNotifier::Severity severity,
                                               const QString &packId)
 {
     Q_UNUSED(packId)
     Q_UNUSED(severity)
     Q_D(MemoryStorageNotificationHandler);
+    const QDateTime time = QDateTime::currentDateTimeUtc();
+    const QByteArray json = QJsonDocument(QJsonObject{{QStringLiteral("timestamp"), time.toString(Qt::ISODate)},
+                                                      {QStringLiteral("message"), message}})
+                                .toJson(QJsonDocument::Compact);
     d->mutex.lock();
-    d->lastMessage = qMakePair(QDateTime::currentDateTimeUtc(), message);
-    d->messages.insert(d->lastMessage.first, message);
+    d->lastMessage = qMakePair(time, message);
+    d->messages.push_back(StoredMessage{d->nextId++, time, message, json});
     d->mutex.unlock();
 }
 
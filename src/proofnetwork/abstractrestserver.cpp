@@ -30,75 +30,341 @@
 #include "proofcore/proofglobal.h"
 #include "proofcore/proofobject.h"
 
+#include "proofnetwork/http2session_p.h"
 #include "proofnetwork/httpparser_p.h"
+#include "proofnetwork/listenershandover_p.h"
+#include "proofnetwork/multipartparser.h"
+#include "proofnetwork/restauthenticator.h"
+#include "proofnetwork/restpushqueue_p.h"
+#include "proofnetwork/restrequestcontext.h"
+#include "proofnetwork/routetable_p.h"
+#include "proofnetwork/websocketcodec_p.h"
 
+#include <QBuffer>
+#include <QCryptographicHash>
 #include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
 #include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonObject>
+#include <QLocale>
 #include <QMetaMethod>
 #include <QMetaObject>
 #include <QMutex>
 #include <QNetworkInterface>
 #include <QReadWriteLock>
+#include <QRunnable>
 #include <QSet>
+#include <QSocketNotifier>
 #include <QSysInfo>
 #include <QTcpSocket>
+#include <QThreadPool>
+#include <QTimer>
 #include <QUrlQuery>
 
 #include <algorithm>
+#include <array>
+#include <chrono>
+#include <deque>
+#include <memory>
+
+#include <zlib.h>
+
+#ifdef Q_OS_LINUX
+#    include <netinet/in.h>
+#    include <netinet/tcp.h>
+#    include <sys/sendfile.h>
+#    include <sys/socket.h>
+#    include <sys/stat.h>
+#    include <sys/uio.h>
+#    include <sys/un.h>
+
+#    include <cerrno>
+#    include <cstring>
+#    include <unistd.h>
+#endif
 
 static constexpr int MIN_THREADS_COUNT = 5;
+static constexpr int DEFAULT_KEEP_ALIVE_TIMEOUT = 5000;
+static constexpr int DEFAULT_MAX_REQUESTS_PER_CONNECTION = 100;
+static constexpr int DEFAULT_HEADERS_TIMEOUT = 10000;
+static constexpr int DEFAULT_BODY_TIMEOUT = 30000;
+static constexpr int DEFAULT_WRITE_TIMEOUT = 30000;
+// Timing wheel covers 64 seconds, sockets with longer deadlines just stay in their slot for more turns
+static constexpr int TIMEOUT_WHEEL_TICK = 250;
+static constexpr int TIMEOUT_WHEEL_SIZE = 256;
+static constexpr int DRAIN_CHECK_INTERVAL = 250;
+static constexpr int MAX_PIPELINED_REQUESTS = 16;
+static constexpr quint32 CONNECTION_SLOTS_CHUNK_SIZE = 256;
+static constexpr quint32 MAX_CONNECTION_SLOTS_CHUNKS = 256;
+static constexpr int DEFAULT_MIN_THREADS_COUNT = 1;
+static constexpr int DEFAULT_THREAD_IDLE_TIMEOUT = 60000;
+static constexpr int IDLE_THREADS_CHECK_INTERVAL = 5000;
+// Sockets count of idle worker that is being stopped, no connection can be reserved at such worker
+static constexpr long long RETIRED_WORKER_SOCKETS_COUNT = -1;
+static constexpr int DEFAULT_LISTEN_BACKLOG = 128;
+static constexpr int ACCEPT_BATCH_SIZE = 64;
+static constexpr int DEFAULT_MAX_QUEUED_HANDLERS = 1000;
+static constexpr int DEFAULT_RETRY_AFTER = 1;
+static constexpr int DEFAULT_MAX_HEADERS_SIZE = 64 * 1024;
+static constexpr qint64 DEFAULT_MAX_BODY_SIZE = 64 * 1024 * 1024;
+static constexpr qint64 DEFAULT_BODY_SPOOL_THRESHOLD = 1024 * 1024;
+static constexpr qint64 DEFAULT_STREAM_HIGH_WATER_MARK = 256 * 1024;
+static constexpr int DEFAULT_MAX_CACHED_RESPONSES = 1000;
+static constexpr int DEFAULT_STATUS_REFRESH_INTERVAL = 10000;
+static constexpr int MAX_RECENT_ERRORS_LIMIT = 10000;
+static constexpr int DEFAULT_HEALTH_STATUS_TTL = 1000;
+static constexpr int DEFAULT_AUTH_CACHE_TTL = 60000;
+static constexpr int DEFAULT_MAX_AUTH_CACHE_SIZE = 10000;
+static constexpr qint64 LATENCY_BUCKETS_USECS[] = {500,    1000,   2500,    5000,    10000,   25000,   50000,
+                                                   100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000};
+static constexpr int LATENCY_BUCKETS_COUNT = sizeof(LATENCY_BUCKETS_USECS) / sizeof(LATENCY_BUCKETS_USECS[0]);
+static constexpr int MIN_STATUS_CODE = 100;
+static constexpr int MAX_STATUS_CODE = 599;
+static constexpr int DEFAULT_COMPRESSION_LEVEL = 6;
+static constexpr int DEFAULT_COMPRESSION_MIN_SIZE = 1024;
+// Decoded request body limit if maxBodySize is not set, protects from decompression bombs
+static constexpr qint64 DEFAULT_MAX_DECODED_BODY_SIZE = 64 * 1024 * 1024;
+static constexpr qint64 FILE_SENDFILE_CHUNK_SIZE = 1024 * 1024;
+static constexpr qint64 FILE_COPY_CHUNK_SIZE = 64 * 1024;
+static constexpr int FILE_CHUNKS_PER_PUMP = 8;
+static constexpr qint64 DEFAULT_PUSH_QUEUE_LIMIT = 1024 * 1024;
+static constexpr qint64 DEFAULT_MAX_WEBSOCKET_MESSAGE_SIZE = 16 * 1024 * 1024;
+static constexpr int DEFAULT_HTTP2_MAX_CONCURRENT_STREAMS = 100;
+static constexpr int DEFAULT_HTTP2_WINDOW_SIZE = 1024 * 1024;
+static constexpr int MIN_HTTP2_WINDOW_SIZE = 65535;
 
 namespace {
 class WorkerThread;
 
-class MethodNode
+enum LatencyPhase
 {
-public:
-    MethodNode();
-    bool contains(const QString &name) const;
-    void clear();
+    ParsePhase,
+    AuthPhase,
+    HandlerPhase,
+    WritePhase,
+    LatencyPhasesCount
+};
+
+enum TimeoutPhase
+{
+    IdleTimeout,
+    HeadersTimeout,
+    BodyTimeout,
+    WriteTimeout,
+    TimeoutPhasesCount,
+    NoTimeout = TimeoutPhasesCount
+};
+
+// Updated from all threads without locks, buckets are not cumulative and are summed only on export
+struct LatencyHistogram
+{
+    void add(qint64 usecs)
+    {
+        const auto bucket = std::lower_bound(std::begin(LATENCY_BUCKETS_USECS), std::end(LATENCY_BUCKETS_USECS), usecs);
+        const auto index = static_cast<size_t>(bucket - std::begin(LATENCY_BUCKETS_USECS));
+        buckets[index].fetch_add(1, std::memory_order_relaxed);
+        sumUsecs.fetch_add(static_cast<quint64>(qMax(0ll, usecs)), std::memory_order_relaxed);
+    }
+
+    std::array<std::atomic_ullong, LATENCY_BUCKETS_COUNT + 1> buckets{};
+    std::atomic_ullong sumUsecs{0};
+};
+
+struct RouteMetrics
+{
+    std::array<std::atomic_ullong, MAX_STATUS_CODE - MIN_STATUS_CODE + 1> statusCounts{};
+    std::array<LatencyHistogram, LatencyPhasesCount> latencies;
+};
+
+struct RestRoute
+{
+    int methodIndex = -1;
+    // Slot takes RestRequestContext instead of headers, path parameters, query and body
+    bool isContextMethod = false;
+    Proof::RestHandler handler;
+    Proof::RestContextHandler contextHandler;
+    bool authRequired = true;
+    Proof::RestExecutionPolicy executionPolicy = Proof::RestExecutionPolicy::Inline;
+    int maxInFlightRequests = 0;
+    std::shared_ptr<std::atomic_int> inFlightRequests;
+    qint64 maxPendingBytes = 0;
+    std::shared_ptr<std::atomic<qint64>> pendingBytes;
+    bool admissionExempt = false;
+    bool bodyStreamed = false;
+    bool bodyMultipart = false;
+    bool compressed = true;
+    int cacheTtl = 0;
+    bool cachePerUser = false;
+    QByteArray key;
+    std::shared_ptr<RouteMetrics> metrics;
+    QString name;
+};
+
+enum class ContentEncoding
+{
+    Identity,
+    Gzip,
+    Deflate,
+    Unsupported
+};
 
-    operator QString() const; // NOLINT(google-explicit-constructor)
-    MethodNode &operator[](const QString &name);
-    void setValue(const QString &value);
+enum class DecodeResult
+{
+    Decoded,
+    TooLarge,
+    Malformed
+};
+
+struct CustomRoute
+{
+    QString method;
+    QString path;
+    RestRoute route;
+};
 
-    QString tag() const;
-    void setTag(const QString &tag);
+// Settings of routes by their index in route table, immutable after construction
+class RestRouteTable
+{
+public:
+    void addRoute(const QList<QByteArray> &segments, const RestRoute &route);
+    const RestRoute *find(const QString &verb, const QStringRef &path, Proof::PathParameters &parameters) const;
 
 private:
-    QHash<QString, MethodNode> m_nodes;
-    QString m_value;
-    QString m_tag;
+    Proof::RouteTable m_table;
+    QVector<RestRoute> m_routes;
 };
 
-struct WorkerThreadInfo
+// Route found during admission, it is reused at dispatch. Table is kept to not let route be destroyed by rebuild
+struct RouteMatch
 {
-    WorkerThreadInfo() {}
-    explicit WorkerThreadInfo(WorkerThread *thread, long long socketCount) : thread(thread)
-    {
-        this->socketCount = socketCount;
-    }
-    ~WorkerThreadInfo() {}
+    std::shared_ptr<const RestRouteTable> table;
+    const RestRoute *route = nullptr;
+    Proof::PathParameters parameters;
+};
 
-    WorkerThreadInfo(const WorkerThreadInfo &other) { *this = other; }
-    WorkerThreadInfo &operator=(const WorkerThreadInfo &other)
-    {
-        thread = other.thread;
-        socketCount.store(other.socketCount);
-        return *this;
-    }
-    WorkerThreadInfo(WorkerThreadInfo &&other) noexcept { *this = other; }
-    WorkerThreadInfo &operator=(WorkerThreadInfo &&other) noexcept
-    {
-        thread = other.thread;
-        socketCount.store(other.socketCount);
-        return *this;
-    }
+// Route settings that are needed before request is dispatched
+struct RouteOptions
+{
+    bool bodyStreamed = false;
+    bool bodyMultipart = false;
+    bool compressed = true;
+    std::shared_ptr<RouteMetrics> metrics;
+    RouteMatch match;
+};
 
-    WorkerThread *thread = nullptr;
-    std::atomic_llong socketCount{0};
+// Result of request body checks shared by HTTP/1.1 and HTTP/2, body can be passed to handler if returnCode is 0
+struct BodyStatus
+{
+    int returnCode = 0;
+    QString reason;
+};
+
+// Slot generation is changed both on connection open and close, so handle of closed connection never matches
+struct ConnectionSlot
+{
+    std::atomic_uint generation{0};
+    QTcpSocket *socket = nullptr;
+};
+
+// Part of file that is sent as response body
+struct FileBody
+{
+    QSharedPointer<QFile> file;
+    qint64 offset = 0;
+    qint64 length = 0;
+};
+
+struct CachedResponse
+{
+    QByteArray routeKey;
+    QByteArray body;
+    QString contentType;
+    QHash<QString, QString> headers;
+    QByteArray eTag;
+    qint64 expiresAt = 0;
+    quint64 insertionStamp = 0;
+};
+
+struct CachedHealth
+{
+    QJsonArray health;
+    qint64 expiresAt = 0;
+};
+
+// Immutable snapshot, rebuilt when credentials or authenticators are changed
+struct AuthenticatorsSet
+{
+    quint64 generation = 0;
+    Proof::RestAuthenticatorSP basic;
+    // Authenticators that are consulted for requests, in order of registration
+    QVector<Proof::RestAuthenticatorSP> active;
+};
+
+// Validated credentials, keyed by digest of Authorization header. Generation drops entries validated by
+// authenticators that were replaced since then
+struct AuthCacheEntry
+{
+    QString identity;
+    qint64 expiresAt = 0;
+    quint64 generation = 0;
+};
+
+// Where answer of request should be cached, generation protects from caching answers computed before invalidation
+struct CacheTarget
+{
+    QByteArray key;
+    QByteArray routeKey;
+    int ttl = 0;
+    quint64 generation = 0;
+};
+
+// Resources taken by request until it is answered
+struct Admission
+{
+    std::shared_ptr<std::atomic_int> routeInFlightRequests;
+    std::shared_ptr<std::atomic<qint64>> routePendingBytes;
+    qint64 bytes = 0;
+    bool counted = false;
+};
+
+struct PendingResponse
+{
+    quint64 sequence = 0;
+    QByteArray head;
+    QByteArray body;
+    Admission admission;
+    Proof::RestChunkProducer producer;
+    FileBody file;
+    // Producer of push answer reads from this queue, connection is switched to WebSocket if handshake is accepted
+    std::shared_ptr<Proof::RestPushQueue> pushQueue;
+    Proof::RestWebSocketHandler webSocketHandler;
+    // Request without body, used for conditional requests and compression negotiation
+    Proof::RestRequestContext requestContext;
+    CacheTarget cacheTarget;
+    std::shared_ptr<RouteMetrics> metrics;
+    qint64 dispatchedAt = 0;
+    qint64 readyAt = 0;
+    // Stream of HTTP/2 connection, such answers are sent as soon as they are ready, not in order of requests
+    quint32 http2Stream = 0;
+    bool compressionAllowed = true;
+    bool ready = false;
+    bool keepAlive = false;
+    bool isHttp10 = false;
+};
+
+// Streamed or file answer at HTTP/2 stream, other streams of connection go on while it is sent
+struct Http2Transfer
+{
+    Proof::RestChunkProducer producer;
+    FileBody file;
+    std::shared_ptr<Proof::RestPushQueue> pushQueue;
+    std::shared_ptr<RouteMetrics> metrics;
+    qint64 readyAt = 0;
+    bool chunkRequested = false;
 };
 
 struct SocketInfo
@@ -106,11 +372,94 @@ struct SocketInfo
     SocketInfo() {}
 
     Proof::HttpParser parser;
+    QByteArray input;
+    // Responses are written strictly in order of requests even if handlers finish out of order
+    std::deque<PendingResponse> pendingResponses;
     QMetaObject::Connection readyReadConnection;
     QMetaObject::Connection disconnectConnection;
     QMetaObject::Connection errorConnection;
+    QMetaObject::Connection bytesWrittenConnection;
+    // Only one deadline is armed at a time, for the phase connection is in now
+    TimeoutPhase timeoutPhase = NoTimeout;
+    qint64 timeoutDeadline = 0;
+    int timeoutSlot = -1;
+    // File that is being sent now, all further answers wait for its end
+    FileBody file;
+    bool fileKeepAlive = false;
+    // Streamed answer that is being written now, all further answers wait for its end
+    Proof::RestChunkProducer stream;
+    bool streamChunked = false;
+    bool streamKeepAlive = false;
+    bool streamChunkRequested = false;
+    // Push channel that feeds the stream above, input is parsed as WebSocket frames when webSocket is set
+    std::shared_ptr<Proof::RestPushQueue> pushQueue;
+    Proof::RestWebSocketHandler webSocketHandler;
+    bool webSocket = false;
+    Proof::WebSocketCodec webSocketCodec;
+    // Admission of request which headers are parsed, but body is still being received
+    Admission admission;
+    bool admissionChecked = false;
+    bool compressionAllowed = true;
+    std::shared_ptr<RouteMetrics> routeMetrics;
+    RouteMatch routeMatch;
+    qint64 requestStartedAt = 0;
+    // Write of streamed or file answer is measured until its last byte
+    std::shared_ptr<RouteMetrics> transferMetrics;
+    qint64 transferReadyAt = 0;
+    // Connection is switched to HTTP/2 after client preface or h2c upgrade, input is parsed as frames then
+    std::shared_ptr<Proof::Http2Session> http2;
+    QHash<quint32, Http2Transfer> http2Transfers;
+    quint32 slot = 0;
+    quint32 generation = 0;
+    int requestsCount = 0;
+    // No more requests are accepted, connection will be closed after last pending response
+    bool finishing = false;
+    bool closing = false;
+};
+
+// Request currently dispatched to handler in this thread, used to bind socket-based answers to exact request
+thread_local Proof::RestRequestHandle dispatchedRequest;
+thread_local QSharedPointer<QIODevice> dispatchedBody;
+thread_local QVector<Proof::MultipartPart> dispatchedParts;
+
+class HandlerTask : public QRunnable
+{
+public:
+    explicit HandlerTask(std::function<void()> &&task) : m_task(std::move(task)) {}
+    void run() override { m_task(); }
+
+private:
+    std::function<void()> m_task;
+};
+
+struct ListenOptions
+{
+    quint16 port = 0;
+    int backlog = DEFAULT_LISTEN_BACKLOG;
+    int deferAcceptTimeout = 0;
+    int fastOpenQueueLength = 0;
+    bool reusePort = false;
 };
 
+QByteArray statusLine(int code, const QString &reason);
+QByteArray httpDate(const QDateTime &dateTime);
+QDateTime parseHttpDate(const QString &value);
+bool isETagMatched(const Proof::RestRequestContext &context, const QByteArray &eTag);
+ContentEncoding acceptedEncoding(const Proof::RestRequestContext &context);
+ContentEncoding contentEncoding(const Proof::RestRequestContext &context);
+QByteArray compressBody(const QByteArray &body, ContentEncoding encoding, int level);
+DecodeResult decompressBody(const QByteArray &body, qint64 maxSize, QByteArray &result);
+bool hasHeader(const QHash<QString, QString> &headers, const QString &name);
+QByteArray encodeOverloadedResponse(int retryAfter);
+qint64 steadyClockMsecs();
+qint64 steadyClockUsecs();
+void addLatency(const std::shared_ptr<RouteMetrics> &metrics, LatencyPhase phase, qint64 startedAt);
+QByteArray prometheusLabel(const QString &value);
+qintptr createListeningSocket(const ListenOptions &options);
+qintptr createUnixListeningSocket(const QString &path, int backlog);
+quint64 unixSocketFileId(const QString &path);
+void writeResponse(QTcpSocket *socket, const QByteArray &head, const QByteArray &body);
+
 class WorkerThread : public QThread
 {
     Q_OBJECT
@@ -122,16 +471,111 @@ public:
     WorkerThread &operator=(WorkerThread &&) = delete;
     ~WorkerThread();
 
-    void sendAnswer(QTcpSocket *socket, const QByteArray &body, const QString &contentType,
+    void sendAnswer(const Proof::RestRequestHandle &request, const QByteArray &body, const QString &contentType,
                     const QHash<QString, QString> &headers, int returnCode, const QString &reason);
+    void sendStreamedAnswer(const Proof::RestRequestHandle &request, const Proof::RestChunkProducer &producer,
+                            const QString &contentType, const QHash<QString, QString> &headers, int returnCode,
+                            const QString &reason);
+    void sendFile(const Proof::RestRequestHandle &request, const QString &filePath, const QString &contentType,
+                  const QHash<QString, QString> &headers);
+    void openEventStream(const Proof::RestRequestHandle &request, const std::shared_ptr<Proof::RestPushQueue> &queue,
+                         const QHash<QString, QString> &headers);
+    void acceptWebSocket(const Proof::RestRequestHandle &request, const std::shared_ptr<Proof::RestPushQueue> &queue,
+                         const Proof::RestWebSocketHandler &handler);
+    // Must be called from this thread only, used during dispatch
+    void sendCachedAnswer(const Proof::RestRequestHandle &request, const CachedResponse &cached);
+    void setCacheTarget(const Proof::RestRequestHandle &request, const CacheTarget &target);
     void handleNewConnection(qintptr socketDescriptor);
     void deleteSocket(QTcpSocket *socket);
     void onReadyRead(QTcpSocket *socket);
+    void onBytesWritten(QTcpSocket *socket);
+    void checkTimeouts();
+    void startDraining();
+    void startAccepting(qintptr listenerDescriptor);
+    void stopAccepting();
     void stop();
 
+    // Can be called from any thread
+    bool isAlive(quint32 slot, quint32 generation) const;
+    long long socketsCount() const;
+    bool reserveSocket();
+    bool isAccepting() const;
+    // Worker that was idle for msecs is marked so that it can be stopped without getting new connections meanwhile
+    bool startRetiring(int idleMsecs);
+    void finishRetiring();
+
 private:
+    ConnectionSlot *connectionSlot(quint32 slot) const;
+    bool acquireSlot(QTcpSocket *socket, SocketInfo &info);
+    void releaseSlot(quint32 slot);
+    void acceptConnections();
+    void processInput(QTcpSocket *socket);
+    void dispatchRequest(QTcpSocket *socket, const Proof::RestRequestHandle &request,
+                         const Proof::RestRequestContext &context, const QByteArray &body,
+                         const QSharedPointer<QIODevice> &bodyDevice, const QVector<Proof::MultipartPart> &parts,
+                         const RouteMatch &match);
+    bool admitRequest(QTcpSocket *socket, SocketInfo &info);
+    bool startMultipartBody(QTcpSocket *socket, SocketInfo &info);
+    BodyStatus checkStreamedBody(const Proof::RestRequestContext &context) const;
+    BodyStatus checkMultipartBody(const Proof::RestRequestContext &context, QByteArray &boundary) const;
+    BodyStatus decodeBody(const Proof::RestRequestContext &context, QByteArray &body) const;
+    void updateTimeout(QTcpSocket *socket, SocketInfo &info);
+    void disarmTimeout(QTcpSocket *socket, SocketInfo &info);
+    void failRequest(QTcpSocket *socket, SocketInfo &info, int returnCode, const QString &reason);
+    void releaseAdmissions(SocketInfo &info);
+    void answer(const Proof::RestRequestHandle &request, const QByteArray &body,
+                const Proof::RestChunkProducer &producer, const FileBody &file, const QString &contentType,
+                const QHash<QString, QString> &headers, int returnCode, const QString &reason);
+    PendingResponse *pendingResponse(const Proof::RestRequestHandle &request);
+    std::deque<PendingResponse>::iterator findPendingResponse(QTcpSocket *socket, SocketInfo &info,
+                                                              quint64 sequence) const;
+    void pumpFile(QTcpSocket *socket, SocketInfo &info);
+    void finishFile(QTcpSocket *socket, SocketInfo &info);
+    void flushResponses(QTcpSocket *socket, SocketInfo &info);
+    void closeAfterResponse(QTcpSocket *socket, SocketInfo &info);
+    void pumpStream(QTcpSocket *socket, SocketInfo &info);
+    void requestStreamChunk(const Proof::RestChunkProducer &producer,
+                            const std::function<void(const QByteArray &chunk, bool isSuccessful)> &callback);
+    void onStreamChunk(quint32 slot, quint32 generation, const QByteArray &chunk, bool isSuccessful);
+    void startPush(QTcpSocket *socket, SocketInfo &info, const PendingResponse &response);
+    void finishPush(SocketInfo &info);
+    void processWebSocketInput(QTcpSocket *socket);
+    void closeWebSocket(QTcpSocket *socket, SocketInfo &info, Proof::WebSocketCodec::CloseCode code);
+    std::shared_ptr<Proof::Http2Session> createHttp2Session() const;
+    void startHttp2(SocketInfo &info, const std::shared_ptr<Proof::Http2Session> &session);
+    bool upgradeToHttp2(QTcpSocket *socket, SocketInfo &info, const Proof::RestRequestContext &context);
+    void processHttp2Input(QTcpSocket *socket);
+    void dispatchHttp2Request(QTcpSocket *socket, SocketInfo &info, const Proof::Http2Request &request);
+    void answerHttp2(QTcpSocket *socket, SocketInfo &info, std::deque<PendingResponse>::iterator pendingIt,
+                     const Proof::HttpHeaderFields &fields, const QByteArray &body,
+                     const Proof::RestChunkProducer &producer, const FileBody &file);
+    void pumpHttp2Streams(QTcpSocket *socket, SocketInfo &info);
+    void onHttp2StreamChunk(quint32 slot, quint32 generation, quint32 streamId, const QByteArray &chunk,
+                            bool isSuccessful);
+    void finishHttp2Transfer(SocketInfo &info, quint32 streamId);
+    void cancelHttp2Stream(SocketInfo &info, quint32 streamId);
+    void flushHttp2(QTcpSocket *socket, SocketInfo &info);
+
     Proof::AbstractRestServerPrivate *const serverD;
     QHash<QTcpSocket *, SocketInfo> sockets;
+    // Chunks are only added while worker is alive, so readers from other threads never see them moved
+    std::atomic<ConnectionSlot *> connectionSlots[MAX_CONNECTION_SLOTS_CHUNKS];
+    quint32 connectionSlotsCount = 0;
+    QVector<quint32> freeConnectionSlots;
+    std::atomic_llong socketCount{0};
+    std::atomic<qint64> idleSince{0};
+    QSocketNotifier *acceptNotifier = nullptr;
+    qintptr listenerDescriptor = -1;
+    std::atomic_bool accepting{false};
+    QTimer *timeoutsTimer = nullptr;
+    // Sockets are bucketed by deadline tick, so each tick checks only sockets that can expire at it
+    std::vector<QSet<QTcpSocket *>> timeoutWheel;
+    qint64 lastTimeoutTick = 0;
+    quint64 lastRequestSequence = 0;
+    QByteArray commonHeaders;
+    // Same headers as HTTP/2 fields, with lowercased names
+    Proof::HttpHeaderFields http2CommonHeaders;
+    uint commonHeadersVersion = 0;
 };
 } // anonymous namespace
 
@@ -150,19 +594,65 @@ public:
     AbstractRestServerPrivate &operator=(AbstractRestServerPrivate &&other) = delete;
     ~AbstractRestServerPrivate() = default;
 
-    void tryToCallMethod(QTcpSocket *socket, const QString &type, const QString &method, const QStringList &headers,
-                         const QByteArray &body);
-    QStringList makeMethodName(const QString &type, const QString &name);
-    MethodNode *findMethod(const QStringList &splittedMethod, QStringList &methodVariableParts);
+    void tryToCallMethod(QTcpSocket *socket, RestRequestContext context, const QByteArray &body,
+                         const RouteMatch &match);
     void fillMethods();
-    void addMethodToTree(const QString &realMethod, const QString &tag);
+    void rebuildAuthenticators();
+    bool authenticate(RestRequestContext &context);
+    QList<QByteArray> routeSegments(const QString &type, const QString &path) const;
+    void invokeRoute(const RestRoute &route, QTcpSocket *socket, const RestRequestContext &context);
+    void invokeRouteInHandlerPool(const std::shared_ptr<const RestRouteTable> &table, const RestRoute *route,
+                                  QTcpSocket *socket, const RestRequestContext &context);
+    void applyRouteSettings(const QList<QByteArray> &segments, RestRoute &route);
+    QByteArray cacheKey(const RestRoute &route, const RestRequestContext &context) const;
+    QByteArray prometheusMetrics();
+    QJsonObject buildStatusTemplate() const;
+    void refreshStatusTemplate();
+    std::shared_ptr<const QJsonObject> currentStatusTemplate();
+    QByteArray statusBody(const QJsonArray &health);
+    QString crashesPath() const;
+    CachedResponse cachedResponse(const QByteArray &key) const;
+    CachedResponse storeCachedResponse(const CacheTarget &target, const QByteArray &body, const QString &contentType,
+                                       const QHash<QString, QString> &headers);
 
-    void sendAnswer(QTcpSocket *socket, const QByteArray &body, const QString &contentType,
+    void sendAnswer(const RestRequestHandle &request, const QByteArray &body, const QString &contentType,
                     const QHash<QString, QString> &headers, int returnCode = 200, const QString &reason = QString());
-    void registerSocket(QTcpSocket *socket);
-    void deleteSocket(QTcpSocket *socket, WorkerThread *worker);
+    void sendStreamedAnswer(const RestRequestHandle &request, const RestChunkProducer &producer,
+                            const QString &contentType, const QHash<QString, QString> &headers, int returnCode,
+                            const QString &reason);
+    RestPushChannel openPushChannel(const RestRequestHandle &request, const QHash<QString, QString> &headers,
+                                    const RestWebSocketHandler &webSocketHandler, bool isWebSocket);
+    void sendFile(const RestRequestHandle &request, const QString &filePath, const QString &contentType,
+                  const QHash<QString, QString> &headers);
+    void registerSocket(const RestRequestHandle &connection);
+    void deleteSocket(QTcpSocket *socket);
+    QByteArray encodedCommonHeaders();
+    bool admitConnection();
+    void releaseConnection();
+    bool admitRequest(const QString &type, const QString &uri, qint64 contentLength, Admission &admission,
+                      RouteOptions &routeOptions);
+    void releaseAdmission(Admission &admission);
+    ListenOptions listenOptions(bool reusePort) const;
+    bool startServerListen();
+    bool startWorkersListen();
+    void stopWorkersListen();
+    bool startUnixSocketListen();
+    void stopUnixSocketListen();
+    void acceptUnixConnections();
+    qintptr takeListener(bool reusePort);
+    void closeInheritedListeners();
+    void checkDrain();
+    WorkerThread *runningWorker(WorkerThread *worker);
+    void stopIdleWorkers();
 
-    const QString restMethodPrefix = QStringLiteral("rest_");
+    const QByteArray restMethodPrefix = QByteArrayLiteral("rest_");
+    const QList<QByteArray> restMethodParameterTypes = {QByteArrayLiteral("QTcpSocket*"),
+                                                        QByteArrayLiteral("QStringList"),
+                                                        QByteArrayLiteral("QStringList"),
+                                                        QByteArrayLiteral("QUrlQuery"),
+                                                        QByteArrayLiteral("QByteArray")};
+    const QList<QByteArray> restContextMethodParameterTypes = {QByteArrayLiteral("QTcpSocket*"),
+                                                               QByteArrayLiteral("Proof::RestRequestContext")};
     const QString noAuthTag = QStringLiteral("NO_AUTH_REQUIRED");
 
     AbstractRestServer *q_ptr = nullptr;
@@ -172,14 +662,130 @@ public:
     QString pathPrefix;
     QStringList splittedPathPrefix;
     QThread *serverThread = nullptr;
-    QVector<WorkerThreadInfo> threadPool;
+    QVector<WorkerThread *> threadPool;
     QReadWriteLock threadPoolLock;
-    QSet<QTcpSocket *> sockets;
-    QMutex socketsMutex;
-    MethodNode methodsTreeRoot;
+    // Used only by QTcpSocket-based API outside of handler dispatch. Requests never touch it: handlers get their handle
+    // from dispatch state and answers are routed by slot. Lock is written only when connection is opened or closed,
+    // it stays because socket pointer is all that legacy asynchronous answers have and it can come from any thread
+    QHash<QTcpSocket *, RestRequestHandle> sockets;
+    QReadWriteLock socketsLock;
+    std::shared_ptr<const RestRouteTable> routeTable;
+    QVector<CustomRoute> customRoutes;
+    QHash<QByteArray, RestExecutionPolicy> executionPolicies;
+    QHash<QByteArray, int> routesMaxInFlightRequests;
+    QHash<QByteArray, qint64> routesMaxPendingBytes;
+    QSet<QByteArray> routesWithStreamedBody;
+    QSet<QByteArray> routesWithMultipartBody;
+    QSet<QByteArray> routesWithoutCompression;
+    QHash<QByteArray, int> routesCacheTtl;
+    QSet<QByteArray> routesCachedPerUser;
+    QHash<QByteArray, CachedResponse> responseCache;
+    // Keys of responseCache with insertion stamps in order of insertion, oldest entry is evicted when cache is full.
+    // Entries that were replaced or invalidated since then have other stamp or are absent, they are just skipped
+    std::deque<QPair<QByteArray, quint64>> responseCacheOrder;
+    quint64 lastCacheInsertionStamp = 0;
+    mutable QReadWriteLock responseCacheLock;
+    std::atomic_ullong cacheGeneration{0};
+    std::atomic_ullong cacheHits{0};
+    std::atomic_ullong cacheMisses{0};
+    QHash<QByteArray, std::shared_ptr<RouteMetrics>> routesMetrics;
+    // Requests that didn't reach any route (unknown endpoints and malformed requests)
+    std::shared_ptr<RouteMetrics> unmatchedMetrics = std::make_shared<RouteMetrics>();
+    // System status parts that are expensive to collect, both are accessed via atomic_load/atomic_store
+    std::shared_ptr<const QJsonObject> statusTemplate;
+    std::shared_ptr<const CachedHealth> cachedHealth[2];
+    std::atomic_int statusRefreshInterval{DEFAULT_STATUS_REFRESH_INTERVAL};
+    std::atomic_int healthStatusTtl{DEFAULT_HEALTH_STATUS_TTL};
+    QTimer *statusRefreshTimer = nullptr;
+    QTimer *drainTimer = nullptr;
+    std::atomic_bool draining{false};
+    qint64 drainDeadline = 0;
+    // Listeners of SO_REUSEPORT workers, used for handover only
+    QVector<qintptr> workersListeners;
+    // Received from previous process, used by next startListen() instead of new sockets
+    QVector<qintptr> inheritedListeners;
+    QString unixSocketPath;
+    QFileDevice::Permissions unixSocketPermissions;
+    bool tcpListeningEnabled = true;
+    qintptr unixListener = -1;
+    // Socket file is removed only if it is still ours and not replaced by successor after handover
+    quint64 unixSocketFile = 0;
+    QSocketNotifier *unixListenerNotifier = nullptr;
+    QFileSystemWatcher *crashesWatcher = nullptr;
+    std::atomic_ullong bytesReceived{0};
+    std::atomic_ullong bytesSent{0};
+    std::atomic_int maxCachedResponses{DEFAULT_MAX_CACHED_RESPONSES};
+    QHash<QByteArray, std::shared_ptr<std::atomic_int>> routesInFlightRequests;
+    QHash<QByteArray, std::shared_ptr<std::atomic<qint64>>> routesPendingBytes;
+    QMutex routesMutex;
     int suggestedMaxThreadsCount = MIN_THREADS_COUNT;
+    int reusePortWorkersCount = 0;
+    int minThreadsCount = DEFAULT_MIN_THREADS_COUNT;
+    int threadIdleTimeout = DEFAULT_THREAD_IDLE_TIMEOUT;
+    int listenBacklog = DEFAULT_LISTEN_BACKLOG;
+    int deferAcceptTimeout = 0;
+    int fastOpenQueueLength = 0;
+    std::atomic_bool tcpNoDelay{false};
+    QTimer *idleThreadsTimer = nullptr;
+    QThreadPool handlerPool;
+    std::atomic_int maxQueuedHandlers{DEFAULT_MAX_QUEUED_HANDLERS};
+    std::atomic_llong queuedHandlers{0};
+    std::atomic_llong runningHandlers{0};
+    std::atomic_ullong completedHandlers{0};
+    std::atomic_ullong rejectedHandlers{0};
+    std::atomic<qint64> maxHandlerWaitTime{0};
+    std::atomic_int maxConnections{0};
+    std::atomic_int maxInFlightRequests{0};
+    std::atomic<qint64> maxPendingBytes{0};
+    std::atomic_int retryAfter{DEFAULT_RETRY_AFTER};
+    std::shared_ptr<const QByteArray> overloadedResponse = std::make_shared<const QByteArray>(
+        encodeOverloadedResponse(DEFAULT_RETRY_AFTER));
+    std::atomic_int connectionsCount{0};
+    std::atomic_int inFlightRequests{0};
+    std::atomic<qint64> pendingBytes{0};
+    std::atomic_ullong rejectedConnections{0};
+    std::atomic_ullong rejectedRequests{0};
+    std::atomic_int maxHeadersSize{DEFAULT_MAX_HEADERS_SIZE};
+    std::atomic<qint64> maxBodySize{DEFAULT_MAX_BODY_SIZE};
+    std::atomic<qint64> bodySpoolThreshold{DEFAULT_BODY_SPOOL_THRESHOLD};
+    std::atomic<qint64> streamHighWaterMark{DEFAULT_STREAM_HIGH_WATER_MARK};
+    std::atomic<qint64> pushQueueLimit{DEFAULT_PUSH_QUEUE_LIMIT};
+    std::atomic_int eventStreams{0};
+    std::atomic_int webSockets{0};
+    std::atomic_ullong rejectedPushMessages{0};
+    std::atomic_bool http2Enabled{false};
+    std::atomic_int http2MaxConcurrentStreams{DEFAULT_HTTP2_MAX_CONCURRENT_STREAMS};
+    std::atomic_int http2WindowSize{DEFAULT_HTTP2_WINDOW_SIZE};
+    std::atomic_int http2Connections{0};
+    std::atomic_ullong http2Streams{0};
+    std::atomic_ullong http2RefusedStreams{0};
+    std::atomic_int compressionLevel{DEFAULT_COMPRESSION_LEVEL};
+    std::atomic_int compressionMinSize{DEFAULT_COMPRESSION_MIN_SIZE};
     RestAuthType authType = RestAuthType::NoAuth;
+    std::shared_ptr<const AuthenticatorsSet> authenticators;
+    QVector<RestAuthenticatorSP> customAuthenticators;
+    quint64 authenticatorsGeneration = 0;
+    QMutex authenticatorsMutex;
+    QHash<QByteArray, AuthCacheEntry> authCache;
+    // Keys of authCache in order of insertion, oldest one is evicted when cache is full
+    std::deque<QByteArray> authCacheOrder;
+    mutable QReadWriteLock authCacheLock;
+    std::atomic_int authCacheTtl{DEFAULT_AUTH_CACHE_TTL};
+    std::atomic_int maxAuthCacheSize{DEFAULT_MAX_AUTH_CACHE_SIZE};
+    std::atomic_ullong authCacheHits{0};
+    std::atomic_ullong authCacheMisses{0};
+    std::atomic_ullong authFailures{0};
     QHash<QString, QString> customHeaders;
+    // Proof-* and custom headers encoded once, workers refetch it only if version is changed
+    QByteArray commonHeaders;
+    mutable QReadWriteLock customHeadersLock;
+    std::atomic_uint commonHeadersVersion{1};
+    std::atomic_int keepAliveTimeout{DEFAULT_KEEP_ALIVE_TIMEOUT};
+    std::atomic_int headersTimeout{DEFAULT_HEADERS_TIMEOUT};
+    std::atomic_int bodyTimeout{DEFAULT_BODY_TIMEOUT};
+    std::atomic_int writeTimeout{DEFAULT_WRITE_TIMEOUT};
+    std::array<std::atomic_ullong, TimeoutPhasesCount> timedOutConnections{};
+    std::atomic_int maxRequestsPerConnection{DEFAULT_MAX_REQUESTS_PER_CONNECTION};
 };
 
 } // namespace Proof
@@ -208,6 +814,16 @@ AbstractRestServer::AbstractRestServer(AbstractRestServerPrivate &dd, const QStr
     setPathPrefix(pathPrefix);
 
     setSuggestedMaxThreadsCount();
+    d->rebuildAuthenticators();
+
+    d->idleThreadsTimer = new QTimer(this);
+    d->idleThreadsTimer->setInterval(IDLE_THREADS_CHECK_INTERVAL);
+    connect(d->idleThreadsTimer, &QTimer::timeout, this, [d] { d->stopIdleWorkers(); });
+    d->statusRefreshTimer = new QTimer(this);
+    connect(d->statusRefreshTimer, &QTimer::timeout, this, [d] { d->refreshStatusTemplate(); });
+    d->drainTimer = new QTimer(this);
+    d->drainTimer->setInterval(DRAIN_CHECK_INTERVAL);
+    connect(d->drainTimer, &QTimer::timeout, this, [d] { d->checkDrain(); });
 
     moveToThread(d->serverThread);
     d->serverThread->moveToThread(d->serverThread);
@@ -218,12 +834,20 @@ AbstractRestServer::~AbstractRestServer()
 {
     Q_D(AbstractRestServer);
     stopListen();
+    d->handlerPool.clear();
+    d->handlerPool.waitForDone();
+    d->closeInheritedListeners();
     d->threadPoolLock.lockForWrite();
-    for (const WorkerThreadInfo &workerInfo : qAsConst(d->threadPool)) {
-        workerInfo.thread->stop();
-        workerInfo.thread->quit();
-        workerInfo.thread->wait(1000);
-        delete workerInfo.thread;
+    // All workers are stopped first and only then waited, so shutdown doesn't take a second per worker
+    for (WorkerThread *worker : qAsConst(d->threadPool)) {
+        if (worker->isRunning()) {
+            worker->stop();
+            worker->quit();
+        }
+    }
+    for (WorkerThread *worker : qAsConst(d->threadPool)) {
+        worker->wait(1000);
+        delete worker;
     }
     d->threadPoolLock.unlock();
 
@@ -263,644 +887,4185 @@ RestAuthType AbstractRestServer::authType() const
     return d->authType;
 }
 
-void AbstractRestServer::setUserName(const QString &userName)
+int AbstractRestServer::keepAliveTimeout() const
 {
-    Q_D(AbstractRestServer);
-    if (d->userName != userName) {
-        d->userName = userName;
-        emit userNameChanged(d->userName);
-    }
+    Q_D_CONST(AbstractRestServer);
+    return d->keepAliveTimeout;
 }
 
-void AbstractRestServer::setPassword(const QString &password)
+int AbstractRestServer::headersTimeout() const
 {
-    Q_D(AbstractRestServer);
-    if (d->password != password) {
-        d->password = password;
-        emit passwordChanged(d->password);
-    }
+    Q_D_CONST(AbstractRestServer);
+    return d->headersTimeout;
 }
 
-void AbstractRestServer::setPathPrefix(const QString &pathPrefix)
+int AbstractRestServer::bodyTimeout() const
 {
-    Q_D(AbstractRestServer);
-    QString loweredPathPrefix = pathPrefix.toLower();
-    if (d->pathPrefix != loweredPathPrefix) {
-        d->pathPrefix = loweredPathPrefix;
-        d->splittedPathPrefix = d->pathPrefix.split('/', QString::SkipEmptyParts);
-        emit pathPrefixChanged(d->pathPrefix);
-    }
+    Q_D_CONST(AbstractRestServer);
+    return d->bodyTimeout;
 }
 
-void AbstractRestServer::setPort(quint16 port)
+int AbstractRestServer::writeTimeout() const
 {
-    Q_D(AbstractRestServer);
-    if (d->port != port) {
-        d->port = port;
-        emit portChanged(d->port);
-    }
+    Q_D_CONST(AbstractRestServer);
+    return d->writeTimeout;
 }
 
-void AbstractRestServer::setSuggestedMaxThreadsCount(int count)
+int AbstractRestServer::maxRequestsPerConnection() const
 {
-    Q_D(AbstractRestServer);
-    if (count < 0) {
-        count = QThread::idealThreadCount();
-        if (count < MIN_THREADS_COUNT)
-            count = MIN_THREADS_COUNT;
-        else
-            count += 2;
-    }
-    d->suggestedMaxThreadsCount = count;
+    Q_D_CONST(AbstractRestServer);
+    return d->maxRequestsPerConnection;
 }
 
-void AbstractRestServer::setAuthType(RestAuthType authType)
+int AbstractRestServer::reusePortWorkersCount() const
 {
-    Q_ASSERT(authType == RestAuthType::NoAuth || authType == RestAuthType::Basic);
-    Q_D(AbstractRestServer);
-    if (d->authType != authType) {
-        d->authType = authType;
-        emit authTypeChanged(d->authType);
-    }
+    Q_D_CONST(AbstractRestServer);
+    return d->reusePortWorkersCount;
 }
 
-void AbstractRestServer::setCustomHeader(const QString &header, const QString &value)
+int AbstractRestServer::minThreadsCount() const
 {
-    Q_D(AbstractRestServer);
-    d->customHeaders[header] = value;
+    Q_D_CONST(AbstractRestServer);
+    return d->minThreadsCount;
 }
 
-QString AbstractRestServer::customHeader(const QString &header) const
+int AbstractRestServer::threadIdleTimeout() const
 {
     Q_D_CONST(AbstractRestServer);
-    return d->customHeaders.value(header);
+    return d->threadIdleTimeout;
 }
 
-bool AbstractRestServer::containsCustomHeader(const QString &header) const
+int AbstractRestServer::listenBacklog() const
 {
     Q_D_CONST(AbstractRestServer);
-    return d->customHeaders.contains(header);
+    return d->listenBacklog;
 }
 
-void AbstractRestServer::unsetCustomHeader(const QString &header)
+QString AbstractRestServer::unixSocketPath() const
 {
-    Q_D(AbstractRestServer);
-    d->customHeaders.remove(header);
+    Q_D_CONST(AbstractRestServer);
+    return d->unixSocketPath;
 }
 
-void AbstractRestServer::startListen()
+QFileDevice::Permissions AbstractRestServer::unixSocketPermissions() const
 {
-    Q_D(AbstractRestServer);
-    if (!ProofObject::safeCall(this, &AbstractRestServer::startListen)) {
-        d->fillMethods();
-        bool isListen = listen(QHostAddress::Any, d->port);
-        if (!isListen)
-            qCCritical(proofNetworkMiscLog) << "Server can't start on port" << d->port;
-    }
+    Q_D_CONST(AbstractRestServer);
+    return d->unixSocketPermissions;
 }
 
-void AbstractRestServer::stopListen()
+bool AbstractRestServer::isTcpListeningEnabled() const
 {
-    if (!ProofObject::safeCall(this, &AbstractRestServer::stopListen, Proof::Call::Block))
-        close();
+    Q_D_CONST(AbstractRestServer);
+    return d->tcpListeningEnabled;
 }
 
-void AbstractRestServer::rest_get_System_Status(QTcpSocket *socket, const QStringList &, const QStringList &,
-                                                const QUrlQuery &query, const QByteArray &)
+bool AbstractRestServer::isUnixSocketListening() const
 {
-    auto maybeHealthStatus = healthStatus(query.hasQueryItem(QStringLiteral("quick")));
-
-    QStringList ipsList;
-    const auto allIfaces = QNetworkInterface::allInterfaces();
-    for (const auto &interface : allIfaces) {
-        const auto addressEntries = interface.addressEntries();
-        for (const auto &address : addressEntries) {
-            if (!address.ip().isLoopback())
-                ipsList << QStringLiteral("%1 (%2)").arg(address.ip().toString(), interface.humanReadableName());
-        }
-    }
-
-    QString lastCrashAt(QStringLiteral("N/A"));
-#if (defined(Q_OS_LINUX) && !defined(Q_OS_ANDROID)) || defined(Q_OS_MAC)
-    QByteArray homePath = qgetenv("HOME");
-    QDir homeDir(homePath.isEmpty() ? "/tmp" : homePath);
-    QFileInfoList crashes = homeDir.entryInfoList({"proof_crash_*"}, QDir::Files);
-    if (!crashes.isEmpty()) {
-        QDateTime mostRecentCrash = crashes.first().lastModified();
-        for (const auto &crash : crashes) {
-            if (crash.lastModified() > mostRecentCrash)
-                mostRecentCrash = crash.lastModified();
-        }
-        lastCrashAt = mostRecentCrash.toUTC().toString(Qt::ISODate);
-    }
-#endif
-
-    QJsonObject statusTemplate{{QStringLiteral("app_type"), qApp->applicationName()},
-                               {QStringLiteral("app_version"), qApp->applicationVersion()},
-                               {QStringLiteral("proof_version"), Proof::proofVersion()},
-                               {QStringLiteral("started_at"), proofApp->startedAt().toString(Qt::ISODate)},
-                               {QStringLiteral("last_crash_at"), lastCrashAt},
-                               {QStringLiteral("os"), QSysInfo::prettyProductName()},
-                               {QStringLiteral("network_addresses"), QJsonArray::fromStringList(ipsList)}};
-    maybeHealthStatus
-        .onSuccess([this, socket, statusTemplate](const HealthStatusMap &healthStatus) {
-            auto statusObj = statusTemplate;
-            auto notificationsMemoryStorage = ErrorNotifier::instance()->handler<MemoryStorageNotificationHandler>();
-            QPair<QDateTime, QString> lastError;
-            if (notificationsMemoryStorage) {
-                statusObj[QStringLiteral("app_id")] = notificationsMemoryStorage->appId();
-                lastError = notificationsMemoryStorage->lastMessage();
-            } else {
-                lastError = qMakePair(QDateTime::currentDateTimeUtc(),
-                                      QStringLiteral("Memory storage error handler not set"));
-            }
-
-            statusObj[QStringLiteral("last_error")] = lastError.first.isValid()
-                                                          ? QJsonObject{{QStringLiteral("timestamp"),
-                                                                         lastError.first.toString(Qt::ISODate)},
-                                                                        {QStringLiteral("message"), lastError.second}}
-                                                          : QJsonValue();
-
-            auto healthMapper = [](const QString &name, const auto &data) {
-                return QJsonObject{{QStringLiteral("name"), name},
-                                   {QStringLiteral("value"), QJsonValue::fromVariant(data.second)},
-                                   {QStringLiteral("updated_at"), data.first.toString(Qt::ISODate)}};
-            };
-            statusObj[QStringLiteral("health")] = algorithms::map(healthStatus, healthMapper, QJsonArray());
-            statusObj[QStringLiteral("generated_at")] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
-            sendAnswer(socket, QJsonDocument(statusObj).toJson(), QStringLiteral("text/json"));
-        })
-        .onFailure([this, socket](const Failure &f) {
-            qCDebug(proofNetworkMiscLog) << "Health status fetch failed with " << f.message << f.data;
-            sendInternalError(socket);
-        });
+    Q_D_CONST(AbstractRestServer);
+    return d->unixListenerNotifier != nullptr;
 }
 
-void AbstractRestServer::rest_get_System_RecentErrors(QTcpSocket *socket, const QStringList &, const QStringList &,
-                                                      const QUrlQuery &, const QByteArray &)
+int AbstractRestServer::deferAcceptTimeout() const
 {
-    auto notificationsMemoryStorage = ErrorNotifier::instance()->handler<MemoryStorageNotificationHandler>();
-    auto lastErrors = notificationsMemoryStorage
-                          ? notificationsMemoryStorage->messages()
-                          : QMultiMap<QDateTime, QString>{{QDateTime::currentDateTimeUtc(),
-                                                           QStringLiteral("Memory storage error handler not set")}};
-
-    auto errorObjectBuilder = [](const QDateTime &time, const QString &error) -> QJsonObject {
-        return QJsonObject{{"timestamp", time.toString(Qt::ISODate)}, {"message", error}};
-    };
-
-    QJsonArray recentErrorsArray;
-    QList<QDateTime> uniqueErrorsKeys = lastErrors.uniqueKeys();
-    std::reverse(uniqueErrorsKeys.begin(), uniqueErrorsKeys.end());
-    for (const auto &time : uniqueErrorsKeys) {
-        const auto allMessages = lastErrors.values(time);
-        for (const auto &message : allMessages)
-            recentErrorsArray.append(errorObjectBuilder(time, message));
-    }
-    sendAnswer(socket, QJsonDocument(recentErrorsArray).toJson(), QStringLiteral("text/json"));
+    Q_D_CONST(AbstractRestServer);
+    return d->deferAcceptTimeout;
 }
 
-Future<HealthStatusMap> AbstractRestServer::healthStatus(bool) const
+int AbstractRestServer::fastOpenQueueLength() const
 {
-    return Future<HealthStatusMap>::successful();
+    Q_D_CONST(AbstractRestServer);
+    return d->fastOpenQueueLength;
 }
 
-void AbstractRestServer::incomingConnection(qintptr socketDescriptor)
+bool AbstractRestServer::tcpNoDelay() const
 {
-    Q_D(AbstractRestServer);
-
-    qCDebug(proofNetworkMiscLog) << "Incoming connection with socket descriptor" << socketDescriptor;
+    Q_D_CONST(AbstractRestServer);
+    return d->tcpNoDelay;
+}
 
-    WorkerThread *worker = nullptr;
+int AbstractRestServer::maxConnections() const
+{
+    Q_D_CONST(AbstractRestServer);
+    return d->maxConnections;
+}
 
-    d->threadPoolLock.lockForRead();
-    if (!d->threadPool.isEmpty()) {
-        auto iter = std::min_element(d->threadPool.begin(), d->threadPool.end(),
-                                     [](const WorkerThreadInfo &lhs, const WorkerThreadInfo &rhs) {
-                                         return lhs.socketCount < rhs.socketCount;
-                                     });
-        if (iter->socketCount == 0 || d->threadPool.count() >= d->suggestedMaxThreadsCount) {
-            worker = iter->thread;
-            ++iter->socketCount;
-        }
-    }
-    d->threadPoolLock.unlock();
+int AbstractRestServer::maxInFlightRequests() const
+{
+    Q_D_CONST(AbstractRestServer);
+    return d->maxInFlightRequests;
+}
 
-    if (worker == nullptr) {
-        worker = new WorkerThread(d);
-        worker->start();
-        d->threadPoolLock.lockForWrite();
-        d->threadPool << WorkerThreadInfo(worker, 1);
-        d->threadPoolLock.unlock();
-    }
+qint64 AbstractRestServer::maxPendingBytes() const
+{
+    Q_D_CONST(AbstractRestServer);
+    return d->maxPendingBytes;
+}
 
-    worker->handleNewConnection(socketDescriptor);
+int AbstractRestServer::retryAfter() const
+{
+    Q_D_CONST(AbstractRestServer);
+    return d->retryAfter;
 }
 
-void AbstractRestServer::sendAnswer(QTcpSocket *socket, const QByteArray &body, const QString &contentType,
-                                    int returnCode, const QString &reason)
+int AbstractRestServer::maxCachedResponses() const
 {
-    Q_D(AbstractRestServer);
-    d->sendAnswer(socket, body, contentType, QHash<QString, QString>(), returnCode, reason);
+    Q_D_CONST(AbstractRestServer);
+    return d->maxCachedResponses;
 }
 
-void AbstractRestServer::sendAnswer(QTcpSocket *socket, const QByteArray &body, const QString &contentType,
-                                    const QHash<QString, QString> &headers, int returnCode, const QString &reason)
+int AbstractRestServer::statusRefreshInterval() const
 {
-    Q_D(AbstractRestServer);
-    d->sendAnswer(socket, body, contentType, headers, returnCode, reason);
+    Q_D_CONST(AbstractRestServer);
+    return d->statusRefreshInterval;
 }
 
-void AbstractRestServer::sendErrorCode(QTcpSocket *socket, int returnCode, const QString &reason, int errorCode,
-                                       const QStringList &args)
+int AbstractRestServer::healthStatusTtl() const
 {
-    QJsonObject body;
-    body.insert(QStringLiteral("error_code"), errorCode);
-    if (!args.empty()) {
-        QJsonArray jsonArgs;
-        for (const auto &arg : args)
-            jsonArgs << arg;
-        body.insert(QStringLiteral("message_args"), jsonArgs);
-    }
-    sendAnswer(socket, QJsonDocument(body).toJson(QJsonDocument::Compact), QStringLiteral("application/json"),
-               returnCode, reason);
+    Q_D_CONST(AbstractRestServer);
+    return d->healthStatusTtl;
 }
 
-bool AbstractRestServer::checkBasicAuth(const QString &encryptedAuth) const
+RestAdmissionStats AbstractRestServer::admissionStats() const
 {
     Q_D_CONST(AbstractRestServer);
-    QByteArray auth = QStringLiteral("%1:%2").arg(d->userName, d->password).toLatin1().toBase64();
-    return encryptedAuth == auth;
+    RestAdmissionStats result;
+    result.connections = d->connectionsCount;
+    result.inFlightRequests = d->inFlightRequests;
+    result.pendingBytes = d->pendingBytes;
+    result.rejectedConnections = d->rejectedConnections;
+    result.rejectedRequests = d->rejectedRequests;
+    return result;
 }
 
-QString AbstractRestServer::parseAuth(QTcpSocket *socket, const QString &header)
+bool AbstractRestServer::isDraining() const
 {
-    QString auth;
+    Q_D_CONST(AbstractRestServer);
+    return d->draining;
+}
+
+int AbstractRestServer::authCacheTtl() const
+{
+    Q_D_CONST(AbstractRestServer);
+    return d->authCacheTtl;
+}
+
+int AbstractRestServer::maxAuthCacheSize() const
+{
+    Q_D_CONST(AbstractRestServer);
+    return d->maxAuthCacheSize;
+}
+
+RestAuthStats AbstractRestServer::authStats() const
+{
+    Q_D_CONST(AbstractRestServer);
+    RestAuthStats result;
+    result.cacheHits = d->authCacheHits;
+    result.cacheMisses = d->authCacheMisses;
+    result.failures = d->authFailures;
+    {
+        QReadLocker lock(&d->authCacheLock);
+        result.cachedCredentials = d->authCache.count();
+    }
+    return result;
+}
+
+RestTimeoutStats AbstractRestServer::timeoutStats() const
+{
+    Q_D_CONST(AbstractRestServer);
+    RestTimeoutStats result;
+    result.idle = d->timedOutConnections[IdleTimeout];
+    result.headers = d->timedOutConnections[HeadersTimeout];
+    result.body = d->timedOutConnections[BodyTimeout];
+    result.write = d->timedOutConnections[WriteTimeout];
+    return result;
+}
+
+int AbstractRestServer::maxHeadersSize() const
+{
+    Q_D_CONST(AbstractRestServer);
+    return d->maxHeadersSize;
+}
+
+qint64 AbstractRestServer::maxBodySize() const
+{
+    Q_D_CONST(AbstractRestServer);
+    return d->maxBodySize;
+}
+
+qint64 AbstractRestServer::bodySpoolThreshold() const
+{
+    Q_D_CONST(AbstractRestServer);
+    return d->bodySpoolThreshold;
+}
+
+qint64 AbstractRestServer::streamHighWaterMark() const
+{
+    Q_D_CONST(AbstractRestServer);
+    return d->streamHighWaterMark;
+}
+
+qint64 AbstractRestServer::pushQueueLimit() const
+{
+    Q_D_CONST(AbstractRestServer);
+    return d->pushQueueLimit;
+}
+
+RestPushStats AbstractRestServer::pushStats() const
+{
+    Q_D_CONST(AbstractRestServer);
+    RestPushStats result;
+    result.eventStreams = d->eventStreams;
+    result.webSockets = d->webSockets;
+    result.rejectedMessages = d->rejectedPushMessages;
+    return result;
+}
+
+bool AbstractRestServer::isHttp2Enabled() const
+{
+    Q_D_CONST(AbstractRestServer);
+    return d->http2Enabled;
+}
+
+int AbstractRestServer::http2MaxConcurrentStreams() const
+{
+    Q_D_CONST(AbstractRestServer);
+    return d->http2MaxConcurrentStreams;
+}
+
+int AbstractRestServer::http2WindowSize() const
+{
+    Q_D_CONST(AbstractRestServer);
+    return d->http2WindowSize;
+}
+
+RestHttp2Stats AbstractRestServer::http2Stats() const
+{
+    Q_D_CONST(AbstractRestServer);
+    RestHttp2Stats result;
+    result.connections = d->http2Connections;
+    result.streams = d->http2Streams;
+    result.refusedStreams = d->http2RefusedStreams;
+    return result;
+}
+
+int AbstractRestServer::compressionLevel() const
+{
+    Q_D_CONST(AbstractRestServer);
+    return d->compressionLevel;
+}
+
+int AbstractRestServer::compressionMinSize() const
+{
+    Q_D_CONST(AbstractRestServer);
+    return d->compressionMinSize;
+}
+
+int AbstractRestServer::handlerThreadsCount() const
+{
+    Q_D_CONST(AbstractRestServer);
+    return d->handlerPool.maxThreadCount();
+}
+
+int AbstractRestServer::maxQueuedHandlers() const
+{
+    Q_D_CONST(AbstractRestServer);
+    return d->maxQueuedHandlers;
+}
+
+RestHandlerPoolStats AbstractRestServer::handlerPoolStats() const
+{
+    Q_D_CONST(AbstractRestServer);
+    RestHandlerPoolStats result;
+    result.queued = d->queuedHandlers;
+    result.running = d->runningHandlers;
+    result.completed = d->completedHandlers;
+    result.rejected = d->rejectedHandlers;
+    result.maxWaitTime = d->maxHandlerWaitTime;
+    return result;
+}
+
+void AbstractRestServer::setUserName(const QString &userName)
+{
+    Q_D(AbstractRestServer);
+    if (d->userName != userName) {
+        d->userName = userName;
+        d->rebuildAuthenticators();
+        emit userNameChanged(d->userName);
+    }
+}
+
+void AbstractRestServer::setPassword(const QString &password)
+{
+    Q_D(AbstractRestServer);
+    if (d->password != password) {
+        d->password = password;
+        d->rebuildAuthenticators();
+        emit passwordChanged(d->password);
+    }
+}
+
+void AbstractRestServer::setPathPrefix(const QString &pathPrefix)
+{
+    Q_D(AbstractRestServer);
+    QString loweredPathPrefix = pathPrefix.toLower();
+    if (d->pathPrefix != loweredPathPrefix) {
+        d->pathPrefix = loweredPathPrefix;
+        d->splittedPathPrefix = d->pathPrefix.split('/', QString::SkipEmptyParts);
+        if (std::atomic_load(&d->routeTable))
+            d->fillMethods();
+        emit pathPrefixChanged(d->pathPrefix);
+    }
+}
+
+void AbstractRestServer::setPort(quint16 port)
+{
+    Q_D(AbstractRestServer);
+    if (d->port != port) {
+        d->port = port;
+        emit portChanged(d->port);
+    }
+}
+
+void AbstractRestServer::setSuggestedMaxThreadsCount(int count)
+{
+    Q_D(AbstractRestServer);
+    if (count < 0) {
+        count = QThread::idealThreadCount();
+        if (count < MIN_THREADS_COUNT)
+            count = MIN_THREADS_COUNT;
+        else
+            count += 2;
+    }
+    d->suggestedMaxThreadsCount = count;
+}
+
+void AbstractRestServer::setAuthType(RestAuthType authType)
+{
+    Q_ASSERT(authType == RestAuthType::NoAuth || authType == RestAuthType::Basic
+             || authType == RestAuthType::BearerToken);
+    Q_D(AbstractRestServer);
+    if (d->authType != authType) {
+        d->authType = authType;
+        d->rebuildAuthenticators();
+        emit authTypeChanged(d->authType);
+    }
+}
+
+void AbstractRestServer::addAuthenticator(const RestAuthenticatorSP &authenticator)
+{
+    Q_D(AbstractRestServer);
+    if (!authenticator)
+        return;
+    {
+        QMutexLocker lock(&d->authenticatorsMutex);
+        d->customAuthenticators << authenticator;
+    }
+    d->rebuildAuthenticators();
+}
+
+void AbstractRestServer::clearAuthenticators()
+{
+    Q_D(AbstractRestServer);
+    {
+        QMutexLocker lock(&d->authenticatorsMutex);
+        d->customAuthenticators.clear();
+    }
+    d->rebuildAuthenticators();
+}
+
+void AbstractRestServer::setAuthCacheTtl(int msecs)
+{
+    Q_D(AbstractRestServer);
+    d->authCacheTtl = qMax(0, msecs);
+}
+
+void AbstractRestServer::setMaxAuthCacheSize(int count)
+{
+    Q_D(AbstractRestServer);
+    d->maxAuthCacheSize = qMax(0, count);
+}
+
+void AbstractRestServer::invalidateAuthCache()
+{
+    Q_D(AbstractRestServer);
+    QWriteLocker lock(&d->authCacheLock);
+    d->authCache.clear();
+    d->authCacheOrder.clear();
+}
+
+void AbstractRestServer::setKeepAliveTimeout(int msecs)
+{
+    Q_D(AbstractRestServer);
+    d->keepAliveTimeout = qMax(0, msecs);
+}
+
+void AbstractRestServer::setHeadersTimeout(int msecs)
+{
+    Q_D(AbstractRestServer);
+    d->headersTimeout = qMax(0, msecs);
+}
+
+void AbstractRestServer::setBodyTimeout(int msecs)
+{
+    Q_D(AbstractRestServer);
+    d->bodyTimeout = qMax(0, msecs);
+}
+
+void AbstractRestServer::setWriteTimeout(int msecs)
+{
+    Q_D(AbstractRestServer);
+    d->writeTimeout = qMax(0, msecs);
+}
+
+void AbstractRestServer::setMaxRequestsPerConnection(int count)
+{
+    Q_D(AbstractRestServer);
+    d->maxRequestsPerConnection = qMax(0, count);
+}
+
+void AbstractRestServer::setReusePortWorkersCount(int count)
+{
+    Q_D(AbstractRestServer);
+    d->reusePortWorkersCount = qMax(0, count);
+}
+
+void AbstractRestServer::setMinThreadsCount(int count)
+{
+    Q_D(AbstractRestServer);
+    d->minThreadsCount = qMax(0, count);
+}
+
+void AbstractRestServer::setThreadIdleTimeout(int msecs)
+{
+    Q_D(AbstractRestServer);
+    d->threadIdleTimeout = qMax(0, msecs);
+}
+
+void AbstractRestServer::setListenBacklog(int backlog)
+{
+    Q_D(AbstractRestServer);
+    d->listenBacklog = backlog > 0 ? backlog : DEFAULT_LISTEN_BACKLOG;
+}
+
+void AbstractRestServer::setUnixSocketPath(const QString &path)
+{
+    Q_D(AbstractRestServer);
+    d->unixSocketPath = path;
+}
+
+void AbstractRestServer::setUnixSocketPermissions(QFileDevice::Permissions permissions)
+{
+    Q_D(AbstractRestServer);
+    d->unixSocketPermissions = permissions;
+}
+
+void AbstractRestServer::setTcpListeningEnabled(bool enabled)
+{
+    Q_D(AbstractRestServer);
+    d->tcpListeningEnabled = enabled;
+}
+
+void AbstractRestServer::setDeferAcceptTimeout(int secs)
+{
+    Q_D(AbstractRestServer);
+    d->deferAcceptTimeout = qMax(0, secs);
+}
+
+void AbstractRestServer::setFastOpenQueueLength(int length)
+{
+    Q_D(AbstractRestServer);
+    d->fastOpenQueueLength = qMax(0, length);
+}
+
+void AbstractRestServer::setTcpNoDelay(bool enabled)
+{
+    Q_D(AbstractRestServer);
+    d->tcpNoDelay = enabled;
+}
+
+void AbstractRestServer::setMaxConnections(int count)
+{
+    Q_D(AbstractRestServer);
+    d->maxConnections = qMax(0, count);
+}
+
+void AbstractRestServer::setMaxInFlightRequests(int count)
+{
+    Q_D(AbstractRestServer);
+    d->maxInFlightRequests = qMax(0, count);
+}
+
+void AbstractRestServer::setMaxPendingBytes(qint64 bytes)
+{
+    Q_D(AbstractRestServer);
+    d->maxPendingBytes = qMax(0ll, bytes);
+}
+
+void AbstractRestServer::setRetryAfter(int secs)
+{
+    Q_D(AbstractRestServer);
+    d->retryAfter = qMax(0, secs);
+    std::atomic_store(&d->overloadedResponse,
+                      std::make_shared<const QByteArray>(encodeOverloadedResponse(d->retryAfter)));
+}
+
+void AbstractRestServer::setMaxCachedResponses(int count)
+{
+    Q_D(AbstractRestServer);
+    d->maxCachedResponses = qMax(0, count);
+    if (count <= 0)
+        invalidateCache();
+}
+
+void AbstractRestServer::setStatusRefreshInterval(int msecs)
+{
+    Q_D(AbstractRestServer);
+    if (ProofObject::safeCall(this, &AbstractRestServer::setStatusRefreshInterval, msecs))
+        return;
+    d->statusRefreshInterval = qMax(0, msecs);
+    if (d->statusRefreshInterval > 0 && isListening()) {
+        d->refreshStatusTemplate();
+        d->statusRefreshTimer->start(d->statusRefreshInterval);
+    } else if (d->statusRefreshInterval <= 0) {
+        d->statusRefreshTimer->stop();
+        std::atomic_store(&d->statusTemplate, std::shared_ptr<const QJsonObject>());
+    }
+}
+
+void AbstractRestServer::setHealthStatusTtl(int msecs)
+{
+    Q_D(AbstractRestServer);
+    d->healthStatusTtl = qMax(0, msecs);
+    for (auto &cachedHealth : d->cachedHealth)
+        std::atomic_store(&cachedHealth, std::shared_ptr<const CachedHealth>());
+}
+
+void AbstractRestServer::invalidateCache()
+{
+    Q_D(AbstractRestServer);
+    QWriteLocker lock(&d->responseCacheLock);
+    ++d->cacheGeneration;
+    d->responseCache.clear();
+    d->responseCacheOrder.clear();
+}
+
+void AbstractRestServer::invalidateCache(const QString &method, const QString &path)
+{
+    Q_D(AbstractRestServer);
+    const QByteArray routeKey = d->routeSegments(method, path).join('/');
+    QWriteLocker lock(&d->responseCacheLock);
+    ++d->cacheGeneration;
+    for (auto it = d->responseCache.begin(); it != d->responseCache.end();)
+        it = it->routeKey == routeKey ? d->responseCache.erase(it) : ++it;
+}
+
+void AbstractRestServer::setMaxHeadersSize(int bytes)
+{
+    Q_D(AbstractRestServer);
+    d->maxHeadersSize = qMax(0, bytes);
+}
+
+void AbstractRestServer::setMaxBodySize(qint64 bytes)
+{
+    Q_D(AbstractRestServer);
+    d->maxBodySize = qMax(0ll, bytes);
+}
+
+void AbstractRestServer::setBodySpoolThreshold(qint64 bytes)
+{
+    Q_D(AbstractRestServer);
+    d->bodySpoolThreshold = qMax(0ll, bytes);
+}
+
+void AbstractRestServer::setStreamHighWaterMark(qint64 bytes)
+{
+    Q_D(AbstractRestServer);
+    d->streamHighWaterMark = bytes > 0 ? bytes : DEFAULT_STREAM_HIGH_WATER_MARK;
+}
+
+void AbstractRestServer::setPushQueueLimit(qint64 bytes)
+{
+    Q_D(AbstractRestServer);
+    d->pushQueueLimit = bytes > 0 ? bytes : DEFAULT_PUSH_QUEUE_LIMIT;
+}
+
+void AbstractRestServer::setHttp2Enabled(bool enabled)
+{
+    Q_D(AbstractRestServer);
+    d->http2Enabled = enabled;
+}
+
+void AbstractRestServer::setHttp2MaxConcurrentStreams(int count)
+{
+    Q_D(AbstractRestServer);
+    d->http2MaxConcurrentStreams = count > 0 ? count : DEFAULT_HTTP2_MAX_CONCURRENT_STREAMS;
+}
+
+void AbstractRestServer::setHttp2WindowSize(int bytes)
+{
+    Q_D(AbstractRestServer);
+    d->http2WindowSize = bytes > 0 ? qMax(bytes, MIN_HTTP2_WINDOW_SIZE) : DEFAULT_HTTP2_WINDOW_SIZE;
+}
+
+void AbstractRestServer::setCompressionLevel(int level)
+{
+    Q_D(AbstractRestServer);
+    d->compressionLevel = qBound(0, level, 9);
+}
+
+void AbstractRestServer::setCompressionMinSize(int bytes)
+{
+    Q_D(AbstractRestServer);
+    d->compressionMinSize = qMax(0, bytes);
+}
+
+void AbstractRestServer::setHandlerThreadsCount(int count)
+{
+    Q_D(AbstractRestServer);
+    d->handlerPool.setMaxThreadCount(count > 0 ? count : QThread::idealThreadCount());
+}
+
+void AbstractRestServer::setMaxQueuedHandlers(int count)
+{
+    Q_D(AbstractRestServer);
+    d->maxQueuedHandlers = qMax(0, count);
+}
+
+void AbstractRestServer::setCustomHeader(const QString &header, const QString &value)
+{
+    Q_D(AbstractRestServer);
+    QWriteLocker lock(&d->customHeadersLock);
+    d->customHeaders[header] = value;
+    d->commonHeaders.clear();
+    ++d->commonHeadersVersion;
+}
+
+QString AbstractRestServer::customHeader(const QString &header) const
+{
+    Q_D_CONST(AbstractRestServer);
+    QReadLocker lock(&d->customHeadersLock);
+    return d->customHeaders.value(header);
+}
+
+bool AbstractRestServer::containsCustomHeader(const QString &header) const
+{
+    Q_D_CONST(AbstractRestServer);
+    QReadLocker lock(&d->customHeadersLock);
+    return d->customHeaders.contains(header);
+}
+
+void AbstractRestServer::unsetCustomHeader(const QString &header)
+{
+    Q_D(AbstractRestServer);
+    QWriteLocker lock(&d->customHeadersLock);
+    if (d->customHeaders.remove(header)) {
+        d->commonHeaders.clear();
+        ++d->commonHeadersVersion;
+    }
+}
+
+void AbstractRestServer::addRoute(const QString &method, const QString &path, const RestHandler &handler,
+                                  bool authRequired)
+{
+    Q_D(AbstractRestServer);
+    RestRoute route;
+    route.handler = handler;
+    route.authRequired = authRequired;
+    route.name = QStringLiteral("%1 %2").arg(method.toUpper(), path);
+    {
+        QMutexLocker lock(&d->routesMutex);
+        d->customRoutes << CustomRoute{method, path, route};
+    }
+    if (std::atomic_load(&d->routeTable))
+        d->fillMethods();
+}
+
+void AbstractRestServer::addRoute(const QString &method, const QString &path, const RestContextHandler &handler,
+                                  bool authRequired)
+{
+    Q_D(AbstractRestServer);
+    RestRoute route;
+    route.contextHandler = handler;
+    route.authRequired = authRequired;
+    route.name = QStringLiteral("%1 %2").arg(method.toUpper(), path);
+    {
+        QMutexLocker lock(&d->routesMutex);
+        d->customRoutes << CustomRoute{method, path, route};
+    }
+    if (std::atomic_load(&d->routeTable))
+        d->fillMethods();
+}
+
+void AbstractRestServer::setRouteExecutionPolicy(const QString &method, const QString &path,
+                                                 RestExecutionPolicy policy)
+{
+    Q_D(AbstractRestServer);
+    {
+        QMutexLocker lock(&d->routesMutex);
+        d->executionPolicies[d->routeSegments(method, path).join('/')] = policy;
+    }
+    if (std::atomic_load(&d->routeTable))
+        d->fillMethods();
+}
+
+void AbstractRestServer::setRouteMaxInFlightRequests(const QString &method, const QString &path, int count)
+{
+    Q_D(AbstractRestServer);
+    {
+        QMutexLocker lock(&d->routesMutex);
+        d->routesMaxInFlightRequests[d->routeSegments(method, path).join('/')] = qMax(0, count);
+    }
+    if (std::atomic_load(&d->routeTable))
+        d->fillMethods();
+}
+
+void AbstractRestServer::setRouteMaxPendingBytes(const QString &method, const QString &path, qint64 bytes)
+{
+    Q_D(AbstractRestServer);
+    {
+        QMutexLocker lock(&d->routesMutex);
+        d->routesMaxPendingBytes[d->routeSegments(method, path).join('/')] = qMax(0ll, bytes);
+    }
+    if (std::atomic_load(&d->routeTable))
+        d->fillMethods();
+}
+
+void AbstractRestServer::setRouteBodyStreamed(const QString &method, const QString &path, bool streamed)
+{
+    Q_D(AbstractRestServer);
+    {
+        QMutexLocker lock(&d->routesMutex);
+        const QByteArray key = d->routeSegments(method, path).join('/');
+        if (streamed)
+            d->routesWithStreamedBody.insert(key);
+        else
+            d->routesWithStreamedBody.remove(key);
+    }
+    if (std::atomic_load(&d->routeTable))
+        d->fillMethods();
+}
+
+void AbstractRestServer::setRouteBodyMultipart(const QString &method, const QString &path, bool multipart)
+{
+    Q_D(AbstractRestServer);
+    {
+        QMutexLocker lock(&d->routesMutex);
+        const QByteArray key = d->routeSegments(method, path).join('/');
+        if (multipart)
+            d->routesWithMultipartBody.insert(key);
+        else
+            d->routesWithMultipartBody.remove(key);
+    }
+    if (std::atomic_load(&d->routeTable))
+        d->fillMethods();
+}
+
+void AbstractRestServer::setRouteCompressed(const QString &method, const QString &path, bool compressed)
+{
+    Q_D(AbstractRestServer);
+    {
+        QMutexLocker lock(&d->routesMutex);
+        const QByteArray key = d->routeSegments(method, path).join('/');
+        if (compressed)
+            d->routesWithoutCompression.remove(key);
+        else
+            d->routesWithoutCompression.insert(key);
+    }
+    if (std::atomic_load(&d->routeTable))
+        d->fillMethods();
+}
+
+void AbstractRestServer::setRouteCacheTtl(const QString &method, const QString &path, int msecs, bool perUser)
+{
+    Q_D(AbstractRestServer);
+    {
+        QMutexLocker lock(&d->routesMutex);
+        const QByteArray key = d->routeSegments(method, path).join('/');
+        d->routesCacheTtl[key] = qMax(0, msecs);
+        if (perUser)
+            d->routesCachedPerUser.insert(key);
+        else
+            d->routesCachedPerUser.remove(key);
+    }
+    invalidateCache(method, path);
+    if (std::atomic_load(&d->routeTable))
+        d->fillMethods();
+}
+
+void AbstractRestServer::startListen()
+{
+    Q_D(AbstractRestServer);
+    if (!ProofObject::safeCall(this, &AbstractRestServer::startListen)) {
+        d->drainTimer->stop();
+        d->draining = false;
+        d->fillMethods();
+        bool isListen = true;
+        if (d->tcpListeningEnabled) {
+            isListen = d->reusePortWorkersCount > 0 ? d->startWorkersListen() : d->startServerListen();
+            if (!isListen)
+                qCCritical(proofNetworkMiscLog) << "Server can't start on port" << d->port;
+        }
+        if (!d->unixSocketPath.isEmpty() && !d->startUnixSocketListen()) {
+            qCCritical(proofNetworkMiscLog) << "Server can't start on unix socket" << d->unixSocketPath;
+            isListen = false;
+        }
+        if (isListen && d->threadIdleTimeout > 0)
+            d->idleThreadsTimer->start();
+
+        if (d->statusRefreshInterval > 0) {
+            d->refreshStatusTemplate();
+            d->statusRefreshTimer->start(d->statusRefreshInterval);
+#if (defined(Q_OS_LINUX) && !defined(Q_OS_ANDROID)) || defined(Q_OS_MAC)
+            // New crash dumps should be visible in status right away, not after next refresh
+            if (!d->crashesWatcher) {
+                d->crashesWatcher = new QFileSystemWatcher(this);
+                d->crashesWatcher->addPath(d->crashesPath());
+                connect(d->crashesWatcher, &QFileSystemWatcher::directoryChanged, this,
+                        [d] { d->refreshStatusTemplate(); });
+            }
+#endif
+        }
+    }
+}
+
+void AbstractRestServer::stopListen()
+{
+    Q_D(AbstractRestServer);
+    if (!ProofObject::safeCall(this, &AbstractRestServer::stopListen, Proof::Call::Block)) {
+        d->idleThreadsTimer->stop();
+        d->statusRefreshTimer->stop();
+        close();
+        d->stopWorkersListen();
+        d->stopUnixSocketListen();
+    }
+}
+
+void AbstractRestServer::drain(int timeoutMsecs)
+{
+    Q_D(AbstractRestServer);
+    if (ProofObject::safeCall(this, &AbstractRestServer::drain, timeoutMsecs))
+        return;
+    if (d->draining)
+        return;
+    qCDebug(proofNetworkMiscLog) << "RestServer: draining" << static_cast<int>(d->connectionsCount)
+                                 << "connections";
+    stopListen();
+    d->draining = true;
+    d->drainDeadline = timeoutMsecs > 0 ? steadyClockMsecs() + timeoutMsecs : 0;
+    {
+        QReadLocker lock(&d->threadPoolLock);
+        for (WorkerThread *worker : qAsConst(d->threadPool)) {
+            if (worker->isRunning())
+                worker->startDraining();
+        }
+    }
+    d->drainTimer->start();
+}
+
+bool AbstractRestServer::handOverListeners(const QString &handoverPath)
+{
+    Q_D(AbstractRestServer);
+    bool result = false;
+    if (ProofObject::safeCall(this, &AbstractRestServer::handOverListeners, Proof::Call::Block, result,
+                              handoverPath)) {
+        return result;
+    }
+    const QVector<qintptr> descriptors = isListening() ? QVector<qintptr>{socketDescriptor()} : d->workersListeners;
+    if (descriptors.isEmpty()) {
+        qCWarning(proofNetworkMiscLog) << "RestServer: nothing to hand over, server is not listening";
+        return false;
+    }
+    result = ListenersHandover::send(handoverPath, descriptors);
+    if (result) {
+        qCDebug(proofNetworkMiscLog) << "RestServer:" << descriptors.count() << "listeners handed over via"
+                                     << handoverPath;
+    }
+    return result;
+}
+
+QVector<qintptr> AbstractRestServer::receiveListeners(const QString &handoverPath, int timeoutMsecs)
+{
+    return ListenersHandover::receive(handoverPath, timeoutMsecs);
+}
+
+void AbstractRestServer::setInheritedListeners(const QVector<qintptr> &descriptors)
+{
+    Q_D(AbstractRestServer);
+    if (ProofObject::safeCall(this, &AbstractRestServer::setInheritedListeners, Proof::Call::Block, descriptors))
+        return;
+    d->closeInheritedListeners();
+    d->inheritedListeners = descriptors;
+}
+
+void AbstractRestServer::rest_get_System_Status(QTcpSocket *socket, const QStringList &, const QStringList &,
+                                                const QUrlQuery &query, const QByteArray &)
+{
+    Q_D(AbstractRestServer);
+    const bool quick = query.hasQueryItem(QStringLiteral("quick"));
+    // Only healthStatus() result is reused, last error and generation time are always actual
+    const auto cachedHealth = std::atomic_load(&d->cachedHealth[quick ? 1 : 0]);
+    if (cachedHealth && cachedHealth->expiresAt > steadyClockMsecs()) {
+        sendAnswer(socket, d->statusBody(cachedHealth->health), QStringLiteral("text/json"));
+        return;
+    }
+
+    const RestRequestHandle request = requestHandle(socket);
+    healthStatus(quick)
+        .onSuccess([this, d, request, quick](const HealthStatusMap &healthStatus) {
+            auto healthMapper = [](const QString &name, const auto &data) {
+                return QJsonObject{{QStringLiteral("name"), name},
+                                   {QStringLiteral("value"), QJsonValue::fromVariant(data.second)},
+                                   {QStringLiteral("updated_at"), data.first.toString(Qt::ISODate)}};
+            };
+            const QJsonArray health = algorithms::map(healthStatus, healthMapper, QJsonArray());
+            const int ttl = d->healthStatusTtl;
+            if (ttl > 0) {
+                auto cached = std::make_shared<CachedHealth>();
+                cached->health = health;
+                cached->expiresAt = steadyClockMsecs() + ttl;
+                std::atomic_store(&d->cachedHealth[quick ? 1 : 0], std::shared_ptr<const CachedHealth>(cached));
+            }
+            sendAnswer(request, d->statusBody(health), QStringLiteral("text/json"));
+        })
+        .onFailure([this, request](const Failure &f) {
+            qCDebug(proofNetworkMiscLog) << "Health status fetch failed with " << f.message << f.data;
+            sendInternalError(request);
+        });
+}
+
+void AbstractRestServer::rest_get_System_RecentErrors(QTcpSocket *socket, const QStringList &, const QStringList &,
+                                                      const QUrlQuery &query, const QByteArray &)
+{
+    auto notificationsMemoryStorage = ErrorNotifier::instance()->handler<MemoryStorageNotificationHandler>();
+    if (!notificationsMemoryStorage) {
+        const QJsonObject error{{"timestamp", QDateTime::currentDateTimeUtc().toString(Qt::ISODate)},
+                                {"message", QStringLiteral("Memory storage error handler not set")}};
+        sendAnswer(socket, QJsonDocument(QJsonArray{error}).toJson(QJsonDocument::Compact),
+                   QStringLiteral("text/json"));
+        return;
+    }
+
+    bool isLimitValid = false;
+    int limit = query.queryItemValue(QStringLiteral("limit")).toInt(&isLimitValid);
+    // All stored errors are returned if limit is not set, as it was before pagination
+    limit = isLimitValid && limit > 0 ? qMin(limit, MAX_RECENT_ERRORS_LIMIT) : 0;
+    const quint64 cursor = query.queryItemValue(QStringLiteral("cursor")).toULongLong();
+    const QDateTime since = QDateTime::fromString(query.queryItemValue(QStringLiteral("since"), QUrl::FullyDecoded),
+                                                  Qt::ISODate);
+
+    // Messages are already serialized, so only requested slice is copied and joined
+    quint64 nextCursor = 0;
+    const QVector<QByteArray> messages = notificationsMemoryStorage->serializedMessages(cursor, since, limit,
+                                                                                        nextCursor);
+    int bodySize = 2 + messages.count();
+    for (const auto &message : messages)
+        bodySize += message.size();
+    QByteArray body;
+    body.reserve(bodySize);
+    body.append('[');
+    for (int i = 0; i < messages.count(); ++i) {
+        if (i)
+            body.append(',');
+        body.append(messages[i]);
+    }
+    body.append(']');
+
+    QHash<QString, QString> headers;
+    if (nextCursor)
+        headers[QStringLiteral("X-Next-Cursor")] = QString::number(nextCursor);
+    sendAnswer(socket, body, QStringLiteral("text/json"), headers);
+}
+
+void AbstractRestServer::rest_get_System_Metrics(QTcpSocket *socket, const QStringList &, const QStringList &,
+                                                 const QUrlQuery &, const QByteArray &)
+{
+    Q_D(AbstractRestServer);
+    sendAnswer(socket, d->prometheusMetrics(), QStringLiteral("text/plain; version=0.0.4"));
+}
+
+Future<HealthStatusMap> AbstractRestServer::healthStatus(bool) const
+{
+    return Future<HealthStatusMap>::successful();
+}
+
+void AbstractRestServer::incomingConnection(qintptr socketDescriptor)
+{
+    Q_D(AbstractRestServer);
+
+    qCDebug(proofNetworkMiscLog) << "Incoming connection with socket descriptor" << socketDescriptor;
+
+    WorkerThread *worker = nullptr;
+    WorkerThread *stoppedWorker = nullptr;
+    int runningWorkersCount = 0;
+
+    // Workers are started and stopped only in server thread, so their state can't change during this scan
+    d->threadPoolLock.lockForRead();
+    for (WorkerThread *candidate : qAsConst(d->threadPool)) {
+        if (!candidate->isRunning()) {
+            if (!stoppedWorker)
+                stoppedWorker = candidate;
+            continue;
+        }
+        ++runningWorkersCount;
+        if (!worker || candidate->socketsCount() < worker->socketsCount())
+            worker = candidate;
+    }
+    if (worker && worker->socketsCount() != 0 && runningWorkersCount < d->suggestedMaxThreadsCount)
+        worker = nullptr;
+    d->threadPoolLock.unlock();
+
+    // Worker could start retiring after it was picked, new connection goes to another one then
+    if (worker == nullptr || !worker->reserveSocket()) {
+        worker = d->runningWorker(stoppedWorker);
+        worker->reserveSocket();
+    }
+    worker->handleNewConnection(socketDescriptor);
+}
+
+QSharedPointer<QIODevice> AbstractRestServer::requestBody(QTcpSocket *socket) const
+{
+    return socket && dispatchedRequest.socket() == socket ? dispatchedBody : QSharedPointer<QIODevice>();
+}
+
+QVector<MultipartPart> AbstractRestServer::requestParts(QTcpSocket *socket) const
+{
+    return socket && dispatchedRequest.socket() == socket ? dispatchedParts : QVector<MultipartPart>();
+}
+
+RestRequestHandle AbstractRestServer::requestHandle(QTcpSocket *socket) const
+{
+    Q_D_CONST(AbstractRestServer);
+    if (socket && dispatchedRequest.socket() == socket)
+        return dispatchedRequest;
+    // Outside of handler dispatch handle doesn't point to particular request,
+    // worker accepts answer to it only if single request is waiting at this socket
+    QReadLocker lock(&d->socketsLock);
+    return d->sockets.value(socket).withSequence(0);
+}
+
+void AbstractRestServer::sendAnswer(QTcpSocket *socket, const QByteArray &body, const QString &contentType,
+                                    int returnCode, const QString &reason)
+{
+    sendAnswer(requestHandle(socket), body, contentType, returnCode, reason);
+}
+
+void AbstractRestServer::sendAnswer(QTcpSocket *socket, const QByteArray &body, const QString &contentType,
+                                    const QHash<QString, QString> &headers, int returnCode, const QString &reason)
+{
+    sendAnswer(requestHandle(socket), body, contentType, headers, returnCode, reason);
+}
+
+void AbstractRestServer::sendAnswer(const RestRequestHandle &request, const QByteArray &body,
+                                    const QString &contentType, int returnCode, const QString &reason)
+{
+    Q_D(AbstractRestServer);
+    d->sendAnswer(request, body, contentType, QHash<QString, QString>(), returnCode, reason);
+}
+
+void AbstractRestServer::sendAnswer(const RestRequestHandle &request, const QByteArray &body,
+                                    const QString &contentType, const QHash<QString, QString> &headers,
+                                    int returnCode, const QString &reason)
+{
+    Q_D(AbstractRestServer);
+    d->sendAnswer(request, body, contentType, headers, returnCode, reason);
+}
+
+void AbstractRestServer::sendStreamedAnswer(QTcpSocket *socket, const RestChunkProducer &producer,
+                                            const QString &contentType, int returnCode, const QString &reason)
+{
+    sendStreamedAnswer(requestHandle(socket), producer, contentType, QHash<QString, QString>(), returnCode, reason);
+}
+
+void AbstractRestServer::sendStreamedAnswer(const RestRequestHandle &request, const RestChunkProducer &producer,
+                                            const QString &contentType, const QHash<QString, QString> &headers,
+                                            int returnCode, const QString &reason)
+{
+    Q_D(AbstractRestServer);
+    d->sendStreamedAnswer(request, producer, contentType, headers, returnCode, reason);
+}
+
+RestPushChannel AbstractRestServer::openEventStream(QTcpSocket *socket, const QHash<QString, QString> &headers)
+{
+    return openEventStream(requestHandle(socket), headers);
+}
+
+RestPushChannel AbstractRestServer::openEventStream(const RestRequestHandle &request,
+                                                    const QHash<QString, QString> &headers)
+{
+    Q_D(AbstractRestServer);
+    return d->openPushChannel(request, headers, RestWebSocketHandler(), false);
+}
+
+RestPushChannel AbstractRestServer::acceptWebSocket(QTcpSocket *socket, const RestWebSocketHandler &handler)
+{
+    return acceptWebSocket(requestHandle(socket), handler);
+}
+
+RestPushChannel AbstractRestServer::acceptWebSocket(const RestRequestHandle &request,
+                                                    const RestWebSocketHandler &handler)
+{
+    Q_D(AbstractRestServer);
+    return d->openPushChannel(request, QHash<QString, QString>(), handler, true);
+}
+
+void AbstractRestServer::sendFile(QTcpSocket *socket, const QString &filePath, const QString &contentType)
+{
+    sendFile(requestHandle(socket), filePath, contentType);
+}
+
+void AbstractRestServer::sendFile(const RestRequestHandle &request, const QString &filePath,
+                                  const QString &contentType, const QHash<QString, QString> &headers)
+{
+    Q_D(AbstractRestServer);
+    d->sendFile(request, filePath, contentType, headers);
+}
+
+void AbstractRestServer::sendErrorCode(QTcpSocket *socket, int returnCode, const QString &reason, int errorCode,
+                                       const QStringList &args)
+{
+    sendErrorCode(requestHandle(socket), returnCode, reason, errorCode, args);
+}
+
+void AbstractRestServer::sendErrorCode(const RestRequestHandle &request, int returnCode, const QString &reason,
+                                       int errorCode, const QStringList &args)
+{
+    QJsonObject body;
+    body.insert(QStringLiteral("error_code"), errorCode);
+    if (!args.empty()) {
+        QJsonArray jsonArgs;
+        for (const auto &arg : args)
+            jsonArgs << arg;
+        body.insert(QStringLiteral("message_args"), jsonArgs);
+    }
+    sendAnswer(request, QJsonDocument(body).toJson(QJsonDocument::Compact), QStringLiteral("application/json"),
+               returnCode, reason);
+}
+
+bool AbstractRestServer::checkBasicAuth(const QString &encryptedAuth) const
+{
+    Q_D_CONST(AbstractRestServer);
+    const auto authenticators = std::atomic_load(&d->authenticators);
+    return authenticators && authenticators->basic->validate(encryptedAuth.toLatin1()).isValid;
+}
+
+QString AbstractRestServer::parseAuth(QTcpSocket *socket, const QString &header)
+{
+    QString auth;
     QStringList parts = header.split(QStringLiteral(":"));
     if (parts.count() != 2) {
         sendInternalError(socket);
     } else {
-        parts = parts.at(1).split(QStringLiteral(" "), QString::SkipEmptyParts);
-        if (parts.count() != 2 || parts.at(0) != QLatin1String("Basic"))
-            sendNotAuthorized(socket);
-        else
-            auth = parts.at(1);
+        parts = parts.at(1).split(QStringLiteral(" "), QString::SkipEmptyParts);
+        if (parts.count() != 2 || parts.at(0).compare(QLatin1String("Basic"), Qt::CaseInsensitive) != 0)
+            sendNotAuthorized(socket);
+        else
+            auth = parts.at(1);
+    }
+    return auth;
+}
+
+void AbstractRestServer::sendBadRequest(QTcpSocket *socket, const QString &reason)
+{
+    sendBadRequest(requestHandle(socket), reason);
+}
+
+void AbstractRestServer::sendBadRequest(const RestRequestHandle &request, const QString &reason)
+{
+    sendAnswer(request, "", QStringLiteral("text/plain; charset=utf-8"), 400, reason);
+}
+
+void AbstractRestServer::sendNotFound(QTcpSocket *socket, const QString &reason)
+{
+    sendNotFound(requestHandle(socket), reason);
+}
+
+void AbstractRestServer::sendNotFound(const RestRequestHandle &request, const QString &reason)
+{
+    sendAnswer(request, "", QStringLiteral("text/plain; charset=utf-8"), 404, reason);
+}
+
+void AbstractRestServer::sendNotAuthorized(QTcpSocket *socket, const QString &reason)
+{
+    sendNotAuthorized(requestHandle(socket), reason);
+}
+
+void AbstractRestServer::sendNotAuthorized(const RestRequestHandle &request, const QString &reason)
+{
+    sendAnswer(request, "", QStringLiteral("text/plain; charset=utf-8"), 401, reason);
+}
+
+void AbstractRestServer::sendConflict(QTcpSocket *socket, const QString &reason)
+{
+    sendConflict(requestHandle(socket), reason);
+}
+
+void AbstractRestServer::sendConflict(const RestRequestHandle &request, const QString &reason)
+{
+    sendAnswer(request, "", QStringLiteral("text/plain; charset=utf-8"), 409, reason);
+}
+
+void AbstractRestServer::sendInternalError(QTcpSocket *socket)
+{
+    sendInternalError(requestHandle(socket));
+}
+
+void AbstractRestServer::sendInternalError(const RestRequestHandle &request)
+{
+    sendAnswer(request, "", QStringLiteral("text/plain; charset=utf-8"), 500, QStringLiteral("Internal Server Error"));
+}
+
+void AbstractRestServer::sendNotImplemented(QTcpSocket *socket, const QString &reason)
+{
+    sendNotImplemented(requestHandle(socket), reason);
+}
+
+void AbstractRestServer::sendNotImplemented(const RestRequestHandle &request, const QString &reason)
+{
+    sendAnswer(request, "", QStringLiteral("text/plain; charset=utf-8"), 501, reason);
+}
+
+void AbstractRestServerPrivate::fillMethods()
+{
+    Q_Q(AbstractRestServer);
+    QMutexLocker lock(&routesMutex);
+    auto table = std::make_shared<RestRouteTable>();
+    const QMetaObject *metaObject = q->metaObject();
+    for (int i = 0; i < metaObject->methodCount(); ++i) {
+        QMetaMethod method = metaObject->method(i);
+        if (method.methodType() != QMetaMethod::Slot || !method.name().startsWith(restMethodPrefix))
+            continue;
+        QList<QByteArray> parameterTypes = method.parameterTypes();
+        // Slots declared inside Proof namespace have unqualified type name
+        if (parameterTypes.count() == 2 && parameterTypes[1] == "RestRequestContext")
+            parameterTypes[1] = "Proof::RestRequestContext";
+        const bool isContextMethod = parameterTypes == restContextMethodParameterTypes;
+        if (!isContextMethod && parameterTypes != restMethodParameterTypes) {
+            qCWarning(proofNetworkMiscLog) << "RestServer: method" << method.methodSignature()
+                                           << "has wrong signature and will be ignored";
+            continue;
+        }
+
+        QString path = QString::fromLatin1(method.name().mid(restMethodPrefix.length()));
+        for (int j = 0; j < path.length(); ++j) {
+            if (path[j].isUpper()) {
+                path[j] = path[j].toLower();
+                if (j > 0 && path[j - 1] != '_')
+                    path.insert(j++, '-');
+            }
+        }
+        const int typeDelimiterIndex = path.indexOf('_');
+        Q_ASSERT(typeDelimiterIndex > 0);
+
+        RestRoute route;
+        route.methodIndex = i;
+        route.isContextMethod = isContextMethod;
+        route.authRequired = noAuthTag != QLatin1String(method.tag());
+        // Built-in system endpoints are not limited, so health checks are answered even under overload
+        route.admissionExempt = i < AbstractRestServer::staticMetaObject.methodCount();
+        route.name = QString::fromLatin1(method.name());
+        const QString type = path.left(typeDelimiterIndex);
+        const QString endpoint = path.mid(typeDelimiterIndex + 1).replace('_', '/');
+        const auto segments = routeSegments(type, endpoint);
+        applyRouteSettings(segments, route);
+        table->addRoute(segments, route);
+    }
+
+    for (const auto &customRoute : qAsConst(customRoutes)) {
+        const auto segments = routeSegments(customRoute.method, customRoute.path);
+        RestRoute route = customRoute.route;
+        applyRouteSettings(segments, route);
+        table->addRoute(segments, route);
+    }
+    std::atomic_store(&routeTable, std::shared_ptr<const RestRouteTable>(std::move(table)));
+}
+
+void AbstractRestServerPrivate::rebuildAuthenticators()
+{
+    QMutexLocker lock(&authenticatorsMutex);
+    auto set = std::make_shared<AuthenticatorsSet>();
+    set->generation = ++authenticatorsGeneration;
+    set->basic = QSharedPointer<BasicRestAuthenticator>::create(userName, password);
+    if (authType == RestAuthType::Basic)
+        set->active << set->basic;
+    set->active << customAuthenticators;
+    std::atomic_store(&authenticators, std::shared_ptr<const AuthenticatorsSet>(std::move(set)));
+}
+
+bool AbstractRestServerPrivate::authenticate(RestRequestContext &context)
+{
+    const QByteArray header = context.header(QLatin1String("Authorization"));
+    const auto set = std::atomic_load(&authenticators);
+    if (header.isEmpty() || !set || set->active.isEmpty()) {
+        ++authFailures;
+        return false;
+    }
+
+    // Repeat callers are answered from cache, digest is used as key to not keep credentials in memory
+    const int ttl = authCacheTtl;
+    QByteArray key;
+    if (ttl > 0) {
+        key = QCryptographicHash::hash(header, QCryptographicHash::Sha256);
+        QReadLocker lock(&authCacheLock);
+        const auto it = authCache.constFind(key);
+        if (it != authCache.cend() && it->generation == set->generation && it->expiresAt > steadyClockMsecs()) {
+            ++authCacheHits;
+            context.m_authIdentity = it->identity;
+            return true;
+        }
+    }
+    ++authCacheMisses;
+
+    const int schemeEnd = header.indexOf(' ');
+    if (schemeEnd > 0) {
+        const QByteArray scheme = header.left(schemeEnd);
+        const QByteArray credentials = header.mid(schemeEnd + 1).trimmed();
+        for (const auto &authenticator : set->active) {
+            if (qstricmp(scheme.constData(), authenticator->scheme().constData()) != 0)
+                continue;
+            const RestAuthResult result = authenticator->validate(credentials);
+            if (!result.isValid)
+                continue;
+            context.m_authIdentity = result.identity;
+            const int maxCacheSize = maxAuthCacheSize;
+            if (ttl > 0 && maxCacheSize > 0) {
+                qint64 lifetime = ttl;
+                if (result.validUntil > 0)
+                    lifetime = qMin(lifetime, result.validUntil - QDateTime::currentMSecsSinceEpoch());
+                const qint64 now = steadyClockMsecs();
+                QWriteLocker lock(&authCacheLock);
+                if (!authCache.contains(key)) {
+                    // Only valid credentials get here, so a burst of new ones pushes out the oldest entries only
+                    while (authCache.count() >= maxCacheSize && !authCacheOrder.empty()) {
+                        authCache.remove(authCacheOrder.front());
+                        authCacheOrder.pop_front();
+                    }
+                    authCacheOrder.push_back(key);
+                }
+                authCache.insert(key, AuthCacheEntry{result.identity, now + lifetime, set->generation});
+            }
+            return true;
+        }
+    }
+    ++authFailures;
+    return false;
+}
+
+QList<QByteArray> AbstractRestServerPrivate::routeSegments(const QString &type, const QString &path) const
+{
+    QList<QByteArray> result{type.toLower().toLatin1()};
+    for (const auto &prefixPart : splittedPathPrefix)
+        result << prefixPart.toUtf8();
+    const auto pathParts = path.split('/', QString::SkipEmptyParts);
+    for (const auto &part : pathParts)
+        result << part.toLower().toUtf8();
+    return result;
+}
+
+void AbstractRestServerPrivate::applyRouteSettings(const QList<QByteArray> &segments, RestRoute &route)
+{
+    const QByteArray key = segments.join('/');
+    route.executionPolicy = executionPolicies.value(key, RestExecutionPolicy::Inline);
+    route.maxInFlightRequests = routesMaxInFlightRequests.value(key, 0);
+    route.maxPendingBytes = routesMaxPendingBytes.value(key, 0);
+    route.bodyStreamed = routesWithStreamedBody.contains(key);
+    route.bodyMultipart = routesWithMultipartBody.contains(key);
+    route.compressed = !routesWithoutCompression.contains(key);
+    route.cacheTtl = segments.first() == "get" ? routesCacheTtl.value(key, 0) : 0;
+    route.cachePerUser = routesCachedPerUser.contains(key);
+    route.key = key;
+    // Metrics survive routes rebuild as well as in-flight counters
+    auto &metrics = routesMetrics[key];
+    if (!metrics)
+        metrics = std::make_shared<RouteMetrics>();
+    route.metrics = metrics;
+    if (route.maxInFlightRequests > 0) {
+        // Counter survives routes rebuild, requests admitted before it are still released properly
+        auto &counter = routesInFlightRequests[key];
+        if (!counter)
+            counter = std::make_shared<std::atomic_int>(0);
+        route.inFlightRequests = counter;
+    }
+    if (route.maxPendingBytes > 0) {
+        auto &counter = routesPendingBytes[key];
+        if (!counter)
+            counter = std::make_shared<std::atomic<qint64>>(0);
+        route.pendingBytes = counter;
+    }
+}
+
+void AbstractRestServerPrivate::invokeRoute(const RestRoute &route, QTcpSocket *socket,
+                                            const RestRequestContext &context)
+{
+    Q_Q(AbstractRestServer);
+    if (route.contextHandler) {
+        route.contextHandler(socket, context);
+        return;
+    }
+    // Signature is already checked in fillMethods(), so slot can be called directly by its index
+    if (route.isContextMethod) {
+        void *args[] = {nullptr, &socket, const_cast<RestRequestContext *>(&context)};
+        QMetaObject::metacall(q, QMetaObject::InvokeMetaMethod, route.methodIndex, args);
+        return;
+    }
+
+    // Legacy handlers get everything decoded upfront
+    QStringList headers = context.headers();
+    QStringList methodVariableParts = context.pathParameters();
+    QUrlQuery query = context.query();
+    QByteArray body = context.body();
+    if (route.handler) {
+        route.handler(socket, headers, methodVariableParts, query, body);
+        return;
+    }
+    void *args[] = {nullptr, &socket, &headers, &methodVariableParts, &query, &body};
+    QMetaObject::metacall(q, QMetaObject::InvokeMetaMethod, route.methodIndex, args);
+}
+
+void AbstractRestServerPrivate::invokeRouteInHandlerPool(const std::shared_ptr<const RestRouteTable> &table,
+                                                         const RestRoute *route, QTcpSocket *socket,
+                                                         const RestRequestContext &context)
+{
+    Q_Q(AbstractRestServer);
+    const RestRequestHandle request = dispatchedRequest;
+    const QSharedPointer<QIODevice> bodyDevice = dispatchedBody;
+    const QVector<MultipartPart> parts = dispatchedParts;
+    const int queueLimit = maxQueuedHandlers;
+    if (queuedHandlers.fetch_add(1) >= queueLimit && queueLimit > 0) {
+        --queuedHandlers;
+        ++rejectedHandlers;
+        qCWarning(proofNetworkMiscLog) << "RestServer: handler pool queue is full," << route->name << "rejected";
+        q->sendAnswer(request, "", QStringLiteral("text/plain; charset=utf-8"), 503,
+                      QStringLiteral("Service Unavailable"));
+        return;
+    }
+
+    QElapsedTimer waitTimer;
+    waitTimer.start();
+    // Table is captured to keep route alive even if routes are rebuilt meanwhile
+    handlerPool.start(new HandlerTask([this, table, route, request, bodyDevice, parts, socket, context, waitTimer]() {
+        const qint64 waitTime = waitTimer.elapsed();
+        qint64 maxWaitTime = maxHandlerWaitTime;
+        while (waitTime > maxWaitTime && !maxHandlerWaitTime.compare_exchange_weak(maxWaitTime, waitTime)) {
+        }
+        --queuedHandlers;
+        ++runningHandlers;
+        const RestRequestHandle previousRequest = dispatchedRequest;
+        const QSharedPointer<QIODevice> previousBody = dispatchedBody;
+        const QVector<MultipartPart> previousParts = dispatchedParts;
+        dispatchedRequest = request;
+        dispatchedBody = bodyDevice;
+        dispatchedParts = parts;
+        invokeRoute(*route, socket, context);
+        dispatchedRequest = previousRequest;
+        dispatchedBody = previousBody;
+        dispatchedParts = previousParts;
+        --runningHandlers;
+        ++completedHandlers;
+    }));
+}
+
+void AbstractRestServerPrivate::tryToCallMethod(QTcpSocket *socket, RestRequestContext context,
+                                                const QByteArray &body, const RouteMatch &match)
+{
+    Q_Q(AbstractRestServer);
+    context.m_body = body;
+    // Route is already found during admission, its parameters are positions in the same uri
+    const std::shared_ptr<const RestRouteTable> &table = match.table;
+    const RestRoute *route = match.route;
+    context.m_pathParameters = match.parameters;
+    qCDebug(proofNetworkMiscLog) << "Request for" << context.m_uri << "associated with"
+                                 << (route ? route->name : QString()) << "at socket" << socket;
+
+    if (route) {
+        bool isAuthenticationSuccessful = true;
+        if (authType != RestAuthType::NoAuth && route->authRequired) {
+            const qint64 authStartedAt = steadyClockUsecs();
+            isAuthenticationSuccessful = authenticate(context);
+            addLatency(route->metrics, AuthPhase, authStartedAt);
+        }
+        if (isAuthenticationSuccessful) {
+            // Cached answer is sent without calling handler at all, otherwise answer is cached when it is sent
+            if (route->cacheTtl > 0 && dispatchedRequest.isValid()) {
+                auto worker = static_cast<WorkerThread *>(dispatchedRequest.worker());
+                const CacheTarget target{cacheKey(*route, context), route->key, route->cacheTtl, cacheGeneration};
+                const CachedResponse cached = cachedResponse(target.key);
+                if (!cached.eTag.isEmpty()) {
+                    ++cacheHits;
+                    qCDebug(proofNetworkMiscLog) << "Replying with cached answer at socket" << socket;
+                    worker->sendCachedAnswer(dispatchedRequest, cached);
+                    return;
+                }
+                ++cacheMisses;
+                worker->setCacheTarget(dispatchedRequest, target);
+            }
+            if (route->executionPolicy == RestExecutionPolicy::HandlerPool)
+                invokeRouteInHandlerPool(table, route, socket, context);
+            else
+                invokeRoute(*route, socket, context);
+        } else {
+            q->sendNotAuthorized(socket);
+        }
+    } else {
+        q->sendNotFound(socket, QStringLiteral("Wrong method"));
+    }
+}
+
+QJsonObject AbstractRestServerPrivate::buildStatusTemplate() const
+{
+    QStringList ipsList;
+    const auto allIfaces = QNetworkInterface::allInterfaces();
+    for (const auto &interface : allIfaces) {
+        const auto addressEntries = interface.addressEntries();
+        for (const auto &address : addressEntries) {
+            if (!address.ip().isLoopback())
+                ipsList << QStringLiteral("%1 (%2)").arg(address.ip().toString(), interface.humanReadableName());
+        }
+    }
+
+    QString lastCrashAt(QStringLiteral("N/A"));
+#if (defined(Q_OS_LINUX) && !defined(Q_OS_ANDROID)) || defined(Q_OS_MAC)
+    QDir homeDir(crashesPath());
+    QFileInfoList crashes = homeDir.entryInfoList({"proof_crash_*"}, QDir::Files);
+    if (!crashes.isEmpty()) {
+        QDateTime mostRecentCrash = crashes.first().lastModified();
+        for (const auto &crash : crashes) {
+            if (crash.lastModified() > mostRecentCrash)
+                mostRecentCrash = crash.lastModified();
+        }
+        lastCrashAt = mostRecentCrash.toUTC().toString(Qt::ISODate);
+    }
+#endif
+
+    return QJsonObject{{QStringLiteral("app_type"), qApp->applicationName()},
+                       {QStringLiteral("app_version"), qApp->applicationVersion()},
+                       {QStringLiteral("proof_version"), Proof::proofVersion()},
+                       {QStringLiteral("started_at"), proofApp->startedAt().toString(Qt::ISODate)},
+                       {QStringLiteral("last_crash_at"), lastCrashAt},
+                       {QStringLiteral("os"), QSysInfo::prettyProductName()},
+                       {QStringLiteral("network_addresses"), QJsonArray::fromStringList(ipsList)}};
+}
+
+void AbstractRestServerPrivate::refreshStatusTemplate()
+{
+    std::atomic_store(&statusTemplate, std::make_shared<const QJsonObject>(buildStatusTemplate()));
+    for (auto &health : cachedHealth)
+        std::atomic_store(&health, std::shared_ptr<const CachedHealth>());
+}
+
+std::shared_ptr<const QJsonObject> AbstractRestServerPrivate::currentStatusTemplate()
+{
+    auto result = std::atomic_load(&statusTemplate);
+    return result ? result : std::make_shared<const QJsonObject>(buildStatusTemplate());
+}
+
+QByteArray AbstractRestServerPrivate::statusBody(const QJsonArray &health)
+{
+    auto statusObj = *currentStatusTemplate();
+    auto notificationsMemoryStorage = ErrorNotifier::instance()->handler<MemoryStorageNotificationHandler>();
+    QPair<QDateTime, QString> lastError;
+    if (notificationsMemoryStorage) {
+        statusObj[QStringLiteral("app_id")] = notificationsMemoryStorage->appId();
+        lastError = notificationsMemoryStorage->lastMessage();
+    } else {
+        lastError = qMakePair(QDateTime::currentDateTimeUtc(), QStringLiteral("Memory storage error handler not set"));
+    }
+
+    statusObj[QStringLiteral("last_error")] = lastError.first.isValid()
+                                                  ? QJsonObject{{QStringLiteral("timestamp"),
+                                                                 lastError.first.toString(Qt::ISODate)},
+                                                                {QStringLiteral("message"), lastError.second}}
+                                                  : QJsonValue();
+    statusObj[QStringLiteral("health")] = health;
+    statusObj[QStringLiteral("generated_at")] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    return QJsonDocument(statusObj).toJson();
+}
+
+QString AbstractRestServerPrivate::crashesPath() const
+{
+    const QByteArray homePath = qgetenv("HOME");
+    return homePath.isEmpty() ? QStringLiteral("/tmp") : QString::fromLocal8Bit(homePath);
+}
+
+QByteArray AbstractRestServerPrivate::prometheusMetrics()
+{
+    static const char *const phaseNames[] = {"parse", "auth", "handler", "write"};
+    QByteArray result;
+    result.reserve(64 * 1024);
+    auto appendMetric = [&result](const char *name, const char *type, const char *help, quint64 value) {
+        result.append("# HELP ").append(name).append(' ').append(help).append("\n# TYPE ").append(name).append(' ');
+        result.append(type).append('\n').append(name).append(' ').append(QByteArray::number(value)).append('\n');
+    };
+
+    QVector<QPair<QByteArray, std::shared_ptr<RouteMetrics>>> metrics;
+    {
+        QMutexLocker lock(&routesMutex);
+        metrics.reserve(routesMetrics.size() + 1);
+        for (auto it = routesMetrics.cbegin(); it != routesMetrics.cend(); ++it) {
+            const int methodDelimiterIndex = it.key().indexOf('/');
+            metrics.append(qMakePair(it.key().left(methodDelimiterIndex).toUpper() + " /"
+                                         + it.key().mid(methodDelimiterIndex + 1),
+                                     it.value()));
+        }
+    }
+    std::sort(metrics.begin(), metrics.end(),
+              [](const auto &left, const auto &right) { return left.first < right.first; });
+    metrics.append(qMakePair(QByteArray("unmatched"), unmatchedMetrics));
+
+    result.append("# HELP proof_rest_requests_total Answered requests by route and status code\n"
+                  "# TYPE proof_rest_requests_total counter\n");
+    for (const auto &routeMetrics : qAsConst(metrics)) {
+        const QByteArray route = prometheusLabel(QString::fromUtf8(routeMetrics.first));
+        for (size_t i = 0; i < routeMetrics.second->statusCounts.size(); ++i) {
+            const quint64 count = routeMetrics.second->statusCounts[i].load(std::memory_order_relaxed);
+            if (!count)
+                continue;
+            result.append("proof_rest_requests_total{route=\"").append(route).append("\",code=\"");
+            result.append(QByteArray::number(static_cast<int>(i) + MIN_STATUS_CODE)).append("\"} ");
+            result.append(QByteArray::number(count)).append('\n');
+        }
+    }
+
+    result.append("# HELP proof_rest_request_duration_seconds Request processing time by route and phase\n"
+                  "# TYPE proof_rest_request_duration_seconds histogram\n");
+    for (const auto &routeMetrics : qAsConst(metrics)) {
+        const QByteArray route = prometheusLabel(QString::fromUtf8(routeMetrics.first));
+        for (int phase = 0; phase < LatencyPhasesCount; ++phase) {
+            const LatencyHistogram &histogram = routeMetrics.second->latencies[static_cast<size_t>(phase)];
+            const QByteArray labels = "route=\"" + route + "\",phase=\"" + phaseNames[phase] + '"';
+            quint64 count = 0;
+            for (int i = 0; i <= LATENCY_BUCKETS_COUNT; ++i) {
+                count += histogram.buckets[static_cast<size_t>(i)].load(std::memory_order_relaxed);
+                const QByteArray bound = i < LATENCY_BUCKETS_COUNT
+                                             ? QByteArray::number(LATENCY_BUCKETS_USECS[i] / 1000000.0, 'g', 6)
+                                             : QByteArray("+Inf");
+                result.append("proof_rest_request_duration_seconds_bucket{").append(labels).append(",le=\"");
+                result.append(bound).append("\"} ").append(QByteArray::number(count)).append('\n');
+            }
+            result.append("proof_rest_request_duration_seconds_sum{").append(labels).append("} ");
+            result.append(QByteArray::number(histogram.sumUsecs.load(std::memory_order_relaxed) / 1000000.0, 'g', 12));
+            result.append("\nproof_rest_request_duration_seconds_count{").append(labels).append("} ");
+            result.append(QByteArray::number(count)).append('\n');
+        }
+    }
+
+    result.append("# HELP proof_rest_worker_sockets Open connections by worker thread\n"
+                  "# TYPE proof_rest_worker_sockets gauge\n");
+    {
+        QReadLocker lock(&threadPoolLock);
+        for (int i = 0; i < threadPool.count(); ++i) {
+            result.append("proof_rest_worker_sockets{worker=\"").append(QByteArray::number(i)).append("\"} ");
+            result.append(QByteArray::number(threadPool[i]->socketsCount())).append('\n');
+        }
+    }
+
+    appendMetric("proof_rest_connections", "gauge", "Open connections", static_cast<quint64>(connectionsCount));
+    appendMetric("proof_rest_in_flight_requests", "gauge", "Requests that are not answered yet",
+                 static_cast<quint64>(inFlightRequests));
+    appendMetric("proof_rest_pending_bytes", "gauge", "Bodies of requests that are not answered yet",
+                 static_cast<quint64>(pendingBytes));
+    appendMetric("proof_rest_rejected_connections_total", "counter", "Connections rejected by admission control",
+                 rejectedConnections);
+    appendMetric("proof_rest_rejected_requests_total", "counter", "Requests rejected by admission control",
+                 rejectedRequests);
+    appendMetric("proof_rest_auth_cache_hits_total", "counter", "Requests authenticated by cached credentials",
+                 authCacheHits);
+    appendMetric("proof_rest_auth_cache_misses_total", "counter", "Requests with credentials checked by authenticator",
+                 authCacheMisses);
+    appendMetric("proof_rest_auth_failures_total", "counter", "Requests rejected by authentication", authFailures);
+    result.append("# HELP proof_rest_timeouts_total Connections closed by timeout by phase\n"
+                  "# TYPE proof_rest_timeouts_total counter\n");
+    static const char *const timeoutPhaseNames[] = {"idle", "headers", "body", "write"};
+    for (int i = 0; i < TimeoutPhasesCount; ++i) {
+        result.append("proof_rest_timeouts_total{phase=\"").append(timeoutPhaseNames[i]).append("\"} ");
+        result.append(QByteArray::number(static_cast<quint64>(timedOutConnections[i]))).append('\n');
+    }
+    appendMetric("proof_rest_received_bytes_total", "counter", "Bytes received from clients", bytesReceived);
+    appendMetric("proof_rest_sent_bytes_total", "counter", "Bytes of answers sent to clients", bytesSent);
+    appendMetric("proof_rest_event_streams", "gauge", "Open Server-Sent Events connections",
+                 static_cast<quint64>(eventStreams));
+    appendMetric("proof_rest_websockets", "gauge", "Open WebSocket connections", static_cast<quint64>(webSockets));
+    appendMetric("proof_rest_rejected_push_messages_total", "counter", "Messages rejected by full push queue",
+                 rejectedPushMessages);
+    appendMetric("proof_rest_http2_connections", "gauge", "Open HTTP/2 connections",
+                 static_cast<quint64>(http2Connections));
+    appendMetric("proof_rest_http2_streams_total", "counter", "Requests received at HTTP/2 streams", http2Streams);
+    appendMetric("proof_rest_http2_refused_streams_total", "counter",
+                 "HTTP/2 streams refused due to concurrent streams limit", http2RefusedStreams);
+    appendMetric("proof_rest_handler_pool_queued", "gauge", "Handlers waiting in handler pool",
+                 static_cast<quint64>(queuedHandlers));
+    appendMetric("proof_rest_handler_pool_running", "gauge", "Handlers running in handler pool",
+                 static_cast<quint64>(runningHandlers));
+    appendMetric("proof_rest_handler_pool_completed_total", "counter", "Handlers completed in handler pool",
+                 static_cast<quint64>(completedHandlers));
+    appendMetric("proof_rest_handler_pool_rejected_total", "counter", "Handlers rejected by full handler pool",
+                 static_cast<quint64>(rejectedHandlers));
+    appendMetric("proof_rest_cache_hits_total", "counter", "Requests answered from response cache", cacheHits);
+    appendMetric("proof_rest_cache_misses_total", "counter", "Cacheable requests passed to handler", cacheMisses);
+    return result;
+}
+
+QByteArray AbstractRestServerPrivate::cacheKey(const RestRoute &route, const RestRequestContext &context) const
+{
+    const QString &uri = context.m_uri;
+    const int queryIndex = uri.indexOf('?');
+    QString path = queryIndex == -1 ? uri : uri.left(queryIndex);
+    while (path.length() > 1 && path.endsWith('/'))
+        path.chop(1);
+    // Order of query parameters doesn't matter for cache
+    auto queryItems = queryIndex == -1 ? QList<QPair<QString, QString>>()
+                                       : QUrlQuery(uri.mid(queryIndex + 1)).queryItems(QUrl::FullyDecoded);
+    std::sort(queryItems.begin(), queryItems.end());
+
+    QByteArray result = route.key;
+    result.append('\n');
+    if (route.cachePerUser)
+        result.append(context.header(QLatin1String("Authorization")));
+    result.append('\n').append(path.toUtf8()).append('?');
+    for (const auto &item : qAsConst(queryItems)) {
+        result.append(QUrl::toPercentEncoding(item.first)).append('=');
+        result.append(QUrl::toPercentEncoding(item.second)).append('&');
+    }
+    return result;
+}
+
+CachedResponse AbstractRestServerPrivate::cachedResponse(const QByteArray &key) const
+{
+    QReadLocker lock(&responseCacheLock);
+    auto it = responseCache.constFind(key);
+    if (it == responseCache.cend() || it->expiresAt <= steadyClockMsecs())
+        return CachedResponse();
+    return *it;
+}
+
+CachedResponse AbstractRestServerPrivate::storeCachedResponse(const CacheTarget &target, const QByteArray &body,
+                                                              const QString &contentType,
+                                                              const QHash<QString, QString> &headers)
+{
+    CachedResponse cached;
+    cached.routeKey = target.routeKey;
+    cached.body = body;
+    cached.contentType = contentType;
+    cached.headers = headers;
+    cached.eTag = '"'
+                  + QCryptographicHash::hash(body, QCryptographicHash::Md5)
+                        .toBase64(QByteArray::Base64UrlEncoding | QByteArray::OmitTrailingEquals)
+                  + '"';
+    const qint64 now = steadyClockMsecs();
+    cached.expiresAt = now + target.ttl;
+
+    const int limit = maxCachedResponses;
+    QWriteLocker lock(&responseCacheLock);
+    if (limit <= 0 || target.generation != cacheGeneration)
+        return cached;
+    const auto isStale = [this](const QPair<QByteArray, quint64> &entry) {
+        const auto it = responseCache.constFind(entry.first);
+        return it == responseCache.cend() || it->insertionStamp != entry.second;
+    };
+    if (!responseCache.contains(target.key)) {
+        while (responseCache.size() >= limit && !responseCacheOrder.empty()) {
+            if (!isStale(responseCacheOrder.front()))
+                responseCache.remove(responseCacheOrder.front().first);
+            responseCacheOrder.pop_front();
+        }
+    }
+    cached.insertionStamp = ++lastCacheInsertionStamp;
+    responseCacheOrder.push_back(qMakePair(target.key, cached.insertionStamp));
+    responseCache[target.key] = cached;
+    // Stale keys are dropped once there are as many of them as live ones, so it is amortized constant per insert
+    if (responseCacheOrder.size() > 2 * static_cast<size_t>(qMax(limit, responseCache.size()))) {
+        responseCacheOrder.erase(std::remove_if(responseCacheOrder.begin(), responseCacheOrder.end(), isStale),
+                                 responseCacheOrder.end());
+    }
+    return cached;
+}
+
+void AbstractRestServerPrivate::sendAnswer(const RestRequestHandle &request, const QByteArray &body,
+                                           const QString &contentType, const QHash<QString, QString> &headers,
+                                           int returnCode, const QString &reason)
+{
+    // Workers are deleted only with server itself, so handle can be checked without locking anything
+    auto worker = static_cast<WorkerThread *>(request.worker());
+    if (worker != nullptr && worker->isAlive(request.slot(), request.generation())) {
+        qCDebug(proofNetworkMiscLog) << "Replying" << returnCode << ":" << reason << "at socket" << request.socket();
+        worker->sendAnswer(request, body, contentType, headers, returnCode, reason);
+    } else {
+        qCDebug(proofNetworkMiscLog).noquote()
+            << "Wanted to reply" << returnCode << ":" << reason << "at socket"
+            << QStringLiteral("QTcpSocket(%1)").arg(reinterpret_cast<quint64>(request.socket()), 0, 16)
+            << "but it is dead already";
+    }
+}
+
+void AbstractRestServerPrivate::sendStreamedAnswer(const RestRequestHandle &request, const RestChunkProducer &producer,
+                                                   const QString &contentType, const QHash<QString, QString> &headers,
+                                                   int returnCode, const QString &reason)
+{
+    auto worker = static_cast<WorkerThread *>(request.worker());
+    if (worker != nullptr && worker->isAlive(request.slot(), request.generation())) {
+        qCDebug(proofNetworkMiscLog) << "Replying with stream" << returnCode << ":" << reason << "at socket"
+                                     << request.socket();
+        worker->sendStreamedAnswer(request, producer, contentType, headers, returnCode, reason);
+    } else {
+        qCDebug(proofNetworkMiscLog) << "Wanted to reply with stream" << returnCode << ":" << reason
+                                     << "but connection is dead already";
+    }
+}
+
+RestPushChannel AbstractRestServerPrivate::openPushChannel(const RestRequestHandle &request,
+                                                           const QHash<QString, QString> &headers,
+                                                           const RestWebSocketHandler &webSocketHandler,
+                                                           bool isWebSocket)
+{
+    auto queue = std::make_shared<RestPushQueue>(isWebSocket, pushQueueLimit.load(), &rejectedPushMessages);
+    auto worker = static_cast<WorkerThread *>(request.worker());
+    if (worker != nullptr && worker->isAlive(request.slot(), request.generation())) {
+        qCDebug(proofNetworkMiscLog) << "Opening" << (isWebSocket ? "WebSocket" : "event stream") << "at socket"
+                                     << request.socket();
+        // Channel can be used right away, messages pushed before worker switches connection just wait in queue
+        if (isWebSocket)
+            worker->acceptWebSocket(request, queue, webSocketHandler);
+        else
+            worker->openEventStream(request, queue, headers);
+    } else {
+        qCDebug(proofNetworkMiscLog) << "Wanted to open push channel but connection is dead already";
+        queue->abort();
+    }
+    return RestPushChannel(queue);
+}
+
+void AbstractRestServerPrivate::sendFile(const RestRequestHandle &request, const QString &filePath,
+                                         const QString &contentType, const QHash<QString, QString> &headers)
+{
+    auto worker = static_cast<WorkerThread *>(request.worker());
+    if (worker != nullptr && worker->isAlive(request.slot(), request.generation())) {
+        qCDebug(proofNetworkMiscLog) << "Replying with file" << filePath << "at socket" << request.socket();
+        worker->sendFile(request, filePath, contentType, headers);
+    } else {
+        qCDebug(proofNetworkMiscLog) << "Wanted to reply with file" << filePath << "but connection is dead already";
+    }
+}
+
+QByteArray AbstractRestServerPrivate::encodedCommonHeaders()
+{
+    {
+        QReadLocker lock(&customHeadersLock);
+        if (!commonHeaders.isEmpty())
+            return commonHeaders;
+    }
+    QWriteLocker lock(&customHeadersLock);
+    if (commonHeaders.isEmpty()) {
+        const QByteArray appName = proofApp->prettifiedApplicationName().toUtf8();
+        commonHeaders = QByteArrayLiteral("Server: proof\r\nProof-Application: ") + appName + "\r\nProof-" + appName
+                        + "-Version: " + qApp->applicationVersion().toUtf8() + "\r\nProof-" + appName
+                        + "-Framework-Version: " + Proof::proofVersion().toUtf8() + "\r\n";
+        for (auto it = customHeaders.cbegin(); it != customHeaders.cend(); ++it)
+            commonHeaders += it.key().toUtf8() + ": " + it.value().toUtf8() + "\r\n";
+    }
+    return commonHeaders;
+}
+
+void AbstractRestServerPrivate::registerSocket(const RestRequestHandle &connection)
+{
+    QWriteLocker lock(&socketsLock);
+    sockets.insert(connection.socket(), connection);
+}
+
+void AbstractRestServerPrivate::deleteSocket(QTcpSocket *socket)
+{
+    QWriteLocker lock(&socketsLock);
+    sockets.remove(socket);
+}
+
+bool AbstractRestServerPrivate::admitConnection()
+{
+    const int limit = maxConnections;
+    if (connectionsCount.fetch_add(1) >= limit && limit > 0) {
+        --connectionsCount;
+        ++rejectedConnections;
+        return false;
+    }
+    return true;
+}
+
+void AbstractRestServerPrivate::releaseConnection()
+{
+    --connectionsCount;
+}
+
+bool AbstractRestServerPrivate::admitRequest(const QString &type, const QString &uri, qint64 contentLength,
+                                             Admission &admission, RouteOptions &routeOptions)
+{
+    const int queryIndex = uri.indexOf('?');
+    const QStringRef path = queryIndex == -1 ? QStringRef(&uri) : uri.leftRef(queryIndex);
+    RouteMatch &match = routeOptions.match;
+    match.table = std::atomic_load(&routeTable);
+    match.route = match.table ? match.table->find(type, path, match.parameters) : nullptr;
+    const RestRoute *route = match.route;
+    if (route) {
+        routeOptions.bodyStreamed = route->bodyStreamed;
+        routeOptions.bodyMultipart = route->bodyMultipart;
+        routeOptions.compressed = route->compressed;
+        routeOptions.metrics = route->metrics;
+    }
+    if (route && route->admissionExempt)
+        return true;
+
+    const int requestsLimit = maxInFlightRequests;
+    if (inFlightRequests.fetch_add(1) >= requestsLimit && requestsLimit > 0) {
+        --inFlightRequests;
+        ++rejectedRequests;
+        return false;
+    }
+    const qint64 bytesLimit = maxPendingBytes;
+    if (pendingBytes.fetch_add(contentLength) + contentLength > bytesLimit && bytesLimit > 0 && contentLength > 0) {
+        pendingBytes -= contentLength;
+        --inFlightRequests;
+        ++rejectedRequests;
+        return false;
+    }
+    if (route && route->maxInFlightRequests > 0) {
+        if (route->inFlightRequests->fetch_add(1) >= route->maxInFlightRequests) {
+            --*route->inFlightRequests;
+            pendingBytes -= contentLength;
+            --inFlightRequests;
+            ++rejectedRequests;
+            return false;
+        }
+        admission.routeInFlightRequests = route->inFlightRequests;
+    }
+    if (route && route->maxPendingBytes > 0 && contentLength > 0) {
+        if (route->pendingBytes->fetch_add(contentLength) + contentLength > route->maxPendingBytes) {
+            *route->pendingBytes -= contentLength;
+            if (admission.routeInFlightRequests)
+                --*admission.routeInFlightRequests;
+            admission.routeInFlightRequests.reset();
+            pendingBytes -= contentLength;
+            --inFlightRequests;
+            ++rejectedRequests;
+            return false;
+        }
+        admission.routePendingBytes = route->pendingBytes;
+    }
+    admission.bytes = contentLength;
+    admission.counted = true;
+    return true;
+}
+
+void AbstractRestServerPrivate::releaseAdmission(Admission &admission)
+{
+    if (!admission.counted)
+        return;
+    --inFlightRequests;
+    pendingBytes -= admission.bytes;
+    if (admission.routeInFlightRequests)
+        --*admission.routeInFlightRequests;
+    if (admission.routePendingBytes)
+        *admission.routePendingBytes -= admission.bytes;
+    admission = Admission();
+}
+
+ListenOptions AbstractRestServerPrivate::listenOptions(bool reusePort) const
+{
+    ListenOptions options;
+    options.port = port;
+    options.backlog = listenBacklog;
+    options.deferAcceptTimeout = deferAcceptTimeout;
+    options.fastOpenQueueLength = fastOpenQueueLength;
+    options.reusePort = reusePort;
+    return options;
+}
+
+bool AbstractRestServerPrivate::startServerListen()
+{
+    Q_Q(AbstractRestServer);
+#ifdef Q_OS_LINUX
+    const qintptr descriptor = takeListener(false);
+    // Only one inherited listener can be used by QTcpServer, others would just keep their queues stalled
+    closeInheritedListeners();
+    if (descriptor < 0)
+        return false;
+    if (!q->setSocketDescriptor(descriptor)) {
+        ::close(static_cast<int>(descriptor));
+        return false;
+    }
+    return true;
+#else
+    return q->listen(QHostAddress::Any, port);
+#endif
+}
+
+bool AbstractRestServerPrivate::startWorkersListen()
+{
+#ifdef Q_OS_LINUX
+    QVector<WorkerThread *> acceptors;
+    // Each inherited SO_REUSEPORT listener has its own accept queue, so all of them need an acceptor
+    const int acceptorsCount = qMax(reusePortWorkersCount, inheritedListeners.count());
+    {
+        QWriteLocker lock(&threadPoolLock);
+        while (threadPool.count() < acceptorsCount)
+            threadPool << new WorkerThread(this);
+        for (int i = 0; i < acceptorsCount; ++i) {
+            if (!threadPool[i]->isRunning())
+                threadPool[i]->start();
+            acceptors << threadPool[i];
+        }
+    }
+
+    for (WorkerThread *worker : qAsConst(acceptors)) {
+        const qintptr descriptor = takeListener(true);
+        if (descriptor < 0) {
+            stopWorkersListen();
+            return false;
+        }
+        workersListeners << descriptor;
+        worker->startAccepting(descriptor);
+    }
+    qCDebug(proofNetworkMiscLog) << "RestServer: listening on port" << port << "with" << acceptors.count()
+                                 << "SO_REUSEPORT workers";
+    return true;
+#else
+    qCWarning(proofNetworkMiscLog) << "RestServer: SO_REUSEPORT workers are not supported on this platform";
+    return startServerListen();
+#endif
+}
+
+void AbstractRestServerPrivate::stopWorkersListen()
+{
+    workersListeners.clear();
+    closeInheritedListeners();
+    QReadLocker lock(&threadPoolLock);
+    for (WorkerThread *worker : qAsConst(threadPool)) {
+        if (worker->isAccepting())
+            worker->stopAccepting();
+    }
+}
+
+bool AbstractRestServerPrivate::startUnixSocketListen()
+{
+    Q_Q(AbstractRestServer);
+    stopUnixSocketListen();
+    unixListener = createUnixListeningSocket(unixSocketPath, listenBacklog);
+    if (unixListener < 0)
+        return false;
+    if (unixSocketPermissions)
+        QFile::setPermissions(unixSocketPath, unixSocketPermissions);
+    unixSocketFile = unixSocketFileId(unixSocketPath);
+    // Local connections are balanced between workers the same way as connections accepted by QTcpServer
+    unixListenerNotifier = new QSocketNotifier(unixListener, QSocketNotifier::Read, q);
+    QObject::connect(unixListenerNotifier, &QSocketNotifier::activated, q, [this] { acceptUnixConnections(); });
+    qCDebug(proofNetworkMiscLog) << "RestServer: listening on unix socket" << unixSocketPath;
+    return true;
+}
+
+void AbstractRestServerPrivate::stopUnixSocketListen()
+{
+    if (unixListener < 0)
+        return;
+    delete unixListenerNotifier;
+    unixListenerNotifier = nullptr;
+#ifdef Q_OS_LINUX
+    ::close(static_cast<int>(unixListener));
+#endif
+    unixListener = -1;
+    if (unixSocketFile && unixSocketFile == unixSocketFileId(unixSocketPath))
+        QFile::remove(unixSocketPath);
+    unixSocketFile = 0;
+}
+
+void AbstractRestServerPrivate::acceptUnixConnections()
+{
+    Q_Q(AbstractRestServer);
+#ifdef Q_OS_LINUX
+    for (int i = 0; i < ACCEPT_BATCH_SIZE && unixListener >= 0; ++i) {
+        const int descriptor = ::accept4(static_cast<int>(unixListener), nullptr, nullptr,
+                                         SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (descriptor < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                qCWarning(proofNetworkMiscLog) << "RestServer: unix socket accept failed:" << qt_error_string(errno);
+            return;
+        }
+        q->incomingConnection(descriptor);
+    }
+#else
+    Q_UNUSED(q)
+#endif
+}
+
+qintptr AbstractRestServerPrivate::takeListener(bool reusePort)
+{
+    if (!inheritedListeners.isEmpty())
+        return inheritedListeners.takeFirst();
+    return createListeningSocket(listenOptions(reusePort));
+}
+
+void AbstractRestServerPrivate::closeInheritedListeners()
+{
+#ifdef Q_OS_LINUX
+    for (qintptr descriptor : qAsConst(inheritedListeners))
+        ::close(static_cast<int>(descriptor));
+#endif
+    inheritedListeners.clear();
+}
+
+void AbstractRestServerPrivate::checkDrain()
+{
+    Q_Q(AbstractRestServer);
+    const int connections = connectionsCount;
+    if (connections <= 0) {
+        drainTimer->stop();
+        qCDebug(proofNetworkMiscLog) << "RestServer: drained";
+        emit q->drained(true);
+        return;
+    }
+    if (drainDeadline && steadyClockMsecs() >= drainDeadline) {
+        drainTimer->stop();
+        qCWarning(proofNetworkMiscLog) << "RestServer: drain deadline reached," << connections
+                                       << "connections are closed forcibly";
+        QReadLocker lock(&threadPoolLock);
+        for (WorkerThread *worker : qAsConst(threadPool)) {
+            if (worker->isRunning())
+                worker->stop();
+        }
+        emit q->drained(false);
+        return;
+    }
+    emit q->drainProgress(connections, inFlightRequests);
+}
+
+WorkerThread *AbstractRestServerPrivate::runningWorker(WorkerThread *worker)
+{
+    if (worker) {
+        qCDebug(proofNetworkMiscLog) << "RestServer: restarting stopped worker" << worker;
+        worker->start();
+        return worker;
+    }
+    worker = new WorkerThread(this);
+    worker->start();
+    QWriteLocker lock(&threadPoolLock);
+    threadPool << worker;
+    return worker;
+}
+
+void AbstractRestServerPrivate::stopIdleWorkers()
+{
+    if (threadIdleTimeout <= 0)
+        return;
+    // Worker objects are never deleted while server is alive, because request handles can still point to them
+    QVector<WorkerThread *> idleWorkers;
+    {
+        QReadLocker lock(&threadPoolLock);
+        int runningWorkersCount = std::count_if(threadPool.cbegin(), threadPool.cend(),
+                                                [](const WorkerThread *worker) { return worker->isRunning(); });
+        for (WorkerThread *worker : qAsConst(threadPool)) {
+            if (runningWorkersCount <= minThreadsCount)
+                break;
+            if (!worker->isRunning() || worker->isAccepting() || !worker->startRetiring(threadIdleTimeout))
+                continue;
+            idleWorkers << worker;
+            --runningWorkersCount;
+        }
+    }
+
+    // Pool is not locked while workers shut down, retiring ones are skipped by connection balancing
+    for (WorkerThread *worker : qAsConst(idleWorkers)) {
+        qCDebug(proofNetworkMiscLog) << "RestServer: stopping idle worker" << worker;
+        worker->stop();
+        worker->quit();
+        worker->wait();
+        worker->finishRetiring();
+    }
+}
+
+WorkerThread::WorkerThread(Proof::AbstractRestServerPrivate *const serverD) : serverD(serverD)
+{
+    for (auto &chunk : connectionSlots)
+        chunk.store(nullptr, std::memory_order_relaxed);
+    timeoutWheel.resize(TIMEOUT_WHEEL_SIZE);
+    timeoutsTimer = new QTimer(this);
+    timeoutsTimer->setInterval(TIMEOUT_WHEEL_TICK);
+    connect(timeoutsTimer, &QTimer::timeout, this, &WorkerThread::checkTimeouts);
+    idleSince = steadyClockMsecs();
+    moveToThread(this);
+}
+
+WorkerThread::~WorkerThread()
+{
+    for (auto &chunk : connectionSlots)
+        delete[] chunk.load(std::memory_order_relaxed);
+}
+
+bool WorkerThread::isAlive(quint32 slot, quint32 generation) const
+{
+    ConnectionSlot *connection = connectionSlot(slot);
+    return connection && generation && connection->generation.load(std::memory_order_acquire) == generation;
+}
+
+long long WorkerThread::socketsCount() const
+{
+    return qMax(0ll, socketCount.load());
+}
+
+bool WorkerThread::reserveSocket()
+{
+    long long count = socketCount;
+    do {
+        if (count == RETIRED_WORKER_SOCKETS_COUNT)
+            return false;
+    } while (!socketCount.compare_exchange_weak(count, count + 1));
+    return true;
+}
+
+bool WorkerThread::isAccepting() const
+{
+    return accepting;
+}
+
+bool WorkerThread::startRetiring(int idleMsecs)
+{
+    long long expected = 0;
+    return steadyClockMsecs() - idleSince >= idleMsecs
+           && socketCount.compare_exchange_strong(expected, RETIRED_WORKER_SOCKETS_COUNT);
+}
+
+void WorkerThread::finishRetiring()
+{
+    socketCount = 0;
+}
+
+ConnectionSlot *WorkerThread::connectionSlot(quint32 slot) const
+{
+    const quint32 chunkIndex = slot / CONNECTION_SLOTS_CHUNK_SIZE;
+    if (chunkIndex >= MAX_CONNECTION_SLOTS_CHUNKS)
+        return nullptr;
+    ConnectionSlot *chunk = connectionSlots[chunkIndex].load(std::memory_order_acquire);
+    return chunk ? &chunk[slot % CONNECTION_SLOTS_CHUNK_SIZE] : nullptr;
+}
+
+bool WorkerThread::acquireSlot(QTcpSocket *socket, SocketInfo &info)
+{
+    quint32 slot;
+    if (!freeConnectionSlots.isEmpty()) {
+        slot = freeConnectionSlots.takeLast();
+    } else {
+        slot = connectionSlotsCount;
+        const quint32 chunkIndex = slot / CONNECTION_SLOTS_CHUNK_SIZE;
+        if (chunkIndex >= MAX_CONNECTION_SLOTS_CHUNKS)
+            return false;
+        if (!connectionSlots[chunkIndex].load(std::memory_order_relaxed))
+            connectionSlots[chunkIndex].store(new ConnectionSlot[CONNECTION_SLOTS_CHUNK_SIZE],
+                                              std::memory_order_release);
+        ++connectionSlotsCount;
+    }
+    ConnectionSlot *connection = connectionSlot(slot);
+    connection->socket = socket;
+    info.slot = slot;
+    info.generation = connection->generation.fetch_add(1, std::memory_order_acq_rel) + 1;
+    // Zero generation is reserved for invalid handles
+    if (!info.generation)
+        info.generation = connection->generation.fetch_add(1, std::memory_order_acq_rel) + 1;
+    return true;
+}
+
+void WorkerThread::releaseSlot(quint32 slot)
+{
+    ConnectionSlot *connection = connectionSlot(slot);
+    connection->generation.fetch_add(1, std::memory_order_acq_rel);
+    connection->socket = nullptr;
+    freeConnectionSlots << slot;
+}
+
+void WorkerThread::handleNewConnection(qintptr socketDescriptor)
+{
+    if (Proof::ProofObject::safeCall(this, &WorkerThread::handleNewConnection, socketDescriptor))
+        return;
+
+    QTcpSocket *tcpSocket = new QTcpSocket();
+    SocketInfo info;
+    if (!tcpSocket->setSocketDescriptor(socketDescriptor)) {
+        qCWarning(proofNetworkMiscLog) << "RestServer: can't create socket, error:" << tcpSocket->errorString();
+        delete tcpSocket;
+        --socketCount;
+        return;
+    }
+    if (!serverD->admitConnection()) {
+        qCDebug(proofNetworkMiscLog) << "RestServer: connections limit reached, socket descriptor" << socketDescriptor
+                                     << "rejected";
+        tcpSocket->write(*std::atomic_load(&serverD->overloadedResponse));
+        connect(tcpSocket, &QTcpSocket::disconnected, tcpSocket, &QObject::deleteLater);
+        tcpSocket->disconnectFromHost();
+        --socketCount;
+        return;
+    }
+    if (!acquireSlot(tcpSocket, info)) {
+        qCWarning(proofNetworkMiscLog) << "RestServer: too many connections in worker, socket descriptor"
+                                       << socketDescriptor << "will be closed";
+        serverD->releaseConnection();
+        delete tcpSocket;
+        --socketCount;
+        return;
+    }
+    serverD->registerSocket(RestRequestHandle(tcpSocket, 0, this, info.slot, info.generation));
+    if (serverD->tcpNoDelay)
+        tcpSocket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+
+    info.readyReadConnection = connect(tcpSocket, &QTcpSocket::readyRead, this,
+                                       [tcpSocket, this] { onReadyRead(tcpSocket); }, Qt::QueuedConnection);
+
+    void (QTcpSocket::*errorSignal)(QAbstractSocket::SocketError) = &QTcpSocket::error;
+    info.errorConnection = connect(tcpSocket, errorSignal, this,
+                                   [tcpSocket] {
+                                       qCWarning(proofNetworkMiscLog)
+                                           << "RestServer: socket error:" << tcpSocket->errorString();
+                                   },
+                                   Qt::QueuedConnection);
+
+    info.disconnectConnection = connect(tcpSocket, &QTcpSocket::disconnected, this,
+                                        [tcpSocket, this] { deleteSocket(tcpSocket); }, Qt::QueuedConnection);
+
+    info.bytesWrittenConnection = connect(tcpSocket, &QTcpSocket::bytesWritten, this,
+                                          [tcpSocket, this] { onBytesWritten(tcpSocket); });
+
+    auto infoIt = sockets.insert(tcpSocket, info);
+    updateTimeout(tcpSocket, *infoIt);
+    if (!timeoutsTimer->isActive()) {
+        lastTimeoutTick = steadyClockMsecs() / TIMEOUT_WHEEL_TICK;
+        timeoutsTimer->start();
+    }
+    qCDebug(proofNetworkMiscLog) << "Handling socket descriptor" << socketDescriptor << "with socket" << tcpSocket;
+}
+
+void WorkerThread::deleteSocket(QTcpSocket *socket)
+{
+    auto infoIt = sockets.find(socket);
+    if (infoIt == sockets.end())
+        return;
+    releaseSlot(infoIt->slot);
+    releaseAdmissions(*infoIt);
+    disarmTimeout(socket, *infoIt);
+    finishPush(*infoIt);
+    for (const auto &pending : infoIt->pendingResponses) {
+        if (pending.pushQueue)
+            pending.pushQueue->abort();
+    }
+    if (infoIt->http2) {
+        const auto streamIds = infoIt->http2Transfers.keys();
+        for (quint32 streamId : streamIds)
+            finishHttp2Transfer(*infoIt, streamId);
+        --serverD->http2Connections;
+    }
+    sockets.erase(infoIt);
+    serverD->deleteSocket(socket);
+    serverD->releaseConnection();
+    delete socket;
+    if (--socketCount == 0) {
+        idleSince = steadyClockMsecs();
+        timeoutsTimer->stop();
+    }
+}
+
+void WorkerThread::onReadyRead(QTcpSocket *socket)
+{
+    auto infoIt = sockets.find(socket);
+    if (infoIt == sockets.end())
+        return;
+    // Rest of pipelined requests stays in socket buffer until some of pending ones are answered.
+    // HTTP/2 connection is read all the time, its streams are limited by session itself
+    if (infoIt->http2 ? infoIt->closing
+                      : infoIt->finishing || infoIt->pendingResponses.size() >= MAX_PIPELINED_REQUESTS) {
+        return;
+    }
+    const QByteArray data = socket->readAll();
+    serverD->bytesReceived += static_cast<quint64>(data.size());
+    infoIt->input.append(data);
+    if (infoIt->webSocket)
+        processWebSocketInput(socket);
+    else if (infoIt->http2)
+        processHttp2Input(socket);
+    else
+        processInput(socket);
+    infoIt = sockets.find(socket);
+    if (infoIt != sockets.end())
+        updateTimeout(socket, *infoIt);
+}
+
+void WorkerThread::processInput(QTcpSocket *socket)
+{
+    forever {
+        auto infoIt = sockets.find(socket);
+        if (infoIt == sockets.end())
+            return;
+        SocketInfo &info = *infoIt;
+        if (info.finishing || info.input.isEmpty() || info.pendingResponses.size() >= MAX_PIPELINED_REQUESTS)
+            return;
+
+        // Client that knows about HTTP/2 support starts connection with preface instead of request
+        if (!info.requestsCount && info.parser.isClean() && serverD->http2Enabled) {
+            const QByteArray preface = Http2Session::clientPreface();
+            if (info.input.size() < preface.size() && preface.startsWith(info.input))
+                return;
+            if (info.input.startsWith(preface)) {
+                qCDebug(proofNetworkMiscLog) << "Starting HTTP/2 with prior knowledge at socket" << socket;
+                startHttp2(info, createHttp2Session());
+                processHttp2Input(socket);
+                return;
+            }
+        }
+
+        if (!info.requestStartedAt)
+            info.requestStartedAt = steadyClockUsecs();
+        info.parser.setMaxHeadersSize(serverD->maxHeadersSize);
+        HttpParser::Result result = info.parser.parseNextPart(info.input);
+        if (result == HttpParser::Result::NeedMore)
+            return;
+
+        if (result == HttpParser::Result::Error) {
+            qCWarning(proofNetworkMiscLog) << "RestServer: parse error:" << info.parser.error();
+            const int errorStatusCode = info.parser.errorStatusCode();
+            QString reason;
+            switch (errorStatusCode) {
+            case 431:
+                reason = QStringLiteral("Request Header Fields Too Large");
+                break;
+            case 500:
+                reason = QStringLiteral("Internal Server Error");
+                break;
+            case 501:
+                reason = QStringLiteral("Not Implemented");
+                break;
+            default:
+                reason = QStringLiteral("Bad Request");
+                break;
+            }
+            failRequest(socket, info, errorStatusCode, reason);
+            return;
+        }
+
+        // Limits are checked before body is received, so body of rejected request is not buffered at all
+        if (result == HttpParser::Result::HeadersComplete) {
+            const qint64 maxBodySize = serverD->maxBodySize;
+            if (maxBodySize > 0 && info.parser.contentLength() > static_cast<qulonglong>(maxBodySize)) {
+                qCDebug(proofNetworkMiscLog) << "RestServer: request body of" << info.parser.contentLength()
+                                             << "bytes at socket" << socket << "is too large";
+                failRequest(socket, info, 413, QStringLiteral("Payload Too Large"));
+                return;
+            }
+            if (!admitRequest(socket, info))
+                return;
+            continue;
+        }
+
+        PendingResponse pending;
+        pending.sequence = ++lastRequestSequence;
+        const RestRequestHandle request(socket, pending.sequence, this, info.slot, info.generation);
+
+        if (!info.admissionChecked && !admitRequest(socket, info))
+            return;
+
+        const RestRequestContext context(info.parser.method(), info.parser.uri(), info.parser.rawHeaders());
+        // Streamed body is available only through requestBody() to not keep it in memory twice
+        const QSharedPointer<QIODevice> bodyDevice = info.parser.bodyDevice();
+        const bool isMultipart = info.parser.isBodyMultipart();
+        const QVector<MultipartPart> parts = info.parser.takeMultipartParts();
+        QByteArray body = bodyDevice || isMultipart ? QByteArray() : info.parser.body();
+        if (!bodyDevice && !isMultipart) {
+            const BodyStatus bodyStatus = decodeBody(context, body);
+            if (bodyStatus.returnCode) {
+                failRequest(socket, info, bodyStatus.returnCode, bodyStatus.reason);
+                return;
+            }
+        }
+
+        info.admissionChecked = false;
+        pending.admission = info.admission;
+        info.admission = Admission();
+        pending.compressionAllowed = info.compressionAllowed;
+        pending.metrics = info.routeMetrics ? info.routeMetrics : serverD->unmatchedMetrics;
+        info.routeMetrics.reset();
+        const RouteMatch match = std::move(info.routeMatch);
+        info.routeMatch = RouteMatch();
+        addLatency(pending.metrics, ParsePhase, info.requestStartedAt);
+        info.requestStartedAt = 0;
+        pending.dispatchedAt = steadyClockUsecs();
+
+        pending.isHttp10 = info.parser.isHttp10();
+        pending.requestContext = context;
+        ++info.requestsCount;
+        // Upgrade request itself is answered at first stream, rest of input belongs to HTTP/2 already
+        if (!bodyDevice && !isMultipart && upgradeToHttp2(socket, info, context)) {
+            pending.http2Stream = 1;
+            info.pendingResponses.push_back(pending);
+            info.parser.reset();
+            dispatchRequest(socket, request, context, body, bodyDevice, parts, match);
+            processHttp2Input(socket);
+            return;
+        }
+        const int maxRequests = serverD->maxRequestsPerConnection;
+        // Nothing is parsed after upgrade request, connection either switches protocol or is closed after answer
+        const bool isUpgrade = context.hasHeader(QLatin1String("Upgrade"));
+        pending.keepAlive = serverD->keepAliveTimeout > 0 && !serverD->draining && info.parser.isKeepAlive()
+                            && !isUpgrade && (maxRequests == 0 || info.requestsCount < maxRequests);
+        if (!pending.keepAlive) {
+            info.finishing = true;
+            if (!isUpgrade)
+                info.input.clear();
+        }
+        info.pendingResponses.push_back(pending);
+
+        info.parser.reset();
+        dispatchRequest(socket, request, context, body, bodyDevice, parts, match);
+    }
+}
+
+void WorkerThread::dispatchRequest(QTcpSocket *socket, const RestRequestHandle &request,
+                                   const RestRequestContext &context, const QByteArray &body,
+                                   const QSharedPointer<QIODevice> &bodyDevice, const QVector<MultipartPart> &parts,
+                                   const RouteMatch &match)
+{
+    const RestRequestHandle previousRequest = dispatchedRequest;
+    const QSharedPointer<QIODevice> previousBody = dispatchedBody;
+    const QVector<MultipartPart> previousParts = dispatchedParts;
+    dispatchedRequest = request;
+    dispatchedBody = bodyDevice;
+    dispatchedParts = parts;
+    serverD->tryToCallMethod(socket, context, body, match);
+    dispatchedRequest = previousRequest;
+    dispatchedBody = previousBody;
+    dispatchedParts = previousParts;
+}
+
+bool WorkerThread::admitRequest(QTcpSocket *socket, SocketInfo &info)
+{
+    info.admissionChecked = true;
+    RouteOptions routeOptions;
+    if (serverD->admitRequest(info.parser.method(), info.parser.uri(),
+                              static_cast<qint64>(info.parser.contentLength()), info.admission, routeOptions)) {
+        info.compressionAllowed = routeOptions.compressed;
+        info.routeMetrics = routeOptions.metrics;
+        info.routeMatch = routeOptions.match;
+        if (routeOptions.bodyMultipart && info.parser.contentLength() > 0)
+            return startMultipartBody(socket, info);
+        if (routeOptions.bodyStreamed) {
+            const RestRequestContext context(info.parser.method(), info.parser.uri(), info.parser.rawHeaders());
+            const BodyStatus bodyStatus = checkStreamedBody(context);
+            if (bodyStatus.returnCode) {
+                failRequest(socket, info, bodyStatus.returnCode, bodyStatus.reason);
+                return false;
+            }
+            info.parser.setBodyStreamed(serverD->bodySpoolThreshold);
+        }
+        return true;
+    }
+
+    qCDebug(proofNetworkMiscLog) << "RestServer: request for" << info.parser.uri() << "at socket" << socket
+                                 << "rejected due to overload";
+    PendingResponse pending;
+    pending.sequence = ++lastRequestSequence;
+    pending.head = *std::atomic_load(&serverD->overloadedResponse);
+    pending.ready = true;
+    info.finishing = true;
+    info.input.clear();
+    info.parser.reset();
+    info.admissionChecked = false;
+    info.pendingResponses.push_back(pending);
+    flushResponses(socket, info);
+    return false;
+}
+
+bool WorkerThread::startMultipartBody(QTcpSocket *socket, SocketInfo &info)
+{
+    const RestRequestContext context(info.parser.method(), info.parser.uri(), info.parser.rawHeaders());
+    QByteArray boundary;
+    const BodyStatus bodyStatus = checkMultipartBody(context, boundary);
+    if (bodyStatus.returnCode) {
+        failRequest(socket, info, bodyStatus.returnCode, bodyStatus.reason);
+        return false;
+    }
+    info.parser.setBodyMultipart(boundary, serverD->bodySpoolThreshold);
+    return true;
+}
+
+BodyStatus WorkerThread::checkStreamedBody(const RestRequestContext &context) const
+{
+    // Streamed body goes to handler as it is received, there is no place where it could be decoded
+    if (contentEncoding(context) == ContentEncoding::Identity)
+        return BodyStatus();
+    qCDebug(proofNetworkMiscLog) << "RestServer: encoded body for streamed route" << context.uri();
+    return BodyStatus{415, QStringLiteral("Unsupported Media Type")};
+}
+
+BodyStatus WorkerThread::checkMultipartBody(const RestRequestContext &context, QByteArray &boundary) const
+{
+    // Parts are split while body is received, so it can't be encoded either
+    boundary = MultipartParser::boundaryFromContentType(context.header(QLatin1String("Content-Type")));
+    if (!boundary.isEmpty() && contentEncoding(context) == ContentEncoding::Identity)
+        return BodyStatus();
+    qCDebug(proofNetworkMiscLog) << "RestServer: request for" << context.uri() << "is not multipart";
+    return BodyStatus{415, QStringLiteral("Unsupported Media Type")};
+}
+
+BodyStatus WorkerThread::decodeBody(const RestRequestContext &context, QByteArray &body) const
+{
+    const ContentEncoding encoding = contentEncoding(context);
+    if (encoding == ContentEncoding::Identity)
+        return BodyStatus();
+    if (encoding == ContentEncoding::Unsupported)
+        return BodyStatus{415, QStringLiteral("Unsupported Media Type")};
+
+    const qint64 maxBodySize = serverD->maxBodySize;
+    QByteArray decoded;
+    switch (decompressBody(body, maxBodySize > 0 ? maxBodySize : DEFAULT_MAX_DECODED_BODY_SIZE, decoded)) {
+    case DecodeResult::Decoded:
+        body = decoded;
+        return BodyStatus();
+    case DecodeResult::TooLarge:
+        qCDebug(proofNetworkMiscLog) << "RestServer: decoded request body for" << context.uri() << "is too large";
+        return BodyStatus{413, QStringLiteral("Payload Too Large")};
+    case DecodeResult::Malformed:
+        break;
+    }
+    qCDebug(proofNetworkMiscLog) << "RestServer: can't decode request body for" << context.uri();
+    return BodyStatus{400, QStringLiteral("Bad Request")};
+}
+
+void WorkerThread::failRequest(QTcpSocket *socket, SocketInfo &info, int returnCode, const QString &reason)
+{
+    PendingResponse pending;
+    pending.sequence = ++lastRequestSequence;
+    pending.metrics = serverD->unmatchedMetrics;
+    pending.dispatchedAt = steadyClockUsecs();
+    info.requestStartedAt = 0;
+    info.routeMetrics.reset();
+    info.routeMatch = RouteMatch();
+    info.finishing = true;
+    info.input.clear();
+    info.parser.reset();
+    info.admissionChecked = false;
+    serverD->releaseAdmission(info.admission);
+    info.pendingResponses.push_back(pending);
+    sendAnswer(RestRequestHandle(socket, pending.sequence, this, info.slot, info.generation), "",
+               QStringLiteral("text/plain; charset=utf-8"), QHash<QString, QString>(), returnCode, reason);
+}
+
+void WorkerThread::releaseAdmissions(SocketInfo &info)
+{
+    serverD->releaseAdmission(info.admission);
+    for (auto &pending : info.pendingResponses)
+        serverD->releaseAdmission(pending.admission);
+}
+
+void WorkerThread::flushResponses(QTcpSocket *socket, SocketInfo &info)
+{
+    const bool wasPipelineFull = info.pendingResponses.size() >= MAX_PIPELINED_REQUESTS;
+    while (!info.stream && !info.file.file && !info.pendingResponses.empty() && info.pendingResponses.front().ready) {
+        const PendingResponse response = std::move(info.pendingResponses.front());
+        info.pendingResponses.pop_front();
+        writeResponse(socket, response.head, response.body);
+        serverD->bytesSent += static_cast<quint64>(response.head.size() + response.body.size());
+        if (!response.producer && !(response.file.file && response.file.length > 0)) {
+            addLatency(response.metrics, WritePhase, response.readyAt);
+        } else {
+            info.transferMetrics = response.metrics;
+            info.transferReadyAt = response.readyAt;
+        }
+        if (response.file.file && response.file.length > 0) {
+            info.file = response.file;
+            info.fileKeepAlive = response.keepAlive;
+            pumpFile(socket, info);
+            break;
+        }
+        if (response.producer) {
+            info.stream = response.producer;
+            info.streamChunked = !response.isHttp10 && !(response.pushQueue && response.pushQueue->isWebSocket);
+            info.streamKeepAlive = response.keepAlive;
+            if (response.pushQueue)
+                startPush(socket, info, response);
+            pumpStream(socket, info);
+            break;
+        }
+        if (!response.keepAlive) {
+            closeAfterResponse(socket, info);
+            return;
+        }
+    }
+
+    updateTimeout(socket, info);
+    if (wasPipelineFull && info.pendingResponses.size() < MAX_PIPELINED_REQUESTS)
+        QMetaObject::invokeMethod(this, [this, socket] { onReadyRead(socket); }, Qt::QueuedConnection);
+}
+
+void WorkerThread::closeAfterResponse(QTcpSocket *socket, SocketInfo &info)
+{
+    info.finishing = true;
+    info.closing = true;
+    releaseAdmissions(info);
+    info.pendingResponses.clear();
+    if (socket->bytesToWrite() == 0)
+        socket->disconnectFromHost();
+    else
+        updateTimeout(socket, info);
+}
+
+void WorkerThread::pumpFile(QTcpSocket *socket, SocketInfo &info)
+{
+    // Data that is already in socket buffer must be sent before file, bytesWritten will call us again
+    if (!info.file.file || socket->bytesToWrite() > 0)
+        return;
+
+    for (int i = 0; i < FILE_CHUNKS_PER_PUMP && info.file.length > 0; ++i) {
+#ifdef Q_OS_LINUX
+        off_t offset = info.file.offset;
+        const ssize_t sent = ::sendfile(static_cast<int>(socket->socketDescriptor()), info.file.file->handle(), &offset,
+                                        static_cast<size_t>(qMin(info.file.length, FILE_SENDFILE_CHUNK_SIZE)));
+        if (sent > 0) {
+            info.file.offset += sent;
+            info.file.length -= sent;
+            serverD->bytesSent += static_cast<quint64>(sent);
+            continue;
+        }
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+            const QString error = sent == 0 ? QStringLiteral("file is truncated") : qt_error_string(errno);
+            qCWarning(proofNetworkMiscLog) << "RestServer: can't send file" << info.file.file->fileName() << ":"
+                                           << error;
+            info.file = FileBody();
+            info.finishing = true;
+            info.closing = true;
+            socket->abort();
+            return;
+        }
+#endif
+        // Kernel buffer is full (or sendfile is not available), so single chunk goes through socket buffer.
+        // It is mapped from page cache if possible and bytesWritten resumes sending when client reads it
+        const qint64 chunkSize = qMin(info.file.length, FILE_COPY_CHUNK_SIZE);
+        uchar *mapped = info.file.file->map(info.file.offset, chunkSize);
+        if (mapped) {
+            socket->write(reinterpret_cast<const char *>(mapped), chunkSize);
+            info.file.file->unmap(mapped);
+        } else {
+            info.file.file->seek(info.file.offset);
+            socket->write(info.file.file->read(chunkSize));
+        }
+        info.file.offset += chunkSize;
+        info.file.length -= chunkSize;
+        serverD->bytesSent += static_cast<quint64>(chunkSize);
+        if (info.file.length > 0)
+            return;
+    }
+
+    // Socket keeps up, but other connections of this thread shouldn't wait for the whole file
+    if (info.file.length > 0) {
+        QMetaObject::invokeMethod(this,
+                                  [this, slot = info.slot, generation = info.generation] {
+                                      if (!isAlive(slot, generation))
+                                          return;
+                                      QTcpSocket *socket = connectionSlot(slot)->socket;
+                                      auto infoIt = sockets.find(socket);
+                                      if (infoIt != sockets.end())
+                                          pumpFile(socket, *infoIt);
+                                  },
+                                  Qt::QueuedConnection);
+        return;
+    }
+    finishFile(socket, info);
+}
+
+void WorkerThread::finishFile(QTcpSocket *socket, SocketInfo &info)
+{
+    info.file = FileBody();
+    addLatency(info.transferMetrics, WritePhase, info.transferReadyAt);
+    info.transferMetrics.reset();
+    if (info.fileKeepAlive)
+        flushResponses(socket, info);
+    else
+        closeAfterResponse(socket, info);
+}
+
+void WorkerThread::pumpStream(QTcpSocket *socket, SocketInfo &info)
+{
+    // Next chunk is requested only when client has read enough of previous ones
+    if (!info.stream || info.streamChunkRequested || socket->bytesToWrite() >= serverD->streamHighWaterMark)
+        return;
+    info.streamChunkRequested = true;
+    const quint32 slot = info.slot;
+    const quint32 generation = info.generation;
+    requestStreamChunk(info.stream, [this, slot, generation](const QByteArray &chunk, bool isSuccessful) {
+        onStreamChunk(slot, generation, chunk, isSuccessful);
+    });
+}
+
+void WorkerThread::requestStreamChunk(const RestChunkProducer &producer,
+                                      const std::function<void(const QByteArray &, bool)> &callback)
+{
+    // Producer can finish in any thread, chunk is always handled in worker thread
+    producer()
+        .onSuccess([this, callback](const QByteArray &chunk) {
+            QMetaObject::invokeMethod(this, [callback, chunk] { callback(chunk, true); }, Qt::QueuedConnection);
+        })
+        .onFailure([this, callback](const Failure &f) {
+            qCWarning(proofNetworkMiscLog) << "RestServer: streamed answer failed:" << f.message;
+            QMetaObject::invokeMethod(this, [callback] { callback(QByteArray(), false); }, Qt::QueuedConnection);
+        });
+}
+
+void WorkerThread::onStreamChunk(quint32 slot, quint32 generation, const QByteArray &chunk, bool isSuccessful)
+{
+    if (!isAlive(slot, generation))
+        return;
+    QTcpSocket *socket = connectionSlot(slot)->socket;
+    auto infoIt = sockets.find(socket);
+    if (infoIt == sockets.end() || !infoIt->stream)
+        return;
+    SocketInfo &info = *infoIt;
+    info.streamChunkRequested = false;
+
+    if (!isSuccessful) {
+        // Status is already sent, so the only way to tell client about failure is to break the connection
+        info.stream = nullptr;
+        finishPush(info);
+        info.finishing = true;
+        info.closing = true;
+        socket->abort();
+        return;
+    }
+
+    if (chunk.isEmpty()) {
+        if (info.streamChunked)
+            socket->write("0\r\n\r\n", 5);
+        info.stream = nullptr;
+        finishPush(info);
+        addLatency(info.transferMetrics, WritePhase, info.transferReadyAt);
+        info.transferMetrics.reset();
+        if (info.streamKeepAlive)
+            flushResponses(socket, info);
+        else
+            closeAfterResponse(socket, info);
+        return;
+    }
+
+    serverD->bytesSent += static_cast<quint64>(chunk.size());
+    if (info.streamChunked) {
+        writeResponse(socket, QByteArray::number(chunk.size(), 16) + "\r\n", chunk);
+        socket->write("\r\n", 2);
+    } else {
+        socket->write(chunk);
+    }
+    pumpStream(socket, info);
+    updateTimeout(socket, info);
+}
+
+void WorkerThread::onBytesWritten(QTcpSocket *socket)
+{
+    auto infoIt = sockets.find(socket);
+    if (infoIt == sockets.end())
+        return;
+    if (infoIt->closing && socket->bytesToWrite() == 0)
+        socket->disconnectFromHost();
+    else if (infoIt->http2)
+        pumpHttp2Streams(socket, *infoIt);
+    else if (infoIt->file.file)
+        pumpFile(socket, *infoIt);
+    else if (infoIt->stream)
+        pumpStream(socket, *infoIt);
+    infoIt = sockets.find(socket);
+    if (infoIt != sockets.end())
+        updateTimeout(socket, *infoIt);
+}
+
+void WorkerThread::startPush(QTcpSocket *socket, SocketInfo &info, const PendingResponse &response)
+{
+    info.pushQueue = response.pushQueue;
+    if (!info.pushQueue->isWebSocket) {
+        ++serverD->eventStreams;
+        return;
+    }
+    ++serverD->webSockets;
+    info.webSocket = true;
+    info.webSocketHandler = response.webSocketHandler;
+    info.finishing = false;
+    info.parser.reset();
+    // Frames could arrive together with handshake request
+    QMetaObject::invokeMethod(this, [this, socket] { onReadyRead(socket); }, Qt::QueuedConnection);
+}
+
+void WorkerThread::finishPush(SocketInfo &info)
+{
+    if (!info.pushQueue)
+        return;
+    info.pushQueue->abort();
+    --(info.webSocket ? serverD->webSockets : serverD->eventStreams);
+    info.pushQueue.reset();
+    info.webSocketHandler = nullptr;
+    info.webSocket = false;
+    info.webSocketCodec = WebSocketCodec();
+}
+
+void WorkerThread::processWebSocketInput(QTcpSocket *socket)
+{
+    forever {
+        auto infoIt = sockets.find(socket);
+        if (infoIt == sockets.end())
+            return;
+        SocketInfo &info = *infoIt;
+        if (!info.webSocket || info.closing)
+            return;
+
+        const qint64 maxBodySize = serverD->maxBodySize;
+        const auto maxMessageSize = static_cast<quint64>(maxBodySize > 0 ? maxBodySize
+                                                                         : DEFAULT_MAX_WEBSOCKET_MESSAGE_SIZE);
+        switch (info.webSocketCodec.decode(info.input, maxMessageSize)) {
+        case WebSocketCodec::Result::NeedMore:
+            return;
+        case WebSocketCodec::Result::Ping:
+            socket->write(WebSocketCodec::encodeFrame(WebSocketCodec::PongFrame, info.webSocketCodec.message()));
+            continue;
+        case WebSocketCodec::Result::Close:
+            closeWebSocket(socket, info, WebSocketCodec::NormalClosure);
+            return;
+        case WebSocketCodec::Result::Error:
+            closeWebSocket(socket, info, info.webSocketCodec.errorCode());
+            return;
+        case WebSocketCodec::Result::Message:
+            break;
+        }
+        if (info.webSocketHandler) {
+            info.webSocketHandler(RestPushChannel(info.pushQueue), info.webSocketCodec.message(),
+                                  info.webSocketCodec.isBinary());
+        }
+    }
+}
+
+void WorkerThread::closeWebSocket(QTcpSocket *socket, SocketInfo &info, WebSocketCodec::CloseCode code)
+{
+    // Close frame is sent only once, if it was queued already then this is client's reply to it
+    if (info.pushQueue->isOpen())
+        socket->write(WebSocketCodec::encodeClose(code));
+    info.stream = nullptr;
+    info.streamChunkRequested = false;
+    finishPush(info);
+    addLatency(info.transferMetrics, WritePhase, info.transferReadyAt);
+    info.transferMetrics.reset();
+    closeAfterResponse(socket, info);
+}
+
+std::shared_ptr<Http2Session> WorkerThread::createHttp2Session() const
+{
+    Http2Session::Settings settings;
+    settings.maxConcurrentStreams = serverD->http2MaxConcurrentStreams;
+    settings.windowSize = serverD->http2WindowSize;
+    settings.maxHeadersSize = serverD->maxHeadersSize;
+    settings.maxBodySize = serverD->maxBodySize;
+    return std::make_shared<Http2Session>(settings);
+}
+
+void WorkerThread::startHttp2(SocketInfo &info, const std::shared_ptr<Http2Session> &session)
+{
+    info.http2 = session;
+    info.parser.reset();
+    ++serverD->http2Connections;
+}
+
+bool WorkerThread::upgradeToHttp2(QTcpSocket *socket, SocketInfo &info, const RestRequestContext &context)
+{
+    // Upgrade is ignored if anything is still sent at this connection, request is answered with HTTP/1.1 then
+    if (!serverD->http2Enabled || info.parser.isHttp10() || !info.pendingResponses.empty() || info.stream
+        || info.file.file || !context.hasHeader(QLatin1String("HTTP2-Settings"))) {
+        return false;
+    }
+    const auto protocols = context.header(QLatin1String("Upgrade")).split(',');
+    const bool isH2cRequested = std::any_of(protocols.cbegin(), protocols.cend(), [](const QByteArray &protocol) {
+        return protocol.trimmed().toLower() == "h2c";
+    });
+    if (!isH2cRequested)
+        return false;
+    auto session = createHttp2Session();
+    if (!session->upgrade(context.header(QLatin1String("HTTP2-Settings")))) {
+        qCDebug(proofNetworkMiscLog) << "RestServer: invalid HTTP2-Settings at socket" << socket
+                                     << ", upgrade is ignored";
+        return false;
+    }
+    qCDebug(proofNetworkMiscLog) << "Upgrading socket" << socket << "to HTTP/2";
+    const QByteArray head = statusLine(101, QStringLiteral("Switching Protocols"))
+                            + "Connection: Upgrade\r\nUpgrade: h2c\r\n\r\n";
+    socket->write(head);
+    serverD->bytesSent += static_cast<quint64>(head.size());
+    startHttp2(info, session);
+    return true;
+}
+
+void WorkerThread::processHttp2Input(QTcpSocket *socket)
+{
+    auto infoIt = sockets.find(socket);
+    if (infoIt == sockets.end() || infoIt->closing)
+        return;
+    const std::shared_ptr<Http2Session> session = infoIt->http2;
+    session->feed(infoIt->input);
+    if (session->hasFailed()) {
+        flushHttp2(socket, *infoIt);
+        return;
+    }
+    serverD->http2RefusedStreams += static_cast<quint64>(session->takeRefusedStreamsCount());
+    const auto resetStreams = session->takeResetStreams();
+    for (quint32 streamId : resetStreams)
+        cancelHttp2Stream(*infoIt, streamId);
+
+    const auto requests = session->takeRequests();
+    for (const Http2Request &request : requests) {
+        infoIt = sockets.find(socket);
+        if (infoIt == sockets.end() || infoIt->closing)
+            return;
+        dispatchHttp2Request(socket, *infoIt, request);
+    }
+    infoIt = sockets.find(socket);
+    if (infoIt != sockets.end())
+        flushHttp2(socket, *infoIt);
+}
+
+void WorkerThread::dispatchHttp2Request(QTcpSocket *socket, SocketInfo &info, const Http2Request &request)
+{
+    ++serverD->http2Streams;
+    ++info.requestsCount;
+    PendingResponse pending;
+    pending.sequence = ++lastRequestSequence;
+    pending.http2Stream = request.streamId;
+    pending.keepAlive = true;
+    pending.dispatchedAt = steadyClockUsecs();
+    const RestRequestHandle handle(socket, pending.sequence, this, info.slot, info.generation);
+    const RestRequestContext context(request.method, request.uri, request.rawHeaders);
+    pending.requestContext = context;
+
+    // Body is received already, so it is checked right away instead of being parsed while it arrives
+    RouteOptions routeOptions;
+    const bool isAdmitted = serverD->admitRequest(request.method, request.uri, request.body.size(),
+                                                  pending.admission, routeOptions);
+    pending.compressionAllowed = routeOptions.compressed;
+    pending.metrics = routeOptions.metrics ? routeOptions.metrics : serverD->unmatchedMetrics;
+    info.pendingResponses.push_back(pending);
+    auto fail = [this, &handle](int returnCode, const QString &reason, const QHash<QString, QString> &headers) {
+        sendAnswer(handle, "", QStringLiteral("text/plain; charset=utf-8"), headers, returnCode, reason);
+    };
+    if (!isAdmitted) {
+        qCDebug(proofNetworkMiscLog) << "RestServer: request for" << request.uri << "at socket" << socket
+                                     << "stream" << request.streamId << "rejected due to overload";
+        fail(503, QStringLiteral("Service Unavailable"),
+             {{QStringLiteral("Retry-After"), QString::number(serverD->retryAfter)}});
+        return;
+    }
+
+    // Body is received completely already, so only its parsing differs from HTTP/1.1
+    QByteArray body = request.body;
+    QSharedPointer<QIODevice> bodyDevice;
+    QVector<MultipartPart> parts;
+    BodyStatus bodyStatus;
+    if (routeOptions.bodyMultipart && !body.isEmpty()) {
+        QByteArray boundary;
+        bodyStatus = checkMultipartBody(context, boundary);
+        if (!bodyStatus.returnCode) {
+            MultipartParser parser(boundary, serverD->bodySpoolThreshold);
+            if (parser.feed(body) == MultipartParser::Result::Finished) {
+                parts = parser.takeParts();
+                body.clear();
+            } else {
+                qCDebug(proofNetworkMiscLog) << "RestServer: invalid multipart body at socket" << socket << "stream"
+                                             << request.streamId << ":" << parser.error();
+                bodyStatus = BodyStatus{400, QStringLiteral("Bad Request")};
+            }
+        }
+    } else if (routeOptions.bodyStreamed) {
+        bodyStatus = checkStreamedBody(context);
+        if (!bodyStatus.returnCode) {
+            QSharedPointer<QBuffer> buffer(new QBuffer);
+            buffer->setData(body);
+            buffer->open(QIODevice::ReadOnly);
+            bodyDevice = buffer;
+            body.clear();
+        }
+    } else {
+        bodyStatus = decodeBody(context, body);
     }
-    return auth;
+    if (bodyStatus.returnCode) {
+        fail(bodyStatus.returnCode, bodyStatus.reason, QHash<QString, QString>());
+        return;
+    }
+    dispatchRequest(socket, handle, context, body, bodyDevice, parts, routeOptions.match);
 }
 
-void AbstractRestServer::sendBadRequest(QTcpSocket *socket, const QString &reason)
+void WorkerThread::answerHttp2(QTcpSocket *socket, SocketInfo &info, std::deque<PendingResponse>::iterator pendingIt,
+                               const HttpHeaderFields &fields, const QByteArray &body,
+                               const RestChunkProducer &producer, const FileBody &file)
 {
-    sendAnswer(socket, "", QStringLiteral("text/plain; charset=utf-8"), 400, reason);
+    const quint32 streamId = pendingIt->http2Stream;
+    const std::shared_ptr<RouteMetrics> metrics = pendingIt->metrics;
+    const qint64 readyAt = steadyClockUsecs();
+    const bool isTransfer = producer || (file.file && file.length > 0);
+    info.http2->sendHeaders(streamId, fields, !isTransfer && body.isEmpty());
+    if (isTransfer) {
+        Http2Transfer transfer;
+        transfer.producer = producer;
+        transfer.file = file;
+        transfer.pushQueue = pendingIt->pushQueue;
+        transfer.metrics = metrics;
+        transfer.readyAt = readyAt;
+        if (transfer.pushQueue)
+            ++serverD->eventStreams;
+        info.http2Transfers.insert(streamId, transfer);
+    } else if (!body.isEmpty()) {
+        info.http2->sendData(streamId, body, true);
+    }
+    info.pendingResponses.erase(pendingIt);
+    pumpHttp2Streams(socket, info);
+    // Answer is only passed to socket buffer here, the rest of it depends on peer's flow control windows
+    if (!isTransfer)
+        addLatency(metrics, WritePhase, readyAt);
+    updateTimeout(socket, info);
 }
 
-void AbstractRestServer::sendNotFound(QTcpSocket *socket, const QString &reason)
+void WorkerThread::pumpHttp2Streams(QTcpSocket *socket, SocketInfo &info)
 {
-    sendAnswer(socket, "", QStringLiteral("text/plain; charset=utf-8"), 404, reason);
-}
+    // Socket buffer is shared by all streams, so nothing new is produced while client doesn't read it
+    const qint64 highWaterMark = serverD->streamHighWaterMark;
+    const auto streamIds = info.http2Transfers.keys();
+    for (quint32 streamId : streamIds) {
+        auto transferIt = info.http2Transfers.find(streamId);
+        if (transferIt == info.http2Transfers.end() || transferIt->chunkRequested)
+            continue;
+        FileBody &file = transferIt->file;
+        if (!file.file) {
+            if (socket->bytesToWrite() + info.http2->queuedBytes(streamId) >= highWaterMark)
+                continue;
+            transferIt->chunkRequested = true;
+            const quint32 slot = info.slot;
+            const quint32 generation = info.generation;
+            requestStreamChunk(transferIt->producer,
+                               [this, slot, generation, streamId](const QByteArray &chunk, bool isSuccessful) {
+                                   onHttp2StreamChunk(slot, generation, streamId, chunk, isSuccessful);
+                               });
+            continue;
+        }
 
-void AbstractRestServer::sendNotAuthorized(QTcpSocket *socket, const QString &reason)
-{
-    sendAnswer(socket, "", QStringLiteral("text/plain; charset=utf-8"), 401, reason);
+        // Files are read by chunks here, sendfile() can't be used since data is framed
+        bool isTruncated = false;
+        while (file.length > 0 && socket->bytesToWrite() + info.http2->queuedBytes(streamId) < highWaterMark) {
+            const qint64 chunkSize = qMin(file.length, FILE_COPY_CHUNK_SIZE);
+            QByteArray chunk;
+            uchar *mapped = file.file->map(file.offset, chunkSize);
+            if (mapped) {
+                chunk = QByteArray(reinterpret_cast<const char *>(mapped), static_cast<int>(chunkSize));
+                file.file->unmap(mapped);
+            } else {
+                file.file->seek(file.offset);
+                chunk = file.file->read(chunkSize);
+            }
+            if (chunk.size() != chunkSize) {
+                qCWarning(proofNetworkMiscLog) << "RestServer: can't send file" << file.file->fileName()
+                                               << ": file is truncated";
+                info.http2->resetStream(streamId, Http2Session::InternalError);
+                isTruncated = true;
+                break;
+            }
+            file.offset += chunkSize;
+            file.length -= chunkSize;
+            info.http2->sendData(streamId, chunk, file.length == 0);
+            flushHttp2(socket, info);
+        }
+        if (file.length == 0 || isTruncated)
+            finishHttp2Transfer(info, streamId);
+    }
+    flushHttp2(socket, info);
 }
 
-void AbstractRestServer::sendConflict(QTcpSocket *socket, const QString &reason)
+void WorkerThread::onHttp2StreamChunk(quint32 slot, quint32 generation, quint32 streamId, const QByteArray &chunk,
+                                      bool isSuccessful)
 {
-    sendAnswer(socket, "", QStringLiteral("text/plain; charset=utf-8"), 409, reason);
+    if (!isAlive(slot, generation))
+        return;
+    QTcpSocket *socket = connectionSlot(slot)->socket;
+    auto infoIt = sockets.find(socket);
+    if (infoIt == sockets.end() || !infoIt->http2)
+        return;
+    SocketInfo &info = *infoIt;
+    auto transferIt = info.http2Transfers.find(streamId);
+    if (transferIt == info.http2Transfers.end())
+        return;
+    transferIt->chunkRequested = false;
+
+    // Status is already sent, so the only way to tell client about failure is to reset the stream
+    if (!isSuccessful) {
+        info.http2->resetStream(streamId, Http2Session::InternalError);
+        finishHttp2Transfer(info, streamId);
+    } else if (chunk.isEmpty()) {
+        info.http2->sendData(streamId, QByteArray(), true);
+        finishHttp2Transfer(info, streamId);
+    } else {
+        info.http2->sendData(streamId, chunk, false);
+    }
+    pumpHttp2Streams(socket, info);
+    updateTimeout(socket, info);
 }
 
-void AbstractRestServer::sendInternalError(QTcpSocket *socket)
+void WorkerThread::finishHttp2Transfer(SocketInfo &info, quint32 streamId)
 {
-    sendAnswer(socket, "", QStringLiteral("text/plain; charset=utf-8"), 500, QStringLiteral("Internal Server Error"));
+    const Http2Transfer transfer = info.http2Transfers.take(streamId);
+    if (transfer.pushQueue) {
+        transfer.pushQueue->abort();
+        --serverD->eventStreams;
+    }
+    addLatency(transfer.metrics, WritePhase, transfer.readyAt);
 }
 
-void AbstractRestServer::sendNotImplemented(QTcpSocket *socket, const QString &reason)
+void WorkerThread::cancelHttp2Stream(SocketInfo &info, quint32 streamId)
 {
-    sendAnswer(socket, "", QStringLiteral("text/plain; charset=utf-8"), 501, reason);
+    qCDebug(proofNetworkMiscLog) << "RestServer: HTTP/2 stream" << streamId << "is reset";
+    auto pendingIt = std::find_if(info.pendingResponses.begin(), info.pendingResponses.end(),
+                                  [streamId](const PendingResponse &pending) {
+                                      return pending.http2Stream == streamId;
+                                  });
+    if (pendingIt != info.pendingResponses.end()) {
+        serverD->releaseAdmission(pendingIt->admission);
+        if (pendingIt->pushQueue)
+            pendingIt->pushQueue->abort();
+        info.pendingResponses.erase(pendingIt);
+    }
+    if (info.http2Transfers.contains(streamId))
+        finishHttp2Transfer(info, streamId);
 }
 
-QStringList AbstractRestServerPrivate::makeMethodName(const QString &type, const QString &name)
+void WorkerThread::flushHttp2(QTcpSocket *socket, SocketInfo &info)
 {
-    QStringList splittedName = name.split(QStringLiteral("/"), QString::SkipEmptyParts);
-    bool isStartedWithPrefix = splittedName.size() >= splittedPathPrefix.size()
-                               && std::equal(splittedPathPrefix.cbegin(), splittedPathPrefix.cend(),
-                                             splittedName.cbegin(),
-                                             [](const QString &prefixPart, const QString &namePart) {
-                                                 return prefixPart == namePart.toLower();
-                                             });
-    if (!isStartedWithPrefix)
-        return QStringList();
-    splittedName.erase(splittedName.begin(), splittedName.begin() + splittedPathPrefix.size());
-    splittedName.prepend(type.toLower());
-    return splittedName;
+    const QByteArray output = info.http2->takeOutput();
+    if (!output.isEmpty()) {
+        socket->write(output);
+        serverD->bytesSent += static_cast<quint64>(output.size());
+    }
+    if (info.closing)
+        return;
+    if (info.http2->hasFailed()) {
+        qCDebug(proofNetworkMiscLog) << "RestServer: HTTP/2 error at socket" << socket << ":" << info.http2->error();
+        closeAfterResponse(socket, info);
+    } else if (info.http2->isGoingAway() && !info.http2->activeStreamsCount() && info.pendingResponses.empty()) {
+        closeAfterResponse(socket, info);
+    }
 }
 
-MethodNode *AbstractRestServerPrivate::findMethod(const QStringList &splittedMethod, QStringList &methodVariableParts)
+void WorkerThread::updateTimeout(QTcpSocket *socket, SocketInfo &info)
 {
-    if (splittedMethod.count() < 2)
-        return nullptr;
-
-    MethodNode *currentNode = &methodsTreeRoot;
-    int i = 0;
-    for (; i < splittedMethod.count(); ++i) {
-        QString loweredPart = splittedMethod[i].toLower();
-        if (!currentNode->contains(loweredPart))
-            break;
-        currentNode = &(*currentNode)[loweredPart];
+    TimeoutPhase phase = NoTimeout;
+    int timeout = 0;
+    if (socket->bytesToWrite() > 0) {
+        phase = WriteTimeout;
+        timeout = serverD->writeTimeout;
+    } else if (info.closing || info.stream || info.file.file || !info.pendingResponses.empty()
+               || !info.http2Transfers.isEmpty()) {
+        // Handlers and stream producers are not limited here, client can't stall them
+        phase = NoTimeout;
+    } else if (info.admissionChecked || (info.http2 && info.http2->activeStreamsCount() > 0)) {
+        phase = BodyTimeout;
+        timeout = serverD->bodyTimeout;
+    } else if (!info.requestsCount || !info.input.isEmpty() || !info.parser.isClean()) {
+        // First request is waited for since connect, so silent connections don't live forever
+        phase = HeadersTimeout;
+        timeout = serverD->headersTimeout;
+    } else {
+        phase = IdleTimeout;
+        timeout = serverD->keepAliveTimeout;
     }
 
-    QString methodName = (*currentNode);
-
-    if (!methodName.isEmpty()) {
-        QStringList partsForDecode = splittedMethod.mid(i);
-        for (QString &part : partsForDecode)
-            part = QString(QByteArray::fromPercentEncoding(part.toUtf8()));
-        methodVariableParts = partsForDecode;
-        return currentNode;
+    if (phase == NoTimeout || timeout <= 0) {
+        disarmTimeout(socket, info);
+        return;
     }
+    // Headers and idle deadlines are never extended by new data, it is exactly what slow clients rely on
+    if (phase == info.timeoutPhase && (phase == HeadersTimeout || phase == IdleTimeout))
+        return;
 
-    return nullptr;
+    info.timeoutPhase = phase;
+    info.timeoutDeadline = steadyClockMsecs() + timeout;
+    const int slot = static_cast<int>(((info.timeoutDeadline + TIMEOUT_WHEEL_TICK - 1) / TIMEOUT_WHEEL_TICK)
+                                      % TIMEOUT_WHEEL_SIZE);
+    if (slot == info.timeoutSlot)
+        return;
+    if (info.timeoutSlot >= 0)
+        timeoutWheel[static_cast<size_t>(info.timeoutSlot)].remove(socket);
+    timeoutWheel[static_cast<size_t>(slot)].insert(socket);
+    info.timeoutSlot = slot;
 }
 
-void AbstractRestServerPrivate::fillMethods()
+void WorkerThread::disarmTimeout(QTcpSocket *socket, SocketInfo &info)
 {
-    Q_Q(AbstractRestServer);
-    methodsTreeRoot.clear();
-    for (int i = 0; i < q->metaObject()->methodCount(); ++i) {
-        QMetaMethod method = q->metaObject()->method(i);
-        if (method.methodType() == QMetaMethod::Slot) {
-            QString currentMethod = QString(method.name());
-            if (currentMethod.startsWith(restMethodPrefix))
-                addMethodToTree(currentMethod, method.tag());
+    if (info.timeoutSlot >= 0)
+        timeoutWheel[static_cast<size_t>(info.timeoutSlot)].remove(socket);
+    info.timeoutSlot = -1;
+    info.timeoutPhase = NoTimeout;
+}
+
+void WorkerThread::checkTimeouts()
+{
+    const qint64 now = steadyClockMsecs();
+    const qint64 currentTick = now / TIMEOUT_WHEEL_TICK;
+    QVector<QTcpSocket *> expired;
+    for (qint64 tick = qMax(lastTimeoutTick + 1, currentTick - TIMEOUT_WHEEL_SIZE + 1); tick <= currentTick; ++tick) {
+        for (QTcpSocket *socket : qAsConst(timeoutWheel[static_cast<size_t>(tick % TIMEOUT_WHEEL_SIZE)])) {
+            auto infoIt = sockets.find(socket);
+            if (infoIt != sockets.end() && infoIt->timeoutDeadline <= now)
+                expired << socket;
         }
     }
+    lastTimeoutTick = currentTick;
+
+    for (QTcpSocket *socket : qAsConst(expired)) {
+        auto infoIt = sockets.find(socket);
+        if (infoIt == sockets.end())
+            continue;
+        const TimeoutPhase phase = infoIt->timeoutPhase;
+        ++serverD->timedOutConnections[static_cast<size_t>(phase)];
+        if (phase == IdleTimeout)
+            qCDebug(proofNetworkMiscLog) << "Closing idle keep-alive socket" << socket;
+        else
+            qCDebug(proofNetworkMiscLog) << "RestServer: socket" << socket << "timed out in phase" << phase;
+        disarmTimeout(socket, *infoIt);
+        infoIt->finishing = true;
+        infoIt->closing = true;
+        socket->abort();
+    }
 }
 
-void AbstractRestServerPrivate::addMethodToTree(const QString &realMethod, const QString &tag)
+void WorkerThread::startDraining()
 {
-    QString method = realMethod.mid(QString(restMethodPrefix).length());
-    for (int i = 0; i < method.length(); ++i) {
-        if (method[i].isUpper()) {
-            method[i] = method[i].toLower();
-            if (i > 0 && method[i - 1] != '_')
-                method.insert(i++, '-');
+    if (ProofObject::safeCall(this, &WorkerThread::startDraining))
+        return;
+    const auto allKeys = sockets.keys();
+    for (QTcpSocket *socket : allKeys) {
+        auto infoIt = sockets.find(socket);
+        if (infoIt == sockets.end())
+            continue;
+        SocketInfo &info = *infoIt;
+        // New streams are not accepted after GOAWAY, connection is closed when already opened ones are answered
+        if (info.http2) {
+            if (info.closing)
+                continue;
+            info.http2->goAway();
+            for (const auto &transfer : qAsConst(info.http2Transfers)) {
+                if (transfer.pushQueue)
+                    transfer.pushQueue->close();
+            }
+            flushHttp2(socket, info);
+            continue;
+        }
+        // Push clients are told to reconnect, hopefully to successor
+        if (info.pushQueue && !info.closing) {
+            info.finishing = true;
+            info.streamKeepAlive = false;
+            info.pushQueue->close(info.webSocket ? WebSocketCodec::encodeClose(WebSocketCodec::GoingAway)
+                                                 : QByteArray());
+            continue;
+        }
+        // Connections without any request yet and requests that are being received now are answered first,
+        // new requests get Connection: close anyway
+        if (info.closing || info.finishing || !info.requestsCount || !info.input.isEmpty() || !info.parser.isClean()
+            || info.admissionChecked) {
+            continue;
+        }
+        if (!info.pendingResponses.empty()) {
+            info.finishing = true;
+            info.pendingResponses.back().keepAlive = false;
+        } else if (info.stream) {
+            info.finishing = true;
+            info.streamKeepAlive = false;
+        } else if (info.file.file) {
+            info.finishing = true;
+            info.fileKeepAlive = false;
+        } else {
+            qCDebug(proofNetworkMiscLog) << "Closing idle keep-alive socket" << socket << "due to drain";
+            closeAfterResponse(socket, info);
         }
     }
+}
 
-    QStringList splittedMethod = method.split(QStringLiteral("_"));
-    Q_ASSERT(splittedMethod.count() >= 2);
+void WorkerThread::startAccepting(qintptr listenerDescriptor)
+{
+    if (Proof::ProofObject::safeCall(this, &WorkerThread::startAccepting, listenerDescriptor))
+        return;
+    stopAccepting();
+    this->listenerDescriptor = listenerDescriptor;
+    acceptNotifier = new QSocketNotifier(listenerDescriptor, QSocketNotifier::Read, this);
+    connect(acceptNotifier, &QSocketNotifier::activated, this, &WorkerThread::acceptConnections);
+    accepting = true;
+}
 
-    MethodNode *currentNode = &methodsTreeRoot;
-    for (int i = 0; i < splittedMethod.count(); ++i) {
-        if (!currentNode->contains(splittedMethod[i]))
-            (*currentNode)[splittedMethod[i]] = MethodNode();
-        currentNode = &(*currentNode)[splittedMethod[i]];
-    }
-    currentNode->setValue(realMethod);
-    currentNode->setTag(tag);
+void WorkerThread::stopAccepting()
+{
+    if (ProofObject::safeCall(this, &WorkerThread::stopAccepting, Proof::Call::Block))
+        return;
+    accepting = false;
+    if (!acceptNotifier)
+        return;
+    delete acceptNotifier;
+    acceptNotifier = nullptr;
+#ifdef Q_OS_LINUX
+    ::close(static_cast<int>(listenerDescriptor));
+#endif
+    listenerDescriptor = -1;
 }
 
-void AbstractRestServerPrivate::tryToCallMethod(QTcpSocket *socket, const QString &type, const QString &method,
-                                                const QStringList &headers, const QByteArray &body)
+void WorkerThread::acceptConnections()
 {
-    Q_Q(AbstractRestServer);
-    QStringList splittedByParamsMethod = method.split('?');
-    QStringList methodVariableParts;
-    QUrlQuery queryParams;
+#ifdef Q_OS_LINUX
+    // Kernel balances connections between SO_REUSEPORT listeners, so each worker accepts only its own share
+    for (int i = 0; i < ACCEPT_BATCH_SIZE; ++i) {
+        const int descriptor = ::accept4(static_cast<int>(listenerDescriptor), nullptr, nullptr,
+                                         SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (descriptor < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                qCWarning(proofNetworkMiscLog) << "RestServer: accept failed:" << qt_error_string(errno);
+            return;
+        }
+        qCDebug(proofNetworkMiscLog) << "Incoming connection with socket descriptor" << descriptor;
+        // Accepting worker is never retired, so reservation can't fail here
+        reserveSocket();
+        handleNewConnection(descriptor);
+    }
+#endif
+}
 
-    Q_ASSERT(splittedByParamsMethod.count());
-    if (splittedByParamsMethod.count() > 1)
-        queryParams = QUrlQuery(splittedByParamsMethod.at(1));
+void WorkerThread::stop()
+{
+    if (!ProofObject::safeCall(this, &WorkerThread::stop, Proof::Call::Block)) {
+        stopAccepting();
+        timeoutsTimer->stop();
+        const auto allKeys = sockets.keys();
+        for (QTcpSocket *socket : allKeys)
+            deleteSocket(socket);
+    }
+}
 
-    MethodNode *methodNode = findMethod(makeMethodName(type, splittedByParamsMethod.at(0)), methodVariableParts);
-    QString methodName = methodNode ? (*methodNode) : QString();
-    qCDebug(proofNetworkMiscLog) << "Request for" << method << "associated with" << methodName << "at socket" << socket;
+void WorkerThread::sendAnswer(const RestRequestHandle &request, const QByteArray &body, const QString &contentType,
+                              const QHash<QString, QString> &headers, int returnCode, const QString &reason)
+{
+    if (Proof::ProofObject::safeCall(this, &WorkerThread::sendAnswer, request, body, contentType, headers, returnCode,
+                                     reason)) {
+        return;
+    }
+    PendingResponse *pending = pendingResponse(request);
+    if (pending && returnCode == 200 && !pending->cacheTarget.key.isEmpty()) {
+        sendCachedAnswer(request, serverD->storeCachedResponse(pending->cacheTarget, body, contentType, headers));
+        return;
+    }
+    answer(request, body, RestChunkProducer(), FileBody(), contentType, headers, returnCode, reason);
+}
 
-    if (methodNode) {
-        bool isAuthenticationSuccessful = true;
-        if (authType == RestAuthType::Basic && methodNode->tag() != noAuthTag) {
-            QString encryptedAuth;
-            for (int i = 0; i < headers.count(); ++i) {
-                if (headers.at(i).startsWith(QLatin1String("Authorization"), Qt::CaseInsensitive)) {
-                    encryptedAuth = q->parseAuth(socket, headers.at(i));
-                    break;
-                }
-            }
-            isAuthenticationSuccessful = (!encryptedAuth.isEmpty() && q->checkBasicAuth(encryptedAuth));
-        }
-        if (isAuthenticationSuccessful) {
-            // clang-format off
-            QMetaObject::invokeMethod(q, methodName.toLatin1().constData(), Qt::DirectConnection,
-                                      Q_ARG(QTcpSocket*, socket), Q_ARG(QStringList, headers),
-                                      Q_ARG(QStringList, methodVariableParts), Q_ARG(QUrlQuery, queryParams),
-                                      Q_ARG(QByteArray, body));
-            // clang-format on
-        } else {
-            q->sendNotAuthorized(socket);
-        }
+void WorkerThread::sendCachedAnswer(const RestRequestHandle &request, const CachedResponse &cached)
+{
+    const PendingResponse *pending = pendingResponse(request);
+    if (!pending)
+        return;
+    QHash<QString, QString> headers = cached.headers;
+    headers[QStringLiteral("ETag")] = QString::fromLatin1(cached.eTag);
+    if (isETagMatched(pending->requestContext, cached.eTag)) {
+        answer(request, QByteArray(), RestChunkProducer(), FileBody(), cached.contentType, headers, 304,
+               QStringLiteral("Not Modified"));
     } else {
-        q->sendNotFound(socket, QStringLiteral("Wrong method"));
+        answer(request, cached.body, RestChunkProducer(), FileBody(), cached.contentType, headers, 200, QString());
     }
 }
 
-void AbstractRestServerPrivate::sendAnswer(QTcpSocket *socket, const QByteArray &body, const QString &contentType,
-                                           const QHash<QString, QString> &headers, int returnCode, const QString &reason)
+void WorkerThread::setCacheTarget(const RestRequestHandle &request, const CacheTarget &target)
 {
-    WorkerThread *worker = nullptr;
-    {
-        QMutexLocker lock(&socketsMutex);
-        if (sockets.contains(socket))
-            worker = qobject_cast<WorkerThread *>(socket->thread());
+    PendingResponse *pending = pendingResponse(request);
+    if (pending)
+        pending->cacheTarget = target;
+}
+
+void WorkerThread::sendStreamedAnswer(const RestRequestHandle &request, const RestChunkProducer &producer,
+                                      const QString &contentType, const QHash<QString, QString> &headers,
+                                      int returnCode, const QString &reason)
+{
+    if (Proof::ProofObject::safeCall(this, &WorkerThread::sendStreamedAnswer, request, producer, contentType, headers,
+                                     returnCode, reason)) {
+        return;
     }
-    if (worker != nullptr) {
-        qCDebug(proofNetworkMiscLog) << "Replying" << returnCode << ":" << reason << "at socket" << socket;
-        worker->sendAnswer(socket, body, contentType, headers, returnCode, reason);
-    } else {
-        qCDebug(proofNetworkMiscLog).noquote()
-            << "Wanted to reply" << returnCode << ":" << reason << "at socket"
-            << QStringLiteral("QTcpSocket(%1)").arg(reinterpret_cast<quint64>(socket), 0, 16)
-            << "but it is dead already";
+    answer(request, QByteArray(), producer, FileBody(), contentType, headers, returnCode, reason);
+}
+
+void WorkerThread::openEventStream(const RestRequestHandle &request, const std::shared_ptr<RestPushQueue> &queue,
+                                   const QHash<QString, QString> &headers)
+{
+    if (Proof::ProofObject::safeCall(this, &WorkerThread::openEventStream, request, queue, headers))
+        return;
+    PendingResponse *pending = pendingResponse(request);
+    if (!pending) {
+        queue->abort();
+        return;
     }
+    pending->pushQueue = queue;
+    QHash<QString, QString> eventHeaders = headers;
+    eventHeaders[QStringLiteral("Cache-Control")] = QStringLiteral("no-cache");
+    answer(request, QByteArray(), [queue]() { return queue->next(); }, FileBody(), QStringLiteral("text/event-stream"),
+           eventHeaders, 200, QString());
 }
 
-void AbstractRestServerPrivate::registerSocket(QTcpSocket *socket)
+void WorkerThread::acceptWebSocket(const RestRequestHandle &request, const std::shared_ptr<RestPushQueue> &queue,
+                                   const RestWebSocketHandler &handler)
 {
-    QMutexLocker lock(&socketsMutex);
-    sockets.insert(socket);
+    if (Proof::ProofObject::safeCall(this, &WorkerThread::acceptWebSocket, request, queue, handler))
+        return;
+    PendingResponse *pending = pendingResponse(request);
+    if (!pending) {
+        queue->abort();
+        return;
+    }
+
+    const RestRequestContext &context = pending->requestContext;
+    const QByteArray key = context.header(QLatin1String("Sec-WebSocket-Key"));
+    const bool isUpgrade = context.header(QLatin1String("Upgrade")).toLower() == "websocket"
+                           && context.header(QLatin1String("Connection")).toLower().contains("upgrade");
+    if (!isUpgrade || key.isEmpty() || pending->isHttp10 || context.method() != QLatin1String("GET")) {
+        queue->abort();
+        answer(request, QByteArray(), RestChunkProducer(), FileBody(), QStringLiteral("text/plain; charset=utf-8"),
+               QHash<QString, QString>(), 400, QStringLiteral("Bad Request"));
+        return;
+    }
+    if (context.header(QLatin1String("Sec-WebSocket-Version")) != "13") {
+        queue->abort();
+        answer(request, QByteArray(), RestChunkProducer(), FileBody(), QStringLiteral("text/plain; charset=utf-8"),
+               {{QStringLiteral("Sec-WebSocket-Version"), QStringLiteral("13")}}, 426,
+               QStringLiteral("Upgrade Required"));
+        return;
+    }
+
+    // Handshake doesn't fit answer() since there are neither content headers nor body
+    serverD->releaseAdmission(pending->admission);
+    pending->head = statusLine(101, QStringLiteral("Switching Protocols"));
+    pending->head.append("Upgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: ");
+    pending->head.append(WebSocketCodec::acceptKey(key));
+    pending->head.append("\r\n\r\n");
+    pending->producer = [queue]() { return queue->next(); };
+    pending->pushQueue = queue;
+    pending->webSocketHandler = handler;
+    pending->keepAlive = false;
+    pending->readyAt = steadyClockUsecs();
+    pending->ready = true;
+    addLatency(pending->metrics, HandlerPhase, pending->dispatchedAt);
+    if (pending->metrics)
+        pending->metrics->statusCounts[static_cast<size_t>(101 - MIN_STATUS_CODE)]++;
+    QTcpSocket *socket = connectionSlot(request.slot())->socket;
+    flushResponses(socket, sockets[socket]);
 }
 
-void AbstractRestServerPrivate::deleteSocket(QTcpSocket *socket, WorkerThread *worker)
+void WorkerThread::sendFile(const RestRequestHandle &request, const QString &filePath, const QString &contentType,
+                            const QHash<QString, QString> &headers)
 {
-    {
-        QMutexLocker lock(&socketsMutex);
-        auto iter = sockets.constFind(socket);
-        if (iter != sockets.cend())
-            sockets.erase(iter);
-        else
+    if (Proof::ProofObject::safeCall(this, &WorkerThread::sendFile, request, filePath, contentType, headers))
+        return;
+    const PendingResponse *pending = pendingResponse(request);
+    if (!pending)
+        return;
+
+    const QString plainText = QStringLiteral("text/plain; charset=utf-8");
+    FileBody body;
+    body.file.reset(new QFile(filePath));
+    if (!body.file->open(QIODevice::ReadOnly)) {
+        qCDebug(proofNetworkMiscLog) << "RestServer: can't open file" << filePath << ":" << body.file->errorString();
+        answer(request, QByteArray(), RestChunkProducer(), FileBody(), plainText, QHash<QString, QString>(), 404,
+               QStringLiteral("Not Found"));
+        return;
+    }
+
+    const qint64 fileSize = body.file->size();
+    const QDateTime lastModified = QFileInfo(*body.file).lastModified().toUTC();
+    const QString lastModifiedString = QString::fromLatin1(httpDate(lastModified));
+    const QString eTag = QStringLiteral("\"%1-%2\"").arg(fileSize, 0, 16).arg(lastModified.toSecsSinceEpoch(), 0, 16);
+    QHash<QString, QString> fileHeaders = headers;
+    fileHeaders[QStringLiteral("Last-Modified")] = lastModifiedString;
+    fileHeaders[QStringLiteral("ETag")] = eTag;
+    fileHeaders[QStringLiteral("Accept-Ranges")] = QStringLiteral("bytes");
+
+    const RestRequestContext &context = pending->requestContext;
+    const QString range = QString::fromLatin1(context.header(QLatin1String("Range")));
+    const QString ifRange = QString::fromLatin1(context.header(QLatin1String("If-Range")));
+    const bool hasIfNoneMatch = context.hasHeader(QLatin1String("If-None-Match"));
+    const QDateTime ifModifiedSince = context.hasHeader(QLatin1String("If-Modified-Since"))
+                                          ? parseHttpDate(QString::fromLatin1(
+                                                context.header(QLatin1String("If-Modified-Since"))))
+                                          : QDateTime();
+
+    // If-None-Match takes precedence over If-Modified-Since if both are present
+    const bool isNotModified = hasIfNoneMatch
+                                   ? isETagMatched(context, eTag.toLatin1())
+                                   : ifModifiedSince.isValid()
+                                         && lastModified.toSecsSinceEpoch() <= ifModifiedSince.toSecsSinceEpoch();
+    if (isNotModified) {
+        answer(request, QByteArray(), RestChunkProducer(), FileBody(), contentType, fileHeaders, 304,
+               QStringLiteral("Not Modified"));
+        return;
+    }
+
+    body.length = fileSize;
+    int returnCode = 200;
+    QString reason;
+    // Only single range is supported, range is ignored if file was changed since client got If-Range validator
+    const bool isRangeApplicable = range.startsWith(QLatin1String("bytes=")) && !range.contains(',')
+                                   && (ifRange.isEmpty() || ifRange == eTag || ifRange == lastModifiedString);
+    if (isRangeApplicable) {
+        const QStringRef spec = range.midRef(6).trimmed();
+        const int dashIndex = spec.indexOf('-');
+        bool isStartValid = false;
+        bool isEndValid = false;
+        qint64 start = dashIndex > 0 ? spec.left(dashIndex).toLongLong(&isStartValid) : -1;
+        qint64 end = dashIndex != -1 && dashIndex < spec.length() - 1 ? spec.mid(dashIndex + 1).toLongLong(&isEndValid)
+                                                                     : -1;
+        if (!isStartValid && !isEndValid) {
+            start = 0;
+            end = fileSize - 1;
+        } else if (!isStartValid) {
+            start = qMax(0ll, fileSize - end);
+            end = fileSize - 1;
+        } else if (!isEndValid || end >= fileSize) {
+            end = fileSize - 1;
+        }
+
+        if (start >= fileSize || start > end) {
+            fileHeaders[QStringLiteral("Content-Range")] = QStringLiteral("bytes */%1").arg(fileSize);
+            answer(request, QByteArray(), RestChunkProducer(), FileBody(), plainText, fileHeaders, 416,
+                   QStringLiteral("Range Not Satisfiable"));
             return;
+        }
+        if (start != 0 || end != fileSize - 1) {
+            body.offset = start;
+            body.length = end - start + 1;
+            returnCode = 206;
+            reason = QStringLiteral("Partial Content");
+            fileHeaders[QStringLiteral("Content-Range")] = QStringLiteral("bytes %1-%2/%3")
+                                                               .arg(start)
+                                                               .arg(end)
+                                                               .arg(fileSize);
+        }
     }
-    delete socket;
-    threadPoolLock.lockForRead();
-    auto iter = std::find_if(threadPool.begin(), threadPool.end(),
-                             [worker](const WorkerThreadInfo &info) { return info.thread == worker; });
-    if (iter != threadPool.end())
-        --iter->socketCount;
-    threadPoolLock.unlock();
+
+    answer(request, QByteArray(), RestChunkProducer(), body, contentType, fileHeaders, returnCode, reason);
 }
 
-WorkerThread::WorkerThread(Proof::AbstractRestServerPrivate *const serverD) : serverD(serverD)
+PendingResponse *WorkerThread::pendingResponse(const RestRequestHandle &request)
 {
-    moveToThread(this);
+    if (!isAlive(request.slot(), request.generation()))
+        return nullptr;
+    auto infoIt = sockets.find(connectionSlot(request.slot())->socket);
+    if (infoIt == sockets.end())
+        return nullptr;
+    const auto pendingIt = findPendingResponse(infoIt.key(), *infoIt, request.sequence());
+    return pendingIt == infoIt->pendingResponses.end() ? nullptr : &*pendingIt;
 }
 
-WorkerThread::~WorkerThread()
-{}
+std::deque<PendingResponse>::iterator WorkerThread::findPendingResponse(QTcpSocket *socket, SocketInfo &info,
+                                                                        quint64 sequence) const
+{
+    const auto end = info.pendingResponses.end();
+    if (sequence) {
+        return std::find_if(info.pendingResponses.begin(), end, [sequence](const PendingResponse &pending) {
+            return !pending.ready && pending.sequence == sequence;
+        });
+    }
+    // Answer by socket from outside of dispatch doesn't know its request, so it is taken only when there is no choice
+    const auto isWaiting = [](const PendingResponse &pending) { return !pending.ready; };
+    const auto pendingIt = std::find_if(info.pendingResponses.begin(), end, isWaiting);
+    if (pendingIt != end && std::find_if(std::next(pendingIt), end, isWaiting) != end) {
+        qCWarning(proofNetworkMiscLog) << "RestServer: several requests are waiting for answer at socket" << socket
+                                       << ", answer by socket is refused. RestRequestHandle should be used instead";
+        return end;
+    }
+    return pendingIt;
+}
 
-void WorkerThread::handleNewConnection(qintptr socketDescriptor)
+void WorkerThread::answer(const RestRequestHandle &request, const QByteArray &body, const RestChunkProducer &producer,
+                          const FileBody &file, const QString &contentType, const QHash<QString, QString> &headers,
+                          int returnCode, const QString &reason)
 {
-    if (Proof::ProofObject::safeCall(this, &WorkerThread::handleNewConnection, socketDescriptor))
+    if (!isAlive(request.slot(), request.generation()))
         return;
+    QTcpSocket *socket = connectionSlot(request.slot())->socket;
+    auto infoIt = sockets.find(socket);
+    if (infoIt == sockets.end() || socket->state() != QTcpSocket::ConnectedState)
+        return;
+    SocketInfo &info = *infoIt;
 
-    QTcpSocket *tcpSocket = new QTcpSocket();
-    serverD->registerSocket(tcpSocket);
-    SocketInfo info;
-    info.readyReadConnection = connect(tcpSocket, &QTcpSocket::readyRead, this,
-                                       [tcpSocket, this] { onReadyRead(tcpSocket); }, Qt::QueuedConnection);
+    auto pendingIt = findPendingResponse(socket, info, request.sequence());
+    if (pendingIt == info.pendingResponses.end()) {
+        qCDebug(proofNetworkMiscLog) << "No request is waiting for answer at socket" << socket << ", reply"
+                                     << returnCode << "dropped";
+        return;
+    }
 
-    void (QTcpSocket::*errorSignal)(QAbstractSocket::SocketError) = &QTcpSocket::error;
-    info.errorConnection = connect(tcpSocket, errorSignal, this,
-                                   [tcpSocket] {
-                                       qCWarning(proofNetworkMiscLog)
-                                           << "RestServer: socket error:" << tcpSocket->errorString();
-                                   },
-                                   Qt::QueuedConnection);
+    serverD->releaseAdmission(pendingIt->admission);
 
-    info.disconnectConnection = connect(tcpSocket, &QTcpSocket::disconnected, this,
-                                        [tcpSocket, this] { deleteSocket(tcpSocket); }, Qt::QueuedConnection);
+    const uint actualCommonHeadersVersion = serverD->commonHeadersVersion;
+    if (commonHeadersVersion != actualCommonHeadersVersion) {
+        commonHeaders = serverD->encodedCommonHeaders();
+        commonHeadersVersion = actualCommonHeadersVersion;
+        http2CommonHeaders.clear();
+        const auto lines = commonHeaders.split('\n');
+        for (const QByteArray &line : lines) {
+            const int colonIndex = line.indexOf(':');
+            if (colonIndex > 0)
+                http2CommonHeaders << qMakePair(line.left(colonIndex).toLower(), line.mid(colonIndex + 1).trimmed());
+        }
+    }
 
-    if (!tcpSocket->setSocketDescriptor(socketDescriptor)) {
-        qCWarning(proofNetworkMiscLog) << "RestServer: can't create socket, error:" << tcpSocket->errorString();
-        serverD->deleteSocket(tcpSocket, this);
+    // HTTP/1.0 clients don't support chunked encoding, streamed answer is delimited by connection close for them
+    const bool isStreamed = static_cast<bool>(producer);
+    if (isStreamed && pendingIt->isHttp10)
+        pendingIt->keepAlive = false;
+
+    // Answer is compressed only if it is big enough to make it worth and if handler didn't encode it already
+    QByteArray encodedBody = body;
+    ContentEncoding encoding = ContentEncoding::Identity;
+    const int compressionLevel = serverD->compressionLevel;
+    const bool isCompressible = compressionLevel > 0 && pendingIt->compressionAllowed && !isStreamed
+                                && !hasHeader(headers, QStringLiteral("Content-Encoding"));
+    // Representation of compressible route depends on Accept-Encoding even if this answer is not compressed
+    const bool isVaryNeeded = isCompressible && !hasHeader(headers, QStringLiteral("Vary"));
+    if (isCompressible && body.size() >= serverD->compressionMinSize) {
+        encoding = acceptedEncoding(pendingIt->requestContext);
+        if (encoding != ContentEncoding::Identity) {
+            encodedBody = compressBody(body, encoding, compressionLevel);
+            if (encodedBody.isEmpty() || encodedBody.size() >= body.size()) {
+                encodedBody = body;
+                encoding = ContentEncoding::Identity;
+            }
+        }
+    }
+
+    const QByteArray encodedContentType = contentType.toUtf8();
+    const QByteArray contentLength = QByteArray::number(file.file ? file.length : encodedBody.size());
+    if (pendingIt->http2Stream) {
+        HttpHeaderFields fields;
+        fields.reserve(http2CommonHeaders.size() + headers.size() + 5);
+        fields << qMakePair(QByteArrayLiteral(":status"), QByteArray::number(returnCode));
+        fields << http2CommonHeaders;
+        fields << qMakePair(QByteArrayLiteral("content-type"), encodedContentType);
+        if (!isStreamed && returnCode != 304)
+            fields << qMakePair(QByteArrayLiteral("content-length"), contentLength);
+        if (encoding != ContentEncoding::Identity) {
+            fields << qMakePair(QByteArrayLiteral("content-encoding"),
+                                encoding == ContentEncoding::Gzip ? QByteArrayLiteral("gzip")
+                                                                  : QByteArrayLiteral("deflate"));
+        }
+        if (isVaryNeeded)
+            fields << qMakePair(QByteArrayLiteral("vary"), QByteArrayLiteral("Accept-Encoding"));
+        for (auto it = headers.cbegin(); it != headers.cend(); ++it) {
+            const QByteArray name = it.key().toUtf8().toLower();
+            // Connection-specific headers are forbidden in HTTP/2
+            if (name != "connection" && name != "keep-alive" && name != "transfer-encoding" && name != "upgrade")
+                fields << qMakePair(name, it.value().toUtf8());
+        }
+        addLatency(pendingIt->metrics, HandlerPhase, pendingIt->dispatchedAt);
+        if (pendingIt->metrics && returnCode >= MIN_STATUS_CODE && returnCode <= MAX_STATUS_CODE)
+            pendingIt->metrics->statusCounts[static_cast<size_t>(returnCode - MIN_STATUS_CODE)]++;
+        answerHttp2(socket, info, pendingIt, fields, returnCode == 304 ? QByteArray() : encodedBody, producer,
+                    returnCode == 304 ? FileBody() : file);
         return;
     }
-    sockets[tcpSocket] = info;
-    qCDebug(proofNetworkMiscLog) << "Handling socket descriptor" << socketDescriptor << "with socket" << tcpSocket;
+
+    const QByteArray status = statusLine(returnCode, reason);
+    QByteArray &head = pendingIt->head;
+    head.reserve(status.size() + commonHeaders.size() + encodedContentType.size() + contentLength.size() + 80
+                 + headers.size() * 64);
+    head.append(status);
+    head.append(commonHeaders);
+    head.append(pendingIt->keepAlive ? "Connection: keep-alive\r\n" : "Connection: close\r\n");
+    head.append("Content-Type: ").append(encodedContentType).append("\r\n");
+    // 304 has neither body nor any framing headers, next response follows its head right away
+    if (!isStreamed && returnCode != 304)
+        head.append("Content-Length: ").append(contentLength).append("\r\n");
+    else if (isStreamed && !pendingIt->isHttp10)
+        head.append("Transfer-Encoding: chunked\r\n");
+    if (encoding != ContentEncoding::Identity)
+        head.append(encoding == ContentEncoding::Gzip ? "Content-Encoding: gzip\r\n" : "Content-Encoding: deflate\r\n");
+    if (isVaryNeeded)
+        head.append("Vary: Accept-Encoding\r\n");
+    for (auto it = headers.cbegin(); it != headers.cend(); ++it)
+        head.append(it.key().toUtf8()).append(": ").append(it.value().toUtf8()).append("\r\n");
+    head.append("\r\n");
+    pendingIt->body = returnCode == 304 ? QByteArray() : encodedBody;
+    pendingIt->producer = producer;
+    pendingIt->file = returnCode == 304 ? FileBody() : file;
+    pendingIt->readyAt = steadyClockUsecs();
+    pendingIt->ready = true;
+    addLatency(pendingIt->metrics, HandlerPhase, pendingIt->dispatchedAt);
+    if (pendingIt->metrics && returnCode >= MIN_STATUS_CODE && returnCode <= MAX_STATUS_CODE)
+        pendingIt->metrics->statusCounts[static_cast<size_t>(returnCode - MIN_STATUS_CODE)]++;
+    flushResponses(socket, info);
 }
 
-void WorkerThread::deleteSocket(QTcpSocket *socket)
+QByteArray statusLine(int code, const QString &reason)
 {
-    sockets.remove(socket);
-    serverD->deleteSocket(socket, this);
+    static const QHash<int, QPair<QString, QByteArray>> predefinedLines = [] {
+        const QVector<QPair<int, QByteArray>> reasons = {{200, "OK"},
+                                                         {201, "Created"},
+                                                         {202, "Accepted"},
+                                                         {204, "No Content"},
+                                                         {206, "Partial Content"},
+                                                         {301, "Moved Permanently"},
+                                                         {302, "Found"},
+                                                         {304, "Not Modified"},
+                                                         {400, "Bad Request"},
+                                                         {401, "Unauthorized"},
+                                                         {403, "Forbidden"},
+                                                         {404, "Not Found"},
+                                                         {405, "Method Not Allowed"},
+                                                         {408, "Request Timeout"},
+                                                         {409, "Conflict"},
+                                                         {413, "Payload Too Large"},
+                                                         {416, "Range Not Satisfiable"},
+                                                         {429, "Too Many Requests"},
+                                                         {431, "Request Header Fields Too Large"},
+                                                         {500, "Internal Server Error"},
+                                                         {501, "Not Implemented"},
+                                                         {503, "Service Unavailable"}};
+        QHash<int, QPair<QString, QByteArray>> result;
+        for (const auto &reason : reasons) {
+            result[reason.first] = qMakePair(QString::fromLatin1(reason.second),
+                                             QByteArray("HTTP/1.1 " + QByteArray::number(reason.first) + ' '
+                                                        + reason.second + "\r\n"));
+        }
+        return result;
+    }();
+
+    auto predefined = predefinedLines.constFind(code);
+    if (predefined != predefinedLines.cend() && (reason.isEmpty() || reason == predefined->first))
+        return predefined->second;
+    return "HTTP/1.1 " + QByteArray::number(code) + ' ' + reason.toUtf8() + "\r\n";
 }
 
-void WorkerThread::onReadyRead(QTcpSocket *socket)
+void writeResponse(QTcpSocket *socket, const QByteArray &head, const QByteArray &body)
 {
-    SocketInfo &info = sockets[socket];
-    HttpParser::Result result = info.parser.parseNextPart(socket->readAll());
-    switch (result) {
-    case HttpParser::Result::Success:
-        disconnect(info.readyReadConnection);
-        serverD->tryToCallMethod(socket, info.parser.method(), info.parser.uri(), info.parser.headers(),
-                                 info.parser.body());
-        break;
-    case HttpParser::Result::Error:
-        qCWarning(proofNetworkMiscLog) << "RestServer: parse error:" << info.parser.error();
-        disconnect(info.readyReadConnection);
-        sendAnswer(socket, "", QStringLiteral("text/plain; charset=utf-8"), QHash<QString, QString>(), 400,
-                   QStringLiteral("Bad Request"));
-        break;
-    case HttpParser::Result::NeedMore:
-        break;
+#ifdef Q_OS_LINUX
+    // Socket buffer is empty, so head and body can be written directly by single syscall without copying them
+    if (socket->bytesToWrite() == 0) {
+        iovec chunks[2];
+        chunks[0].iov_base = const_cast<char *>(head.constData());
+        chunks[0].iov_len = static_cast<size_t>(head.size());
+        chunks[1].iov_base = const_cast<char *>(body.constData());
+        chunks[1].iov_len = static_cast<size_t>(body.size());
+        msghdr message = {};
+        message.msg_iov = chunks;
+        message.msg_iovlen = body.isEmpty() ? 1 : 2;
+        qint64 written = ::sendmsg(static_cast<int>(socket->socketDescriptor()), &message, MSG_NOSIGNAL);
+        if (written < 0)
+            written = 0;
+        if (written < head.size()) {
+            socket->write(head.constData() + written, head.size() - written);
+            socket->write(body);
+        } else if (written - head.size() < body.size()) {
+            socket->write(body.constData() + (written - head.size()), body.size() - (written - head.size()));
+        }
+        return;
     }
+#endif
+    socket->write(head);
+    socket->write(body);
 }
 
-void WorkerThread::stop()
+QByteArray httpDate(const QDateTime &dateTime)
 {
-    if (!ProofObject::safeCall(this, &WorkerThread::stop, Proof::Call::Block)) {
-        const auto allKeys = sockets.keys();
-        for (QTcpSocket *socket : allKeys)
-            deleteSocket(socket);
+    return QLocale::c().toString(dateTime.toUTC(), QStringLiteral("ddd, dd MMM yyyy hh:mm:ss 'GMT'")).toLatin1();
+}
+
+QDateTime parseHttpDate(const QString &value)
+{
+    QDateTime result = QLocale::c().toDateTime(value, QStringLiteral("ddd, dd MMM yyyy hh:mm:ss 'GMT'"));
+    result.setTimeSpec(Qt::UTC);
+    return result;
+}
+
+bool isETagMatched(const Proof::RestRequestContext &context, const QByteArray &eTag)
+{
+    // If-None-Match uses weak comparison, so W/ prefix doesn't matter at either side
+    const auto opaqueTag = [](const QByteArray &tag) { return tag.startsWith("W/") ? tag.mid(2) : tag; };
+    const QByteArray expectedTag = opaqueTag(eTag);
+    const auto values = context.headerValues(QLatin1String("If-None-Match"));
+    for (const QByteArray &value : values) {
+        const auto tags = value.split(',');
+        for (const QByteArray &tag : tags) {
+            const QByteArray trimmedTag = tag.trimmed();
+            if (trimmedTag == "*" || opaqueTag(trimmedTag) == expectedTag)
+                return true;
+        }
     }
+    return false;
 }
 
-void WorkerThread::sendAnswer(QTcpSocket *socket, const QByteArray &body, const QString &contentType,
-                              const QHash<QString, QString> &headers, int returnCode, const QString &reason)
+ContentEncoding acceptedEncoding(const Proof::RestRequestContext &context)
 {
-    if (Proof::ProofObject::safeCall(this, &WorkerThread::sendAnswer, socket, body, contentType, headers, returnCode,
-                                     reason)) {
-        return;
+    // -1 means coding is not mentioned, explicit q of coding always wins over wildcard
+    double gzipQuality = -1.0;
+    double deflateQuality = -1.0;
+    double wildcardQuality = -1.0;
+    const auto values = context.headerValues(QLatin1String("Accept-Encoding"));
+    for (const QByteArray &value : values) {
+        const auto codings = value.split(',');
+        for (const QByteArray &coding : codings) {
+            const auto parts = coding.split(';');
+            const QByteArray name = parts.first().trimmed();
+            if (name.isEmpty())
+                continue;
+            double quality = 1.0;
+            for (int i = 1; i < parts.count(); ++i) {
+                const QByteArray param = parts[i].trimmed();
+                if (qstrnicmp(param.constData(), "q=", 2) == 0)
+                    quality = param.mid(2).toDouble();
+            }
+            if (qstricmp(name.constData(), "gzip") == 0 || qstricmp(name.constData(), "x-gzip") == 0)
+                gzipQuality = quality;
+            else if (qstricmp(name.constData(), "deflate") == 0)
+                deflateQuality = quality;
+            else if (name == "*")
+                wildcardQuality = quality;
+        }
     }
+    if (gzipQuality < 0.0)
+        gzipQuality = wildcardQuality;
+    if (deflateQuality < 0.0)
+        deflateQuality = wildcardQuality;
+    return gzipQuality > 0.0 ? ContentEncoding::Gzip
+                             : deflateQuality > 0.0 ? ContentEncoding::Deflate : ContentEncoding::Identity;
+}
 
-    if (sockets.contains(socket) && socket->state() == QTcpSocket::ConnectedState) {
-        QStringList additionalHeadersList;
-        additionalHeadersList << QStringLiteral("Proof-Application: %1").arg(proofApp->prettifiedApplicationName());
-        additionalHeadersList << QStringLiteral("Proof-%1-Version: %2")
-                                     .arg(proofApp->prettifiedApplicationName(), qApp->applicationVersion());
-        additionalHeadersList << QStringLiteral("Proof-%1-Framework-Version: %2")
-                                     .arg(proofApp->prettifiedApplicationName(), Proof::proofVersion());
-        for (auto it = serverD->customHeaders.cbegin(); it != serverD->customHeaders.cend(); ++it)
-            additionalHeadersList << QStringLiteral("%1: %2").arg(it.key(), it.value());
-        for (auto it = headers.cbegin(); it != headers.cend(); ++it)
-            additionalHeadersList << QStringLiteral("%1: %2").arg(it.key(), it.value());
-        QString additionalHeaders = additionalHeadersList.join(QStringLiteral("\r\n")) + "\r\n";
-
-        //TODO: Add support for keep-alive
-        socket->write(QStringLiteral("HTTP/1.1 %1 %2\r\n"
-                                     "Server: proof\r\n"
-                                     "Connection: closed\r\n"
-                                     "Content-Type: %3\r\n"
-                                     "%4"
-                                     "%5"
-                                     "\r\n")
-                          .arg(QString::number(returnCode), reason, contentType,
-                               !body.isEmpty() ? QStringLiteral("Content-Length: %1\r\n").arg(body.size()) : QString(),
-                               additionalHeaders)
-                          .toUtf8());
-
-        socket->write(body);
-        connect(socket, &QTcpSocket::bytesWritten, this, [socket] {
-            if (socket->bytesToWrite() == 0)
-                socket->disconnectFromHost();
-        });
+ContentEncoding contentEncoding(const Proof::RestRequestContext &context)
+{
+    if (!context.hasHeader(QLatin1String("Content-Encoding")))
+        return ContentEncoding::Identity;
+    const QByteArray value = context.header(QLatin1String("Content-Encoding"));
+    if (value.isEmpty() || qstricmp(value.constData(), "identity") == 0)
+        return ContentEncoding::Identity;
+    if (qstricmp(value.constData(), "gzip") == 0 || qstricmp(value.constData(), "x-gzip") == 0)
+        return ContentEncoding::Gzip;
+    if (qstricmp(value.constData(), "deflate") == 0)
+        return ContentEncoding::Deflate;
+    return ContentEncoding::Unsupported;
+}
+
+QByteArray compressBody(const QByteArray &body, ContentEncoding encoding, int level)
+{
+    z_stream stream = {};
+    // 16 added to window bits tells zlib to write gzip wrapper instead of zlib one
+    const int windowBits = encoding == ContentEncoding::Gzip ? MAX_WBITS + 16 : MAX_WBITS;
+    if (deflateInit2(&stream, level, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return QByteArray();
+    QByteArray result(static_cast<int>(deflateBound(&stream, static_cast<uLong>(body.size()))), Qt::Uninitialized);
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(body.constData()));
+    stream.avail_in = static_cast<uInt>(body.size());
+    stream.next_out = reinterpret_cast<Bytef *>(result.data());
+    stream.avail_out = static_cast<uInt>(result.size());
+    const int status = deflate(&stream, Z_FINISH);
+    deflateEnd(&stream);
+    if (status != Z_STREAM_END)
+        return QByteArray();
+    result.resize(static_cast<int>(stream.total_out));
+    return result;
+}
+
+DecodeResult decompressBody(const QByteArray &body, qint64 maxSize, QByteArray &result)
+{
+    z_stream stream = {};
+    // 32 added to window bits enables automatic detection of gzip and zlib wrappers
+    if (inflateInit2(&stream, MAX_WBITS + 32) != Z_OK)
+        return DecodeResult::Malformed;
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(body.constData()));
+    stream.avail_in = static_cast<uInt>(body.size());
+    result.clear();
+    int status = Z_OK;
+    bool isTooLarge = false;
+    char buffer[16 * 1024];
+    while (status == Z_OK) {
+        stream.next_out = reinterpret_cast<Bytef *>(buffer);
+        stream.avail_out = sizeof(buffer);
+        status = inflate(&stream, Z_NO_FLUSH);
+        if (status != Z_OK && status != Z_STREAM_END)
+            break;
+        const int decodedSize = static_cast<int>(sizeof(buffer) - stream.avail_out);
+        if (result.size() + decodedSize > maxSize) {
+            isTooLarge = true;
+            break;
+        }
+        result.append(buffer, decodedSize);
+        if (status == Z_OK && !stream.avail_in && stream.avail_out)
+            status = Z_DATA_ERROR;
     }
+    inflateEnd(&stream);
+    if (isTooLarge)
+        return DecodeResult::TooLarge;
+    return status == Z_STREAM_END ? DecodeResult::Decoded : DecodeResult::Malformed;
 }
 
-MethodNode::MethodNode()
-{}
+bool hasHeader(const QHash<QString, QString> &headers, const QString &name)
+{
+    for (auto it = headers.cbegin(); it != headers.cend(); ++it) {
+        if (it.key().compare(name, Qt::CaseInsensitive) == 0)
+            return true;
+    }
+    return false;
+}
+
+QByteArray encodeOverloadedResponse(int retryAfter)
+{
+    return "HTTP/1.1 503 Service Unavailable\r\nServer: proof\r\nRetry-After: " + QByteArray::number(retryAfter)
+           + "\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+}
 
-bool MethodNode::contains(const QString &name) const
+qint64 steadyClockMsecs()
 {
-    return m_nodes.contains(name);
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
 }
 
-void MethodNode::clear()
+qint64 steadyClockUsecs()
 {
-    m_nodes.clear();
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
 }
 
-MethodNode::operator QString() const
+void addLatency(const std::shared_ptr<RouteMetrics> &metrics, LatencyPhase phase, qint64 startedAt)
 {
-    return m_value;
+    if (metrics && startedAt)
+        metrics->latencies[phase].add(steadyClockUsecs() - startedAt);
+}
+
+QByteArray prometheusLabel(const QString &value)
+{
+    QByteArray result = value.toUtf8();
+    result.replace('\\', "\\\\").replace('"', "\\\"").replace('\n', "\\n");
+    return result;
+}
+
+qintptr createListeningSocket(const ListenOptions &options)
+{
+#ifdef Q_OS_LINUX
+    int descriptor = ::socket(AF_INET6, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    const bool isIpv6 = descriptor >= 0;
+    if (!isIpv6)
+        descriptor = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (descriptor < 0) {
+        qCWarning(proofNetworkMiscLog) << "RestServer: can't create listening socket:" << qt_error_string(errno);
+        return -1;
+    }
+
+    const int enabled = 1;
+    const int disabled = 0;
+    ::setsockopt(descriptor, SOL_SOCKET, SO_REUSEADDR, &enabled, sizeof(enabled));
+    if (isIpv6)
+        ::setsockopt(descriptor, IPPROTO_IPV6, IPV6_V6ONLY, &disabled, sizeof(disabled));
+    if (options.reusePort && ::setsockopt(descriptor, SOL_SOCKET, SO_REUSEPORT, &enabled, sizeof(enabled)) != 0) {
+        qCWarning(proofNetworkMiscLog) << "RestServer: can't set SO_REUSEPORT:" << qt_error_string(errno);
+        ::close(descriptor);
+        return -1;
+    }
+    if (options.deferAcceptTimeout > 0
+        && ::setsockopt(descriptor, IPPROTO_TCP, TCP_DEFER_ACCEPT, &options.deferAcceptTimeout,
+                        sizeof(options.deferAcceptTimeout))
+               != 0) {
+        qCWarning(proofNetworkMiscLog) << "RestServer: can't set TCP_DEFER_ACCEPT:" << qt_error_string(errno);
+    }
+    if (options.fastOpenQueueLength > 0
+        && ::setsockopt(descriptor, IPPROTO_TCP, TCP_FASTOPEN, &options.fastOpenQueueLength,
+                        sizeof(options.fastOpenQueueLength))
+               != 0) {
+        qCWarning(proofNetworkMiscLog) << "RestServer: can't set TCP_FASTOPEN:" << qt_error_string(errno);
+    }
+
+    int bindResult;
+    if (isIpv6) {
+        sockaddr_in6 address = {};
+        address.sin6_family = AF_INET6;
+        address.sin6_addr = in6addr_any;
+        address.sin6_port = htons(options.port);
+        bindResult = ::bind(descriptor, reinterpret_cast<sockaddr *>(&address), sizeof(address));
+    } else {
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        address.sin_port = htons(options.port);
+        bindResult = ::bind(descriptor, reinterpret_cast<sockaddr *>(&address), sizeof(address));
+    }
+    if (bindResult != 0 || ::listen(descriptor, options.backlog) != 0) {
+        qCWarning(proofNetworkMiscLog) << "RestServer: can't listen on port" << options.port << ":"
+                                       << qt_error_string(errno);
+        ::close(descriptor);
+        return -1;
+    }
+    return descriptor;
+#else
+    Q_UNUSED(options)
+    return -1;
+#endif
 }
 
-MethodNode &MethodNode::operator[](const QString &name)
+qintptr createUnixListeningSocket(const QString &path, int backlog)
 {
-    return m_nodes[name];
+#ifdef Q_OS_LINUX
+    const QByteArray encodedPath = QFile::encodeName(path);
+    sockaddr_un address = {};
+    if (encodedPath.isEmpty() || static_cast<size_t>(encodedPath.size()) >= sizeof(address.sun_path)) {
+        qCWarning(proofNetworkMiscLog) << "RestServer: unix socket path" << path << "is too long";
+        return -1;
+    }
+    const int descriptor = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (descriptor < 0) {
+        qCWarning(proofNetworkMiscLog) << "RestServer: can't create unix socket:" << qt_error_string(errno);
+        return -1;
+    }
+    // Socket file left by previous run (or by process we are replacing) would make bind fail
+    if (unixSocketFileId(path))
+        ::unlink(encodedPath.constData());
+
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, encodedPath.constData(), static_cast<size_t>(encodedPath.size()));
+    if (::bind(descriptor, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0
+        || ::listen(descriptor, backlog) != 0) {
+        qCWarning(proofNetworkMiscLog) << "RestServer: can't listen on unix socket" << path << ":"
+                                       << qt_error_string(errno);
+        ::close(descriptor);
+        return -1;
+    }
+    return descriptor;
+#else
+    Q_UNUSED(path)
+    Q_UNUSED(backlog)
+    qCWarning(proofNetworkMiscLog) << "RestServer: unix socket listening is not supported on this platform";
+    return -1;
+#endif
 }
 
-void MethodNode::setValue(const QString &value)
+quint64 unixSocketFileId(const QString &path)
 {
-    m_value = value;
+#ifdef Q_OS_LINUX
+    struct stat fileInfo = {};
+    if (::lstat(QFile::encodeName(path).constData(), &fileInfo) != 0 || !S_ISSOCK(fileInfo.st_mode))
+        return 0;
+    return static_cast<quint64>(fileInfo.st_ino);
+#else
+    Q_UNUSED(path)
+    return 0;
+#endif
 }
 
-QString MethodNode::tag() const
+void RestRouteTable::addRoute(const QList<QByteArray> &segments, const RestRoute &route)
 {
-    return m_tag;
+    const int index = m_table.addRoute(segments);
+    if (index < m_routes.count()) {
+        qCWarning(proofNetworkMiscLog) << "RestServer:" << m_routes[index].name << "is overridden by" << route.name;
+        m_routes[index] = route;
+    } else {
+        m_routes << route;
+    }
 }
 
-void MethodNode::setTag(const QString &tag)
+const RestRoute *RestRouteTable::find(const QString &verb, const QStringRef &path, PathParameters &parameters) const
 {
-    m_tag = tag;
+    const int index = m_table.find(verb, path, parameters);
+    return index == -1 ? nullptr : &m_routes[index];
 }
 
 #include "abstractrestserver.moc"
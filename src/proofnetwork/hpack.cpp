@@ -0,0 +1,353 @@
+/* Copyright 2018, OpenSoft Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright notice, this list of
+ * conditions and the following disclaimer in the documentation and/or other materials provided
+ * with the distribution.
+ *     * Neither the name of OpenSoft Inc. nor the names of its contributors may be used to endorse
+ * or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include "proofnetwork/hpack_p.h"
+
+#include <QHash>
+
+#include <vector>
+
+using namespace Proof;
+
+namespace {
+// Each entry of dynamic table takes its name, value and this overhead of table size
+constexpr int ENTRY_OVERHEAD = 32;
+constexpr int STATIC_TABLE_SIZE = 61;
+constexpr quint32 MAX_DECODED_INTEGER = 0x7FFFFFFF;
+constexpr int EOS_SYMBOL = 256;
+
+struct StaticEntry
+{
+    const char *name;
+    const char *value;
+};
+
+const StaticEntry STATIC_TABLE[STATIC_TABLE_SIZE] = {
+    {":authority", ""}, {":method", "GET"}, {":method", "POST"}, {":path", "/"}, {":path", "/index.html"},
+    {":scheme", "http"}, {":scheme", "https"}, {":status", "200"}, {":status", "204"}, {":status", "206"},
+    {":status", "304"}, {":status", "400"}, {":status", "404"}, {":status", "500"}, {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"}, {"accept-language", ""}, {"accept-ranges", ""}, {"accept", ""},
+    {"access-control-allow-origin", ""}, {"age", ""}, {"allow", ""}, {"authorization", ""}, {"cache-control", ""},
+    {"content-disposition", ""}, {"content-encoding", ""}, {"content-language", ""}, {"content-length", ""},
+    {"content-location", ""}, {"content-range", ""}, {"content-type", ""}, {"cookie", ""}, {"date", ""},
+    {"etag", ""}, {"expect", ""}, {"expires", ""}, {"from", ""}, {"host", ""}, {"if-match", ""},
+    {"if-modified-since", ""}, {"if-none-match", ""}, {"if-range", ""}, {"if-unmodified-since", ""},
+    {"last-modified", ""}, {"link", ""}, {"location", ""}, {"max-forwards", ""}, {"proxy-authenticate", ""},
+    {"proxy-authorization", ""}, {"range", ""}, {"referer", ""}, {"refresh", ""}, {"retry-after", ""},
+    {"server", ""}, {"set-cookie", ""}, {"strict-transport-security", ""}, {"transfer-encoding", ""},
+    {"user-agent", ""}, {"vary", ""}, {"via", ""}, {"www-authenticate", ""}
+};
+
+struct HuffmanCode
+{
+    quint32 code;
+    int length;
+};
+
+// RFC 7541 Appendix B, indexed by symbol
+const HuffmanCode HUFFMAN_CODES[EOS_SYMBOL + 1] = {
+    {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28}, {0xfffffe4, 28}, {0xfffffe5, 28},
+    {0xfffffe6, 28}, {0xfffffe7, 28}, {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+    {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28}, {0xfffffed, 28}, {0xfffffee, 28},
+    {0xfffffef, 28}, {0xffffff0, 28}, {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+    {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28}, {0xffffff8, 28}, {0xffffff9, 28},
+    {0xffffffa, 28}, {0xffffffb, 28}, {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12}, {0x1ff9, 13}, {0x15, 6},
+    {0xf8, 8}, {0x7fa, 11}, {0x3fa, 10}, {0x3fb, 10}, {0xf9, 8}, {0x7fb, 11}, {0xfa, 8}, {0x16, 6}, {0x17, 6},
+    {0x18, 6}, {0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6}, {0x1a, 6}, {0x1b, 6}, {0x1c, 6}, {0x1d, 6}, {0x1e, 6},
+    {0x1f, 6}, {0x5c, 7}, {0xfb, 8}, {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10}, {0x1ffa, 13}, {0x21, 6},
+    {0x5d, 7}, {0x5e, 7}, {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7}, {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7},
+    {0x67, 7}, {0x68, 7}, {0x69, 7}, {0x6a, 7}, {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7}, {0x6f, 7}, {0x70, 7},
+    {0x71, 7}, {0x72, 7}, {0xfc, 8}, {0x73, 7}, {0xfd, 8}, {0x1ffb, 13}, {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14},
+    {0x22, 6}, {0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5}, {0x24, 6}, {0x5, 5}, {0x25, 6}, {0x26, 6}, {0x27, 6},
+    {0x6, 5}, {0x74, 7}, {0x75, 7}, {0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5}, {0x2b, 6}, {0x76, 7}, {0x2c, 6},
+    {0x8, 5}, {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7}, {0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15}, {0x7fc, 11},
+    {0x3ffd, 14}, {0x1ffd, 13}, {0xffffffc, 28}, {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20},
+    {0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23}, {0x3fffd6, 22}, {0x7fffda, 23}, {0x7fffdb, 23},
+    {0x7fffdc, 23}, {0x7fffdd, 23}, {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23}, {0xffffec, 24}, {0xffffed, 24},
+    {0x3fffd7, 22}, {0x7fffe0, 23}, {0xffffee, 24}, {0x7fffe1, 23}, {0x7fffe2, 23}, {0x7fffe3, 23}, {0x7fffe4, 23},
+    {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23}, {0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24},
+    {0x3fffda, 22}, {0x1fffdd, 21}, {0xfffe9, 20}, {0x3fffdb, 22}, {0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23},
+    {0x1fffde, 21}, {0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24}, {0x1fffdf, 21}, {0x3fffdf, 22},
+    {0x7fffeb, 23}, {0x7fffec, 23}, {0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21}, {0x7fffed, 23},
+    {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23}, {0xfffea, 20}, {0x3fffe2, 22}, {0x3fffe3, 22}, {0x3fffe4, 22},
+    {0x7ffff0, 23}, {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23}, {0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20},
+    {0x7fff1, 19}, {0x3fffe7, 22}, {0x7ffff2, 23}, {0x3fffe8, 22}, {0x1ffffec, 25}, {0x3ffffe2, 26},
+    {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27}, {0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24},
+    {0x1ffffed, 25}, {0x7fff2, 19}, {0x1fffe3, 21}, {0x3ffffe6, 26}, {0x7ffffe0, 27}, {0x7ffffe1, 27},
+    {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24}, {0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26},
+    {0x3ffffe9, 26}, {0xffffffd, 28}, {0x7ffffe3, 27}, {0x7ffffe4, 27}, {0x7ffffe5, 27}, {0xfffec, 20},
+    {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21}, {0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23},
+    {0x3fffea, 22}, {0x3fffeb, 22}, {0x1ffffee, 25}, {0x1ffffef, 25}, {0xfffff4, 24}, {0xfffff5, 24},
+    {0x3ffffea, 26}, {0x7ffff4, 23}, {0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26},
+    {0x7ffffe7, 27}, {0x7ffffe8, 27}, {0x7ffffe9, 27}, {0x7ffffea, 27}, {0x7ffffeb, 27}, {0xffffffe, 28},
+    {0x7ffffec, 27}, {0x7ffffed, 27}, {0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26},
+    {0x3fffffff, 30}
+};
+
+struct HuffmanNode
+{
+    int children[2] = {-1, -1};
+    int symbol = -1;
+};
+
+// Binary tree built from codes, decoding walks it bit by bit
+const std::vector<HuffmanNode> &huffmanTree()
+{
+    static const std::vector<HuffmanNode> tree = [] {
+        std::vector<HuffmanNode> result(1);
+        for (int symbol = 0; symbol <= EOS_SYMBOL; ++symbol) {
+            const HuffmanCode &code = HUFFMAN_CODES[symbol];
+            size_t node = 0;
+            for (int bit = code.length - 1; bit >= 0; --bit) {
+                const int direction = (code.code >> bit) & 1;
+                if (result[node].children[direction] == -1) {
+                    result[node].children[direction] = static_cast<int>(result.size());
+                    result.emplace_back();
+                }
+                node = static_cast<size_t>(result[node].children[direction]);
+            }
+            result[node].symbol = symbol;
+        }
+        return result;
+    }();
+    return tree;
+}
+
+bool decodeHuffman(const uchar *data, quint32 size, QByteArray &result)
+{
+    const std::vector<HuffmanNode> &tree = huffmanTree();
+    result.reserve(static_cast<int>(size * 8 / 5));
+    size_t node = 0;
+    int pendingBits = 0;
+    bool isPaddingValid = true;
+    for (quint32 i = 0; i < size; ++i) {
+        for (int bit = 7; bit >= 0; --bit) {
+            const int direction = (data[i] >> bit) & 1;
+            const int next = tree[node].children[direction];
+            if (next == -1)
+                return false;
+            node = static_cast<size_t>(next);
+            ++pendingBits;
+            isPaddingValid = isPaddingValid && direction == 1;
+            const int symbol = tree[node].symbol;
+            if (symbol == -1)
+                continue;
+            if (symbol == EOS_SYMBOL)
+                return false;
+            result.append(static_cast<char>(symbol));
+            node = 0;
+            pendingBits = 0;
+            isPaddingValid = true;
+        }
+    }
+    // Padding is the most significant bits of EOS, i.e. up to 7 ones
+    return pendingBits <= 7 && isPaddingValid;
+}
+
+bool decodeInteger(const uchar *&data, const uchar *end, int prefixBits, quint32 &value)
+{
+    if (data >= end)
+        return false;
+    const quint32 prefixMax = (1u << prefixBits) - 1;
+    quint64 result = *data++ & prefixMax;
+    if (result < prefixMax) {
+        value = static_cast<quint32>(result);
+        return true;
+    }
+    for (int shift = 0; data < end && shift <= 28; shift += 7) {
+        const uchar byte = *data++;
+        result += static_cast<quint64>(byte & 0x7F) << shift;
+        if (result > MAX_DECODED_INTEGER)
+            return false;
+        if (!(byte & 0x80)) {
+            value = static_cast<quint32>(result);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool decodeString(const uchar *&data, const uchar *end, QByteArray &result)
+{
+    if (data >= end)
+        return false;
+    const bool isHuffman = *data & 0x80;
+    quint32 length = 0;
+    if (!decodeInteger(data, end, 7, length) || length > static_cast<quint32>(end - data))
+        return false;
+    result.clear();
+    if (isHuffman) {
+        if (!decodeHuffman(data, length, result))
+            return false;
+    } else {
+        result = QByteArray(reinterpret_cast<const char *>(data), static_cast<int>(length));
+    }
+    data += length;
+    return true;
+}
+
+void encodeInteger(QByteArray &result, uchar firstByteFlags, int prefixBits, quint32 value)
+{
+    const quint32 prefixMax = (1u << prefixBits) - 1;
+    if (value < prefixMax) {
+        result.append(static_cast<char>(firstByteFlags | value));
+        return;
+    }
+    result.append(static_cast<char>(firstByteFlags | prefixMax));
+    value -= prefixMax;
+    while (value >= 0x80) {
+        result.append(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    result.append(static_cast<char>(value));
+}
+
+void encodeString(QByteArray &result, const QByteArray &value)
+{
+    encodeInteger(result, 0x00, 7, static_cast<quint32>(value.size()));
+    result.append(value);
+}
+} // namespace
+
+HpackDecoder::HpackDecoder(int maxTableSize) : m_maxTableSize(maxTableSize), m_currentMaxTableSize(maxTableSize)
+{}
+
+bool HpackDecoder::decode(const QByteArray &block, HttpHeaderFields &fields, qint64 maxDecodedSize)
+{
+    const uchar *data = reinterpret_cast<const uchar *>(block.constData());
+    const uchar *const end = data + block.size();
+    const int initialFieldsCount = fields.count();
+    qint64 decodedSize = 0;
+    while (data < end) {
+        const uchar firstByte = *data;
+        quint32 index = 0;
+        HttpHeaderField result;
+        if (firstByte & 0x80) {
+            // Indexed field
+            if (!decodeInteger(data, end, 7, index) || !field(index, result))
+                return false;
+            decodedSize += result.first.size() + result.second.size() + ENTRY_OVERHEAD;
+            if (decodedSize > maxDecodedSize)
+                return false;
+            fields << result;
+            continue;
+        }
+        if ((firstByte & 0xE0) == 0x20) {
+            // Dynamic table size update, allowed only at the beginning of block
+            quint32 size = 0;
+            if (fields.count() != initialFieldsCount || !decodeInteger(data, end, 5, size)
+                || size > static_cast<quint32>(m_maxTableSize)) {
+                return false;
+            }
+            m_currentMaxTableSize = static_cast<int>(size);
+            evict(m_currentMaxTableSize);
+            continue;
+        }
+
+        // Literal with incremental indexing has 6-bit prefix, without indexing and never indexed have 4-bit one
+        const bool isIndexed = (firstByte & 0xC0) == 0x40;
+        if (!decodeInteger(data, end, isIndexed ? 6 : 4, index))
+            return false;
+        if (index == 0) {
+            if (!decodeString(data, end, result.first))
+                return false;
+        } else if (!field(index, result)) {
+            return false;
+        }
+        if (!decodeString(data, end, result.second))
+            return false;
+        if (isIndexed)
+            insert(result);
+        decodedSize += result.first.size() + result.second.size() + ENTRY_OVERHEAD;
+        if (decodedSize > maxDecodedSize)
+            return false;
+        fields << result;
+    }
+    return true;
+}
+
+bool HpackDecoder::field(quint32 index, HttpHeaderField &result) const
+{
+    if (index == 0)
+        return false;
+    if (index <= STATIC_TABLE_SIZE) {
+        const StaticEntry &entry = STATIC_TABLE[index - 1];
+        result = qMakePair(QByteArray(entry.name), QByteArray(entry.value));
+        return true;
+    }
+    const quint32 dynamicIndex = index - STATIC_TABLE_SIZE - 1;
+    if (dynamicIndex >= m_table.size())
+        return false;
+    result = m_table[dynamicIndex];
+    return true;
+}
+
+void HpackDecoder::insert(const HttpHeaderField &field)
+{
+    const int entrySize = field.first.size() + field.second.size() + ENTRY_OVERHEAD;
+    // Entry larger than table just empties it
+    evict(qMax(0, m_currentMaxTableSize - entrySize));
+    if (entrySize > m_currentMaxTableSize)
+        return;
+    m_table.push_front(field);
+    m_tableSize += entrySize;
+}
+
+void HpackDecoder::evict(int maxSize)
+{
+    while (m_tableSize > maxSize && !m_table.empty()) {
+        const HttpHeaderField &oldest = m_table.back();
+        m_tableSize -= oldest.first.size() + oldest.second.size() + ENTRY_OVERHEAD;
+        m_table.pop_back();
+    }
+}
+
+QByteArray HpackEncoder::encode(const HttpHeaderFields &fields) const
+{
+    // Exact pairs are looked up by "name\0value" key, names by themselves
+    static const QPair<QHash<QByteArray, int>, QHash<QByteArray, int>> staticIndex = [] {
+        QPair<QHash<QByteArray, int>, QHash<QByteArray, int>> result;
+        for (int i = STATIC_TABLE_SIZE - 1; i >= 0; --i) {
+            const QByteArray name = STATIC_TABLE[i].name;
+            result.first.insert(name + '\0' + STATIC_TABLE[i].value, i + 1);
+            result.second.insert(name, i + 1);
+        }
+        return result;
+    }();
+
+    QByteArray result;
+    for (const HttpHeaderField &field : fields) {
+        const int fieldIndex = staticIndex.first.value(field.first + '\0' + field.second, 0);
+        if (fieldIndex) {
+            encodeInteger(result, 0x80, 7, static_cast<quint32>(fieldIndex));
+            continue;
+        }
+        const int nameIndex = staticIndex.second.value(field.first, 0);
+        encodeInteger(result, 0x00, 4, static_cast<quint32>(nameIndex));
+        if (!nameIndex)
+            encodeString(result, field.first);
+        encodeString(result, field.second);
+    }
+    return result;
+}
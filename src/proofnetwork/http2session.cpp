@@ -0,0 +1,775 @@
+/* Copyright 2018, OpenSoft Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright notice, this list of
+ * conditions and the following disclaimer in the documentation and/or other materials provided
+ * with the distribution.
+ *     * Neither the name of OpenSoft Inc. nor the names of its contributors may be used to endorse
+ * or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include "proofnetwork/http2session_p.h"
+
+#include <QtEndian>
+
+using namespace Proof;
+
+namespace {
+constexpr int FRAME_HEADER_SIZE = 9;
+constexpr int DEFAULT_WINDOW_SIZE = 65535;
+constexpr qint64 MAX_WINDOW_SIZE = 0x7FFFFFFF;
+constexpr int DEFAULT_MAX_FRAME_SIZE = 16384;
+constexpr int MAX_FRAME_SIZE_LIMIT = 16777215;
+constexpr int HEADER_FIELD_OVERHEAD = 32;
+
+enum FrameType : quint8
+{
+    DataFrame = 0x0,
+    HeadersFrame = 0x1,
+    PriorityFrame = 0x2,
+    RstStreamFrame = 0x3,
+    SettingsFrame = 0x4,
+    PushPromiseFrame = 0x5,
+    PingFrame = 0x6,
+    GoAwayFrame = 0x7,
+    WindowUpdateFrame = 0x8,
+    ContinuationFrame = 0x9
+};
+
+enum FrameFlag : quint8
+{
+    AckFlag = 0x1,
+    EndStreamFlag = 0x1,
+    EndHeadersFlag = 0x4,
+    PaddedFlag = 0x8,
+    PriorityFlag = 0x20
+};
+
+enum SettingId : quint16
+{
+    HeaderTableSizeSetting = 0x1,
+    EnablePushSetting = 0x2,
+    MaxConcurrentStreamsSetting = 0x3,
+    InitialWindowSizeSetting = 0x4,
+    MaxFrameSizeSetting = 0x5,
+    MaxHeaderListSizeSetting = 0x6
+};
+
+quint32 readUInt32(const char *data)
+{
+    return qFromBigEndian<quint32>(reinterpret_cast<const uchar *>(data));
+}
+
+void appendUInt16(QByteArray &result, quint16 value)
+{
+    result.append(static_cast<char>(value >> 8)).append(static_cast<char>(value));
+}
+
+void appendUInt32(QByteArray &result, quint32 value)
+{
+    appendUInt16(result, static_cast<quint16>(value >> 16));
+    appendUInt16(result, static_cast<quint16>(value));
+}
+
+// Padding length and priority fields are skipped, false means malformed frame
+bool framePayload(quint8 flags, bool hasPriority, const QByteArray &payload, QByteArray &result)
+{
+    int start = 0;
+    int padding = 0;
+    if (flags & PaddedFlag) {
+        if (payload.isEmpty())
+            return false;
+        padding = static_cast<uchar>(payload.at(0));
+        start = 1;
+    }
+    if (hasPriority && (flags & PriorityFlag))
+        start += 5;
+    if (start + padding > payload.size())
+        return false;
+    result = payload.mid(start, payload.size() - start - padding);
+    return true;
+}
+
+// Connection-specific fields are not allowed in HTTP/2 (RFC 7540 8.1.2.2)
+bool isConnectionSpecificField(const QByteArray &name)
+{
+    return name == "connection" || name == "keep-alive" || name == "proxy-connection" || name == "transfer-encoding"
+           || name == "upgrade";
+}
+} // namespace
+
+Http2Session::Http2Session(const Settings &settings) : m_settings(settings)
+{
+    m_settings.windowSize = qMax(DEFAULT_WINDOW_SIZE, settings.windowSize);
+    m_connectionReceiveWindow = m_settings.windowSize;
+
+    // Server preface, connection window can be changed only by WINDOW_UPDATE
+    QByteArray payload;
+    appendUInt16(payload, MaxConcurrentStreamsSetting);
+    appendUInt32(payload, static_cast<quint32>(m_settings.maxConcurrentStreams));
+    appendUInt16(payload, InitialWindowSizeSetting);
+    appendUInt32(payload, static_cast<quint32>(m_settings.windowSize));
+    appendUInt16(payload, MaxHeaderListSizeSetting);
+    appendUInt32(payload, static_cast<quint32>(m_settings.maxHeadersSize));
+    writeFrame(SettingsFrame, 0, 0, payload.constData(), payload.size());
+    if (m_settings.windowSize > DEFAULT_WINDOW_SIZE)
+        writeWindowUpdate(0, static_cast<quint32>(m_settings.windowSize - DEFAULT_WINDOW_SIZE));
+}
+
+QByteArray Http2Session::clientPreface()
+{
+    return QByteArrayLiteral("PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n");
+}
+
+bool Http2Session::upgrade(const QByteArray &encodedSettings)
+{
+    const QByteArray settings = QByteArray::fromBase64(encodedSettings, QByteArray::Base64UrlEncoding);
+    if (settings.size() % 6 || applySettings(settings.constData(), settings.size()) != NoError)
+        return false;
+    // 101 answer acknowledges these settings, so no SETTINGS ACK is sent
+    Stream stream;
+    stream.sendWindow = m_peerInitialWindowSize;
+    stream.receiveWindow = m_settings.windowSize;
+    stream.remoteClosed = true;
+    m_streams.insert(1, stream);
+    m_lastStreamId = 1;
+    return true;
+}
+
+void Http2Session::feed(QByteArray &input)
+{
+    if (m_failed) {
+        input.clear();
+        return;
+    }
+    int position = 0;
+    if (!m_prefaceReceived) {
+        const QByteArray preface = clientPreface();
+        if (input.size() < preface.size())
+            return;
+        if (!input.startsWith(preface)) {
+            connectionError(ProtocolError, QStringLiteral("Invalid connection preface"));
+            input.clear();
+            return;
+        }
+        m_prefaceReceived = true;
+        position = preface.size();
+    }
+
+    while (!m_failed && input.size() - position >= FRAME_HEADER_SIZE) {
+        const char *header = input.constData() + position;
+        const int length = static_cast<int>(readUInt32(header) >> 8);
+        const quint8 type = static_cast<quint8>(header[3]);
+        const quint8 flags = static_cast<quint8>(header[4]);
+        const quint32 streamId = readUInt32(header + 5) & 0x7FFFFFFF;
+        // We never announce larger SETTINGS_MAX_FRAME_SIZE
+        if (length > DEFAULT_MAX_FRAME_SIZE) {
+            connectionError(FrameSizeError, QStringLiteral("Frame of %1 bytes is too large").arg(length));
+            break;
+        }
+        if (input.size() - position - FRAME_HEADER_SIZE < length)
+            break;
+        if (!m_settingsReceived && (type != SettingsFrame || (flags & AckFlag))) {
+            connectionError(ProtocolError, QStringLiteral("Connection preface doesn't start with SETTINGS"));
+            break;
+        }
+        m_settingsReceived = true;
+        processFrame(type, flags, streamId, input.mid(position + FRAME_HEADER_SIZE, length));
+        position += FRAME_HEADER_SIZE + length;
+    }
+    if (m_failed)
+        input.clear();
+    else
+        input.remove(0, position);
+}
+
+QVector<Http2Request> Http2Session::takeRequests()
+{
+    QVector<Http2Request> result;
+    result.swap(m_requests);
+    return result;
+}
+
+QVector<quint32> Http2Session::takeResetStreams()
+{
+    QVector<quint32> result;
+    result.swap(m_resetStreams);
+    return result;
+}
+
+int Http2Session::takeRefusedStreamsCount()
+{
+    const int result = m_refusedStreamsCount;
+    m_refusedStreamsCount = 0;
+    return result;
+}
+
+QByteArray Http2Session::takeOutput()
+{
+    QByteArray result;
+    result.swap(m_output);
+    return result;
+}
+
+void Http2Session::sendHeaders(quint32 streamId, const HttpHeaderFields &fields, bool endStream)
+{
+    auto streamIt = m_streams.find(streamId);
+    if (m_failed || streamIt == m_streams.end() || streamIt->localClosed)
+        return;
+    const QByteArray block = m_encoder.encode(fields);
+    int offset = 0;
+    do {
+        const int size = qMin(block.size() - offset, m_peerMaxFrameSize);
+        const bool isLast = offset + size == block.size();
+        quint8 flags = isLast ? EndHeadersFlag : 0;
+        if (!offset && endStream)
+            flags |= EndStreamFlag;
+        writeFrame(offset ? ContinuationFrame : HeadersFrame, flags, streamId, block.constData() + offset, size);
+        offset += size;
+    } while (offset < block.size());
+    if (endStream) {
+        streamIt->localClosed = true;
+        closeStreamIfDone(streamId);
+    }
+}
+
+void Http2Session::sendData(quint32 streamId, const QByteArray &data, bool endStream)
+{
+    auto streamIt = m_streams.find(streamId);
+    if (m_failed || streamIt == m_streams.end() || streamIt->localClosed || streamIt->outputFinished)
+        return;
+    streamIt->output.append(data);
+    streamIt->outputFinished = endStream;
+    flushStream(streamId);
+}
+
+void Http2Session::resetStream(quint32 streamId, ErrorCode code)
+{
+    if (m_failed)
+        return;
+    writeRstStream(streamId, code);
+    if (m_streams.remove(streamId))
+        m_resetStreams << streamId;
+}
+
+void Http2Session::goAway(ErrorCode code)
+{
+    if (m_goAwaySent)
+        return;
+    m_goAwaySent = true;
+    QByteArray payload;
+    appendUInt32(payload, m_lastStreamId);
+    appendUInt32(payload, code);
+    writeFrame(GoAwayFrame, 0, 0, payload.constData(), payload.size());
+}
+
+qint64 Http2Session::queuedBytes(quint32 streamId) const
+{
+    auto streamIt = m_streams.constFind(streamId);
+    return streamIt == m_streams.cend() ? 0 : streamIt->output.size() - streamIt->outputOffset;
+}
+
+int Http2Session::activeStreamsCount() const
+{
+    return m_streams.count();
+}
+
+bool Http2Session::isGoingAway() const
+{
+    return m_goAwaySent || m_goAwayReceived;
+}
+
+bool Http2Session::hasFailed() const
+{
+    return m_failed;
+}
+
+QString Http2Session::error() const
+{
+    return m_error;
+}
+
+Http2Session::ErrorCode Http2Session::applySettings(const char *data, int size)
+{
+    for (int offset = 0; offset + 6 <= size; offset += 6) {
+        const quint16 id = qFromBigEndian<quint16>(reinterpret_cast<const uchar *>(data + offset));
+        const quint32 value = readUInt32(data + offset + 2);
+        switch (id) {
+        case EnablePushSetting:
+            if (value > 1)
+                return ProtocolError;
+            break;
+        case InitialWindowSizeSetting: {
+            if (value > MAX_WINDOW_SIZE)
+                return FlowControlError;
+            // Change is applied to all streams, their windows can become negative
+            const qint64 delta = static_cast<qint64>(value) - m_peerInitialWindowSize;
+            for (auto &stream : m_streams) {
+                stream.sendWindow += delta;
+                if (stream.sendWindow > MAX_WINDOW_SIZE)
+                    return FlowControlError;
+            }
+            m_peerInitialWindowSize = value;
+            break;
+        }
+        case MaxFrameSizeSetting:
+            if (value < DEFAULT_MAX_FRAME_SIZE || value > MAX_FRAME_SIZE_LIMIT)
+                return ProtocolError;
+            m_peerMaxFrameSize = static_cast<int>(value);
+            break;
+        case HeaderTableSizeSetting:
+        case MaxConcurrentStreamsSetting:
+        case MaxHeaderListSizeSetting:
+        default:
+            // Our encoder doesn't use dynamic table and server never opens streams itself
+            break;
+        }
+    }
+    return NoError;
+}
+
+void Http2Session::processFrame(quint8 type, quint8 flags, quint32 streamId, const QByteArray &payload)
+{
+    if (m_isHeaderBlockOpen && (type != ContinuationFrame || streamId != m_headerBlockStreamId)) {
+        connectionError(ProtocolError, QStringLiteral("Header block is interrupted by another frame"));
+        return;
+    }
+
+    switch (type) {
+    case DataFrame:
+        processData(flags, streamId, payload);
+        break;
+    case HeadersFrame:
+        processHeaders(flags, streamId, payload);
+        break;
+    case PriorityFrame:
+        if (!streamId)
+            connectionError(ProtocolError, QStringLiteral("PRIORITY frame at stream 0"));
+        else if (payload.size() != 5)
+            resetStream(streamId, FrameSizeError);
+        break;
+    case RstStreamFrame:
+        if (!streamId || streamId > m_lastStreamId) {
+            connectionError(ProtocolError, QStringLiteral("RST_STREAM frame at idle stream %1").arg(streamId));
+        } else if (payload.size() != 4) {
+            connectionError(FrameSizeError, QStringLiteral("Invalid RST_STREAM frame size"));
+        } else if (m_streams.remove(streamId)) {
+            m_resetStreams << streamId;
+        }
+        break;
+    case SettingsFrame:
+        processSettings(flags, streamId, payload);
+        break;
+    case PushPromiseFrame:
+        connectionError(ProtocolError, QStringLiteral("PUSH_PROMISE frame from client"));
+        break;
+    case PingFrame:
+        if (streamId)
+            connectionError(ProtocolError, QStringLiteral("PING frame at stream %1").arg(streamId));
+        else if (payload.size() != 8)
+            connectionError(FrameSizeError, QStringLiteral("Invalid PING frame size"));
+        else if (!(flags & AckFlag))
+            writeFrame(PingFrame, AckFlag, 0, payload.constData(), payload.size());
+        break;
+    case GoAwayFrame:
+        if (streamId)
+            connectionError(ProtocolError, QStringLiteral("GOAWAY frame at stream %1").arg(streamId));
+        else
+            m_goAwayReceived = true;
+        break;
+    case WindowUpdateFrame:
+        processWindowUpdate(streamId, payload);
+        break;
+    case ContinuationFrame:
+        if (!m_isHeaderBlockOpen) {
+            connectionError(ProtocolError, QStringLiteral("Unexpected CONTINUATION frame"));
+            break;
+        }
+        m_headerBlock.append(payload);
+        // Block is decoded only when it is complete, so its size is limited to not buffer it infinitely
+        if (m_headerBlock.size() > m_settings.maxHeadersSize * 2) {
+            connectionError(EnhanceYourCalm, QStringLiteral("Header block is too large"));
+            break;
+        }
+        if (flags & EndHeadersFlag)
+            finishHeaderBlock();
+        break;
+    default:
+        // Unknown frame types must be ignored
+        break;
+    }
+}
+
+void Http2Session::processData(quint8 flags, quint32 streamId, const QByteArray &payload)
+{
+    if (!streamId) {
+        connectionError(ProtocolError, QStringLiteral("DATA frame at stream 0"));
+        return;
+    }
+    if (streamId > m_lastStreamId) {
+        connectionError(ProtocolError, QStringLiteral("DATA frame at idle stream %1").arg(streamId));
+        return;
+    }
+    // Whole frame including padding is counted by flow control
+    if (payload.size() > m_connectionReceiveWindow) {
+        connectionError(FlowControlError, QStringLiteral("Connection receive window is exceeded"));
+        return;
+    }
+    m_connectionReceiveWindow -= payload.size();
+
+    auto streamIt = m_streams.find(streamId);
+    // Frames of streams that were reset or answered early can still be in flight, they are just dropped
+    if (streamIt == m_streams.end()) {
+        replenishWindows(0);
+        return;
+    }
+    QByteArray data;
+    if (streamIt->remoteClosed) {
+        resetStream(streamId, StreamClosedError);
+    } else if (payload.size() > streamIt->receiveWindow) {
+        resetStream(streamId, FlowControlError);
+    } else if (!framePayload(flags, false, payload, data)) {
+        connectionError(ProtocolError, QStringLiteral("Invalid padding of DATA frame"));
+        return;
+    } else {
+        streamIt->receiveWindow -= payload.size();
+        if (!streamIt->rejected) {
+            streamIt->request.body.append(data);
+            const qint64 maxBodySize = m_settings.maxBodySize;
+            if (maxBodySize > 0 && streamIt->request.body.size() > maxBodySize)
+                rejectStream(streamId, 413);
+        }
+        streamIt = m_streams.find(streamId);
+        if (streamIt != m_streams.end() && (flags & EndStreamFlag)) {
+            streamIt->remoteClosed = true;
+            completeRequest(streamId);
+        }
+    }
+    replenishWindows(m_streams.contains(streamId) ? streamId : 0);
+}
+
+void Http2Session::processHeaders(quint8 flags, quint32 streamId, const QByteArray &payload)
+{
+    if (!streamId) {
+        connectionError(ProtocolError, QStringLiteral("HEADERS frame at stream 0"));
+        return;
+    }
+    if (!framePayload(flags, true, payload, m_headerBlock)) {
+        connectionError(ProtocolError, QStringLiteral("Invalid padding of HEADERS frame"));
+        return;
+    }
+    m_headerBlockStreamId = streamId;
+    m_headerBlockEndsStream = flags & EndStreamFlag;
+    m_isHeaderBlockOpen = true;
+    if (flags & EndHeadersFlag)
+        finishHeaderBlock();
+}
+
+void Http2Session::processSettings(quint8 flags, quint32 streamId, const QByteArray &payload)
+{
+    if (streamId) {
+        connectionError(ProtocolError, QStringLiteral("SETTINGS frame at stream %1").arg(streamId));
+        return;
+    }
+    if (flags & AckFlag) {
+        if (!payload.isEmpty())
+            connectionError(FrameSizeError, QStringLiteral("SETTINGS ACK frame with payload"));
+        return;
+    }
+    if (payload.size() % 6) {
+        connectionError(FrameSizeError, QStringLiteral("Invalid SETTINGS frame size"));
+        return;
+    }
+    const ErrorCode result = applySettings(payload.constData(), payload.size());
+    if (result != NoError) {
+        connectionError(result, QStringLiteral("Invalid SETTINGS value"));
+        return;
+    }
+    writeFrame(SettingsFrame, AckFlag, 0, nullptr, 0);
+    flushAllStreams();
+}
+
+void Http2Session::processWindowUpdate(quint32 streamId, const QByteArray &payload)
+{
+    if (payload.size() != 4) {
+        connectionError(FrameSizeError, QStringLiteral("Invalid WINDOW_UPDATE frame size"));
+        return;
+    }
+    const quint32 increment = readUInt32(payload.constData()) & 0x7FFFFFFF;
+    if (!streamId) {
+        m_connectionSendWindow += increment;
+        if (!increment || m_connectionSendWindow > MAX_WINDOW_SIZE) {
+            connectionError(increment ? FlowControlError : ProtocolError,
+                            QStringLiteral("Invalid connection WINDOW_UPDATE"));
+            return;
+        }
+        flushAllStreams();
+        return;
+    }
+
+    if (streamId > m_lastStreamId) {
+        connectionError(ProtocolError, QStringLiteral("WINDOW_UPDATE frame at idle stream %1").arg(streamId));
+        return;
+    }
+    auto streamIt = m_streams.find(streamId);
+    if (streamIt == m_streams.end())
+        return;
+    streamIt->sendWindow += increment;
+    if (!increment || streamIt->sendWindow > MAX_WINDOW_SIZE)
+        resetStream(streamId, increment ? FlowControlError : ProtocolError);
+    else
+        flushStream(streamId);
+}
+
+void Http2Session::finishHeaderBlock()
+{
+    m_isHeaderBlockOpen = false;
+    HttpHeaderFields fields;
+    // Block is decoded even if stream is not going to be processed, otherwise decoder state is lost.
+    // Fields above maxHeadersSize are still decoded to answer such request with 431
+    if (!m_decoder.decode(m_headerBlock, fields, static_cast<qint64>(m_settings.maxHeadersSize) * 4)) {
+        connectionError(CompressionError, QStringLiteral("Can't decode header block"));
+        return;
+    }
+    m_headerBlock.clear();
+    const quint32 streamId = m_headerBlockStreamId;
+
+    auto streamIt = m_streams.find(streamId);
+    if (streamIt != m_streams.end()) {
+        // Trailers, they are not passed to handlers
+        if (streamIt->remoteClosed) {
+            resetStream(streamId, StreamClosedError);
+        } else if (!m_headerBlockEndsStream) {
+            resetStream(streamId, ProtocolError);
+        } else {
+            streamIt->remoteClosed = true;
+            completeRequest(streamId);
+        }
+        return;
+    }
+    if (!(streamId % 2)) {
+        connectionError(ProtocolError, QStringLiteral("Client opened even stream %1").arg(streamId));
+        return;
+    }
+    // Closed stream or new stream after GOAWAY
+    if (streamId <= m_lastStreamId || m_goAwaySent)
+        return;
+    m_lastStreamId = streamId;
+
+    if (m_streams.count() >= m_settings.maxConcurrentStreams) {
+        writeRstStream(streamId, RefusedStream);
+        ++m_refusedStreamsCount;
+        return;
+    }
+
+    Stream stream;
+    stream.sendWindow = m_peerInitialWindowSize;
+    stream.receiveWindow = m_settings.windowSize;
+    stream.remoteClosed = m_headerBlockEndsStream;
+    stream.request.streamId = streamId;
+    if (!fillRequest(stream, fields)) {
+        writeRstStream(streamId, ProtocolError);
+        return;
+    }
+    m_streams.insert(streamId, stream);
+
+    qint64 fieldsSize = 0;
+    for (const HttpHeaderField &field : qAsConst(fields))
+        fieldsSize += field.first.size() + field.second.size() + HEADER_FIELD_OVERHEAD;
+    const qint64 maxBodySize = m_settings.maxBodySize;
+    if (fieldsSize > m_settings.maxHeadersSize)
+        rejectStream(streamId, 431);
+    else if (maxBodySize > 0 && stream.expectedContentLength > maxBodySize)
+        rejectStream(streamId, 413);
+    else if (stream.remoteClosed)
+        completeRequest(streamId);
+}
+
+bool Http2Session::fillRequest(Stream &stream, const HttpHeaderFields &fields)
+{
+    QByteArray method;
+    QByteArray path;
+    QByteArray scheme;
+    QByteArray authority;
+    bool hasHost = false;
+    bool hasRegularFields = false;
+    QByteArray &rawHeaders = stream.request.rawHeaders;
+    for (const HttpHeaderField &field : fields) {
+        const QByteArray &name = field.first;
+        if (name.startsWith(':')) {
+            QByteArray *target = nullptr;
+            if (name == ":method")
+                target = &method;
+            else if (name == ":path")
+                target = &path;
+            else if (name == ":scheme")
+                target = &scheme;
+            else if (name == ":authority")
+                target = &authority;
+            // Pseudo-fields must be known, unique and go before regular ones
+            if (!target || !target->isEmpty() || hasRegularFields || field.second.isEmpty())
+                return false;
+            *target = field.second;
+            continue;
+        }
+        hasRegularFields = true;
+        if (name.isEmpty() || name != name.toLower() || isConnectionSpecificField(name))
+            return false;
+        if (name == "te" && field.second != "trailers")
+            return false;
+        if (name == "content-length") {
+            bool ok = false;
+            stream.expectedContentLength = field.second.toLongLong(&ok);
+            if (!ok || stream.expectedContentLength < 0)
+                return false;
+        }
+        hasHost = hasHost || name == "host";
+        rawHeaders.append(name).append(": ").append(field.second).append("\r\n");
+    }
+    // CONNECT is the only method without :path and :scheme, it is not supported by server anyway
+    if (method.isEmpty() || path.isEmpty() || scheme.isEmpty())
+        return false;
+    if (!authority.isEmpty() && !hasHost)
+        rawHeaders.prepend("host: " + authority + "\r\n");
+    stream.request.method = QString::fromLatin1(method);
+    stream.request.uri = QString::fromUtf8(path);
+    return true;
+}
+
+void Http2Session::completeRequest(quint32 streamId)
+{
+    auto streamIt = m_streams.find(streamId);
+    if (streamIt == m_streams.end() || streamIt->rejected)
+        return;
+    const qint64 expectedLength = streamIt->expectedContentLength;
+    if (expectedLength >= 0 && expectedLength != streamIt->request.body.size()) {
+        resetStream(streamId, ProtocolError);
+        return;
+    }
+    m_requests << streamIt->request;
+    streamIt->request = Http2Request();
+    closeStreamIfDone(streamId);
+}
+
+void Http2Session::rejectStream(quint32 streamId, int statusCode)
+{
+    auto streamIt = m_streams.find(streamId);
+    if (streamIt == m_streams.end())
+        return;
+    streamIt->rejected = true;
+    streamIt->request = Http2Request();
+    sendHeaders(streamId, {qMakePair(QByteArrayLiteral(":status"), QByteArray::number(statusCode))}, true);
+}
+
+void Http2Session::flushStream(quint32 streamId)
+{
+    auto streamIt = m_streams.find(streamId);
+    if (streamIt == m_streams.end() || streamIt->localClosed)
+        return;
+    Stream &stream = *streamIt;
+    forever {
+        const int pending = stream.output.size() - stream.outputOffset;
+        const qint64 window = qMin(stream.sendWindow, m_connectionSendWindow);
+        const int size = static_cast<int>(qMin(qMin(static_cast<qint64>(pending), window),
+                                               static_cast<qint64>(m_peerMaxFrameSize)));
+        const bool isLast = stream.outputFinished && size == pending;
+        if (size <= 0 && !isLast)
+            break;
+        writeFrame(DataFrame, isLast ? EndStreamFlag : 0, streamId, stream.output.constData() + stream.outputOffset,
+                   qMax(0, size));
+        stream.sendWindow -= qMax(0, size);
+        m_connectionSendWindow -= qMax(0, size);
+        stream.outputOffset += qMax(0, size);
+        if (isLast) {
+            stream.localClosed = true;
+            break;
+        }
+    }
+    // Sent data is dropped only when it is a noticeable part of buffer, not after each frame
+    if (stream.outputOffset > 0 && stream.outputOffset * 2 >= stream.output.size()) {
+        stream.output.remove(0, stream.outputOffset);
+        stream.outputOffset = 0;
+    }
+    closeStreamIfDone(streamId);
+}
+
+void Http2Session::flushAllStreams()
+{
+    const auto streamIds = m_streams.keys();
+    for (quint32 streamId : streamIds) {
+        if (m_connectionSendWindow <= 0)
+            break;
+        flushStream(streamId);
+    }
+}
+
+void Http2Session::closeStreamIfDone(quint32 streamId)
+{
+    auto streamIt = m_streams.find(streamId);
+    if (streamIt == m_streams.end() || !streamIt->localClosed)
+        return;
+    // Answer is complete while client still sends body, it is stopped since nobody will read it
+    if (!streamIt->remoteClosed)
+        writeRstStream(streamId, NoError);
+    m_streams.erase(streamIt);
+}
+
+void Http2Session::replenishWindows(quint32 streamId)
+{
+    // Bodies are buffered right away, so windows are restored as soon as half of them is used
+    const qint64 windowSize = m_settings.windowSize;
+    if (m_connectionReceiveWindow <= windowSize / 2) {
+        writeWindowUpdate(0, static_cast<quint32>(windowSize - m_connectionReceiveWindow));
+        m_connectionReceiveWindow = windowSize;
+    }
+    auto streamIt = m_streams.find(streamId);
+    if (streamIt == m_streams.end() || streamIt->remoteClosed || streamIt->receiveWindow > windowSize / 2)
+        return;
+    writeWindowUpdate(streamId, static_cast<quint32>(windowSize - streamIt->receiveWindow));
+    streamIt->receiveWindow = windowSize;
+}
+
+void Http2Session::connectionError(ErrorCode code, const QString &error)
+{
+    goAway(code);
+    m_failed = true;
+    m_error = error;
+    m_streams.clear();
+}
+
+void Http2Session::writeFrame(quint8 type, quint8 flags, quint32 streamId, const char *payload, int size)
+{
+    appendUInt32(m_output, static_cast<quint32>(size) << 8 | type);
+    m_output.append(static_cast<char>(flags));
+    appendUInt32(m_output, streamId);
+    if (size > 0)
+        m_output.append(payload, size);
+}
+
+void Http2Session::writeRstStream(quint32 streamId, ErrorCode code)
+{
+    QByteArray payload;
+    appendUInt32(payload, code);
+    writeFrame(RstStreamFrame, 0, streamId, payload.constData(), payload.size());
+}
+
+void Http2Session::writeWindowUpdate(quint32 streamId, quint32 increment)
+{
+    QByteArray payload;
+    appendUInt32(payload, increment);
+    writeFrame(WindowUpdateFrame, 0, streamId, payload.constData(), payload.size());
+}
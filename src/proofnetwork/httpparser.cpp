@@ -24,18 +24,22 @@
  */
 #include "proofnetwork/httpparser_p.h"
 
+#include "proofnetwork/proofnetwork_global.h"
+
+#include <QBuffer>
+#include <QDir>
 #include <QObject>
 #include <QRegExp>
+#include <QTemporaryFile>
 
 using namespace Proof;
 
-const QRegExp HttpParser::FIRST_LINE_REG_EXP{"(.*) (.*) HTTP/1[.][01]\r\n"};
-const QRegExp HttpParser::HEADER_REG_EXP{"((.*): (.*))\r\n"};
+const QRegExp HttpParser::FIRST_LINE_REG_EXP{"(.*) (.*) HTTP/1[.]([01])\r\n"};
 
 HttpParser::HttpParser()
 {}
 
-HttpParser::Result HttpParser::parseNextPart(QByteArray data) // clazy:exclude=function-args-by-ref
+HttpParser::Result HttpParser::parseNextPart(QByteArray &data)
 {
     Result result;
     do
@@ -44,6 +48,50 @@ HttpParser::Result HttpParser::parseNextPart(QByteArray data) // clazy:exclude=f
     return result;
 }
 
+void HttpParser::reset()
+{
+    m_state = &HttpParser::initialState;
+    m_data.clear();
+    m_contentLength = 0;
+    m_hasContentLength = false;
+    m_method.clear();
+    m_uri.clear();
+    m_rawHeaders.clear();
+    m_connection.clear();
+    m_hasTransferEncoding = false;
+    m_isHttp10 = false;
+    m_isBodyStreamed = false;
+    m_headersSize = 0;
+    m_bodyFile.reset();
+    m_multipart.reset();
+    m_multipartBytesReceived = 0;
+    m_error.clear();
+    m_errorStatusCode = 400;
+}
+
+void HttpParser::setMaxHeadersSize(int size)
+{
+    m_maxHeadersSize = size;
+}
+
+void HttpParser::setBodyStreamed(qint64 memoryThreshold)
+{
+    m_isBodyStreamed = true;
+    if (m_contentLength <= static_cast<qulonglong>(qMax(0ll, memoryThreshold)))
+        return;
+    m_bodyFile.reset(new QTemporaryFile(QDir::tempPath() + QStringLiteral("/proof_request_body_XXXXXX")));
+    if (!m_bodyFile->open()) {
+        qCWarning(proofNetworkMiscLog) << "RestServer: can't create temporary file for request body:"
+                                       << m_bodyFile->errorString();
+        m_bodyFile.reset();
+    }
+}
+
+void HttpParser::setBodyMultipart(const QByteArray &boundary, qint64 memoryThreshold)
+{
+    m_multipart.reset(new MultipartParser(boundary, memoryThreshold));
+}
+
 QString HttpParser::method() const
 {
     return m_method;
@@ -56,7 +104,18 @@ QString HttpParser::uri() const
 
 QStringList HttpParser::headers() const
 {
-    return m_headers;
+    QStringList result;
+    const auto lines = m_rawHeaders.split('\n');
+    for (const QByteArray &line : lines) {
+        if (!line.isEmpty())
+            result << QString::fromUtf8(line.constData(), line.size() - 1);
+    }
+    return result;
+}
+
+QByteArray HttpParser::rawHeaders() const
+{
+    return m_rawHeaders;
 }
 
 QByteArray HttpParser::body() const
@@ -64,11 +123,81 @@ QByteArray HttpParser::body() const
     return m_data;
 }
 
+qulonglong HttpParser::contentLength() const
+{
+    return m_contentLength;
+}
+
+QSharedPointer<QIODevice> HttpParser::bodyDevice() const
+{
+    if (!m_isBodyStreamed)
+        return QSharedPointer<QIODevice>();
+    if (m_bodyFile) {
+        m_bodyFile->seek(0);
+        return m_bodyFile;
+    }
+    QSharedPointer<QBuffer> buffer(new QBuffer);
+    buffer->setData(m_data);
+    buffer->open(QIODevice::ReadOnly);
+    return buffer;
+}
+
+bool HttpParser::isBodyMultipart() const
+{
+    return !m_multipart.isNull();
+}
+
+QVector<MultipartPart> HttpParser::takeMultipartParts()
+{
+    return m_multipart ? m_multipart->takeParts() : QVector<MultipartPart>();
+}
+
+bool HttpParser::isKeepAlive() const
+{
+    // Body framing is known only by Content-Length, so nothing after such request can be trusted
+    if (m_hasTransferEncoding)
+        return false;
+    const auto tokens = m_connection.split(',', QString::SkipEmptyParts);
+    bool keepAliveToken = false;
+    for (const auto &token : tokens) {
+        const auto trimmedToken = token.trimmed();
+        if (trimmedToken.compare(QLatin1String("close"), Qt::CaseInsensitive) == 0)
+            return false;
+        if (trimmedToken.compare(QLatin1String("keep-alive"), Qt::CaseInsensitive) == 0)
+            keepAliveToken = true;
+    }
+    return !m_isHttp10 || keepAliveToken;
+}
+
+bool HttpParser::isHttp10() const
+{
+    return m_isHttp10;
+}
+
+bool HttpParser::isClean() const
+{
+    return m_state == &HttpParser::initialState && m_data.isEmpty();
+}
+
 QString HttpParser::error() const
 {
     return m_error;
 }
 
+int HttpParser::errorStatusCode() const
+{
+    return m_errorStatusCode;
+}
+
+bool HttpParser::checkHeadersSize()
+{
+    if (m_maxHeadersSize <= 0 || m_headersSize + m_data.size() <= m_maxHeadersSize)
+        return true;
+    m_error = QStringLiteral("Headers are larger than %1 bytes").arg(m_maxHeadersSize);
+    m_errorStatusCode = 431;
+    return false;
+}
+
 HttpParser::Result HttpParser::initialState(QByteArray &data)
 {
     Result result;
@@ -76,12 +205,16 @@ HttpParser::Result HttpParser::initialState(QByteArray &data)
     if (endLineIndex != -1) {
         m_data.append(data.constData(), endLineIndex + 1);
         data.remove(0, endLineIndex + 1);
+        if (!checkHeadersSize())
+            return Result::Error;
+        m_headersSize += m_data.size();
         QString startLine(m_data);
         m_data.clear();
         QRegExp firstLineRegExp = FIRST_LINE_REG_EXP;
         if (firstLineRegExp.indexIn(startLine) != -1) {
             m_method = firstLineRegExp.cap(1);
             m_uri = firstLineRegExp.cap(2);
+            m_isHttp10 = firstLineRegExp.cap(3) == QLatin1String("0");
             m_state = &HttpParser::headersState;
             result = Result::NeedMore;
         } else {
@@ -91,7 +224,7 @@ HttpParser::Result HttpParser::initialState(QByteArray &data)
     } else {
         m_data.append(data);
         data.clear();
-        result = Result::NeedMore;
+        result = checkHeadersSize() ? Result::NeedMore : Result::Error;
     }
     return result;
 }
@@ -103,52 +236,93 @@ HttpParser::Result HttpParser::headersState(QByteArray &data)
     if (endLineIndex != -1) {
         m_data.append(data.constData(), endLineIndex + 1);
         data.remove(0, endLineIndex + 1);
-        QString header(m_data);
-        m_data.clear();
-        QRegExp headerRegExp = HEADER_REG_EXP;
-        if (headerRegExp.indexIn(header) != -1) {
+        if (!checkHeadersSize())
+            return Result::Error;
+        m_headersSize += m_data.size();
+        // Header line is kept as bytes, only headers that affect parsing are looked at here
+        const int separatorIndex = m_data.indexOf(": ");
+        if (separatorIndex > 0 && m_data.endsWith("\r\n")) {
             result = Result::NeedMore;
-            m_headers << headerRegExp.cap(1);
-            if (headerRegExp.cap(2).compare(QLatin1String("Content-Length"), Qt::CaseInsensitive) == 0) {
+            const auto isNameEqual = [this, separatorIndex](const char *name) {
+                return static_cast<int>(qstrlen(name)) == separatorIndex
+                       && qstrnicmp(m_data.constData(), name, static_cast<uint>(separatorIndex)) == 0;
+            };
+            if (isNameEqual("Connection")) {
+                m_connection = QString::fromLatin1(m_data.mid(separatorIndex + 2, m_data.size() - separatorIndex - 4));
+            } else if (isNameEqual("Transfer-Encoding")) {
+                m_hasTransferEncoding = true;
+            } else if (isNameEqual("Content-Length")) {
+                const QByteArray value = m_data.mid(separatorIndex + 2, m_data.size() - separatorIndex - 4);
                 bool ok = false;
-                m_contentLength = headerRegExp.cap(3).toULongLong(&ok);
+                const qulonglong contentLength = value.toULongLong(&ok);
                 if (!ok) {
                     result = Result::Error;
                     m_error = QStringLiteral("Can't convert %1 to unsinged long long for \"Content-Length\"")
-                                  .arg(headerRegExp.cap(3));
+                                  .arg(QString::fromLatin1(value));
+                } else if (m_hasContentLength && contentLength != m_contentLength) {
+                    result = Result::Error;
+                    m_error = QStringLiteral("Conflicting \"Content-Length\" values");
                 }
+                m_contentLength = contentLength;
+                m_hasContentLength = true;
             }
-        } else if (header == QLatin1String("\r\n")) {
-            if (m_contentLength != 0) {
+            m_rawHeaders.append(m_data);
+            m_data.clear();
+        } else if (m_data == "\r\n") {
+            m_data.clear();
+            // Chunked bodies are not decoded, request is rejected instead of reading its body as next request
+            if (m_hasTransferEncoding) {
+                m_error = m_hasContentLength
+                              ? QStringLiteral("Both \"Transfer-Encoding\" and \"Content-Length\" are set")
+                              : QStringLiteral("\"Transfer-Encoding\" is not supported");
+                m_errorStatusCode = m_hasContentLength ? 400 : 501;
+                result = Result::Error;
+            } else if (m_contentLength != 0) {
                 m_state = &HttpParser::bodyState;
-                result = Result::NeedMore;
+                result = Result::HeadersComplete;
             } else {
                 result = Result::Success;
             }
         } else {
-            m_error = QStringLiteral("Invalid header: %1").arg(header);
+            m_error = QStringLiteral("Invalid header: %1").arg(QString::fromUtf8(m_data));
+            m_data.clear();
             result = Result::Error;
         }
     } else {
         m_data.append(data);
         data.clear();
-        result = Result::NeedMore;
+        result = checkHeadersSize() ? Result::NeedMore : Result::Error;
     }
     return result;
 }
 
 HttpParser::Result HttpParser::bodyState(QByteArray &data)
 {
-    Result result;
-    m_data.append(data);
-    data.clear();
-    if ((qulonglong)m_data.size() > m_contentLength) {
-        m_error = QString();
-        result = Result::Error;
-    } else if ((qulonglong)m_data.size() == m_contentLength) {
-        result = Result::Success;
+    // Everything after Content-Length bytes belongs to next request and stays in data
+    const qulonglong bytesReceived = m_multipart ? m_multipartBytesReceived
+                                     : m_bodyFile ? static_cast<qulonglong>(m_bodyFile->size())
+                                                  : static_cast<qulonglong>(m_data.size());
+    const qulonglong bytesLeft = m_contentLength - bytesReceived;
+    const int bytesToTake = static_cast<int>(qMin(bytesLeft, static_cast<qulonglong>(data.size())));
+    if (m_multipart) {
+        m_multipartBytesReceived += static_cast<qulonglong>(bytesToTake);
+        if (m_multipart->feed(data.constData(), bytesToTake) == MultipartParser::Result::Error) {
+            m_error = QStringLiteral("Invalid multipart body: %1").arg(m_multipart->error());
+            return Result::Error;
+        }
+        if (static_cast<qulonglong>(bytesToTake) == bytesLeft && !m_multipart->isFinished()) {
+            m_error = QStringLiteral("Multipart body is not finished with closing boundary");
+            return Result::Error;
+        }
+    } else if (m_bodyFile) {
+        if (m_bodyFile->write(data.constData(), bytesToTake) != bytesToTake) {
+            m_error = QStringLiteral("Can't write request body to temporary file: %1").arg(m_bodyFile->errorString());
+            m_errorStatusCode = 500;
+            return Result::Error;
+        }
     } else {
-        result = Result::NeedMore;
+        m_data.append(data.constData(), bytesToTake);
     }
-    return result;
+    data.remove(0, bytesToTake);
+    return static_cast<qulonglong>(bytesToTake) == bytesLeft ? Result::Success : Result::NeedMore;
 }
@@ -0,0 +1,169 @@
+/* Copyright 2018, OpenSoft Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright notice, this list of
+ * conditions and the following disclaimer in the documentation and/or other materials provided
+ * with the distribution.
+ *     * Neither the name of OpenSoft Inc. nor the names of its contributors may be used to endorse
+ * or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include "proofnetwork/listenershandover_p.h"
+
+#include "proofnetwork/proofnetwork_global.h"
+
+#include <QFile>
+
+#ifdef Q_OS_LINUX
+#    include <sys/socket.h>
+#    include <sys/uio.h>
+#    include <sys/un.h>
+
+#    include <cerrno>
+#    include <cstring>
+#    include <poll.h>
+#    include <unistd.h>
+#endif
+
+using namespace Proof;
+
+#ifdef Q_OS_LINUX
+namespace {
+// SCM_MAX_FD, max descriptors that can be passed in one message
+constexpr int MAX_DESCRIPTORS = 253;
+} // namespace
+#endif
+
+bool ListenersHandover::send(const QString &path, const QVector<qintptr> &descriptors)
+{
+#ifdef Q_OS_LINUX
+    const QByteArray encodedPath = QFile::encodeName(path);
+    sockaddr_un address = {};
+    if (encodedPath.isEmpty() || static_cast<size_t>(encodedPath.size()) >= sizeof(address.sun_path)
+        || descriptors.isEmpty() || descriptors.count() > MAX_DESCRIPTORS) {
+        qCWarning(proofNetworkMiscLog) << "RestServer: wrong handover path or listeners count" << path
+                                       << descriptors.count();
+        return false;
+    }
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, encodedPath.constData(), static_cast<size_t>(encodedPath.size()));
+
+    const int unixSocket = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (unixSocket < 0 || ::connect(unixSocket, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+        qCWarning(proofNetworkMiscLog) << "RestServer: can't connect to handover socket" << path << ":"
+                                       << qt_error_string(errno);
+        if (unixSocket >= 0)
+            ::close(unixSocket);
+        return false;
+    }
+
+    QVector<int> rawDescriptors;
+    rawDescriptors.reserve(descriptors.count());
+    for (qintptr descriptor : descriptors)
+        rawDescriptors << static_cast<int>(descriptor);
+    const size_t descriptorsSize = sizeof(int) * static_cast<size_t>(rawDescriptors.count());
+    QByteArray control(static_cast<int>(CMSG_SPACE(descriptorsSize)), '\0');
+    // Descriptors count is sent as payload as well, at least one byte of data is required for ancillary data
+    quint32 count = static_cast<quint32>(rawDescriptors.count());
+    iovec payload = {&count, sizeof(count)};
+    msghdr message = {};
+    message.msg_iov = &payload;
+    message.msg_iovlen = 1;
+    message.msg_control = control.data();
+    message.msg_controllen = static_cast<size_t>(control.size());
+    cmsghdr *header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(descriptorsSize);
+    std::memcpy(CMSG_DATA(header), rawDescriptors.constData(), descriptorsSize);
+
+    const bool result = ::sendmsg(unixSocket, &message, MSG_NOSIGNAL) == static_cast<ssize_t>(sizeof(count));
+    if (!result)
+        qCWarning(proofNetworkMiscLog) << "RestServer: can't hand over listeners:" << qt_error_string(errno);
+    ::close(unixSocket);
+    return result;
+#else
+    Q_UNUSED(path)
+    Q_UNUSED(descriptors)
+    qCWarning(proofNetworkMiscLog) << "RestServer: listeners handover is not supported on this platform";
+    return false;
+#endif
+}
+
+QVector<qintptr> ListenersHandover::receive(const QString &path, int timeoutMsecs)
+{
+    QVector<qintptr> result;
+#ifdef Q_OS_LINUX
+    const QByteArray encodedPath = QFile::encodeName(path);
+    sockaddr_un address = {};
+    if (encodedPath.isEmpty() || static_cast<size_t>(encodedPath.size()) >= sizeof(address.sun_path)) {
+        qCWarning(proofNetworkMiscLog) << "RestServer: wrong handover path" << path;
+        return result;
+    }
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, encodedPath.constData(), static_cast<size_t>(encodedPath.size()));
+
+    ::unlink(encodedPath.constData());
+    const int listener = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener < 0 || ::bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0
+        || ::listen(listener, 1) != 0) {
+        qCWarning(proofNetworkMiscLog) << "RestServer: can't listen on handover socket" << path << ":"
+                                       << qt_error_string(errno);
+        if (listener >= 0)
+            ::close(listener);
+        return result;
+    }
+
+    pollfd pollDescriptor = {listener, POLLIN, 0};
+    const int pollResult = ::poll(&pollDescriptor, 1, timeoutMsecs > 0 ? timeoutMsecs : -1);
+    const int unixSocket = pollResult > 0 ? ::accept4(listener, nullptr, nullptr, SOCK_CLOEXEC) : -1;
+    ::close(listener);
+    ::unlink(encodedPath.constData());
+    if (unixSocket < 0) {
+        qCWarning(proofNetworkMiscLog) << "RestServer: no listeners received via" << path;
+        return result;
+    }
+
+    QByteArray control(static_cast<int>(CMSG_SPACE(sizeof(int) * MAX_DESCRIPTORS)), '\0');
+    quint32 count = 0;
+    iovec payload = {&count, sizeof(count)};
+    msghdr message = {};
+    message.msg_iov = &payload;
+    message.msg_iovlen = 1;
+    message.msg_control = control.data();
+    message.msg_controllen = static_cast<size_t>(control.size());
+    if (::recvmsg(unixSocket, &message, MSG_CMSG_CLOEXEC) == static_cast<ssize_t>(sizeof(count))) {
+        for (cmsghdr *header = CMSG_FIRSTHDR(&message); header; header = CMSG_NXTHDR(&message, header)) {
+            if (header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS)
+                continue;
+            const size_t receivedCount = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            QVector<int> rawDescriptors(static_cast<int>(receivedCount));
+            std::memcpy(rawDescriptors.data(), CMSG_DATA(header), receivedCount * sizeof(int));
+            for (int descriptor : qAsConst(rawDescriptors))
+                result << descriptor;
+        }
+    }
+    ::close(unixSocket);
+    if (result.count() != static_cast<int>(count))
+        qCWarning(proofNetworkMiscLog) << "RestServer: received" << result.count() << "listeners of" << count;
+#else
+    Q_UNUSED(path)
+    Q_UNUSED(timeoutMsecs)
+    qCWarning(proofNetworkMiscLog) << "RestServer: listeners handover is not supported on this platform";
+#endif
+    return result;
+}
@@ -0,0 +1,329 @@
+/* Copyright 2018, OpenSoft Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright notice, this list of
+ * conditions and the following disclaimer in the documentation and/or other materials provided
+ * with the distribution.
+ *     * Neither the name of OpenSoft Inc. nor the names of its contributors may be used to endorse
+ * or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include "proofnetwork/multipartparser.h"
+
+#include <QBuffer>
+#include <QDir>
+#include <QTemporaryFile>
+
+using namespace Proof;
+
+namespace {
+// RFC 2046 limits boundary to 70 characters
+constexpr int MAX_BOUNDARY_SIZE = 70;
+
+bool isWhitespace(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+// Parameter of header value in "type; name=value; name=\"quoted value\"" form, empty if there is no such parameter
+QByteArray headerParameter(const QByteArray &value, const QByteArray &name)
+{
+    int position = value.indexOf(';');
+    while (position != -1 && position < value.size()) {
+        ++position;
+        while (position < value.size() && isWhitespace(value.at(position)))
+            ++position;
+        const int nameStart = position;
+        while (position < value.size() && value.at(position) != '=' && value.at(position) != ';')
+            ++position;
+        const QByteArray parameterName = value.mid(nameStart, position - nameStart).trimmed();
+        if (position >= value.size() || value.at(position) == ';')
+            continue;
+        ++position;
+        QByteArray parameterValue;
+        if (position < value.size() && value.at(position) == '"') {
+            for (++position; position < value.size() && value.at(position) != '"'; ++position) {
+                if (value.at(position) == '\\' && position + 1 < value.size())
+                    ++position;
+                parameterValue.append(value.at(position));
+            }
+            position = value.indexOf(';', position);
+        } else {
+            const int valueEnd = value.indexOf(';', position);
+            parameterValue = value.mid(position, valueEnd == -1 ? -1 : valueEnd - position).trimmed();
+            position = valueEnd;
+        }
+        if (qstricmp(parameterName.constData(), name.constData()) == 0)
+            return parameterValue;
+    }
+    return QByteArray();
+}
+} // namespace
+
+QByteArray MultipartPart::header(const QByteArray &name) const
+{
+    for (const auto &header : headers) {
+        if (qstricmp(header.first.constData(), name.constData()) == 0)
+            return header.second;
+    }
+    return QByteArray();
+}
+
+MultipartParser::MultipartParser(const QByteArray &boundary, qint64 memoryThreshold)
+    : m_delimiter("\r\n--" + boundary), m_delimiterMatcher(m_delimiter), m_memoryThreshold(memoryThreshold)
+{
+    // First boundary usually has no CRLF before it, so it is added to find all delimiters the same way
+    m_buffer = "\r\n";
+    if (boundary.isEmpty() || boundary.size() > MAX_BOUNDARY_SIZE)
+        fail(QStringLiteral("Invalid multipart boundary: %1").arg(QString::fromLatin1(boundary)));
+}
+
+QByteArray MultipartParser::boundaryFromContentType(const QByteArray &contentType)
+{
+    if (!contentType.trimmed().toLower().startsWith("multipart/"))
+        return QByteArray();
+    return headerParameter(contentType, "boundary");
+}
+
+MultipartParser::Result MultipartParser::feed(const char *data, qint64 size)
+{
+    if (m_state == State::Failed)
+        return Result::Error;
+    if (m_state == State::Epilogue)
+        return Result::Finished;
+
+    m_buffer.append(data, static_cast<int>(size));
+    // Delimiter can be split between feeds, so this many bytes at the end can't be treated as body yet
+    const int keptTailSize = m_delimiter.size() - 1;
+    int position = 0;
+    bool needMore = false;
+    while (!needMore && m_state != State::Epilogue) {
+        switch (m_state) {
+        case State::Preamble: {
+            const int delimiterIndex = m_delimiterMatcher.indexIn(m_buffer, position);
+            if (delimiterIndex == -1) {
+                position = qMax(position, m_buffer.size() - keptTailSize);
+                needMore = true;
+            } else {
+                position = delimiterIndex + m_delimiter.size();
+                m_state = State::Delimiter;
+            }
+            break;
+        }
+        case State::Delimiter: {
+            // Delimiter is followed either by "--" if it is the closing one or by optional whitespaces and CRLF
+            if (m_buffer.size() - position < 2) {
+                needMore = true;
+                break;
+            }
+            if (m_buffer.at(position) == '-' && m_buffer.at(position + 1) == '-') {
+                position = m_buffer.size();
+                m_state = State::Epilogue;
+                break;
+            }
+            const int lineEnd = m_buffer.indexOf("\r\n", position);
+            if (lineEnd == -1 && m_buffer.size() - position > MAX_BOUNDARY_SIZE)
+                return fail(QStringLiteral("Boundary line is too long"));
+            if (lineEnd == -1) {
+                needMore = true;
+                break;
+            }
+            for (int i = position; i < lineEnd; ++i) {
+                if (!isWhitespace(m_buffer.at(i)))
+                    return fail(QStringLiteral("Invalid boundary line"));
+            }
+            position = lineEnd + 2;
+            m_state = State::Headers;
+            break;
+        }
+        case State::Headers: {
+            if (m_buffer.size() - position < 2) {
+                needMore = true;
+                break;
+            }
+            // Headers are ended by empty line, which goes right after boundary line if part has no headers
+            const bool hasHeaders = m_buffer.at(position) != '\r' || m_buffer.at(position + 1) != '\n';
+            const int headersEnd = hasHeaders ? m_buffer.indexOf("\r\n\r\n", position) : position - 2;
+            const int headersSize = headersEnd == -1 ? m_buffer.size() - position : headersEnd + 2 - position;
+            if (headersSize > m_maxHeadersSize && m_maxHeadersSize > 0)
+                return fail(QStringLiteral("Part headers are larger than %1 bytes").arg(m_maxHeadersSize));
+            if (headersEnd == -1) {
+                needMore = true;
+                break;
+            }
+            if (m_maxPartsCount > 0 && m_partsCount >= m_maxPartsCount)
+                return fail(QStringLiteral("Body contains more than %1 parts").arg(m_maxPartsCount));
+            if (!parseHeaders(m_buffer.constData() + position, qMax(0, headersSize)))
+                return Result::Error;
+            ++m_partsCount;
+            position = headersEnd + 4;
+            m_state = State::Body;
+            break;
+        }
+        case State::Body: {
+            const int delimiterIndex = m_delimiterMatcher.indexIn(m_buffer, position);
+            const int bodyEnd = delimiterIndex == -1 ? qMax(position, m_buffer.size() - keptTailSize) : delimiterIndex;
+            if (!appendToPart(m_buffer.constData() + position, bodyEnd - position))
+                return Result::Error;
+            if (delimiterIndex == -1) {
+                position = bodyEnd;
+                needMore = true;
+            } else {
+                finishPart();
+                position = delimiterIndex + m_delimiter.size();
+                m_state = State::Delimiter;
+            }
+            break;
+        }
+        case State::Epilogue:
+        case State::Failed:
+            break;
+        }
+    }
+
+    if (m_state == State::Epilogue) {
+        m_buffer.clear();
+        return Result::Finished;
+    }
+    m_buffer.remove(0, position);
+    return Result::NeedMore;
+}
+
+MultipartParser::Result MultipartParser::feed(const QByteArray &data)
+{
+    return feed(data.constData(), data.size());
+}
+
+void MultipartParser::setMaxHeadersSize(int size)
+{
+    m_maxHeadersSize = size;
+}
+
+void MultipartParser::setMaxPartsCount(int count)
+{
+    m_maxPartsCount = count;
+}
+
+void MultipartParser::setPartHandler(const PartHandler &handler)
+{
+    m_partHandler = handler;
+}
+
+bool MultipartParser::isFinished() const
+{
+    return m_state == State::Epilogue;
+}
+
+QString MultipartParser::error() const
+{
+    return m_error;
+}
+
+QVector<MultipartPart> MultipartParser::takeParts()
+{
+    QVector<MultipartPart> result;
+    result.swap(m_parts);
+    return result;
+}
+
+bool MultipartParser::parseHeaders(const char *data, int size)
+{
+    m_part = MultipartPart();
+    m_partData.clear();
+    m_partFile.reset();
+    const QByteArray headers(data, size);
+    int lineStart = 0;
+    while (lineStart < headers.size()) {
+        const int lineEnd = headers.indexOf("\r\n", lineStart);
+        const int colonIndex = headers.indexOf(':', lineStart);
+        if (colonIndex <= lineStart || colonIndex > lineEnd) {
+            fail(QStringLiteral("Invalid part header: %1")
+                     .arg(QString::fromUtf8(headers.mid(lineStart, lineEnd - lineStart))));
+            return false;
+        }
+        m_part.headers << qMakePair(headers.mid(lineStart, colonIndex - lineStart),
+                                    headers.mid(colonIndex + 1, lineEnd - colonIndex - 1).trimmed());
+        lineStart = lineEnd + 2;
+    }
+
+    const QByteArray disposition = m_part.header("Content-Disposition");
+    m_part.name = QString::fromUtf8(headerParameter(disposition, "name"));
+    m_part.fileName = QString::fromUtf8(headerParameter(disposition, "filename"));
+    // RFC 7578 default for parts without Content-Type
+    m_part.contentType = m_part.header("Content-Type");
+    if (m_part.contentType.isEmpty())
+        m_part.contentType = "text/plain";
+    return true;
+}
+
+bool MultipartParser::appendToPart(const char *data, int size)
+{
+    if (size <= 0)
+        return true;
+    m_part.size += size;
+    if (!m_partFile && m_partData.size() + size > m_memoryThreshold) {
+        m_partFile.reset(new QTemporaryFile(QDir::tempPath() + QStringLiteral("/proof_multipart_part_XXXXXX")));
+        if (!m_partFile->open()) {
+            fail(QStringLiteral("Can't create temporary file for part: %1").arg(m_partFile->errorString()));
+            return false;
+        }
+        if (m_partFile->write(m_partData) != m_partData.size()) {
+            fail(QStringLiteral("Can't write part to temporary file: %1").arg(m_partFile->errorString()));
+            return false;
+        }
+        m_partData.clear();
+    }
+    if (!m_partFile) {
+        m_partData.append(data, size);
+        return true;
+    }
+    if (m_partFile->write(data, size) != size) {
+        fail(QStringLiteral("Can't write part to temporary file: %1").arg(m_partFile->errorString()));
+        return false;
+    }
+    return true;
+}
+
+void MultipartParser::finishPart()
+{
+    if (m_partFile) {
+        m_partFile->seek(0);
+        m_part.body = m_partFile;
+        m_partFile.reset();
+    } else {
+        QSharedPointer<QBuffer> buffer(new QBuffer);
+        buffer->setData(m_partData);
+        buffer->open(QIODevice::ReadOnly);
+        m_part.body = buffer;
+        m_partData.clear();
+    }
+    if (m_partHandler)
+        m_partHandler(m_part);
+    m_parts << m_part;
+    m_part = MultipartPart();
+}
+
+MultipartParser::Result MultipartParser::fail(const QString &error)
+{
+    m_state = State::Failed;
+    m_error = error;
+    m_buffer.clear();
+    m_part = MultipartPart();
+    m_partData.clear();
+    m_partFile.reset();
+    return Result::Error;
+}
@@ -0,0 +1,114 @@
+/* Copyright 2018, OpenSoft Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright notice, this list of
+ * conditions and the following disclaimer in the documentation and/or other materials provided
+ * with the distribution.
+ *     * Neither the name of OpenSoft Inc. nor the names of its contributors may be used to endorse
+ * or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include "proofnetwork/restauthenticator.h"
+
+#include <QCryptographicHash>
+#include <QMessageAuthenticationCode>
+
+using namespace Proof;
+
+namespace {
+const QByteArray::Base64Options TOKEN_ENCODING = QByteArray::Base64UrlEncoding | QByteArray::OmitTrailingEquals;
+} // namespace
+
+RestAuthenticator::~RestAuthenticator()
+{}
+
+bool RestAuthenticator::isEqualInConstantTime(const QByteArray &left, const QByteArray &right)
+{
+    if (left.size() != right.size())
+        return false;
+    unsigned char difference = 0;
+    for (int i = 0; i < left.size(); ++i)
+        difference |= static_cast<unsigned char>(left[i] ^ right[i]);
+    return difference == 0;
+}
+
+BasicRestAuthenticator::BasicRestAuthenticator(const QString &userName, const QString &password)
+    : m_userName(userName),
+      m_digest(QCryptographicHash::hash(QStringLiteral("%1:%2").arg(userName, password).toLatin1().toBase64(),
+                                        QCryptographicHash::Sha256))
+{}
+
+QByteArray BasicRestAuthenticator::scheme() const
+{
+    return QByteArrayLiteral("Basic");
+}
+
+RestAuthResult BasicRestAuthenticator::validate(const QByteArray &credentials) const
+{
+    RestAuthResult result;
+    // Digests are compared instead of credentials, so comparison time doesn't depend on credentials length
+    result.isValid = isEqualInConstantTime(QCryptographicHash::hash(credentials, QCryptographicHash::Sha256),
+                                           m_digest);
+    if (result.isValid)
+        result.identity = m_userName;
+    return result;
+}
+
+HmacBearerRestAuthenticator::HmacBearerRestAuthenticator(const QByteArray &secret) : m_secret(secret)
+{}
+
+QByteArray HmacBearerRestAuthenticator::scheme() const
+{
+    return QByteArrayLiteral("Bearer");
+}
+
+RestAuthResult HmacBearerRestAuthenticator::validate(const QByteArray &credentials) const
+{
+    RestAuthResult result;
+    const int delimiterIndex = credentials.indexOf('.');
+    if (delimiterIndex <= 0)
+        return result;
+    const QByteArray payload = credentials.left(delimiterIndex);
+    if (!isEqualInConstantTime(signature(payload), credentials.mid(delimiterIndex + 1)))
+        return result;
+
+    const QByteArray decodedPayload = QByteArray::fromBase64(payload, TOKEN_ENCODING);
+    const int expirationIndex = decodedPayload.lastIndexOf(':');
+    if (expirationIndex == -1)
+        return result;
+    bool ok = false;
+    const qint64 expiresAt = decodedPayload.mid(expirationIndex + 1).toLongLong(&ok);
+    if (!ok || (expiresAt > 0 && expiresAt * 1000 <= QDateTime::currentMSecsSinceEpoch()))
+        return result;
+
+    result.isValid = true;
+    result.identity = QString::fromUtf8(decodedPayload.left(expirationIndex));
+    result.validUntil = expiresAt * 1000;
+    return result;
+}
+
+QByteArray HmacBearerRestAuthenticator::issueToken(const QString &identity, const QDateTime &expiresAt) const
+{
+    const qint64 expiration = expiresAt.isValid() ? expiresAt.toMSecsSinceEpoch() / 1000 : 0;
+    const QByteArray payload = (identity.toUtf8() + ':' + QByteArray::number(expiration)).toBase64(TOKEN_ENCODING);
+    return payload + '.' + signature(payload);
+}
+
+QByteArray HmacBearerRestAuthenticator::signature(const QByteArray &payload) const
+{
+    return QMessageAuthenticationCode::hash(payload, m_secret, QCryptographicHash::Sha256).toBase64(TOKEN_ENCODING);
+}
@@ -0,0 +1,163 @@
+/* Copyright 2018, OpenSoft Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright notice, this list of
+ * conditions and the following disclaimer in the documentation and/or other materials provided
+ * with the distribution.
+ *     * Neither the name of OpenSoft Inc. nor the names of its contributors may be used to endorse
+ * or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include "proofnetwork/restpushqueue_p.h"
+
+#include "proofnetwork/abstractrestserver.h"
+#include "proofnetwork/websocketcodec_p.h"
+
+using namespace Proof;
+
+namespace {
+QByteArray encodeEvent(const QByteArray &data, const QByteArray &event, const QByteArray &id)
+{
+    QByteArray result;
+    result.reserve(data.size() + event.size() + id.size() + 32);
+    if (!event.isEmpty())
+        result.append("event: ").append(event).append('\n');
+    if (!id.isEmpty())
+        result.append("id: ").append(id).append('\n');
+    const auto lines = data.split('\n');
+    for (const QByteArray &line : lines)
+        result.append("data: ").append(line).append('\n');
+    result.append('\n');
+    return result;
+}
+} // namespace
+
+bool RestPushQueue::push(const QByteArray &message)
+{
+    QMutexLocker lock(&m_mutex);
+    if (!m_isOpen)
+        return false;
+    if (m_queued.size() + message.size() > m_limit) {
+        ++*m_rejectedMessages;
+        return false;
+    }
+    if (!m_isWaiting) {
+        m_queued.append(message);
+        return true;
+    }
+    m_isWaiting = false;
+    Promise<QByteArray> waiting = m_waiting;
+    lock.unlock();
+    waiting.success(message);
+    return true;
+}
+
+Future<QByteArray> RestPushQueue::next()
+{
+    QMutexLocker lock(&m_mutex);
+    if (!m_queued.isEmpty()) {
+        QByteArray result;
+        result.swap(m_queued);
+        return Future<QByteArray>::successful(result);
+    }
+    if (!m_isOpen)
+        return Future<QByteArray>::successful(QByteArray());
+    m_waiting = Promise<QByteArray>();
+    m_isWaiting = true;
+    return m_waiting.future();
+}
+
+void RestPushQueue::close(const QByteArray &closingMessage)
+{
+    QMutexLocker lock(&m_mutex);
+    if (!m_isOpen)
+        return;
+    m_isOpen = false;
+    if (!m_isWaiting) {
+        m_queued.append(closingMessage);
+        return;
+    }
+    m_isWaiting = false;
+    Promise<QByteArray> waiting = m_waiting;
+    lock.unlock();
+    waiting.success(closingMessage);
+}
+
+void RestPushQueue::abort()
+{
+    QMutexLocker lock(&m_mutex);
+    m_isOpen = false;
+    m_queued.clear();
+    if (!m_isWaiting)
+        return;
+    m_isWaiting = false;
+    Promise<QByteArray> waiting = m_waiting;
+    lock.unlock();
+    waiting.success(QByteArray());
+}
+
+bool RestPushQueue::isOpen() const
+{
+    QMutexLocker lock(&m_mutex);
+    return m_isOpen;
+}
+
+qint64 RestPushQueue::queuedBytes() const
+{
+    QMutexLocker lock(&m_mutex);
+    return m_queued.size();
+}
+
+RestPushChannel::RestPushChannel(const std::shared_ptr<RestPushQueue> &queue) : m_queue(queue)
+{}
+
+bool RestPushChannel::isOpen() const
+{
+    return m_queue && m_queue->isOpen();
+}
+
+bool RestPushChannel::isWebSocket() const
+{
+    return m_queue && m_queue->isWebSocket;
+}
+
+qint64 RestPushChannel::queuedBytes() const
+{
+    return m_queue ? m_queue->queuedBytes() : 0;
+}
+
+bool RestPushChannel::push(const QByteArray &data, const QByteArray &event, const QByteArray &id)
+{
+    if (!m_queue)
+        return false;
+    return m_queue->push(m_queue->isWebSocket ? WebSocketCodec::encodeFrame(WebSocketCodec::TextFrame, data)
+                                              : encodeEvent(data, event, id));
+}
+
+bool RestPushChannel::pushBinary(const QByteArray &data)
+{
+    return m_queue && m_queue->isWebSocket
+           && m_queue->push(WebSocketCodec::encodeFrame(WebSocketCodec::BinaryFrame, data));
+}
+
+void RestPushChannel::close()
+{
+    if (m_queue) {
+        m_queue->close(m_queue->isWebSocket ? WebSocketCodec::encodeClose(WebSocketCodec::NormalClosure)
+                                            : QByteArray());
+    }
+}
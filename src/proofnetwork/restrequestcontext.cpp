@@ -0,0 +1,217 @@
+/* Copyright 2018, OpenSoft Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright notice, this list of
+ * conditions and the following disclaimer in the documentation and/or other materials provided
+ * with the distribution.
+ *     * Neither the name of OpenSoft Inc. nor the names of its contributors may be used to endorse
+ * or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include "proofnetwork/restrequestcontext.h"
+
+#include <QUrl>
+
+#include <cstring>
+
+using namespace Proof;
+
+namespace {
+bool isHeaderSpace(char c)
+{
+    return c == ' ' || c == '\t';
+}
+} // namespace
+
+RestRequestContext::RestRequestContext(const QString &method, const QString &uri, const QByteArray &rawHeaders,
+                                       const QByteArray &body)
+    : m_method(method), m_uri(uri), m_rawHeaders(rawHeaders), m_body(body)
+{
+    const char *data = m_rawHeaders.constData();
+    const int size = m_rawHeaders.size();
+    int lineStart = 0;
+    while (lineStart < size) {
+        const auto lineEndPointer = static_cast<const char *>(
+            std::memchr(data + lineStart, '\n', static_cast<size_t>(size - lineStart)));
+        const int lineEnd = lineEndPointer ? static_cast<int>(lineEndPointer - data) : size;
+        int valueEnd = lineEnd;
+        if (valueEnd > lineStart && data[valueEnd - 1] == '\r')
+            --valueEnd;
+        const auto colon = static_cast<const char *>(
+            std::memchr(data + lineStart, ':', static_cast<size_t>(valueEnd - lineStart)));
+        if (colon) {
+            int nameEnd = static_cast<int>(colon - data);
+            int valueStart = nameEnd + 1;
+            while (nameEnd > lineStart && isHeaderSpace(data[nameEnd - 1]))
+                --nameEnd;
+            while (valueStart < valueEnd && isHeaderSpace(data[valueStart]))
+                ++valueStart;
+            while (valueEnd > valueStart && isHeaderSpace(data[valueEnd - 1]))
+                --valueEnd;
+            m_headers.append(HeaderEntry{headerNameHash(data + lineStart, nameEnd - lineStart), lineStart,
+                                         nameEnd - lineStart, valueStart, valueEnd - valueStart});
+        }
+        lineStart = lineEnd + 1;
+    }
+}
+
+QString RestRequestContext::method() const
+{
+    return m_method;
+}
+
+QString RestRequestContext::uri() const
+{
+    return m_uri;
+}
+
+QStringRef RestRequestContext::path() const
+{
+    const int queryIndex = m_uri.indexOf('?');
+    return queryIndex == -1 ? QStringRef(&m_uri) : m_uri.leftRef(queryIndex);
+}
+
+QStringRef RestRequestContext::rawQuery() const
+{
+    const int queryIndex = m_uri.indexOf('?');
+    return queryIndex == -1 ? QStringRef() : m_uri.midRef(queryIndex + 1);
+}
+
+QByteArray RestRequestContext::body() const
+{
+    return m_body;
+}
+
+QString RestRequestContext::authIdentity() const
+{
+    return m_authIdentity;
+}
+
+bool RestRequestContext::hasHeader(QLatin1String name) const
+{
+    return findHeader(name, nullptr) != nullptr;
+}
+
+QByteArray RestRequestContext::header(QLatin1String name) const
+{
+    const HeaderEntry *entry = findHeader(name, nullptr);
+    return entry ? m_rawHeaders.mid(entry->valueStart, entry->valueLength) : QByteArray();
+}
+
+QList<QByteArray> RestRequestContext::headerValues(QLatin1String name) const
+{
+    QList<QByteArray> result;
+    for (const HeaderEntry *entry = findHeader(name, nullptr); entry; entry = findHeader(name, entry + 1))
+        result << m_rawHeaders.mid(entry->valueStart, entry->valueLength);
+    return result;
+}
+
+QByteArray RestRequestContext::rawHeaders() const
+{
+    return m_rawHeaders;
+}
+
+QStringList RestRequestContext::headers() const
+{
+    QStringList result;
+    result.reserve(m_headers.count());
+    const char *data = m_rawHeaders.constData();
+    for (const HeaderEntry &entry : m_headers) {
+        result << QString::fromUtf8(data + entry.nameStart, entry.nameLength) + QLatin1String(": ")
+                      + QString::fromUtf8(data + entry.valueStart, entry.valueLength);
+    }
+    return result;
+}
+
+bool RestRequestContext::hasQueryItem(const QString &name) const
+{
+    return query().hasQueryItem(name);
+}
+
+QString RestRequestContext::queryItem(const QString &name) const
+{
+    const QStringRef query = rawQuery();
+    int position = 0;
+    while (position < query.length()) {
+        int itemEnd = query.indexOf('&', position);
+        if (itemEnd == -1)
+            itemEnd = query.length();
+        const QStringRef item = query.mid(position, itemEnd - position);
+        position = itemEnd + 1;
+        const int separatorIndex = item.indexOf('=');
+        const QStringRef key = separatorIndex == -1 ? item : item.left(separatorIndex);
+        const bool isMatched = key.contains('%') ? QUrl::fromPercentEncoding(key.toUtf8()) == name : key == name;
+        if (isMatched)
+            return separatorIndex == -1 ? QString() : QUrl::fromPercentEncoding(item.mid(separatorIndex + 1).toUtf8());
+    }
+    return QString();
+}
+
+QUrlQuery RestRequestContext::query() const
+{
+    return QUrlQuery(rawQuery().toString());
+}
+
+int RestRequestContext::pathParametersCount() const
+{
+    return m_pathParameters.count();
+}
+
+QString RestRequestContext::pathParameter(int index) const
+{
+    if (index < 0 || index >= m_pathParameters.count())
+        return QString();
+    const QPair<int, int> &range = m_pathParameters[index];
+    return QString::fromUtf8(QByteArray::fromPercentEncoding(m_uri.midRef(range.first, range.second).toUtf8()));
+}
+
+QStringList RestRequestContext::pathParameters() const
+{
+    QStringList result;
+    result.reserve(m_pathParameters.count());
+    for (int i = 0; i < m_pathParameters.count(); ++i)
+        result << pathParameter(i);
+    return result;
+}
+
+const RestRequestContext::HeaderEntry *RestRequestContext::findHeader(QLatin1String name,
+                                                                      const HeaderEntry *from) const
+{
+    const uint hash = headerNameHash(name.data(), name.size());
+    const HeaderEntry *end = m_headers.constData() + m_headers.count();
+    for (const HeaderEntry *entry = from ? from : m_headers.constData(); entry < end; ++entry) {
+        if (entry->hash == hash && entry->nameLength == name.size()
+            && qstrnicmp(m_rawHeaders.constData() + entry->nameStart, name.data(),
+                         static_cast<uint>(name.size()))
+                   == 0) {
+            return entry;
+        }
+    }
+    return nullptr;
+}
+
+uint RestRequestContext::headerNameHash(const char *name, int length)
+{
+    // FNV-1a over lowercased name
+    uint result = 2166136261u;
+    for (int i = 0; i < length; ++i) {
+        const char c = name[i];
+        result ^= static_cast<uchar>(c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c);
+        result *= 16777619u;
+    }
+    return result;
+}
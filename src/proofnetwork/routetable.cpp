@@ -0,0 +1,133 @@
+/* Copyright 2018, OpenSoft Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright notice, this list of
+ * conditions and the following disclaimer in the documentation and/or other materials provided
+ * with the distribution.
+ *     * Neither the name of OpenSoft Inc. nor the names of its contributors may be used to endorse
+ * or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include "proofnetwork/routetable_p.h"
+
+#include <algorithm>
+
+using namespace Proof;
+
+RouteTable::RouteTable()
+{
+    m_nodes.resize(1);
+}
+
+int RouteTable::addRoute(const QList<QByteArray> &segments)
+{
+    int current = 0;
+    for (const QByteArray &segment : segments) {
+        const bool isParameter = segment.startsWith('{') && segment.endsWith('}');
+        int next = isParameter ? m_nodes[current].parameterChild : -1;
+        if (!isParameter) {
+            const auto &children = m_nodes[current].children;
+            auto found = std::find_if(children.cbegin(), children.cend(),
+                                      [this, &segment](int child) { return m_nodes[child].segment == segment; });
+            if (found != children.cend())
+                next = *found;
+        }
+        if (next == -1) {
+            next = m_nodes.count();
+            Node node;
+            node.segment = segment;
+            m_nodes << node;
+            if (isParameter)
+                m_nodes[current].parameterChild = next;
+            else
+                m_nodes[current].children << next;
+        }
+        current = next;
+    }
+
+    if (m_nodes[current].routeIndex == -1)
+        m_nodes[current].routeIndex = m_routesCount++;
+    return m_nodes[current].routeIndex;
+}
+
+int RouteTable::find(const QString &verb, const QStringRef &path, PathParameters &parameters) const
+{
+    parameters.clear();
+    const int verbNode = literalChild(0, QStringRef(&verb));
+    return verbNode == -1 ? -1 : matchNode(verbNode, path, 0, parameters);
+}
+
+// Literal child is preferred, parameter child at the same level is tried if literal one leads to dead end.
+// Recursion is bounded by depth of the tree, parameters are left untouched if nothing is matched
+int RouteTable::matchNode(int nodeIndex, const QStringRef &path, int position, PathParameters &parameters) const
+{
+    const int length = path.length();
+    while (position < length && path.at(position) == '/')
+        ++position;
+
+    if (position < length) {
+        int segmentEnd = path.indexOf('/', position);
+        if (segmentEnd == -1)
+            segmentEnd = length;
+        const QStringRef segment = path.mid(position, segmentEnd - position);
+        const int next = literalChild(nodeIndex, segment);
+        if (next != -1) {
+            const int routeIndex = matchNode(next, path, segmentEnd, parameters);
+            if (routeIndex != -1)
+                return routeIndex;
+        }
+        const int parameterChild = m_nodes[nodeIndex].parameterChild;
+        if (parameterChild != -1) {
+            const int parametersCount = parameters.count();
+            parameters.append(qMakePair(path.position() + position, segment.length()));
+            const int routeIndex = matchNode(parameterChild, path, segmentEnd, parameters);
+            if (routeIndex != -1)
+                return routeIndex;
+            parameters.resize(parametersCount);
+        }
+    }
+
+    const int routeIndex = m_nodes[nodeIndex].routeIndex;
+    if (routeIndex == -1)
+        return -1;
+
+    // Segments that are left after route is matched are passed as parameters too
+    while (position < length) {
+        if (path.at(position) == '/') {
+            ++position;
+            continue;
+        }
+        int segmentEnd = path.indexOf('/', position);
+        if (segmentEnd == -1)
+            segmentEnd = length;
+        parameters.append(qMakePair(path.position() + position, segmentEnd - position));
+        position = segmentEnd;
+    }
+    return routeIndex;
+}
+
+int RouteTable::literalChild(int nodeIndex, const QStringRef &segment) const
+{
+    for (int child : m_nodes[nodeIndex].children) {
+        const QByteArray &childSegment = m_nodes[child].segment;
+        if (childSegment.size() == segment.size()
+            && segment.compare(QLatin1String(childSegment), Qt::CaseInsensitive) == 0) {
+            return child;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,167 @@
+/* Copyright 2018, OpenSoft Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted
+ * provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright notice, this list of
+ * conditions and the following disclaimer.
+ *    * Redistributions in binary form must reproduce the above copyright notice, this list of
+ * conditions and the following disclaimer in the documentation and/or other materials provided
+ * with the distribution.
+ *     * Neither the name of OpenSoft Inc. nor the names of its contributors may be used to endorse
+ * or promote products derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include "proofnetwork/websocketcodec_p.h"
+
+#include <QCryptographicHash>
+#include <QtEndian>
+
+#include <limits>
+
+using namespace Proof;
+
+namespace {
+// Message is buffered in QByteArray, so it can't be bigger than it allows whatever limit is given
+constexpr quint64 MAX_MESSAGE_SIZE = std::numeric_limits<int>::max() - 14;
+constexpr int MASK_SIZE = 4;
+const QByteArray HANDSHAKE_GUID = QByteArrayLiteral("258EAFA5-E914-47DA-95CA-C5AB0DC85B11");
+} // namespace
+
+WebSocketCodec::Result WebSocketCodec::decode(QByteArray &data, quint64 maxMessageSize)
+{
+    maxMessageSize = qMin(maxMessageSize, MAX_MESSAGE_SIZE);
+    forever {
+        if (data.size() < 2)
+            return Result::NeedMore;
+
+        const auto *header = reinterpret_cast<const uchar *>(data.constData());
+        const bool isFinal = header[0] & 0x80;
+        const auto opcode = static_cast<Opcode>(header[0] & 0x0F);
+        const bool isMasked = header[1] & 0x80;
+        quint64 length = header[1] & 0x7F;
+        int headerSize = 2;
+        if (length == 126) {
+            if (data.size() < 4)
+                return Result::NeedMore;
+            length = qFromBigEndian<quint16>(header + 2);
+            headerSize = 4;
+        } else if (length == 127) {
+            if (data.size() < 10)
+                return Result::NeedMore;
+            length = qFromBigEndian<quint64>(header + 2);
+            headerSize = 10;
+        }
+        // Clients must mask their frames, extensions are not negotiated so reserved bits must be empty
+        const bool isControl = opcode & 0x08;
+        if (!isMasked || (header[0] & 0x70) || (isControl && (!isFinal || length > 125)))
+            return fail(ProtocolError);
+        // Length can be up to 2^64 - 1, so it is compared to room that is left instead of adding to it
+        const auto receivedSize = static_cast<quint64>(m_fragments.size());
+        if (receivedSize > maxMessageSize || length > maxMessageSize - receivedSize)
+            return fail(MessageTooBig);
+        const quint64 frameSize = static_cast<quint64>(headerSize) + MASK_SIZE + length;
+        if (static_cast<quint64>(data.size()) < frameSize)
+            return Result::NeedMore;
+
+        QByteArray payload = data.mid(headerSize + MASK_SIZE, static_cast<int>(length));
+        const char *mask = data.constData() + headerSize;
+        for (int i = 0; i < payload.size(); ++i)
+            payload[i] = static_cast<char>(payload[i] ^ mask[i % MASK_SIZE]);
+        data.remove(0, static_cast<int>(frameSize));
+
+        switch (opcode) {
+        case PingFrame:
+            m_message = payload;
+            return Result::Ping;
+        case PongFrame:
+            continue;
+        case CloseFrame:
+            return Result::Close;
+        case ContinuationFrame:
+        case TextFrame:
+        case BinaryFrame:
+            break;
+        default:
+            return fail(ProtocolError);
+        }
+
+        // Continuation is expected only inside fragmented message and only there
+        if ((opcode == ContinuationFrame) == (m_fragmentsOpcode == ContinuationFrame))
+            return fail(ProtocolError);
+        if (opcode != ContinuationFrame)
+            m_fragmentsOpcode = opcode;
+        m_fragments.append(payload);
+        if (!isFinal)
+            continue;
+
+        m_isBinary = m_fragmentsOpcode == BinaryFrame;
+        m_message.clear();
+        m_message.swap(m_fragments);
+        m_fragmentsOpcode = ContinuationFrame;
+        return Result::Message;
+    }
+}
+
+QByteArray WebSocketCodec::message() const
+{
+    return m_message;
+}
+
+bool WebSocketCodec::isBinary() const
+{
+    return m_isBinary;
+}
+
+WebSocketCodec::CloseCode WebSocketCodec::errorCode() const
+{
+    return m_errorCode;
+}
+
+QByteArray WebSocketCodec::encodeFrame(Opcode opcode, const QByteArray &payload)
+{
+    QByteArray result;
+    result.reserve(payload.size() + 10);
+    result.append(static_cast<char>(0x80 | opcode));
+    if (payload.size() < 126) {
+        result.append(static_cast<char>(payload.size()));
+    } else if (payload.size() <= 0xFFFF) {
+        result.append(static_cast<char>(126));
+        result.append(2, '\0');
+        qToBigEndian(static_cast<quint16>(payload.size()), reinterpret_cast<uchar *>(result.data() + 2));
+    } else {
+        result.append(static_cast<char>(127));
+        result.append(8, '\0');
+        qToBigEndian(static_cast<quint64>(payload.size()), reinterpret_cast<uchar *>(result.data() + 2));
+    }
+    result.append(payload);
+    return result;
+}
+
+QByteArray WebSocketCodec::encodeClose(CloseCode code)
+{
+    QByteArray payload(2, '\0');
+    qToBigEndian(static_cast<quint16>(code), reinterpret_cast<uchar *>(payload.data()));
+    return encodeFrame(CloseFrame, payload);
+}
+
+QByteArray WebSocketCodec::acceptKey(const QByteArray &key)
+{
+    return QCryptographicHash::hash(key + HANDSHAKE_GUID, QCryptographicHash::Sha1).toBase64();
+}
+
+WebSocketCodec::Result WebSocketCodec::fail(CloseCode code)
+{
+    m_errorCode = code;
+    return Result::Error;
+}
@@ -57,3 +57,37 @@ TEST(MemoryStorageNotificationHandlerTest, notify)
         EXPECT_EQ(last.second, all.last());
     }
 }
+
+TEST(MemoryStorageNotificationHandlerTest, serializedMessages)
+{
+    MemoryStorageNotificationHandler *handler = new MemoryStorageNotificationHandler("pagesHandler");
+    QDateTime beforeStart = QDateTime::currentDateTimeUtc().addSecs(-1);
+    for (int i = 1; i <= 5; ++i)
+        handler->notify(QStringLiteral("message %1").arg(i), ErrorNotifier::Severity::Error, QString());
+
+    quint64 nextCursor = 0;
+    auto page = handler->serializedMessages(0, QDateTime(), 2, nextCursor);
+    ASSERT_EQ(2, page.count());
+    EXPECT_TRUE(page[0].contains("\"message\":\"message 5\"")) << page[0].constData();
+    EXPECT_TRUE(page[1].contains("\"message\":\"message 4\"")) << page[1].constData();
+    EXPECT_TRUE(page[0].startsWith("{\"")) << page[0].constData();
+    EXPECT_NE(0u, nextCursor);
+
+    page = handler->serializedMessages(nextCursor, QDateTime(), 2, nextCursor);
+    ASSERT_EQ(2, page.count());
+    EXPECT_TRUE(page[0].contains("\"message\":\"message 3\"")) << page[0].constData();
+    EXPECT_TRUE(page[1].contains("\"message\":\"message 2\"")) << page[1].constData();
+
+    page = handler->serializedMessages(nextCursor, QDateTime(), 2, nextCursor);
+    ASSERT_EQ(1, page.count());
+    EXPECT_TRUE(page[0].contains("\"message\":\"message 1\"")) << page[0].constData();
+    EXPECT_EQ(0u, nextCursor);
+
+    page = handler->serializedMessages(0, beforeStart, 0, nextCursor);
+    EXPECT_EQ(5, page.count());
+    page = handler->serializedMessages(0, QDateTime::currentDateTimeUtc().addSecs(10), 0, nextCursor);
+    EXPECT_TRUE(page.isEmpty());
+    EXPECT_EQ(0u, nextCursor);
+    EXPECT_EQ(5, handler->messages().count());
+    delete handler;
+}
@@ -1,24 +1,142 @@
 // clazy:skip
 
+#include "proofseed/tasks.h"
+
 #include "proofcore/coreapplication.h"
+#include "proofcore/errornotifier.h"
+#include "proofcore/memorystoragenotificationhandler.h"
 
 #include "proofnetwork/abstractrestserver.h"
 #include "proofnetwork/proofnetwork_types.h"
+#include "proofnetwork/restauthenticator.h"
 #include "proofnetwork/restclient.h"
 
 #include "gtest/proof/test_global.h"
 
+#include <QDir>
 #include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QNetworkReply>
+#include <QRegExp>
+#include <QSemaphore>
+#include <QTcpSocket>
+#include <QTemporaryFile>
 #include <QTest>
+#include <QtEndian>
 
+#include <atomic>
 #include <tuple>
 
+#ifdef Q_OS_LINUX
+#    include <sys/socket.h>
+#    include <sys/un.h>
+
+#    include <cstring>
+#endif
+
 using testing::Test;
 using testing::TestWithParam;
 
+static QByteArray readHttpResponse(QTcpSocket *socket, QByteArray &buffer)
+{
+    QTime timer;
+    timer.start();
+    while (timer.elapsed() < 10000) {
+        int headersEnd = buffer.indexOf("\r\n\r\n");
+        if (headersEnd != -1) {
+            QRegExp contentLengthRegExp("\r\nContent-Length: (\\d+)\r\n", Qt::CaseInsensitive);
+            int contentLength = 0;
+            if (contentLengthRegExp.indexIn(QString::fromLatin1(buffer.left(headersEnd + 2))) != -1)
+                contentLength = contentLengthRegExp.cap(1).toInt();
+            int responseSize = headersEnd + 4 + contentLength;
+            if (buffer.left(headersEnd + 2).contains("\r\nTransfer-Encoding: chunked\r\n")) {
+                const int lastChunkIndex = buffer.indexOf("0\r\n\r\n", headersEnd + 4);
+                responseSize = lastChunkIndex == -1 ? buffer.size() + 1 : lastChunkIndex + 5;
+            }
+            if (buffer.size() >= responseSize) {
+                QByteArray response = buffer.left(responseSize);
+                buffer.remove(0, responseSize);
+                return response;
+            }
+        }
+        if (socket->state() != QAbstractSocket::ConnectedState && !socket->bytesAvailable())
+            break;
+        socket->waitForReadyRead(50);
+        buffer.append(socket->readAll());
+    }
+    return QByteArray();
+}
+
+struct Http2Frame
+{
+    quint8 type = 0;
+    quint8 flags = 0;
+    quint32 streamId = 0;
+    QByteArray payload;
+};
+
+static QByteArray http2Frame(quint8 type, quint8 flags, quint32 streamId, const QByteArray &payload = QByteArray())
+{
+    QByteArray result(9, 0);
+    qToBigEndian<quint32>(static_cast<quint32>(payload.size()) << 8 | type, result.data());
+    result[4] = static_cast<char>(flags);
+    qToBigEndian<quint32>(streamId, result.data() + 5);
+    return result + payload;
+}
+
+// GET request encoded with HPACK literals without Huffman coding
+static QByteArray http2GetRequest(quint32 streamId, const QByteArray &path)
+{
+    // :method GET and :scheme http are indexed, :path and :authority have indexed names
+    const QByteArray block = QByteArray("\x82\x86\x04") + static_cast<char>(path.size()) + path + '\x01' + '\x09'
+                             + "127.0.0.1";
+    // END_STREAM | END_HEADERS
+    return http2Frame(0x1, 0x5, streamId, block);
+}
+
+static bool readHttp2Frame(QTcpSocket *socket, QByteArray &buffer, Http2Frame &frame)
+{
+    QTime timer;
+    timer.start();
+    while (timer.elapsed() < 10000) {
+        if (buffer.size() >= 9) {
+            const int length = static_cast<int>(qFromBigEndian<quint32>(buffer.constData()) >> 8);
+            if (buffer.size() >= 9 + length) {
+                frame.type = static_cast<quint8>(buffer.at(3));
+                frame.flags = static_cast<quint8>(buffer.at(4));
+                frame.streamId = qFromBigEndian<quint32>(buffer.constData() + 5) & 0x7FFFFFFF;
+                frame.payload = buffer.mid(9, length);
+                buffer.remove(0, 9 + length);
+                return true;
+            }
+        }
+        if (socket->state() != QAbstractSocket::ConnectedState && !socket->bytesAvailable())
+            break;
+        socket->waitForReadyRead(50);
+        buffer.append(socket->readAll());
+    }
+    return false;
+}
+
+// Reads frames until all streams are finished, returns header blocks and bodies of streams
+static void readHttp2Streams(QTcpSocket *socket, QByteArray &buffer, int count, QMap<quint32, QByteArray> &headers,
+                             QMap<quint32, QByteArray> &bodies, QMap<quint32, quint32> &resets)
+{
+    Http2Frame frame;
+    int finished = 0;
+    while (finished < count && readHttp2Frame(socket, buffer, frame)) {
+        if (frame.type == 0x1)
+            headers[frame.streamId] = frame.payload;
+        else if (frame.type == 0x0)
+            bodies[frame.streamId] += frame.payload;
+        else if (frame.type == 0x3)
+            resets[frame.streamId] = qFromBigEndian<quint32>(frame.payload.constData());
+        if (((frame.type == 0x0 || frame.type == 0x1) && (frame.flags & 0x1)) || frame.type == 0x3)
+            ++finished;
+    }
+}
+
 class TestRestServer : public Proof::AbstractRestServer
 {
     Q_OBJECT
@@ -49,7 +167,48 @@ class TestRestServerWithoutAuth : public Proof::AbstractRestServer
 {
     Q_OBJECT
 public:
-    TestRestServerWithoutAuth() : Proof::AbstractRestServer(9092) {}
+    explicit TestRestServerWithoutAuth(quint16 port = 9092) : Proof::AbstractRestServer(port)
+    {
+        addRoute("GET", "/orders/{id}/items",
+                 [this](QTcpSocket *socket, const QStringList &, const QStringList &methodVariableParts,
+                        const QUrlQuery &, const QByteArray &) {
+                     sendAnswer(socket, "order items", "text/plain", 200, methodVariableParts.join('/'));
+                 });
+        addRoute("GET", "/orders/latest/summary",
+                 [this](QTcpSocket *socket, const QStringList &, const QStringList &, const QUrlQuery &,
+                        const QByteArray &) { sendAnswer(socket, "latest summary", "text/plain"); });
+        addRoute("GET", "/customers/{id}", [this](QTcpSocket *socket, const Proof::RestRequestContext &context) {
+            sendAnswer(socket, context.header(QLatin1String("x-trace-id")), "text/plain", 200,
+                       context.pathParameter(0) + "|" + context.queryItem("name"));
+        });
+        addRoute("GET", "/whoami", [this](QTcpSocket *socket, const Proof::RestRequestContext &context) {
+            sendAnswer(socket, context.authIdentity().toUtf8(), "text/plain");
+        });
+        setRouteExecutionPolicy("GET", "/heavy/test-method", Proof::RestExecutionPolicy::HandlerPool);
+        setRouteExecutionPolicy("GET", "/latched/test-method", Proof::RestExecutionPolicy::HandlerPool);
+        setRouteBodyStreamed("POST", "/upload/test-method", true);
+        setRouteBodyMultipart("POST", "/form/test-method", true);
+        setRouteMaxPendingBytes("POST", "/context/test-method", 1024);
+        setRouteCacheTtl("GET", "/cached/test-method", 60000);
+        if (servedFile.open()) {
+            servedFile.write("0123456789abcdefghij");
+            servedFile.flush();
+        }
+    }
+
+    QTemporaryFile servedFile;
+    // Latched handler doesn't answer until test releases it
+    QSemaphore handlerLatch;
+    std::atomic_int cachedMethodCalls{0};
+    mutable std::atomic_int healthStatusCalls{0};
+
+protected:
+    Proof::Future<Proof::HealthStatusMap> healthStatus(bool) const override
+    {
+        ++healthStatusCalls;
+        const auto calls = qMakePair(QDateTime::currentDateTimeUtc(), QVariant(healthStatusCalls.load()));
+        return Proof::Future<Proof::HealthStatusMap>::successful(Proof::HealthStatusMap{{"calls", calls}});
+    }
 
 public slots:
     void rest_get_TestMethod(QTcpSocket *socket, const QStringList &, const QStringList &, const QUrlQuery &,
@@ -64,6 +223,124 @@ public slots:
         sendAnswer(socket, __func__, "text/plain");
     }
 
+    void rest_post_Upload_TestMethod(QTcpSocket *socket, const QStringList &, const QStringList &, const QUrlQuery &,
+                                     const QByteArray &body)
+    {
+        QSharedPointer<QIODevice> bodyDevice = requestBody(socket);
+        if (!bodyDevice || !body.isEmpty()) {
+            sendInternalError(socket);
+            return;
+        }
+        sendAnswer(socket, bodyDevice->readAll(), "text/plain", 200,
+                   bodyDevice->inherits("QFileDevice") ? "file" : "memory");
+    }
+
+    // Answers with "name=size:storage" line for each part
+    void rest_post_Form_TestMethod(QTcpSocket *socket, const QStringList &, const QStringList &, const QUrlQuery &,
+                                   const QByteArray &body)
+    {
+        if (!body.isEmpty()) {
+            sendInternalError(socket);
+            return;
+        }
+        QByteArray result;
+        const auto parts = requestParts(socket);
+        for (const auto &part : parts) {
+            result += part.name.toUtf8() + "=" + QByteArray::number(part.body->readAll().size()) + ":"
+                      + (part.body->inherits("QFileDevice") ? "file" : "memory") + "\n";
+        }
+        sendAnswer(socket, result, "text/plain");
+    }
+
+    void rest_post_Echo_TestMethod(QTcpSocket *socket, const QStringList &, const QStringList &, const QUrlQuery &,
+                                   const QByteArray &body)
+    {
+        sendAnswer(socket, body, "text/plain");
+    }
+
+    void rest_post_Context_TestMethod(QTcpSocket *socket, const Proof::RestRequestContext &context)
+    {
+        sendAnswer(socket, context.body(), "text/plain", 200,
+                   QString::number(context.headerValues(QLatin1String("X-Tag")).count()));
+    }
+
+    void rest_get_Events_TestMethod(QTcpSocket *socket, const QStringList &, const QStringList &, const QUrlQuery &,
+                                    const QByteArray &)
+    {
+        Proof::RestPushChannel channel = openEventStream(socket);
+        channel.push("hello", "greeting", "1");
+        channel.push("multi\nline");
+        channel.close();
+        EXPECT_FALSE(channel.push("after close"));
+    }
+
+    void rest_get_Socket_TestMethod(QTcpSocket *socket, const QStringList &, const QStringList &, const QUrlQuery &,
+                                    const QByteArray &)
+    {
+        acceptWebSocket(socket, [](Proof::RestPushChannel channel, const QByteArray &message, bool isBinary) {
+            if (isBinary)
+                channel.pushBinary(message);
+            else
+                channel.push("echo: " + message);
+        });
+    }
+
+    void rest_get_Stream_TestMethod(QTcpSocket *socket, const QStringList &, const QStringList &, const QUrlQuery &,
+                                    const QByteArray &)
+    {
+        auto counter = std::make_shared<int>(0);
+        sendStreamedAnswer(socket, [counter]() {
+            ++*counter;
+            return Proof::Future<QByteArray>::successful(*counter <= 3 ? QByteArray(10, 'a' + *counter - 1)
+                                                                         : QByteArray());
+        }, "text/plain");
+    }
+
+    void rest_get_File_TestMethod(QTcpSocket *socket, const QStringList &, const QStringList &, const QUrlQuery &,
+                                  const QByteArray &)
+    {
+        sendFile(socket, servedFile.fileName(), "text/plain");
+    }
+
+    void rest_get_Cached_TestMethod(QTcpSocket *socket, const QStringList &, const QStringList &, const QUrlQuery &,
+                                    const QByteArray &)
+    {
+        sendAnswer(socket, "call " + QByteArray::number(++cachedMethodCalls), "text/plain");
+    }
+
+    void rest_get_Heavy_TestMethod(QTcpSocket *socket, const QStringList &, const QStringList &, const QUrlQuery &,
+                                   const QByteArray &)
+    {
+        QThread::msleep(200);
+        sendAnswer(socket, __func__, "text/plain");
+    }
+
+    void rest_get_Latched_TestMethod(QTcpSocket *socket, const QStringList &, const QStringList &, const QUrlQuery &,
+                                     const QByteArray &)
+    {
+        handlerLatch.tryAcquire(1, 10000);
+        sendAnswer(socket, __func__, "text/plain");
+    }
+
+    void rest_get_Delayed_TestMethod(QTcpSocket *socket, const QStringList &, const QStringList &, const QUrlQuery &,
+                                     const QByteArray &)
+    {
+        Proof::RestRequestHandle request = requestHandle(socket);
+        Proof::tasks::run([this, request]() {
+            QThread::msleep(300);
+            sendAnswer(request, "rest_get_Delayed_TestMethod", "text/plain");
+        });
+    }
+
+    void rest_get_LateSocket_TestMethod(QTcpSocket *socket, const QStringList &, const QStringList &,
+                                        const QUrlQuery &, const QByteArray &)
+    {
+        Proof::tasks::run([this, socket]() {
+            QThread::msleep(300);
+            sendAnswer(socket, "rest_get_LateSocket_TestMethod", "text/plain");
+        });
+    }
+
     void rest_get_TestMethodWithCustomHeader(QTcpSocket *socket, const QStringList &, const QStringList &,
                                              const QUrlQuery &, const QByteArray &)
     {
@@ -345,6 +622,71 @@ TEST_F(RestServerTest, doubleRequest)
     delete slowReply;
 }
 
+TEST_F(RestServerTest, typedRoute)
+{
+    ASSERT_TRUE(restServerWithoutAuthUT->isListening());
+
+    QNetworkReply *reply = restClientWithoutAuthUT->get("/Orders/42/items/extra").result();
+    QTime timer;
+    timer.start();
+    while (!reply->isFinished() && timer.elapsed() < 10000)
+        QThread::msleep(5);
+    ASSERT_TRUE(reply->isFinished());
+    EXPECT_EQ(200, reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt());
+    EXPECT_EQ("42/extra", reply->attribute(QNetworkRequest::HttpReasonPhraseAttribute).toString());
+    EXPECT_EQ("order items", QString(reply->readAll()).trimmed());
+    delete reply;
+
+    reply = restClientWithoutAuthUT->get("/orders/42").result();
+    timer.start();
+    while (!reply->isFinished() && timer.elapsed() < 10000)
+        QThread::msleep(5);
+    ASSERT_TRUE(reply->isFinished());
+    EXPECT_EQ(404, reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt());
+    delete reply;
+
+    // Literal segment that leads to dead end falls back to parameter at the same level
+    reply = restClientWithoutAuthUT->get("/orders/latest/items").result();
+    timer.start();
+    while (!reply->isFinished() && timer.elapsed() < 10000)
+        QThread::msleep(5);
+    ASSERT_TRUE(reply->isFinished());
+    EXPECT_EQ(200, reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt());
+    EXPECT_EQ("latest", reply->attribute(QNetworkRequest::HttpReasonPhraseAttribute).toString());
+    EXPECT_EQ("order items", QString(reply->readAll()).trimmed());
+    delete reply;
+
+    reply = restClientWithoutAuthUT->get("/orders/latest/summary").result();
+    timer.start();
+    while (!reply->isFinished() && timer.elapsed() < 10000)
+        QThread::msleep(5);
+    ASSERT_TRUE(reply->isFinished());
+    EXPECT_EQ(200, reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt());
+    EXPECT_EQ("latest summary", QString(reply->readAll()).trimmed());
+    delete reply;
+}
+
+TEST_F(RestServerTest, requestContext)
+{
+    ASSERT_TRUE(restServerWithoutAuthUT->isListening());
+
+    QTcpSocket socket;
+    socket.connectToHost("127.0.0.1", 9092);
+    ASSERT_TRUE(socket.waitForConnected(10000));
+    QByteArray buffer;
+    socket.write("GET /customers/a%20b?name=John%20Doe&x=1 HTTP/1.1\r\nHost: 127.0.0.1\r\n"
+                 "X-TRACE-ID:  abc-123 \r\n\r\n");
+    QByteArray response = readHttpResponse(&socket, buffer);
+    EXPECT_TRUE(response.startsWith("HTTP/1.1 200 a b|John Doe\r\n")) << response.constData();
+    EXPECT_TRUE(response.endsWith("\r\n\r\nabc-123")) << response.constData();
+
+    socket.write("POST /context/test-method HTTP/1.1\r\nHost: 127.0.0.1\r\nx-tag: 1\r\nX-Tag: 2\r\n"
+                 "Content-Length: 4\r\n\r\nbody");
+    response = readHttpResponse(&socket, buffer);
+    EXPECT_TRUE(response.startsWith("HTTP/1.1 200 2\r\n")) << response.constData();
+    EXPECT_TRUE(response.endsWith("\r\n\r\nbody")) << response.constData();
+}
+
 TEST_F(RestServerTest, dynamicHeaderRetrieve)
 {
     ASSERT_TRUE(restServerWithoutAuthUT->isListening());
@@ -412,6 +754,33 @@ TEST_F(RestServerTest, bothHeadersRetrieve)
     delete reply;
 }
 
+TEST_F(RestServerTest, predefinedHeaderSetAndUnset)
+{
+    ASSERT_TRUE(restServerWithoutAuthUT->isListening());
+    restServerWithoutAuthUT->setCustomHeader("RemovableHeader", "removable header value");
+
+    QNetworkReply *reply = restClientWithoutAuthUT->get("/test-method").result();
+    QTime timer;
+    timer.start();
+    while (!reply->isFinished() && timer.elapsed() < 10000)
+        QThread::msleep(5);
+    ASSERT_TRUE(reply->isFinished());
+    EXPECT_EQ(200, reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt());
+    EXPECT_EQ("OK", reply->attribute(QNetworkRequest::HttpReasonPhraseAttribute).toString());
+    EXPECT_EQ("removable header value", reply->rawHeader("RemovableHeader"));
+    delete reply;
+
+    restServerWithoutAuthUT->unsetCustomHeader("RemovableHeader");
+    reply = restClientWithoutAuthUT->get("/test-method").result();
+    timer.start();
+    while (!reply->isFinished() && timer.elapsed() < 10000)
+        QThread::msleep(5);
+    ASSERT_TRUE(reply->isFinished());
+    EXPECT_EQ(200, reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt());
+    EXPECT_FALSE(reply->hasRawHeader("RemovableHeader"));
+    delete reply;
+}
+
 TEST_F(RestServerTest, errorCode)
 {
     ASSERT_TRUE(restServerWithoutAuthUT->isListening());
@@ -508,4 +877,1227 @@ TEST_F(RestServerTest, notImplementedHttpCode)
     delete reply;
 }
 
+TEST_F(RestServerTest, keepAlive)
+{
+    ASSERT_TRUE(restServerWithoutAuthUT->isListening());
+
+    QTcpSocket socket;
+    socket.connectToHost("127.0.0.1", 9092);
+    ASSERT_TRUE(socket.waitForConnected(10000));
+    QByteArray buffer;
+    for (int i = 0; i < 3; ++i) {
+        socket.write("GET /test-method HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+        const QByteArray response = readHttpResponse(&socket, buffer);
+        EXPECT_TRUE(response.startsWith("HTTP/1.1 200")) << response.constData();
+        EXPECT_TRUE(response.contains("\r\nConnection: keep-alive\r\n")) << response.constData();
+        EXPECT_TRUE(response.endsWith("rest_get_TestMethod")) << response.constData();
+    }
+    EXPECT_EQ(QAbstractSocket::ConnectedState, socket.state());
+}
+
+TEST_F(RestServerTest, connectionClose)
+{
+    ASSERT_TRUE(restServerWithoutAuthUT->isListening());
+
+    QTcpSocket socket;
+    socket.connectToHost("127.0.0.1", 9092);
+    ASSERT_TRUE(socket.waitForConnected(10000));
+    QByteArray buffer;
+    socket.write("GET /test-method HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n\r\n");
+    const QByteArray response = readHttpResponse(&socket, buffer);
+    EXPECT_TRUE(response.startsWith("HTTP/1.1 200")) << response.constData();
+    EXPECT_TRUE(response.contains("\r\nConnection: close\r\n")) << response.constData();
+    EXPECT_TRUE(response.endsWith("rest_get_TestMethod")) << response.constData();
+    EXPECT_TRUE(socket.state() == QAbstractSocket::UnconnectedState || socket.waitForDisconnected(10000));
+}
+
+TEST_F(RestServerTest, http10WithoutKeepAlive)
+{
+    ASSERT_TRUE(restServerWithoutAuthUT->isListening());
+
+    QTcpSocket socket;
+    socket.connectToHost("127.0.0.1", 9092);
+    ASSERT_TRUE(socket.waitForConnected(10000));
+    QByteArray buffer;
+    socket.write("GET /test-method HTTP/1.0\r\n\r\n");
+    const QByteArray response = readHttpResponse(&socket, buffer);
+    EXPECT_TRUE(response.contains("\r\nConnection: close\r\n")) << response.constData();
+    EXPECT_TRUE(socket.state() == QAbstractSocket::UnconnectedState || socket.waitForDisconnected(10000));
+}
+
+TEST_F(RestServerTest, transferEncodingWithoutKeepAlive)
+{
+    ASSERT_TRUE(restServerWithoutAuthUT->isListening());
+
+    QTcpSocket socket;
+    socket.connectToHost("127.0.0.1", 9092);
+    ASSERT_TRUE(socket.waitForConnected(10000));
+    QByteArray buffer;
+    socket.write("GET /test-method HTTP/1.1\r\nHost: 127.0.0.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+                 "2e\r\nGET /test-method HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n\r\n0\r\n\r\n");
+    const QByteArray response = readHttpResponse(&socket, buffer);
+    EXPECT_TRUE(response.contains("\r\nConnection: close\r\n")) << response.constData();
+    EXPECT_TRUE(socket.state() == QAbstractSocket::UnconnectedState || socket.waitForDisconnected(10000));
+    buffer.append(socket.readAll());
+    EXPECT_TRUE(buffer.isEmpty()) << buffer.constData();
+}
+
+TEST_F(RestServerTest, pipelining)
+{
+    ASSERT_TRUE(restServerWithoutAuthUT->isListening());
+
+    QTcpSocket socket;
+    socket.connectToHost("127.0.0.1", 9092);
+    ASSERT_TRUE(socket.waitForConnected(10000));
+    QByteArray buffer;
+    socket.write("GET /delayed/test-method HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n"
+                 "GET /test-method HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n"
+                 "GET /error/not-found HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n"
+                 "GET /test-method HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n\r\n");
+
+    QByteArray response = readHttpResponse(&socket, buffer);
+    EXPECT_TRUE(response.startsWith("HTTP/1.1 200")) << response.constData();
+    EXPECT_TRUE(response.endsWith("rest_get_Delayed_TestMethod")) << response.constData();
+
+    response = readHttpResponse(&socket, buffer);
+    EXPECT_TRUE(response.startsWith("HTTP/1.1 200")) << response.constData();
+    EXPECT_TRUE(response.endsWith("rest_get_TestMethod")) << response.constData();
+
+    response = readHttpResponse(&socket, buffer);
+    EXPECT_TRUE(response.startsWith("HTTP/1.1 404")) << response.constData();
+
+    response = readHttpResponse(&socket, buffer);
+    EXPECT_TRUE(response.startsWith("HTTP/1.1 200")) << response.constData();
+    EXPECT_TRUE(response.contains("\r\nConnection: close\r\n")) << response.constData();
+    EXPECT_TRUE(response.endsWith("rest_get_TestMethod")) << response.constData();
+    EXPECT_TRUE(socket.state() == QAbstractSocket::UnconnectedState || socket.waitForDisconnected(10000));
+}
+
+TEST_F(RestServerTest, pipeliningWithBody)
+{
+    ASSERT_TRUE(restServerWithoutAuthUT->isListening());
+
+    QTcpSocket socket;
+    socket.connectToHost("127.0.0.1", 9092);
+    ASSERT_TRUE(socket.waitForConnected(10000));
+    QByteArray buffer;
+    socket.write("GET /test-method HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Length: 4\r\n\r\nbody"
+                 "GET /test-method HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+
+    for (int i = 0; i < 2; ++i) {
+        const QByteArray response = readHttpResponse(&socket, buffer);
+        EXPECT_TRUE(response.startsWith("HTTP/1.1 200")) << response.constData();
+        EXPECT_TRUE(response.endsWith("rest_get_TestMethod")) << response.constData();
+    }
+    EXPECT_EQ(QAbstractSocket::ConnectedState, socket.state());
+}
+
+TEST_F(RestServerTest, pipeliningWithChunkedBody)
+{
+    ASSERT_TRUE(restServerWithoutAuthUT->isListening());
+
+    // Chunked body must not be parsed as next request
+    QTcpSocket socket;
+    socket.connectToHost("127.0.0.1", 9092);
+    ASSERT_TRUE(socket.waitForConnected(10000));
+    QByteArray buffer;
+    socket.write("POST /test-method HTTP/1.1\r\nHost: 127.0.0.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+                 "2e\r\nGET /test-method HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n\r\n0\r\n\r\n"
+                 "GET /test-method HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+    QByteArray response = readHttpResponse(&socket, buffer);
+    EXPECT_TRUE(response.startsWith("HTTP/1.1 501")) << response.constData();
+    EXPECT_TRUE(response.contains("\r\nConnection: close\r\n")) << response.constData();
+    EXPECT_TRUE(socket.state() == QAbstractSocket::UnconnectedState || socket.waitForDisconnected(10000));
+    buffer.append(socket.readAll());
+    EXPECT_TRUE(buffer.isEmpty()) << buffer.constData();
+
+    // Both framings at once are ambiguous
+    QTcpSocket ambiguousSocket;
+    ambiguousSocket.connectToHost("127.0.0.1", 9092);
+    ASSERT_TRUE(ambiguousSocket.waitForConnected(10000));
+    buffer.clear();
+    ambiguousSocket.write("POST /test-method HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Length: 5\r\n"
+                          "Transfer-Encoding: chunked\r\n\r\n0\r\n\r\n"
+                          "GET /test-method HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+    response = readHttpResponse(&ambiguousSocket, buffer);
+    EXPECT_TRUE(response.startsWith("HTTP/1.1 400")) << response.constData();
+    EXPECT_TRUE(ambiguousSocket.state() == QAbstractSocket::UnconnectedState
+                || ambiguousSocket.waitForDisconnected(10000));
+    buffer.append(ambiguousSocket.readAll());
+    EXPECT_TRUE(buffer.isEmpty()) << buffer.constData();
+}
+
+TEST_F(RestServerTest, pipeliningWithConflictingContentLength)
+{
+    ASSERT_TRUE(restServerWithoutAuthUT->isListening());
+
+    QTcpSocket socket;
+    socket.connectToHost("127.0.0.1", 9092);
+    ASSERT_TRUE(socket.waitForConnected(10000));
+    QByteArray buffer;
+    socket.write("POST /test-method HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Length: 4\r\nContent-Length: 0\r\n\r\n"
+                 "body"
+                 "GET /test-method HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+    const QByteArray response = readHttpResponse(&socket, buffer);
+    EXPECT_TRUE(response.startsWith("HTTP/1.1 400")) << response.constData();
+    EXPECT_TRUE(response.contains("\r\nConnection: close\r\n")) << response.constData();
+    EXPECT_TRUE(socket.state() == QAbstractSocket::UnconnectedState || socket.waitForDisconnected(10000));
+    buffer.append(socket.readAll());
+    EXPECT_TRUE(buffer.isEmpty()) << buffer.constData();
+
+    // Repeated equal value is still a single length
+    QTcpSocket repeatedSocket;
+    repeatedSocket.connectToHost("127.0.0.1", 9092);
+    ASSERT_TRUE(repeatedSocket.waitForConnected(10000));
+    buffer.clear();
+    repeatedSocket.write("GET /test-method HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Length: 4\r\n"
+                         "Content-Length: 4\r\n\r\nbody"
+                         "GET /test-method HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+    for (int i = 0; i < 2; ++i) {
+        const QByteArray repeatedResponse = readHttpResponse(&repeatedSocket, buffer);
+        EXPECT_TRUE(repeatedResponse.endsWith("rest_get_TestMethod")) << repeatedResponse.constData();
+    }
+    EXPECT_EQ(QAbstractSocket::ConnectedState, repeatedSocket.state());
+}
+
+TEST_F(RestServerTest, socketAnswerOutsideDispatch)
+{
+    ASSERT_TRUE(restServerWithoutAuthUT->isListening());
+
+    QTcpSocket socket;
+    socket.connectToHost("127.0.0.1", 9092);
+    ASSERT_TRUE(socket.waitForConnected(10000));
+    QByteArray buffer;
+    socket.write("GET /late-socket/test-method HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+    const QByteArray response = readHttpResponse(&socket, buffer);
+    EXPECT_TRUE(response.endsWith("rest_get_LateSocket_TestMethod")) << response.constData();
+
+    // With several requests waiting socket can't tell which one is answered, so answers are not sent at all
+    QTcpSocket pipelinedSocket;
+    pipelinedSocket.connectToHost("127.0.0.1", 9092);
+    ASSERT_TRUE(pipelinedSocket.waitForConnected(10000));
+    buffer.clear();
+    pipelinedSocket.write("GET /late-socket/test-method HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n"
+                          "GET /late-socket/test-method HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+    EXPECT_FALSE(pipelinedSocket.waitForReadyRead(1000));
+    EXPECT_TRUE(pipelinedSocket.readAll().isEmpty());
+}
+
+TEST_F(RestServerTest, staleHandleAfterDisconnect)
+{
+    ASSERT_TRUE(restServerWithoutAuthUT->isListening());
+
+    QTcpSocket abandonedSocket;
+    abandonedSocket.connectToHost("127.0.0.1", 9092);
+    ASSERT_TRUE(abandonedSocket.waitForConnected(10000));
+    abandonedSocket.write("GET /delayed/test-method HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+    ASSERT_TRUE(abandonedSocket.waitForBytesWritten(10000));
+    abandonedSocket.abort();
+
+    // New connection can reuse slot of aborted one, delayed answer must not leak into it
+    QTcpSocket socket;
+    socket.connectToHost("127.0.0.1", 9092);
+    ASSERT_TRUE(socket.waitForConnected(10000));
+    QByteArray buffer;
+    socket.write("GET /test-method HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+    const QByteArray response = readHttpResponse(&socket, buffer);
+    EXPECT_TRUE(response.endsWith("rest_get_TestMethod")) << response.constData();
+
+    EXPECT_FALSE(socket.waitForReadyRead(600));
+    EXPECT_TRUE(buffer.isEmpty()) << buffer.constData();
+    EXPECT_EQ(QAbstractSocket::ConnectedState, socket.state());
+}
+
+TEST_F(RestServerTest, reusePortWorkers)
+{
+    std::unique_ptr<TestRestServerWithoutAuth> server(new TestRestServerWithoutAuth(9093));
+    server->setReusePortWorkersCount(2);
+    server->setTcpNoDelay(true);
+    server->setListenBacklog(256);
+    EXPECT_EQ(2, server->reusePortWorkersCount());
+    EXPECT_TRUE(server->tcpNoDelay());
+    EXPECT_EQ(256, server->listenBacklog());
+    server->startListen();
+
+    for (int i = 0; i < 4; ++i) {
+        QTcpSocket socket;
+        QTime timer;
+        timer.start();
+        do {
+            socket.abort();
+            socket.connectToHost("127.0.0.1", 9093);
+        } while (!socket.waitForConnected(1000) && timer.elapsed() < 10000);
+        ASSERT_EQ(QAbstractSocket::ConnectedState, socket.state());
+        QByteArray buffer;
+        socket.write("GET /test-method HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+        const QByteArray response = readHttpResponse(&socket, buffer);
+        EXPECT_TRUE(response.startsWith("HTTP/1.1 200")) << response.constData();
+        EXPECT_TRUE(response.endsWith("rest_get_TestMethod")) << response.constData();
+    }
+    server->stopListen();
+}
+
+TEST_F(RestServerTest, handlerPool)
+{
+    ASSERT_TRUE(restServerWithoutAuthUT->isListening());
+    const quint64 completedBefore = restServerWithoutAuthUT->handlerPoolStats().completed;
+
+    QTcpSocket socket;
+    socket.connectToHost("127.0.0.1", 9092);
+    ASSERT_TRUE(socket.waitForConnected(10000));
+    QByteArray buffer;
+    socket.write("GET /heavy/test-method HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n"
+                 "GET /test-method HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+
+    QByteArray response = readHttpResponse(&socket, buffer);
+    EXPECT_TRUE(response.startsWith("HTTP/1.1 200")) << response.constData();
+    EXPECT_TRUE(response.endsWith("rest_get_Heavy_TestMethod")) << response.constData();
+
+    response = readHttpResponse(&socket, buffer);
+    EXPECT_TRUE(response.startsWith("HTTP/1.1 200")) << response.constData();
+    EXPECT_TRUE(response.endsWith("rest_get_TestMethod")) << response.constData();
+
+    QTime timer;
+    timer.start();
+    while (restServerWithoutAuthUT->handlerPoolStats().completed == completedBefore && timer.elapsed() < 1000)
+        QThread::msleep(5);
+    const Proof::RestHandlerPoolStats stats = restServerWithoutAuthUT->handlerPoolStats();
+    EXPECT_EQ(completedBefore + 1, stats.completed);
+    EXPECT_EQ(0, stats.queued);
+    EXPECT_EQ(0u, stats.rejected);
+}
+
+TEST_F(RestServerTest, handlerPoolKeepsWorkerResponsive)
+{
+    // Both connections are served by single worker, inline handler can't run if it is blocked by pool one
+    std::unique_ptr<TestRestServerWithoutAuth> server(new TestRestServerWithoutAuth(9101));
+    server->setSuggestedMaxThreadsCount(1);
+    server->startListen();
+    QTime timer;
+    timer.start();
+    while (!server->isListening() && timer.elapsed() < 10000)
+        QThread::msleep(50);
+    ASSERT_TRUE(server->isListening());
+
+    QTcpSocket latchedSocket;
+    latchedSocket.connectToHost("127.0.0.1", 9101);
+    ASSERT_TRUE(latchedSocket.waitForConnected(10000));
+    QByteArray latchedBuffer;
+    QTcpSocket socket;
+    socket.connectToHost("127.0.0.1", 9101);
+    ASSERT_TRUE(socket.waitForConnected(10000));
+    QByteArray buffer;
+
+    latchedSocket.write("GET /latched/test-method HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+    ASSERT_TRUE(latchedSocket.waitForBytesWritten(10000));
+    timer.restart();
+    while (!server->handlerPoolStats().running && timer.elapsed() < 10000)
+        QThread::msleep(5);
+    ASSERT_EQ(1, server->handlerPoolStats().running);
+
+    socket.write("GET /test-method HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+    QByteArray response = readHttpResponse(&socket, buffer);
+    EXPECT_TRUE(response.endsWith("rest_get_TestMethod")) << response.constData();
+    // Latched handler is still blocked, so inline request was answered before it
+    EXPECT_EQ(1, server->handlerPoolStats().running);
+    EXPECT_EQ(0, latchedSocket.bytesAvailable());
+
+    server->handlerLatch.release();
+    response = readHttpResponse(&latchedSocket, latchedBuffer);
+    EXPECT_TRUE(response.endsWith("rest_get_Latched_TestMethod")) << response.constData();
+    server->stopListen();
+}
+
+TEST_F(RestServerTest, admissionControl)
+{
+    std::unique_ptr<TestRestServerWithoutAuth> server(new TestRestServerWithoutAuth(9094));
+    server->setMaxInFlightRequests(1);
+    server->setMaxConnections(2);
+    server->setRetryAfter(7);
+    server->startListen();
+    QTime timer;
+    timer.start();
+    while (!server->isListening() && timer.elapsed() < 10000)
+        QThread::msleep(50);
+    ASSERT_TRUE(server->isListening());
+
+    QTcpSocket busySocket;
+    busySocket.connectToHost("127.0.0.1", 9094);
+    ASSERT_TRUE(busySocket.waitForConnected(10000));
+    QByteArray busyBuffer;
+    busySocket.write("GET /delayed/test-method HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+    ASSERT_TRUE(busySocket.waitForBytesWritten(10000));
+    QThread::msleep(50);
+
+    QTcpSocket rejectedSocket;
+    rejectedSocket.connectToHost("127.0.0.1", 9094);
+    ASSERT_TRUE(rejectedSocket.waitForConnected(10000));
+    QByteArray rejectedBuffer;
+    rejectedSocket.write("GET /test-method HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+    QByteArray response = readHttpResponse(&rejectedSocket, rejectedBuffer);
+    EXPECT_TRUE(response.startsWith("HTTP/1.1 503")) << response.constData();
+    EXPECT_TRUE(response.contains("\r\nRetry-After: 7\r\n")) << response.constData();
+    EXPECT_TRUE(rejectedSocket.state() == QAbstractSocket::UnconnectedState
+                || rejectedSocket.waitForDisconnected(10000));
+
+    response = readHttpResponse(&busySocket, busyBuffer);
+    EXPECT_TRUE(response.endsWith("rest_get_Delayed_TestMethod")) << response.constData();
+    QThread::msleep(100);
+
+    QTcpSocket extraSocket;
+    extraSocket.connectToHost("127.0.0.1", 9094);
+    ASSERT_TRUE(extraSocket.waitForConnected(10000));
+    QByteArray extraBuffer;
+    extraSocket.write("GET /test-method HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+    response = readHttpResponse(&extraSocket, extraBuffer);
+    EXPECT_TRUE(response.endsWith("rest_get_TestMethod")) << response.constData();
+
+    QTcpSocket overLimitSocket;
+    overLimitSocket.connectToHost("127.0.0.1", 9094);
+    ASSERT_TRUE(overLimitSocket.waitForConnected(10000));
+    QByteArray overLimitBuffer;
+    response = readHttpResponse(&overLimitSocket, overLimitBuffer);
+    EXPECT_TRUE(response.startsWith("HTTP/1.1 503")) << response.constData();
+
+    const Proof::RestAdmissionStats stats = server->admissionStats();
+    EXPECT_EQ(1u, stats.rejectedRequests);
+    EXPECT_EQ(1u, stats.rejectedConnections);
+    EXPECT_EQ(0, stats.inFlightRequests);
+
+    // Route bytes limit is applied even though global one is not set
+    extraSocket.write("POST /context/test-method HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Length: 2000\r\n\r\n");
+    response = readHttpResponse(&extraSocket, extraBuffer);
+    EXPECT_TRUE(response.startsWith("HTTP/1.1 503")) << response.constData();
+    EXPECT_EQ(2u, server->admissionStats().rejectedRequests);
+    server->stopListen();
+}
+
+TEST_F(RestServerTest, streamedBody)
+{
+    ASSERT_TRUE(restServerWithoutAuthUT->isListening());
+    restServerWithoutAuthUT->setBodySpoolThreshold(16);
+
+    QTcpSocket socket;
+    socket.connectToHost("127.0.0.1", 9092);
+    ASSERT_TRUE(socket.waitForConnected(10000));
+    QByteArray buffer;
+    const QByteArray smallBody = "small body";
+    const QByteArray largeBody(1000, 'x');
+    socket.write("POST /upload/test-method HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Length: "
+                 + QByteArray::number(smallBody.size()) + "\r\n\r\n" + smallBody);
+    socket.write("POST /upload/test-method HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Length: "
+                 + QByteArray::number(largeBody.size()) + "\r\n\r\n" + largeBody);
+
+    QByteArray response = readHttpResponse(&socket, buffer);
+    EXPECT_TRUE(response.startsWith("HTTP/1.1 200 memory")) << response.constData();
+    EXPECT_TRUE(response.endsWith("\r\n\r\n" + smallBody)) << response.constData();
+
+    response = readHttpResponse(&socket, buffer);
+    EXPECT_TRUE(response.startsWith("HTTP/1.1 200 file")) << response.constData();
+    EXPECT_TRUE(response.endsWith("\r\n\r\n" + largeBody)) << response.constData();
+    restServerWithoutAuthUT->setBodySpoolThreshold(1024 * 1024);
+}
+
+TEST_F(RestServerTest, multipartBody)
+{
+    ASSERT_TRUE(restServerWithoutAuthUT->isListening());
+    restServerWithoutAuthUT->setBodySpoolThreshold(100);
+
+    QTcpSocket socket;
+    socket.connectToHost("127.0.0.1", 9092);
+    ASSERT_TRUE(socket.waitForConnected(10000));
+    QByteArray buffer;
+    const QByteArray body = "--xyz\r\nContent-Disposition: form-data; name=\"comment\"\r\n\r\nsmall part\r\n"
+                            "--xyz\r\nContent-Disposition: form-data; name=\"scan\"; filename=\"scan.bin\"\r\n"
+                            "Content-Type: application/octet-stream\r\n\r\n"
+                            + QByteArray(1000, 'x') + "\r\n--xyz--\r\n";
+    const QByteArray head = "POST /form/test-method HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Length: "
+                            + QByteArray::number(body.size());
+    socket.write(head + "\r\nContent-Type: multipart/form-data; boundary=xyz\r\n\r\n" + body.left(50));
+    socket.flush();
+    QThread::msleep(50);
+    socket.write(body.mid(50));
+    QByteArray response = readHttpResponse(&socket, buffer);
+    EXPECT_TRUE(response.startsWith("HTTP/1.1 200")) << response.constData();
+    EXPECT_TRUE(response.endsWith("\r\n\r\ncomment=10:memory\nscan=1000:file\n")) << response.constData();
+
+    socket.write(head + "\r\nContent-Type: text/plain\r\n\r\n" + body);
+    response = readHttpResponse(&socket, buffer);
+    EXPECT_TRUE(response.startsWith("HTTP/1.1 415")) << response.constData();
+    restServerWithoutAuthUT->setBodySpoolThreshold(1024 * 1024);
+}
+
+TEST_F(RestServerTest, requestSizeLimits)
+{
+    std::unique_ptr<TestRestServerWithoutAuth> server(new TestRestServerWithoutAuth(9095));
+    server->setMaxHeadersSize(256);
+    server->setMaxBodySize(10);
+    server->startListen();
+    QTime timer;
+    timer.start();
+    while (!server->isListening() && timer.elapsed() < 10000)
+        QThread::msleep(50);
+    ASSERT_TRUE(server->isListening());
+
+    QTcpSocket bodySocket;
+    bodySocket.connectToHost("127.0.0.1", 9095);
+    ASSERT_TRUE(bodySocket.waitForConnected(10000));
+    QByteArray buffer;
+    bodySocket.write("POST /test-method HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Length: 100\r\n\r\n");
+    QByteArray response = readHttpResponse(&bodySocket, buffer);
+    EXPECT_TRUE(response.startsWith("HTTP/1.1 413")) << response.constData();
+    EXPECT_TRUE(response.contains("\r\nConnection: close\r\n")) << response.constData();
+
+    QTcpSocket headersSocket;
+    headersSocket.connectToHost("127.0.0.1", 9095);
+    ASSERT_TRUE(headersSocket.waitForConnected(10000));
+    buffer.clear();
+    headersSocket.write("GET /test-method HTTP/1.1\r\nHost: 127.0.0.1\r\nX-Padding: " + QByteArray(512, 'x')
+                        + "\r\n\r\n");
+    response = readHttpResponse(&headersSocket, buffer);
+    EXPECT_TRUE(response.startsWith("HTTP/1.1 431")) << response.constData();
+    server->stopListen();
+}
+
+TEST_F(RestServerTest, connectionTimeouts)
+{
+    std::unique_ptr<TestRestServerWithoutAuth> server(new TestRestServerWithoutAuth(9096));
+    server->setHeadersTimeout(500);
+    server->setBodyTimeout(500);
+    server->setKeepAliveTimeout(500);
+    server->startListen();
+    QTime timer;
+    timer.start();
+    while (!server->isListening() && timer.elapsed() < 10000)
+        QThread::msleep(50);
+    ASSERT_TRUE(server->isListening());
+
+    QTcpSocket silentSocket;
+    silentSocket.connectToHost("127.0.0.1", 9096);
+    ASSERT_TRUE(silentSocket.waitForConnected(10000));
+    EXPECT_TRUE(silentSocket.waitForDisconnected(10000));
+
+    // Headers deadline is not extended by trickling data
+    QTcpSocket slowHeadersSocket;
+    slowHeadersSocket.connectToHost("127.0.0.1", 9096);
+    ASSERT_TRUE(slowHeadersSocket.waitForConnected(10000));
+    slowHeadersSocket.write("GET /test-method HTTP/1.1\r\n");
+    timer.restart();
+    while (slowHeadersSocket.state() == QAbstractSocket::ConnectedState && timer.elapsed() < 10000) {
+        slowHeadersSocket.write("X-Slow: 1\r\n");
+        slowHeadersSocket.waitForDisconnected(200);
+    }
+    EXPECT_EQ(QAbstractSocket::UnconnectedState, slowHeadersSocket.state());
+    EXPECT_GT(5000, timer.elapsed());
+
+    QTcpSocket bodySocket;
+    bodySocket.connectToHost("127.0.0.1", 9096);
+    ASSERT_TRUE(bodySocket.waitForConnected(10000));
+    bodySocket.write("POST /test-method HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Length: 100\r\n\r\n12345");
+    EXPECT_TRUE(bodySocket.waitForDisconnected(10000));
+
+    QTcpSocket idleSocket;
+    idleSocket.connectToHost("127.0.0.1", 9096);
+    ASSERT_TRUE(idleSocket.waitForConnected(10000));
+    QByteArray buffer;
+    idleSocket.write("GET /test-method HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+    const QByteArray response = readHttpResponse(&idleSocket, buffer);
+    EXPECT_TRUE(response.startsWith("HTTP/1.1 200")) << response.constData();
+    EXPECT_TRUE(idleSocket.state() == QAbstractSocket::UnconnectedState || idleSocket.waitForDisconnected(10000));
+
+    const RestTimeoutStats stats = server->timeoutStats();
+    EXPECT_EQ(2u, stats.headers);
+    EXPECT_EQ(1u, stats.body);
+    EXPECT_EQ(1u, stats.idle);
+    EXPECT_EQ(0u, stats.write);
+    server->stopListen();
+}
+
+TEST_F(RestServerTest, bearerAuth)
+{
+    std::unique_ptr<TestRestServerWithoutAuth> server(new TestRestServerWithoutAuth(9099));
+    auto authenticator = QSharedPointer<Proof::HmacBearerRestAuthenticator>::create("secret");
+    server->setAuthType(Proof::RestAuthType::BearerToken);
+    server->addAuthenticator(authenticator);
+    server->startListen();
+    QTime timer;
+    timer.start();
+    while (!server->isListening() && timer.elapsed() < 10000)
+        QThread::msleep(50);
+    ASSERT_TRUE(server->isListening());
+
+    const QByteArray token = authenticator->issueToken("john", QDateTime::currentDateTimeUtc().addSecs(3600));
+    const QByteArray expiredToken = authenticator->issueToken("john", QDateTime::currentDateTimeUtc().addSecs(-1));
+    QByteArray tamperedToken = token;
+    tamperedToken[0] = tamperedToken[0] == 'a' ? 'b' : 'a';
+    const auto request = [](const QByteArray &path, const QByteArray &authorization) {
+        return "GET " + path + " HTTP/1.1\r\nHost: 127.0.0.1\r\nAuthorization: " + authorization + "\r\n\r\n";
+    };
+
+    QTcpSocket socket;
+    socket.connectToHost("127.0.0.1", 9099);
+    ASSERT_TRUE(socket.waitForConnected(10000));
+    QByteArray buffer;
+    for (int i = 0; i < 3; ++i) {
+        socket.write(request("/whoami", "Bearer " + token));
+        const QByteArray response = readHttpResponse(&socket, buffer);
+        EXPECT_TRUE(response.startsWith("HTTP/1.1 200")) << response.constData();
+        EXPECT_TRUE(response.endsWith("\r\n\r\njohn")) << response.constData();
+    }
+    for (const QByteArray &authorization :
+         {"Bearer " + expiredToken, "Bearer " + tamperedToken, "Basic " + token, QByteArray("Bearer")}) {
+        socket.write(request("/whoami", authorization));
+        const QByteArray response = readHttpResponse(&socket, buffer);
+        EXPECT_TRUE(response.startsWith("HTTP/1.1 401")) << authorization.constData();
+    }
+    socket.write(request("/system/status", "Bearer " + tamperedToken));
+    const QByteArray response = readHttpResponse(&socket, buffer);
+    EXPECT_TRUE(response.startsWith("HTTP/1.1 200")) << response.constData();
+
+    Proof::RestAuthStats stats = server->authStats();
+    EXPECT_EQ(2u, stats.cacheHits);
+    EXPECT_EQ(5u, stats.cacheMisses);
+    EXPECT_EQ(4u, stats.failures);
+    EXPECT_EQ(1, stats.cachedCredentials);
+
+    server->invalidateAuthCache();
+    EXPECT_EQ(0, server->authStats().cachedCredentials);
+    server->clearAuthenticators();
+    socket.write(request("/whoami", "Bearer " + token));
+    EXPECT_TRUE(readHttpResponse(&socket, buffer).startsWith("HTTP/1.1 401"));
+    server->stopListen();
+}
+
+TEST_F(RestServerTest, serverSentEvents)
+{
+    ASSERT_TRUE(restServerWithoutAuthUT->isListening());
+
+    QTcpSocket socket;
+    socket.connectToHost("127.0.0.1", 9092);
+    ASSERT_TRUE(socket.waitForConnected(10000));
+    QByteArray buffer;
+    socket.write("GET /events/test-method HTTP/1.1\r\nHost: 127.0.0.1\r\nAccept: text/event-stream\r\n\r\n");
+    const QByteArray response = readHttpResponse(&socket, buffer);
+    EXPECT_TRUE(response.startsWith("HTTP/1.1 200")) << response.constData();
+    EXPECT_TRUE(response.contains("\r\nContent-Type: text/event-stream\r\n")) << response.constData();
+    EXPECT_TRUE(response.contains("\r\nCache-Control: no-cache\r\n")) << response.constData();
+    EXPECT_TRUE(response.contains("event: greeting\nid: 1\ndata: hello\n\n")) << response.constData();
+    EXPECT_TRUE(response.contains("data: multi\ndata: line\n\n")) << response.constData();
+    EXPECT_FALSE(response.contains("after close")) << response.constData();
+
+    // Connection is reusable after stream is closed by server
+    socket.write("GET /test-method HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+    EXPECT_TRUE(readHttpResponse(&socket, buffer).endsWith("rest_get_TestMethod"));
+    EXPECT_EQ(0, restServerWithoutAuthUT->pushStats().eventStreams);
+}
+
+static QByteArray maskedFrame(quint8 opcode, const QByteArray &payload)
+{
+    const char mask[] = {0x12, 0x34, 0x56, 0x78};
+    QByteArray result;
+    result.append(static_cast<char>(0x80 | opcode));
+    result.append(static_cast<char>(0x80 | payload.size()));
+    result.append(mask, 4);
+    for (int i = 0; i < payload.size(); ++i)
+        result.append(static_cast<char>(payload[i] ^ mask[i % 4]));
+    return result;
+}
+
+TEST_F(RestServerTest, webSocket)
+{
+    ASSERT_TRUE(restServerWithoutAuthUT->isListening());
+
+    QTcpSocket socket;
+    socket.connectToHost("127.0.0.1", 9092);
+    ASSERT_TRUE(socket.waitForConnected(10000));
+    socket.write("GET /socket/test-method HTTP/1.1\r\nHost: 127.0.0.1\r\nUpgrade: websocket\r\n"
+                 "Connection: Upgrade\r\nSec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                 "Sec-WebSocket-Version: 13\r\n\r\n");
+    QByteArray buffer;
+    QTime timer;
+    timer.start();
+    while (!buffer.contains("\r\n\r\n") && timer.elapsed() < 10000) {
+        socket.waitForReadyRead(50);
+        buffer.append(socket.readAll());
+    }
+    const int headEnd = buffer.indexOf("\r\n\r\n") + 4;
+    const QByteArray head = buffer.left(headEnd);
+    buffer.remove(0, headEnd);
+    EXPECT_TRUE(head.startsWith("HTTP/1.1 101 Switching Protocols\r\n")) << head.constData();
+    EXPECT_TRUE(head.contains("\r\nSec-WebSocket-Accept: s3pPLMBiTxaQ9kK+4zLOjM4BVfs=\r\n")) << head.constData();
+
+    const auto readFrame = [&socket, &buffer]() {
+        QTime timer;
+        timer.start();
+        while ((buffer.size() < 2 || buffer.size() < 2 + (buffer[1] & 0x7F)) && timer.elapsed() < 10000) {
+            socket.waitForReadyRead(50);
+            buffer.append(socket.readAll());
+        }
+        const int frameSize = buffer.size() < 2 ? 0 : 2 + (buffer[1] & 0x7F);
+        const QByteArray frame = buffer.left(frameSize);
+        buffer.remove(0, frameSize);
+        return frame;
+    };
+
+    socket.write(maskedFrame(0x1, "hi"));
+    EXPECT_EQ(QByteArray("\x81\x08" "echo: hi"), readFrame());
+    socket.write(maskedFrame(0x9, "ping"));
+    EXPECT_EQ(QByteArray("\x8A\x04" "ping"), readFrame());
+    socket.write(maskedFrame(0x2, QByteArray("\x00\x01", 2)));
+    EXPECT_EQ(QByteArray("\x82\x02\x00\x01", 4), readFrame());
+    EXPECT_EQ(1, restServerWithoutAuthUT->pushStats().webSockets);
+
+    socket.write(maskedFrame(0x8, QByteArray("\x03\xE8", 2)));
+    EXPECT_EQ(QByteArray("\x88\x02\x03\xE8", 4), readFrame());
+    EXPECT_TRUE(socket.state() == QAbstractSocket::UnconnectedState || socket.waitForDisconnected(10000));
+
+    QTcpSocket plainSocket;
+    plainSocket.connectToHost("127.0.0.1", 9092);
+    ASSERT_TRUE(plainSocket.waitForConnected(10000));
+    QByteArray plainBuffer;
+    plainSocket.write("GET /socket/test-method HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+    const QByteArray response = readHttpResponse(&plainSocket, plainBuffer);
+    EXPECT_TRUE(response.startsWith("HTTP/1.1 400")) << response.constData();
+}
+
+TEST_F(RestServerTest, drain)
+{
+    std::unique_ptr<TestRestServerWithoutAuth> server(new TestRestServerWithoutAuth(9097));
+    server->startListen();
+    QTime timer;
+    timer.start();
+    while (!server->isListening() && timer.elapsed() < 10000)
+        QThread::msleep(50);
+    ASSERT_TRUE(server->isListening());
+
+    QTcpSocket idleSocket;
+    idleSocket.connectToHost("127.0.0.1", 9097);
+    ASSERT_TRUE(idleSocket.waitForConnected(10000));
+    QByteArray idleBuffer;
+    idleSocket.write("GET /test-method HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+    QByteArray response = readHttpResponse(&idleSocket, idleBuffer);
+    EXPECT_TRUE(response.contains("\r\nConnection: keep-alive\r\n")) << response.constData();
+
+    QTcpSocket busySocket;
+    busySocket.connectToHost("127.0.0.1", 9097);
+    ASSERT_TRUE(busySocket.waitForConnected(10000));
+    busySocket.write("POST /echo/test-method HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Length: 10\r\n\r\n12345");
+    busySocket.waitForBytesWritten(10000);
+    QThread::msleep(100);
+
+    server->drain(10000);
+    EXPECT_TRUE(idleSocket.waitForDisconnected(10000));
+    EXPECT_TRUE(server->isDraining());
+    EXPECT_FALSE(server->isListening());
+
+    QByteArray busyBuffer;
+    busySocket.write("67890");
+    response = readHttpResponse(&busySocket, busyBuffer);
+    EXPECT_TRUE(response.startsWith("HTTP/1.1 200")) << response.constData();
+    EXPECT_TRUE(response.contains("\r\nConnection: close\r\n")) << response.constData();
+    EXPECT_TRUE(response.endsWith("1234567890")) << response.constData();
+    EXPECT_TRUE(busySocket.state() == QAbstractSocket::UnconnectedState || busySocket.waitForDisconnected(10000));
+
+    timer.restart();
+    while (server->admissionStats().connections && timer.elapsed() < 10000)
+        QThread::msleep(50);
+    EXPECT_EQ(0, server->admissionStats().connections);
+}
+
+#ifdef Q_OS_LINUX
+TEST_F(RestServerTest, listenersHandover)
+{
+    const QString handoverPath = QDir::temp().absoluteFilePath(QStringLiteral("proof-rest-handover-test"));
+    std::unique_ptr<TestRestServerWithoutAuth> server(new TestRestServerWithoutAuth(9098));
+    server->startListen();
+    QTime timer;
+    timer.start();
+    while (!server->isListening() && timer.elapsed() < 10000)
+        QThread::msleep(50);
+    ASSERT_TRUE(server->isListening());
+
+    auto received = Proof::tasks::run(
+        [handoverPath]() { return AbstractRestServer::receiveListeners(handoverPath, 10000); });
+    timer.restart();
+    bool isHandedOver = false;
+    while (!isHandedOver && timer.elapsed() < 10000) {
+        isHandedOver = server->handOverListeners(handoverPath);
+        if (!isHandedOver)
+            QThread::msleep(50);
+    }
+    ASSERT_TRUE(isHandedOver);
+    const QVector<qintptr> listeners = received.result();
+    ASSERT_EQ(1, listeners.count());
+
+    std::unique_ptr<TestRestServerWithoutAuth> successor(new TestRestServerWithoutAuth(9098));
+    successor->setInheritedListeners(listeners);
+    successor->startListen();
+    timer.restart();
+    while (!successor->isListening() && timer.elapsed() < 10000)
+        QThread::msleep(50);
+    ASSERT_TRUE(successor->isListening());
+    server->drain(1000);
+
+    QTcpSocket socket;
+    socket.connectToHost("127.0.0.1", 9098);
+    ASSERT_TRUE(socket.waitForConnected(10000));
+    QByteArray buffer;
+    socket.write("GET /test-method HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+    const QByteArray response = readHttpResponse(&socket, buffer);
+    EXPECT_TRUE(response.startsWith("HTTP/1.1 200")) << response.constData();
+    EXPECT_FALSE(server->isListening());
+    successor->stopListen();
+}
+#endif
+
+TEST_F(RestServerTest, unixSocketListener)
+{
+    const QString socketPath = QDir::temp().absoluteFilePath(QStringLiteral("proof-rest-unix-test.sock"));
+    std::unique_ptr<TestRestServerWithoutAuth> server(new TestRestServerWithoutAuth(9097));
+    server->setTcpListeningEnabled(false);
+    server->setUnixSocketPath(socketPath);
+    server->setUnixSocketPermissions(QFileDevice::ReadOwner | QFileDevice::WriteOwner);
+    server->startListen();
+    QTime timer;
+    timer.start();
+    while (!server->isUnixSocketListening() && timer.elapsed() < 10000)
+        QThread::msleep(50);
+    ASSERT_TRUE(server->isUnixSocketListening());
+    EXPECT_FALSE(server->isListening());
+    EXPECT_EQ(QFileDevice::ReadOwner | QFileDevice::WriteOwner, QFile::permissions(socketPath));
+
+    const int descriptor = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    ASSERT_GE(descriptor, 0);
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    const QByteArray encodedPath = QFile::encodeName(socketPath);
+    std::memcpy(address.sun_path, encodedPath.constData(), static_cast<size_t>(encodedPath.size()));
+    ASSERT_EQ(0, ::connect(descriptor, reinterpret_cast<sockaddr *>(&address), sizeof(address)));
+    QTcpSocket socket;
+    ASSERT_TRUE(socket.setSocketDescriptor(descriptor));
+    QByteArray buffer;
+    for (int i = 0; i < 2; ++i) {
+        socket.write("GET /test-method HTTP/1.1\r\nHost: localhost\r\n\r\n");
+        const QByteArray response = readHttpResponse(&socket, buffer);
+        EXPECT_TRUE(response.startsWith("HTTP/1.1 200")) << response.constData();
+    }
+    socket.disconnectFromHost();
+
+    server->stopListen();
+    EXPECT_FALSE(server->isUnixSocketListening());
+    EXPECT_FALSE(QFile::exists(socketPath));
+}
+#endif
+
+TEST_F(RestServerTest, http2PriorKnowledge)
+{
+    std::unique_ptr<TestRestServerWithoutAuth> server(new TestRestServerWithoutAuth(9100));
+    server->setHttp2Enabled(true);
+    server->setHttp2MaxConcurrentStreams(2);
+    server->startListen();
+    QTime timer;
+    timer.start();
+    while (!server->isListening() && timer.elapsed() < 10000)
+        QThread::msleep(50);
+    ASSERT_TRUE(server->isListening());
+
+    QTcpSocket socket;
+    socket.connectToHost("127.0.0.1", 9100);
+    ASSERT_TRUE(socket.waitForConnected(10000));
+    socket.write("PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n" + http2Frame(0x4, 0x0, 0) + http2GetRequest(1, "/test-method")
+                 + http2GetRequest(3, "/heavy/test-method") + http2GetRequest(5, "/no-such-method"));
+    QByteArray buffer;
+    Http2Frame frame;
+    ASSERT_TRUE(readHttp2Frame(&socket, buffer, frame));
+    EXPECT_EQ(0x4, frame.type);
+    EXPECT_EQ(0u, frame.streamId);
+
+    QMap<quint32, QByteArray> headers;
+    QMap<quint32, QByteArray> bodies;
+    QMap<quint32, quint32> resets;
+    readHttp2Streams(&socket, buffer, 3, headers, bodies, resets);
+    // Indexed :status 200 from static table
+    EXPECT_TRUE(headers[1].startsWith('\x88'));
+    EXPECT_EQ("rest_get_TestMethod", bodies[1]);
+    EXPECT_TRUE(headers[3].startsWith('\x88'));
+    EXPECT_EQ("rest_get_Heavy_TestMethod", bodies[3]);
+    // Stream 5 is opened while first two are still processed
+    EXPECT_EQ(7u, resets.value(5));
+    EXPECT_EQ(1u, server->http2Stats().refusedStreams);
+    EXPECT_EQ(2u, server->http2Stats().streams);
+    EXPECT_EQ(1, server->http2Stats().connections);
+
+    socket.write(http2GetRequest(7, "/no-such-method"));
+    headers.clear();
+    readHttp2Streams(&socket, buffer, 1, headers, bodies, resets);
+    // Indexed :status 404
+    EXPECT_TRUE(headers[7].startsWith('\x8d'));
+
+    socket.disconnectFromHost();
+    server->stopListen();
+}
+
+TEST_F(RestServerTest, http2Upgrade)
+{
+    std::unique_ptr<TestRestServerWithoutAuth> server(new TestRestServerWithoutAuth(9100));
+    server->setHttp2Enabled(true);
+    server->startListen();
+    QTime timer;
+    timer.start();
+    while (!server->isListening() && timer.elapsed() < 10000)
+        QThread::msleep(50);
+    ASSERT_TRUE(server->isListening());
+
+    QTcpSocket socket;
+    socket.connectToHost("127.0.0.1", 9100);
+    ASSERT_TRUE(socket.waitForConnected(10000));
+    socket.write("GET /test-method HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: Upgrade, HTTP2-Settings\r\n"
+                 "Upgrade: h2c\r\nHTTP2-Settings: AAMAAABkAAQAAP__AAIAAAAA\r\n\r\n");
+    QByteArray buffer;
+    timer.restart();
+    while (!buffer.contains("\r\n\r\n") && timer.elapsed() < 10000) {
+        socket.waitForReadyRead(50);
+        buffer.append(socket.readAll());
+    }
+    const int headEnd = buffer.indexOf("\r\n\r\n") + 4;
+    const QByteArray head = buffer.left(headEnd);
+    buffer.remove(0, headEnd);
+    EXPECT_TRUE(head.startsWith("HTTP/1.1 101 Switching Protocols\r\n")) << head.constData();
+    EXPECT_TRUE(head.contains("\r\nUpgrade: h2c\r\n")) << head.constData();
+
+    socket.write("PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n" + http2Frame(0x4, 0x0, 0) + http2GetRequest(3, "/test-method"));
+    QMap<quint32, QByteArray> headers;
+    QMap<quint32, QByteArray> bodies;
+    QMap<quint32, quint32> resets;
+    readHttp2Streams(&socket, buffer, 2, headers, bodies, resets);
+    EXPECT_TRUE(headers[1].startsWith('\x88'));
+    EXPECT_EQ("rest_get_TestMethod", bodies[1]);
+    EXPECT_TRUE(headers[3].startsWith('\x88'));
+    EXPECT_EQ("rest_get_TestMethod", bodies[3]);
+
+    // HTTP/1.1 is still served if server doesn't accept HTTP/2
+    server->setHttp2Enabled(false);
+    QTcpSocket plainSocket;
+    plainSocket.connectToHost("127.0.0.1", 9100);
+    ASSERT_TRUE(plainSocket.waitForConnected(10000));
+    buffer.clear();
+    plainSocket.write("GET /test-method HTTP/1.1\r\nHost: 127.0.0.1\r\nUpgrade: h2c\r\n"
+                      "HTTP2-Settings: AAMAAABkAAQAAP__AAIAAAAA\r\n\r\n");
+    const QByteArray response = readHttpResponse(&plainSocket, buffer);
+    EXPECT_TRUE(response.startsWith("HTTP/1.1 200")) << response.constData();
+
+    socket.disconnectFromHost();
+    server->stopListen();
+}
+
+TEST_F(RestServerTest, streamedAnswer)
+{
+    ASSERT_TRUE(restServerWithoutAuthUT->isListening());
+
+    QTcpSocket socket;
+    socket.connectToHost("127.0.0.1", 9092);
+    ASSERT_TRUE(socket.waitForConnected(10000));
+    QByteArray buffer;
+    socket.write("GET /stream/test-method HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n"
+                 "GET /test-method HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+
+    QByteArray response = readHttpResponse(&socket, buffer);
+    EXPECT_TRUE(response.startsWith("HTTP/1.1 200")) << response.constData();
+    EXPECT_TRUE(response.contains("\r\nTransfer-Encoding: chunked\r\n")) << response.constData();
+    EXPECT_FALSE(response.contains("\r\nContent-Length:")) << response.constData();
+    EXPECT_TRUE(response.endsWith("\r\n\r\na\r\naaaaaaaaaa\r\na\r\nbbbbbbbbbb\r\na\r\ncccccccccc\r\n0\r\n\r\n"))
+        << response.constData();
+
+    response = readHttpResponse(&socket, buffer);
+    EXPECT_TRUE(response.endsWith("rest_get_TestMethod")) << response.constData();
+    EXPECT_EQ(QAbstractSocket::ConnectedState, socket.state());
+}
+
+TEST_F(RestServerTest, streamedAnswerHttp10)
+{
+    ASSERT_TRUE(restServerWithoutAuthUT->isListening());
+
+    QTcpSocket socket;
+    socket.connectToHost("127.0.0.1", 9092);
+    ASSERT_TRUE(socket.waitForConnected(10000));
+    socket.write("GET /stream/test-method HTTP/1.0\r\n\r\n");
+    EXPECT_TRUE(socket.state() == QAbstractSocket::UnconnectedState || socket.waitForDisconnected(10000));
+    const QByteArray response = socket.readAll();
+    EXPECT_FALSE(response.contains("\r\nTransfer-Encoding: chunked\r\n")) << response.constData();
+    EXPECT_TRUE(response.contains("\r\nConnection: close\r\n")) << response.constData();
+    EXPECT_TRUE(response.endsWith("\r\n\r\naaaaaaaaaabbbbbbbbbbcccccccccc")) << response.constData();
+}
+
+TEST_F(RestServerTest, fileAnswer)
+{
+    ASSERT_TRUE(restServerWithoutAuthUT->isListening());
+
+    QTcpSocket socket;
+    socket.connectToHost("127.0.0.1", 9092);
+    ASSERT_TRUE(socket.waitForConnected(10000));
+    QByteArray buffer;
+    socket.write("GET /file/test-method HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+    QByteArray response = readHttpResponse(&socket, buffer);
+    EXPECT_TRUE(response.startsWith("HTTP/1.1 200")) << response.constData();
+    EXPECT_TRUE(response.contains("\r\nAccept-Ranges: bytes\r\n")) << response.constData();
+    EXPECT_TRUE(response.contains("\r\nLast-Modified: ")) << response.constData();
+    EXPECT_TRUE(response.endsWith("\r\n\r\n0123456789abcdefghij")) << response.constData();
+    QRegExp eTagRegExp("\r\nETag: (\"[^\"]+\")\r\n");
+    ASSERT_NE(-1, eTagRegExp.indexIn(QString::fromLatin1(response)));
+    const QByteArray eTag = eTagRegExp.cap(1).toLatin1();
+
+    socket.write("GET /file/test-method HTTP/1.1\r\nHost: 127.0.0.1\r\nRange: bytes=5-9\r\n\r\n"
+                 "GET /file/test-method HTTP/1.1\r\nHost: 127.0.0.1\r\nRange: bytes=-3\r\n\r\n"
+                 "GET /file/test-method HTTP/1.1\r\nHost: 127.0.0.1\r\nRange: bytes=30-\r\n\r\n"
+                 "GET /file/test-method HTTP/1.1\r\nHost: 127.0.0.1\r\nRange: bytes=5-9\r\nIf-Range: \"other\"\r\n\r\n"
+                 "GET /file/test-method HTTP/1.1\r\nHost: 127.0.0.1\r\nIf-None-Match: "
+                 + eTag + "\r\n\r\n"
+                 "GET /file/test-method HTTP/1.1\r\nHost: 127.0.0.1\r\nIf-None-Match: \"other\", W/"
+                 + eTag + "\r\n\r\n"
+                 "GET /file/test-method HTTP/1.1\r\nHost: 127.0.0.1\r\nIf-None-Match: \"other\"\r\n"
+                 "If-Modified-Since: Fri, 01 Jan 2100 00:00:00 GMT\r\n\r\n");
+    response = readHttpResponse(&socket, buffer);
+    EXPECT_TRUE(response.startsWith("HTTP/1.1 206")) << response.constData();
+    EXPECT_TRUE(response.contains("\r\nContent-Range: bytes 5-9/20\r\n")) << response.constData();
+    EXPECT_TRUE(response.endsWith("\r\n\r\n56789")) << response.constData();
+
+    response = readHttpResponse(&socket, buffer);
+    EXPECT_TRUE(response.startsWith("HTTP/1.1 206")) << response.constData();
+    EXPECT_TRUE(response.endsWith("\r\n\r\nhij")) << response.constData();
+
+    response = readHttpResponse(&socket, buffer);
+    EXPECT_TRUE(response.startsWith("HTTP/1.1 416")) << response.constData();
+    EXPECT_TRUE(response.contains("\r\nContent-Range: bytes */20\r\n")) << response.constData();
+
+    response = readHttpResponse(&socket, buffer);
+    EXPECT_TRUE(response.startsWith("HTTP/1.1 200")) << response.constData();
+    EXPECT_TRUE(response.endsWith("\r\n\r\n0123456789abcdefghij")) << response.constData();
+
+    response = readHttpResponse(&socket, buffer);
+    EXPECT_TRUE(response.startsWith("HTTP/1.1 304")) << response.constData();
+    EXPECT_TRUE(response.endsWith("\r\n\r\n")) << response.constData();
+
+    // Tags list is matched with weak comparison, same as for cached answers
+    response = readHttpResponse(&socket, buffer);
+    EXPECT_TRUE(response.startsWith("HTTP/1.1 304")) << response.constData();
+
+    // If-None-Match takes precedence over If-Modified-Since
+    response = readHttpResponse(&socket, buffer);
+    EXPECT_TRUE(response.startsWith("HTTP/1.1 200")) << response.constData();
+    EXPECT_TRUE(response.endsWith("\r\n\r\n0123456789abcdefghij")) << response.constData();
+    EXPECT_EQ(QAbstractSocket::ConnectedState, socket.state());
+}
+
+TEST_F(RestServerTest, compression)
+{
+    ASSERT_TRUE(restServerWithoutAuthUT->isListening());
+
+    QTcpSocket socket;
+    socket.connectToHost("127.0.0.1", 9092);
+    ASSERT_TRUE(socket.waitForConnected(10000));
+    QByteArray buffer;
+    QByteArray data;
+    for (int i = 0; i < 500; ++i)
+        data.append(QStringLiteral("{\"id\":%1,\"name\":\"item\"},").arg(i).toLatin1());
+    // qCompress writes 4 bytes of uncompressed size before zlib stream
+    const QByteArray compressedData = qCompress(data).mid(4);
+    socket.write("POST /echo/test-method HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Encoding: deflate\r\n"
+                 "Accept-Encoding: gzip;q=0, deflate\r\nContent-Length: "
+                 + QByteArray::number(compressedData.size()) + "\r\n\r\n" + compressedData);
+    QByteArray response = readHttpResponse(&socket, buffer);
+    EXPECT_TRUE(response.startsWith("HTTP/1.1 200")) << response.constData();
+    EXPECT_TRUE(response.contains("\r\nContent-Encoding: deflate\r\n")) << response.constData();
+    EXPECT_TRUE(response.contains("\r\nVary: Accept-Encoding\r\n")) << response.constData();
+    QByteArray responseBody = response.mid(response.indexOf("\r\n\r\n") + 4);
+    EXPECT_GT(data.size() / 5, responseBody.size());
+    QByteArray sizePrefix(4, '\0');
+    qToBigEndian(static_cast<quint32>(data.size()), reinterpret_cast<uchar *>(sizePrefix.data()));
+    EXPECT_EQ(data, qUncompress(sizePrefix + responseBody));
+
+    socket.write("POST /echo/test-method HTTP/1.1\r\nHost: 127.0.0.1\r\nAccept-Encoding: gzip\r\n"
+                 "Content-Length: 5\r\n\r\nsmall");
+    response = readHttpResponse(&socket, buffer);
+    EXPECT_FALSE(response.contains("\r\nContent-Encoding:")) << response.constData();
+    EXPECT_TRUE(response.contains("\r\nVary: Accept-Encoding\r\n")) << response.constData();
+    EXPECT_TRUE(response.endsWith("\r\n\r\nsmall")) << response.constData();
+
+    socket.write("POST /echo/test-method HTTP/1.1\r\nHost: 127.0.0.1\r\nAccept-Encoding: gzip;q=0, *\r\n"
+                 "Content-Length: " + QByteArray::number(data.size()) + "\r\n\r\n" + data);
+    response = readHttpResponse(&socket, buffer);
+    EXPECT_TRUE(response.contains("\r\nContent-Encoding: deflate\r\n")) << response.constData();
+
+    socket.write("POST /echo/test-method HTTP/1.1\r\nHost: 127.0.0.1\r\nAccept-Encoding: gzip;q=0, deflate;q=0, *\r\n"
+                 "Content-Length: " + QByteArray::number(data.size()) + "\r\n\r\n" + data);
+    response = readHttpResponse(&socket, buffer);
+    EXPECT_FALSE(response.contains("\r\nContent-Encoding:")) << response.constData();
+    EXPECT_TRUE(response.endsWith("\r\n\r\n" + data)) << response.constData();
+
+    const qint64 maxBodySize = restServerWithoutAuthUT->maxBodySize();
+    restServerWithoutAuthUT->setMaxBodySize(data.size() / 2);
+    socket.write("POST /echo/test-method HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Encoding: deflate\r\nContent-Length: "
+                 + QByteArray::number(compressedData.size()) + "\r\n\r\n" + compressedData);
+    response = readHttpResponse(&socket, buffer);
+    EXPECT_TRUE(response.startsWith("HTTP/1.1 413")) << response.constData();
+    restServerWithoutAuthUT->setMaxBodySize(maxBodySize);
+
+    QTcpSocket streamedSocket;
+    streamedSocket.connectToHost("127.0.0.1", 9092);
+    ASSERT_TRUE(streamedSocket.waitForConnected(10000));
+    buffer.clear();
+    streamedSocket.write("POST /upload/test-method HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Encoding: deflate\r\n"
+                         "Content-Length: "
+                         + QByteArray::number(compressedData.size()) + "\r\n\r\n" + compressedData);
+    response = readHttpResponse(&streamedSocket, buffer);
+    EXPECT_TRUE(response.startsWith("HTTP/1.1 415")) << response.constData();
+
+    QTcpSocket unsupportedSocket;
+    unsupportedSocket.connectToHost("127.0.0.1", 9092);
+    ASSERT_TRUE(unsupportedSocket.waitForConnected(10000));
+    buffer.clear();
+    unsupportedSocket.write("POST /echo/test-method HTTP/1.1\r\nHost: 127.0.0.1\r\nContent-Encoding: br\r\n"
+                            "Content-Length: 5\r\n\r\nsmall");
+    response = readHttpResponse(&unsupportedSocket, buffer);
+    EXPECT_TRUE(response.startsWith("HTTP/1.1 415")) << response.constData();
+}
+
+TEST_F(RestServerTest, responseCache)
+{
+    ASSERT_TRUE(restServerWithoutAuthUT->isListening());
+    restServerWithoutAuthUT->invalidateCache();
+
+    QTcpSocket socket;
+    socket.connectToHost("127.0.0.1", 9092);
+    ASSERT_TRUE(socket.waitForConnected(10000));
+    QByteArray buffer;
+    socket.write("GET /cached/test-method?b=2&a=1 HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+    QByteArray response = readHttpResponse(&socket, buffer);
+    EXPECT_TRUE(response.startsWith("HTTP/1.1 200")) << response.constData();
+    QRegExp eTagRegExp("\r\nETag: (\"[^\"]+\")\r\n");
+    ASSERT_NE(-1, eTagRegExp.indexIn(QString::fromLatin1(response)));
+    const QByteArray eTag = eTagRegExp.cap(1).toLatin1();
+    const QByteArray body = response.mid(response.indexOf("\r\n\r\n") + 4);
+    const int calls = restServerWithoutAuthUT->cachedMethodCalls;
+
+    socket.write("GET /cached/test-method?a=1&b=2 HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n"
+                 "GET /cached/test-method?a=1&b=2 HTTP/1.1\r\nHost: 127.0.0.1\r\nIf-None-Match: "
+                 + eTag + "\r\n\r\n");
+    response = readHttpResponse(&socket, buffer);
+    EXPECT_TRUE(response.contains("\r\nETag: " + eTag + "\r\n")) << response.constData();
+    EXPECT_TRUE(response.endsWith("\r\n\r\n" + body)) << response.constData();
+    response = readHttpResponse(&socket, buffer);
+    EXPECT_TRUE(response.startsWith("HTTP/1.1 304")) << response.constData();
+    EXPECT_TRUE(response.endsWith("\r\n\r\n")) << response.constData();
+    EXPECT_EQ(calls, restServerWithoutAuthUT->cachedMethodCalls);
+
+    // 304 carries no framing headers, so pipelined answer after it must be read intact
+    socket.write("GET /cached/test-method?a=1&b=2 HTTP/1.1\r\nHost: 127.0.0.1\r\nIf-None-Match: " + eTag
+                 + "\r\n\r\nGET /cached/test-method?a=1&b=2 HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+    response = readHttpResponse(&socket, buffer);
+    EXPECT_TRUE(response.startsWith("HTTP/1.1 304")) << response.constData();
+    EXPECT_FALSE(response.contains("\r\nTransfer-Encoding:")) << response.constData();
+    EXPECT_FALSE(response.contains("\r\nContent-Length:")) << response.constData();
+    response = readHttpResponse(&socket, buffer);
+    EXPECT_TRUE(response.startsWith("HTTP/1.1 200")) << response.constData();
+    EXPECT_TRUE(response.endsWith("\r\n\r\n" + body)) << response.constData();
+    EXPECT_TRUE(buffer.isEmpty()) << buffer.constData();
+    EXPECT_EQ(calls, restServerWithoutAuthUT->cachedMethodCalls);
+
+    restServerWithoutAuthUT->invalidateCache("GET", "/cached/test-method");
+    socket.write("GET /cached/test-method?a=1&b=2 HTTP/1.1\r\nHost: 127.0.0.1\r\nIf-None-Match: " + eTag
+                 + "\r\n\r\n");
+    response = readHttpResponse(&socket, buffer);
+    EXPECT_TRUE(response.startsWith("HTTP/1.1 200")) << response.constData();
+    EXPECT_FALSE(response.endsWith("\r\n\r\n" + body)) << response.constData();
+    EXPECT_EQ(calls + 1, restServerWithoutAuthUT->cachedMethodCalls);
+}
+
+TEST_F(RestServerTest, metrics)
+{
+    ASSERT_TRUE(restServerWithoutAuthUT->isListening());
+
+    QTcpSocket socket;
+    socket.connectToHost("127.0.0.1", 9092);
+    ASSERT_TRUE(socket.waitForConnected(10000));
+    QByteArray buffer;
+    socket.write("GET /test-method HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n"
+                 "GET /wrong-method HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+    QByteArray response = readHttpResponse(&socket, buffer);
+    EXPECT_TRUE(response.startsWith("HTTP/1.1 200")) << response.constData();
+    response = readHttpResponse(&socket, buffer);
+    EXPECT_TRUE(response.startsWith("HTTP/1.1 404")) << response.constData();
+
+    socket.write("GET /system/metrics HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+    response = readHttpResponse(&socket, buffer);
+    EXPECT_TRUE(response.startsWith("HTTP/1.1 200")) << response.constData();
+    EXPECT_TRUE(response.contains("\r\nContent-Type: text/plain; version=0.0.4\r\n")) << response.constData();
+    EXPECT_TRUE(response.contains("\nproof_rest_requests_total{route=\"GET /test-method\",code=\"200\"} "));
+    EXPECT_TRUE(response.contains("\nproof_rest_requests_total{route=\"unmatched\",code=\"404\"} "));
+    EXPECT_TRUE(response.contains("\nproof_rest_request_duration_seconds_bucket{route=\"GET /test-method\","
+                                  "phase=\"handler\",le=\"+Inf\"} "));
+    EXPECT_TRUE(response.contains("\nproof_rest_request_duration_seconds_count{route=\"GET /test-method\","
+                                  "phase=\"parse\"} "));
+    EXPECT_TRUE(response.contains("\nproof_rest_worker_sockets{worker=\"0\"} "));
+    EXPECT_TRUE(response.contains("\n# TYPE proof_rest_rejected_requests_total counter\n"));
+}
+
+TEST_F(RestServerTest, cachedStatus)
+{
+    ASSERT_TRUE(restServerWithoutAuthUT->isListening());
+    restServerWithoutAuthUT->setHealthStatusTtl(60000);
+
+    QTcpSocket socket;
+    socket.connectToHost("127.0.0.1", 9092);
+    ASSERT_TRUE(socket.waitForConnected(10000));
+    QByteArray buffer;
+    socket.write("GET /system/status HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+    const QByteArray firstResponse = readHttpResponse(&socket, buffer);
+    EXPECT_TRUE(firstResponse.startsWith("HTTP/1.1 200")) << firstResponse.constData();
+    const int calls = restServerWithoutAuthUT->healthStatusCalls;
+
+    socket.write("GET /system/status HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+    QByteArray response = readHttpResponse(&socket, buffer);
+    EXPECT_EQ(firstResponse.mid(firstResponse.indexOf("\r\n\r\n")), response.mid(response.indexOf("\r\n\r\n")));
+    EXPECT_EQ(calls, restServerWithoutAuthUT->healthStatusCalls);
+
+    socket.write("GET /system/status?quick HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+    response = readHttpResponse(&socket, buffer);
+    EXPECT_TRUE(response.startsWith("HTTP/1.1 200")) << response.constData();
+    EXPECT_EQ(calls + 1, restServerWithoutAuthUT->healthStatusCalls);
+
+    restServerWithoutAuthUT->setHealthStatusTtl(0);
+    socket.write("GET /system/status HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+    response = readHttpResponse(&socket, buffer);
+    EXPECT_TRUE(response.startsWith("HTTP/1.1 200")) << response.constData();
+    EXPECT_EQ(calls + 2, restServerWithoutAuthUT->healthStatusCalls);
+    restServerWithoutAuthUT->setHealthStatusTtl(1000);
+}
+
+TEST_F(RestServerTest, recentErrorsPages)
+{
+    ASSERT_TRUE(restServerWithoutAuthUT->isListening());
+    ASSERT_TRUE(Proof::ErrorNotifier::instance()->handler<Proof::MemoryStorageNotificationHandler>());
+    Proof::ErrorNotifier::instance()->notify("first error");
+    Proof::ErrorNotifier::instance()->notify("second error");
+
+    QTcpSocket socket;
+    socket.connectToHost("127.0.0.1", 9092);
+    ASSERT_TRUE(socket.waitForConnected(10000));
+    QByteArray buffer;
+    socket.write("GET /system/recent-errors?limit=1 HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+    QByteArray response = readHttpResponse(&socket, buffer);
+    EXPECT_TRUE(response.startsWith("HTTP/1.1 200")) << response.constData();
+    QRegExp cursorRegExp("\r\nX-Next-Cursor: (\\d+)\r\n");
+    ASSERT_NE(-1, cursorRegExp.indexIn(QString::fromLatin1(response)));
+    QJsonArray errors = QJsonDocument::fromJson(response.mid(response.indexOf("\r\n\r\n") + 4)).array();
+    ASSERT_EQ(1, errors.count());
+    EXPECT_EQ("second error", errors[0].toObject()["message"].toString());
+
+    socket.write("GET /system/recent-errors?limit=1&cursor=" + cursorRegExp.cap(1).toLatin1()
+                 + " HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n");
+    response = readHttpResponse(&socket, buffer);
+    errors = QJsonDocument::fromJson(response.mid(response.indexOf("\r\n\r\n") + 4)).array();
+    ASSERT_EQ(1, errors.count());
+    EXPECT_EQ("first error", errors[0].toObject()["message"].toString());
+}
+
 #include "abstractrestserver_test.moc"
@@ -0,0 +1,95 @@
+// clazy:skip
+#include "proofnetwork/multipartparser.h"
+
+#include "gtest/proof/test_global.h"
+
+using namespace Proof;
+
+namespace {
+const QByteArray BODY = "preamble\r\n"
+                        "--AaB03x\r\n"
+                        "Content-Disposition: form-data; name=\"field\"\r\n"
+                        "\r\n"
+                        "value\r\n"
+                        "--AaB03x  \r\n"
+                        "Content-Disposition: form-data; name=\"files\"; filename=\"a \\\"b\\\".txt\"\r\n"
+                        "Content-Type: application/octet-stream\r\n"
+                        "\r\n"
+                        "\r\n--AaB03 is not a boundary\r\n"
+                        "--AaB03x\r\n"
+                        "\r\n"
+                        "no headers\r\n"
+                        "--AaB03x--\r\n"
+                        "epilogue";
+} // namespace
+
+TEST(MultipartParserTest, boundaryFromContentType)
+{
+    EXPECT_EQ("AaB03x", MultipartParser::boundaryFromContentType("multipart/form-data; boundary=AaB03x"));
+    EXPECT_EQ("a b;c", MultipartParser::boundaryFromContentType("Multipart/Mixed;charset=utf-8; BOUNDARY=\"a b;c\""));
+    EXPECT_EQ("", MultipartParser::boundaryFromContentType("multipart/form-data"));
+    EXPECT_EQ("", MultipartParser::boundaryFromContentType("text/plain; boundary=AaB03x"));
+}
+
+TEST(MultipartParserTest, parts)
+{
+    // Each chunk size makes boundaries split between feeds at different positions
+    for (int chunkSize : {1, 2, 3, 7, 11, 1000}) {
+        MultipartParser parser("AaB03x", 16);
+        QStringList handledParts;
+        parser.setPartHandler([&handledParts](const MultipartPart &part) { handledParts << part.name; });
+        MultipartParser::Result result = MultipartParser::Result::NeedMore;
+        for (int i = 0; i < BODY.size(); i += chunkSize) {
+            EXPECT_EQ(MultipartParser::Result::NeedMore, result) << chunkSize;
+            result = parser.feed(BODY.mid(i, chunkSize));
+        }
+        EXPECT_EQ(MultipartParser::Result::Finished, result) << chunkSize;
+        EXPECT_TRUE(parser.isFinished());
+        EXPECT_EQ(QStringList({"field", "files", ""}), handledParts);
+
+        const QVector<MultipartPart> parts = parser.takeParts();
+        ASSERT_EQ(3, parts.count()) << chunkSize;
+        EXPECT_EQ("field", parts[0].name);
+        EXPECT_TRUE(parts[0].fileName.isEmpty());
+        EXPECT_EQ("text/plain", parts[0].contentType);
+        EXPECT_EQ(5, parts[0].size);
+        EXPECT_EQ("value", parts[0].body->readAll());
+        EXPECT_FALSE(parts[0].body->inherits("QFileDevice"));
+
+        EXPECT_EQ("files", parts[1].name);
+        EXPECT_EQ("a \"b\".txt", parts[1].fileName);
+        EXPECT_EQ("application/octet-stream", parts[1].contentType);
+        EXPECT_EQ("application/octet-stream", parts[1].header("content-type"));
+        EXPECT_EQ("\r\n--AaB03 is not a boundary", parts[1].body->readAll());
+        EXPECT_TRUE(parts[1].body->inherits("QFileDevice"));
+
+        EXPECT_TRUE(parts[2].headers.isEmpty());
+        EXPECT_EQ("no headers", parts[2].body->readAll());
+        EXPECT_TRUE(parser.takeParts().isEmpty());
+    }
+}
+
+TEST(MultipartParserTest, errors)
+{
+    MultipartParser invalidBoundaryLine("AaB03x");
+    EXPECT_EQ(MultipartParser::Result::Error, invalidBoundaryLine.feed("--AaB03x\r\n\r\nvalue\r\n--AaB03xyz\r\n"));
+    EXPECT_FALSE(invalidBoundaryLine.error().isEmpty());
+    EXPECT_EQ(MultipartParser::Result::Error, invalidBoundaryLine.feed("--AaB03x--"));
+
+    MultipartParser invalidHeader("AaB03x");
+    EXPECT_EQ(MultipartParser::Result::Error, invalidHeader.feed("--AaB03x\r\nno colon\r\n\r\nvalue"));
+
+    MultipartParser largeHeaders("AaB03x");
+    largeHeaders.setMaxHeadersSize(32);
+    EXPECT_EQ(MultipartParser::Result::Error,
+              largeHeaders.feed("--AaB03x\r\nContent-Disposition: form-data; name=\"field\""));
+
+    MultipartParser tooManyParts("AaB03x");
+    tooManyParts.setMaxPartsCount(1);
+    EXPECT_EQ(MultipartParser::Result::Error, tooManyParts.feed("--AaB03x\r\n\r\na\r\n--AaB03x\r\n\r\nb"));
+    EXPECT_EQ(1, tooManyParts.takeParts().count());
+
+    MultipartParser unfinished("AaB03x");
+    EXPECT_EQ(MultipartParser::Result::NeedMore, unfinished.feed("--AaB03x\r\n\r\nvalue"));
+    EXPECT_FALSE(unfinished.isFinished());
+}